@@ -121,6 +121,47 @@ typedef struct stp_image
    * need to be associated with the image object.
    */
   void *rep;
+  /**
+   * This optional callback transfers several consecutive rows from the
+   * image to the library in a single call.  It should copy COUNT rows,
+   * starting at FIRST_ROW, into the data buffer; row N of the block
+   * starts at data + N * stride, and byte_limit bytes are available
+   * for each row.  The return value is the same as for get_row().  The
+   * library never requests rows beyond height(), and rows are still
+   * requested in ascending order, but a block may contain rows that
+   * the driver subsequently skips.  If this member is NULL, get_row()
+   * is called once for each row instead.  It is placed at the end of
+   * the structure so that existing initializers remain valid, but
+   * applications built against an older copy of this header must be
+   * rebuilt.
+   * @param image the image in use.
+   * @param data a pointer to count * stride bytes of pixel data.
+   * @param stride the distance in bytes between the start of each row.
+   * @param byte_limit (image width * number of channels).
+   * @param first_row the first row to transfer.
+   * @param count the number of rows to transfer.
+   */
+  stp_image_status_t (*get_rows)(struct stp_image *image, unsigned char *data,
+				 size_t stride, size_t byte_limit,
+				 int first_row, int count);
+  /**
+   * This optional callback lets the library read a row in place
+   * rather than having it copied by get_row().  It should set *data
+   * to point to the pixel data for ROW, laid out as get_row() would
+   * have written it, and return STP_IMAGE_STATUS_OK.  The data must
+   * remain valid and unchanged until the next call to any of the
+   * image's callbacks.  If the row is not available in memory, it
+   * should set *data to NULL, in which case the library falls back to
+   * get_rows() or get_row().  Rows are requested in the same order as
+   * for get_row(), so the same row may be requested more than once.
+   * @param image the image in use.
+   * @param data receives a pointer to the row, or NULL.
+   * @param byte_limit (image width * number of channels).
+   * @param row the row to return.
+   */
+  stp_image_status_t (*borrow_row)(struct stp_image *image,
+				   const unsigned char **data,
+				   size_t byte_limit, int row);
 } stp_image_t;
 
 extern void stp_image_init(stp_image_t *image);
@@ -130,6 +171,13 @@ extern int stp_image_height(stp_image_t *image); /* In pixels */
 extern stp_image_status_t stp_image_get_row(stp_image_t *image,
 					    unsigned char *data,
 					    size_t limit, int row);
+extern stp_image_status_t stp_image_get_rows(stp_image_t *image,
+					     unsigned char *data,
+					     size_t stride, size_t limit,
+					     int first_row, int count);
+extern stp_image_status_t stp_image_borrow_row(stp_image_t *image,
+					       const unsigned char **data,
+					       size_t limit, int row);
 extern const char *stp_image_get_appname(stp_image_t *image);
 extern void stp_image_conclude(stp_image_t *image);
 
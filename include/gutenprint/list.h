@@ -271,6 +271,24 @@ extern "C" {
    */
   extern stp_node_sortfunc stp_list_get_sortfunc(const stp_list_t *list);
 
+  /**
+   * Set whether a list keeps a hash index of its items' names.
+   * An indexed list finds items by name and long name in constant
+   * time, at the cost of some memory and of updating the index as
+   * items are created and destroyed.  The name of an item's data must
+   * not change while it is in an indexed list.
+   * @param list the list to use.
+   * @param use_index whether to index the list.
+   */
+  extern void stp_list_set_name_index(stp_list_t *list, int use_index);
+
+  /**
+   * Get whether a list keeps a hash index of its items' names.
+   * @param list the list to use.
+   * @returns the value previously set with stp_list_set_name_index.
+   */
+  extern int stp_list_get_name_index(const stp_list_t *list);
+
   /**
    * Create a new list item.
    * @param list the list to use.
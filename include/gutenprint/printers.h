@@ -188,6 +188,8 @@ extern void stp_set_printer_defaults_soft(stp_vars_t *v, const stp_printer_t *p)
  * Print the image.
  * @warning stp_job_start() must be called prior to the first call to
  * this function.
+ * Jobs using different vars objects may be printed concurrently from
+ * separate threads; see stp_init() for the details.
  * @param v the vars to use.
  * @param image the image to print.
  * @returns 0 on failure, 1 on success, 2 on abort requested by the
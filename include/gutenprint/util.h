@@ -50,6 +50,19 @@ extern "C" {
  * except as specifically noted.
  * It is responsible for loading modules and XML data and initialising
  * internal data structures.
+ *
+ * Thread safety: when the library is built with pthreads, stp_init()
+ * may be called from any thread, and more than once.  After it has
+ * returned, data shared between jobs (printer and paper lists, XML
+ * data, dither matrices) is either immutable or loaded on first use
+ * under an internal lock, and all mutable print state belongs to a
+ * stp_vars_t.  Any number of threads may therefore run stp_start_job(),
+ * stp_print() and stp_end_job() concurrently, provided that each
+ * thread uses its own stp_vars_t and stp_image_t, and that the output
+ * and error functions of each stp_vars_t are safe to call from that
+ * thread.  A single stp_vars_t must not be used by more than one
+ * thread at a time.  The global output and debug functions are not
+ * protected, and should be set before any jobs are started.
  * @returns 0 on success, 1 on failure.
  */
 extern int stp_init(void);
@@ -152,6 +165,12 @@ extern void stp_putraw(const stp_raw_t *r, const stp_vars_t *v);
 extern void stp_send_command(const stp_vars_t *v, const char *command,
 			     const char *format, ...);
 
+/*
+ * Pass any buffered printer output to the outfunc.  stp_start_job(),
+ * stp_print() and stp_end_job() do this before they return.
+ */
+extern void stp_flush_output(const stp_vars_t *v);
+
 extern void stp_erputc(int ch);
 
 extern void stp_eprintf(const stp_vars_t *v, const char *format, ...)
@@ -207,6 +226,32 @@ extern void *stp_zalloc (size_t);
 extern void *stp_realloc (void *ptr, size_t);
 extern void stp_free(void *ptr);
 
+/**
+ * Memory allocation statistics, collected when STP_ALLOC_STATS is set
+ * in the environment at the time stp_init() is called.  The arenas
+ * and arena_bytes counters describe arenas that currently exist; the
+ * rest are totals since stp_init().
+ */
+typedef struct
+{
+  unsigned long allocations;	/*!< Calls to stp_malloc() and stp_realloc() */
+  unsigned long frees;		/*!< Calls to stp_free() */
+  unsigned long long bytes_allocated; /*!< Bytes requested */
+  double seconds;		/*!< Time spent in the allocator */
+  unsigned long arenas;		/*!< Live arenas */
+  unsigned long arena_allocations; /*!< Allocations from arenas */
+  unsigned long long arena_bytes_reserved; /*!< Bytes held by live arenas */
+  unsigned long long arena_bytes_used; /*!< Bytes handed out by live arenas */
+} stp_allocation_stats_t;
+
+/**
+ * Get the memory allocation statistics.
+ * @param stats receives the statistics.
+ * @returns 1 if statistics are being collected, otherwise 0 (and the
+ * statistics are all zero).
+ */
+extern int stp_get_allocation_stats(stp_allocation_stats_t *stats);
+
 #define STP_SAFE_FREE(x)			\
 do						\
 {						\
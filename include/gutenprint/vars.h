@@ -474,6 +474,24 @@ extern void stp_set_dbgdata(stp_vars_t *v, void *val);
  */
 extern void *stp_get_dbgdata(const stp_vars_t *v);
 
+/**
+ * Set the size of the buffer used to collect printer output.  Output
+ * is passed to the outfunc in blocks of up to this many bytes rather
+ * than a few bytes at a time; a size of zero passes all output
+ * straight through.  Any output already buffered is flushed first.
+ * The default is 64 KB.
+ * @param v the vars to use.
+ * @param size the buffer size in bytes.
+ */
+extern void stp_set_output_buffer_size(stp_vars_t *v, size_t size);
+
+/**
+ * Get the size of the buffer used to collect printer output.
+ * @param v the vars to use.
+ * @returns the buffer size in bytes.
+ */
+extern size_t stp_get_output_buffer_size(const stp_vars_t *v);
+
 /**
  * Merge defaults for a printer with user-chosen settings.
  * @deprecated This is likely to go away.
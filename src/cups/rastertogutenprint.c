@@ -20,9 +20,18 @@
  *
  *   main()                    - Main entry and processing of driver.
  *   cups_writefunc()          - Write data to a file...
+ *   writer_start()            - Start the asynchronous output writer.
+ *   writer_write()            - Queue data for the output writer.
+ *   writer_flush()            - Wait for all queued output to be written.
+ *   writer_stop()             - Stop the asynchronous output writer.
+ *   flush_output()            - Write out everything printed so far.
  *   cancel_job()              - Cancel the current job...
  *   Image_get_appname()       - Get the application we are running.
  *   Image_get_row()           - Get one row of the image.
+ *   Image_get_rows()          - Get several consecutive rows of the image.
+ *   Image_borrow_row()        - Lend one row of the image to the library.
+ *   read_row()                - Read one row of the raster.
+ *   report_progress()         - Report how far through the page we are.
  *   Image_height()            - Return the height of an image.
  *   Image_init()              - Initialize an image.
  *   Image_conclude()          - Close the progress display.
@@ -55,6 +64,9 @@
 #ifdef HAVE_LIMITS_H
 #include <limits.h>
 #endif
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
 #include "i18n.h"
 #include <gutenprint/xml.h>
 
@@ -105,10 +117,14 @@ typedef struct
   stp_dimension_t	d_top_trim;
   int			last_percent;
   int			shrink_to_fit;
+  unsigned char		*line;		/* Raster line lent to the library */
+  size_t		line_size;
+  int			line_row;	/* Row held in line, or -1 */
   CUPS_HEADER_T		header;		/* Page header from file */
 } cups_image_t;
 
 static void	cups_writefunc(void *file, const char *buf, size_t bytes);
+static void	flush_output(void);
 static void	cups_errfunc(void *file, const char *buf, size_t bytes);
 static void	cups_dbgfunc(void *file, const char *buf, size_t bytes);
 static void	cancel_job(int sig);
@@ -116,6 +132,13 @@ static const char *Image_get_appname(stp_image_t *image);
 static stp_image_status_t Image_get_row(stp_image_t *image,
 					unsigned char *data,
 					size_t byte_limit, int row);
+static stp_image_status_t Image_get_rows(stp_image_t *image,
+					 unsigned char *data,
+					 size_t stride, size_t byte_limit,
+					 int first_row, int count);
+static stp_image_status_t Image_borrow_row(stp_image_t *image,
+					   const unsigned char **data,
+					   size_t byte_limit, int row);
 static int	Image_height(stp_image_t *image);
 static int	Image_width(stp_image_t *image);
 static void	Image_conclude(stp_image_t *image);
@@ -130,9 +153,48 @@ static stp_image_t theImage =
   Image_get_row,
   Image_get_appname,
   Image_conclude,
-  NULL
+  NULL,
+  Image_get_rows,
+  Image_borrow_row
 };
 
+#ifdef HAVE_PTHREAD_H
+/*
+ * Output is handed to a writer thread through a small ring of fixed
+ * size buffers, so that rendering can carry on while a slow backend
+ * drains stdout.  Once every buffer is waiting to be written, the
+ * renderer blocks until the writer frees one.
+ */
+
+#define WRITER_BUFFER_COUNT	4
+#define WRITER_BUFFER_SIZE	(256 * 1024)
+
+typedef struct
+{
+  char			*data;
+  size_t		bytes;		/* Bytes of data in the buffer */
+} writer_buffer_t;
+
+typedef struct
+{
+  FILE			*prn;		/* File to write to */
+  pthread_t		thread;
+  pthread_mutex_t	lock;
+  pthread_cond_t	cond;
+  writer_buffer_t	buffers[WRITER_BUFFER_COUNT];
+  unsigned		queued;		/* Buffers handed to the writer */
+  unsigned		written;	/* Buffers the writer has finished */
+  int			shutdown;
+} async_writer_t;
+
+static async_writer_t *writer = NULL;
+
+static async_writer_t *writer_start(FILE *prn);
+static void	writer_write(async_writer_t *w, const char *buf, size_t bytes);
+static void	writer_flush(async_writer_t *w);
+static void	writer_stop(async_writer_t *w);
+#endif /* HAVE_PTHREAD_H */
+
 static volatile stp_image_status_t Image_status = STP_IMAGE_STATUS_OK;
 static double total_bytes_printed = 0;
 static int print_messages_as_errors = 0;
@@ -1312,11 +1374,23 @@ main(int  argc,				/* I - Number of command-line arguments */
 
   cups.ras = cupsRasterOpen(fd, CUPS_RASTER_READ);
 
+#ifdef HAVE_PTHREAD_H
+ /*
+  * Write output on a thread of its own, so that a slow backend doesn't
+  * stall rendering...
+  */
+
+  writer = writer_start(stdout);
+#endif
+
  /*
   * Process pages as needed...
   */
 
   cups.page = 0;
+  cups.line = NULL;
+  cups.line_size = 0;
+  cups.line_row = -1;
 
   if (! suppress_messages)
     fprintf(stderr, "DEBUG: Gutenprint: About to start printing loop.\n");
@@ -1374,6 +1448,7 @@ main(int  argc,				/* I - Number of command-line arguments */
       /* Pass along the page number */
       stp_set_int_parameter(v, "PageNumber", cups.page);
       cups.row = 0;
+      cups.line_row = -1;
       if (! suppress_messages)
 	print_debug_block(v, &cups);
       print_messages_as_errors = 1;
@@ -1398,7 +1473,7 @@ main(int  argc,				/* I - Number of command-line arguments */
 	}
       print_messages_as_errors = 0;
 
-      fflush(stdout);
+      flush_output();
 
       /*
        * Purge any remaining bitmap data...
@@ -1415,10 +1490,19 @@ main(int  argc,				/* I - Number of command-line arguments */
 	fprintf(stderr, "DEBUG: Gutenprint: %s job\n",
 		aborted ? "Aborted" : "Ending");
       stp_end_job(v, &theImage);
-      fflush(stdout);
+      flush_output();
       stp_vars_destroy(v);
     }
+#ifdef HAVE_PTHREAD_H
+  if (writer)
+    {
+      writer_stop(writer);
+      writer = NULL;
+    }
+#endif
   cupsRasterClose(cups.ras);
+  if (cups.line)
+    free(cups.line);
   (void) times(&tms);
   (void) gettimeofday(&t2, NULL);
   clocks_per_sec = sysconf(_SC_CLK_TCK);
@@ -1442,6 +1526,168 @@ main(int  argc,				/* I - Number of command-line arguments */
 }
 
 
+#ifdef HAVE_PTHREAD_H
+/*
+ * 'writer_thread()' - Write queued buffers in order.
+ */
+
+static void *
+writer_thread(void *arg)		/* I - Writer */
+{
+  async_writer_t	*w = (async_writer_t *) arg;
+
+  pthread_mutex_lock(&w->lock);
+  while (1)
+    {
+      writer_buffer_t *b;
+      while (w->written == w->queued && !w->shutdown)
+	pthread_cond_wait(&w->cond, &w->lock);
+      if (w->written == w->queued)
+	break;
+      b = &(w->buffers[w->written % WRITER_BUFFER_COUNT]);
+      pthread_mutex_unlock(&w->lock);
+      fwrite(b->data, 1, b->bytes, w->prn);
+      pthread_mutex_lock(&w->lock);
+      b->bytes = 0;
+      w->written++;
+      pthread_cond_broadcast(&w->cond);
+    }
+  pthread_mutex_unlock(&w->lock);
+  return NULL;
+}
+
+
+/*
+ * 'writer_start()' - Start the asynchronous output writer.
+ */
+
+static async_writer_t *			/* O - Writer, or NULL */
+writer_start(FILE *prn)			/* I - File to write to */
+{
+  async_writer_t	*w;
+  int			i;
+
+  if ((w = calloc(1, sizeof(async_writer_t))) == NULL)
+    return (NULL);
+  for (i = 0; i < WRITER_BUFFER_COUNT; i ++)
+    if ((w->buffers[i].data = malloc(WRITER_BUFFER_SIZE)) == NULL)
+      break;
+  w->prn = prn;
+  pthread_mutex_init(&w->lock, NULL);
+  pthread_cond_init(&w->cond, NULL);
+  if (i < WRITER_BUFFER_COUNT ||
+      pthread_create(&w->thread, NULL, writer_thread, w) != 0)
+    {
+      pthread_cond_destroy(&w->cond);
+      pthread_mutex_destroy(&w->lock);
+      for (i = 0; i < WRITER_BUFFER_COUNT; i ++)
+	free(w->buffers[i].data);
+      free(w);
+      return (NULL);
+    }
+  return (w);
+}
+
+
+/*
+ * 'writer_write()' - Queue data for the output writer.
+ */
+
+static void
+writer_write(async_writer_t *w,		/* I - Writer */
+	     const char     *buf,	/* I - Data to write */
+	     size_t         bytes)	/* I - Number of bytes */
+{
+  while (bytes > 0)
+    {
+      writer_buffer_t *b;
+      size_t	count;
+
+      pthread_mutex_lock(&w->lock);
+      while (w->queued - w->written >= WRITER_BUFFER_COUNT)
+	pthread_cond_wait(&w->cond, &w->lock);
+      pthread_mutex_unlock(&w->lock);
+
+      b = &(w->buffers[w->queued % WRITER_BUFFER_COUNT]);
+      count = WRITER_BUFFER_SIZE - b->bytes;
+      if (count > bytes)
+	count = bytes;
+      memcpy(b->data + b->bytes, buf, count);
+      b->bytes += count;
+      buf += count;
+      bytes -= count;
+
+      if (b->bytes == WRITER_BUFFER_SIZE)
+	{
+	  pthread_mutex_lock(&w->lock);
+	  w->queued++;
+	  pthread_cond_broadcast(&w->cond);
+	  pthread_mutex_unlock(&w->lock);
+	}
+    }
+}
+
+
+/*
+ * 'writer_flush()' - Wait for all queued output to be written.
+ */
+
+static void
+writer_flush(async_writer_t *w)		/* I - Writer */
+{
+  pthread_mutex_lock(&w->lock);
+  while (w->queued - w->written >= WRITER_BUFFER_COUNT)
+    pthread_cond_wait(&w->cond, &w->lock);
+  if (w->buffers[w->queued % WRITER_BUFFER_COUNT].bytes > 0)
+    {
+      w->queued++;
+      pthread_cond_broadcast(&w->cond);
+    }
+  while (w->written != w->queued)
+    pthread_cond_wait(&w->cond, &w->lock);
+  pthread_mutex_unlock(&w->lock);
+}
+
+
+/*
+ * 'writer_stop()' - Stop the asynchronous output writer.
+ */
+
+static void
+writer_stop(async_writer_t *w)		/* I - Writer */
+{
+  int	i;
+
+  writer_flush(w);
+  pthread_mutex_lock(&w->lock);
+  w->shutdown = 1;
+  pthread_cond_broadcast(&w->cond);
+  pthread_mutex_unlock(&w->lock);
+  pthread_join(w->thread, NULL);
+  pthread_cond_destroy(&w->cond);
+  pthread_mutex_destroy(&w->lock);
+  for (i = 0; i < WRITER_BUFFER_COUNT; i ++)
+    free(w->buffers[i].data);
+  free(w);
+}
+#endif /* HAVE_PTHREAD_H */
+
+
+/*
+ * 'flush_output()' - Write out everything printed so far.
+ */
+
+static void
+flush_output(void)
+{
+#ifdef HAVE_PTHREAD_H
+  if (writer)
+    writer_flush(writer);
+#endif
+  fflush(stdout);
+}
+
+
 /*
  * 'cups_writefunc()' - Write data to a file...
  */
@@ -1451,6 +1697,13 @@ cups_writefunc(void *file, const char *buf, size_t bytes)
 {
   FILE *prn = (FILE *)file;
   total_bytes_printed += bytes;
+#ifdef HAVE_PTHREAD_H
+  if (writer && writer->prn == prn)
+    {
+      writer_write(writer, buf, bytes);
+      return;
+    }
+#endif
   fwrite(buf, 1, bytes, prn);
 }
 
@@ -1532,7 +1785,7 @@ Image_get_appname(stp_image_t *image)		/* I - Image */
 
 
 /*
- * 'Image_get_row()' - Get one row of the image.
+ * 'throwaway_data()' - Discard raster data outside the printed area.
  */
 
 static void
@@ -1550,39 +1803,23 @@ throwaway_data(int amount, cups_image_t *cups)
     cupsRasterReadPixels(cups->ras, trash, leftover);
 }
 
+
+/*
+ * 'read_row()' - Read one row of the raster, skipping ahead to the row
+ *                requested.
+ */
+
 static stp_image_status_t
-Image_get_row(stp_image_t   *image,	/* I - Image */
-	      unsigned char *data,	/* O - Row */
-	      size_t	    byte_limit,	/* I - how many bytes in data */
-	      int           row)	/* I - Row number (unused) */
+read_row(cups_image_t  *cups,		/* I - CUPS image */
+	 unsigned char *data,		/* O - Row */
+	 int           row,		/* I - Row number */
+	 int           bytes_per_line,	/* I - Bytes to keep */
+	 int           left_margin,	/* I - Bytes to toss on the left */
+	 int           right_margin,	/* I - Bytes to toss on the right */
+	 int           margin)		/* I - Padding after right margin */
 {
-  cups_image_t	*cups;			/* CUPS image */
   int		i;			/* Looping var */
-  int 		bytes_per_line;
-  int		margin;
-  stp_image_status_t tmp_image_status = Image_status;
-  unsigned char *orig = data;           /* Temporary pointer */
   static int warned = 0;                /* Error warning printed? */
-  int new_percent;
-  int left_margin, right_margin;
-
-  if ((cups = (cups_image_t *)(image->rep)) == NULL)
-    {
-      stp_i18n_printf(po, _("ERROR: Gutenprint image is not initialized!  "
-                            "Please report this bug to "
-			    "gimp-print-devel@lists.sourceforge.net\n"));
-      return STP_IMAGE_STATUS_ABORT;
-    }
-  bytes_per_line =
-    ((cups->adjusted_width * cups->header.cupsBitsPerPixel) + CHAR_BIT - 1) /
-    CHAR_BIT;
-
-  left_margin = ((cups->left_trim * cups->header.cupsBitsPerPixel) + CHAR_BIT - 1) /
-    CHAR_BIT;
-  right_margin = ((cups->right_trim * cups->header.cupsBitsPerPixel) + CHAR_BIT - 1) /
-    CHAR_BIT;
-  margin = cups->header.cupsBytesPerLine - left_margin - bytes_per_line -
-    right_margin;
 
   if (cups->row < cups->header.cupsHeight)
   {
@@ -1635,7 +1872,6 @@ Image_get_row(stp_image_t   *image,	/* I - Image */
    * input, such as that generated by psnup.  The output is barely
    * legible, but it's better than the garbage output otherwise.
    */
-  data = orig;
   if (cups->header.cupsBitsPerPixel == 1)
     {
       if (warned == 0)
@@ -1653,6 +1889,18 @@ Image_get_row(stp_image_t   *image,	/* I - Image */
 	    data[i]=0;
 	}
     }
+  return STP_IMAGE_STATUS_OK;
+}
+
+/*
+ * 'report_progress()' - Report how far through the page we are.
+ */
+
+static stp_image_status_t
+report_progress(cups_image_t       *cups,	/* I - CUPS image */
+		stp_image_status_t status)	/* I - Image status */
+{
+  int new_percent;
 
   new_percent = (int) (100.0 * cups->row / cups->header.cupsHeight);
   if (new_percent > cups->last_percent)
@@ -1666,12 +1914,130 @@ Image_get_row(stp_image_t   *image,	/* I - Image */
       cups->last_percent = new_percent;
     }
 
-  if (tmp_image_status != STP_IMAGE_STATUS_OK)
+  if (status != STP_IMAGE_STATUS_OK)
     {
       if (! suppress_messages)
-	fprintf(stderr, "DEBUG: Gutenprint: Image status %d\n", tmp_image_status);
+	fprintf(stderr, "DEBUG: Gutenprint: Image status %d\n", status);
+    }
+  return status;
+}
+
+/*
+ * 'Image_get_rows()' - Get several consecutive rows of the image.
+ */
+
+static stp_image_status_t
+Image_get_rows(stp_image_t   *image,	/* I - Image */
+	       unsigned char *data,	/* O - Rows */
+	       size_t	     stride,	/* I - Distance between rows */
+	       size_t	     byte_limit,/* I - how many bytes in each row */
+	       int           first_row,	/* I - First row number */
+	       int           count)	/* I - Number of rows */
+{
+  cups_image_t	*cups;			/* CUPS image */
+  int		i;			/* Looping var */
+  int 		bytes_per_line;
+  int		margin;
+  stp_image_status_t tmp_image_status = Image_status;
+  int left_margin, right_margin;
+
+  if ((cups = (cups_image_t *)(image->rep)) == NULL)
+    {
+      stp_i18n_printf(po, _("ERROR: Gutenprint image is not initialized!  "
+                            "Please report this bug to "
+			    "gimp-print-devel@lists.sourceforge.net\n"));
+      return STP_IMAGE_STATUS_ABORT;
+    }
+  bytes_per_line =
+    ((cups->adjusted_width * cups->header.cupsBitsPerPixel) + CHAR_BIT - 1) /
+    CHAR_BIT;
+
+  left_margin = ((cups->left_trim * cups->header.cupsBitsPerPixel) + CHAR_BIT - 1) /
+    CHAR_BIT;
+  right_margin = ((cups->right_trim * cups->header.cupsBitsPerPixel) + CHAR_BIT - 1) /
+    CHAR_BIT;
+  margin = cups->header.cupsBytesPerLine - left_margin - bytes_per_line -
+    right_margin;
+
+  for (i = 0; i < count; i++)
+    if (read_row(cups, data + i * stride, first_row + i, bytes_per_line,
+		 left_margin, right_margin, margin) != STP_IMAGE_STATUS_OK)
+      return STP_IMAGE_STATUS_ABORT;
+
+  return report_progress(cups, tmp_image_status);
+}
+
+/*
+ * 'Image_borrow_row()' - Lend one row of the image to the library.
+ *
+ * The whole raster line, margins included, is read in a single call
+ * into a buffer we keep, and the library converts it in place.  The
+ * line stays there until the next one is borrowed, so the same row may
+ * be lent again.  Rows that need to be synthesized or expanded are left
+ * to Image_get_rows().
+ */
+
+static stp_image_status_t
+Image_borrow_row(stp_image_t         *image,	/* I - Image */
+		 const unsigned char **data,	/* O - Row */
+		 size_t              byte_limit,/* I - how many bytes in data */
+		 int                 row)	/* I - Row number */
+{
+  cups_image_t	*cups;			/* CUPS image */
+  stp_image_status_t tmp_image_status = Image_status;
+  int left_margin;
+
+  *data = NULL;
+  if ((cups = (cups_image_t *)(image->rep)) == NULL)
+    return STP_IMAGE_STATUS_OK;
+  if (cups->header.cupsBitsPerPixel == 1 ||
+      row >= cups->header.cupsHeight)
+    return STP_IMAGE_STATUS_OK;
+
+  left_margin = ((cups->left_trim * cups->header.cupsBitsPerPixel) + CHAR_BIT - 1) /
+    CHAR_BIT;
+  if (row == cups->line_row)
+    {
+      *data = cups->line + left_margin;
+      return report_progress(cups, tmp_image_status);
+    }
+  if (cups->row > row)
+    return STP_IMAGE_STATUS_OK;
+
+  if (cups->line_size < cups->header.cupsBytesPerLine)
+    {
+      cups->line_size = cups->header.cupsBytesPerLine;
+      cups->line = realloc(cups->line, cups->line_size);
+      if (!cups->line)
+	{
+	  cups->line_size = 0;
+	  cups->line_row = -1;
+	  return STP_IMAGE_STATUS_OK;
+	}
+    }
+
+  while (cups->row <= row)
+    {
+      cupsRasterReadPixels(cups->ras, cups->line, cups->header.cupsBytesPerLine);
+      cups->row ++;
     }
-  return tmp_image_status;
+  cups->line_row = row;
+  *data = cups->line + left_margin;
+
+  return report_progress(cups, tmp_image_status);
+}
+
+/*
+ * 'Image_get_row()' - Get one row of the image.
+ */
+
+static stp_image_status_t
+Image_get_row(stp_image_t   *image,	/* I - Image */
+	      unsigned char *data,	/* O - Row */
+	      size_t	    byte_limit,	/* I - how many bytes in data */
+	      int           row)	/* I - Row number */
+{
+  return Image_get_rows(image, data, byte_limit, byte_limit, row, 1);
 }
 
 
@@ -0,0 +1,194 @@
+/*
+ *   Check that rastertogutenprint lends the right raster line when the
+ *   library asks for the same row more than once.
+ *
+ *   This program is free software; you can redistribute it and/or modify it
+ *   under the terms of the GNU General Public License as published by the Free
+ *   Software Foundation; either version 2 of the License, or (at your option)
+ *   any later version.
+ *
+ *   This program is distributed in the hope that it will be useful, but
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *   or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *   for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * The image callbacks are static, so the filter is compiled in directly,
+ * with its main() renamed out of the way.  A small raster whose pixels
+ * encode their row and column is written to a temporary file and read
+ * back through Image_borrow_row() and Image_get_row().
+ */
+#define main rastertogutenprint_main
+int rastertogutenprint_main(int argc, char *argv[]);
+#include "rastertogutenprint.c"
+#undef main
+
+#include <stdio.h>
+
+#define WIDTH 64
+#define HEIGHT 16
+#define LEFT_TRIM 3
+
+#if (CUPS_VERSION_MAJOR > 1 || (CUPS_VERSION_MAJOR == 1 && CUPS_VERSION_MINOR > 1))
+#define CUPS_WRITE_HEADER cupsRasterWriteHeader2
+#else
+#define CUPS_WRITE_HEADER cupsRasterWriteHeader
+#endif
+
+static unsigned char
+pixel(int row, int column)
+{
+  return (unsigned char) (row * 37 + column);
+}
+
+static int
+write_raster(int fd)
+{
+  cups_raster_t *ras = cupsRasterOpen(fd, CUPS_RASTER_WRITE);
+  CUPS_HEADER_T header;
+  unsigned char line[WIDTH];
+  int row, column;
+
+  if (!ras)
+    return 1;
+  memset(&header, 0, sizeof(header));
+  header.HWResolution[0] = 72;
+  header.HWResolution[1] = 72;
+  header.cupsWidth = WIDTH;
+  header.cupsHeight = HEIGHT;
+  header.cupsBitsPerColor = 8;
+  header.cupsBitsPerPixel = 8;
+  header.cupsBytesPerLine = WIDTH;
+  header.cupsColorOrder = CUPS_ORDER_CHUNKED;
+  header.cupsColorSpace = CUPS_CSPACE_K;
+  if (!CUPS_WRITE_HEADER(ras, &header))
+    {
+      cupsRasterClose(ras);
+      return 1;
+    }
+  for (row = 0; row < HEIGHT; row++)
+    {
+      for (column = 0; column < WIDTH; column++)
+	line[column] = pixel(row, column);
+      if (cupsRasterWritePixels(ras, line, WIDTH) != WIDTH)
+	{
+	  cupsRasterClose(ras);
+	  return 1;
+	}
+    }
+  cupsRasterClose(ras);
+  return 0;
+}
+
+/*
+ * A row that the image declined to lend is only an error if it had to
+ * be lent; one that it did lend must hold the pixels of that row.
+ */
+static int
+check_row(const char *what, const unsigned char *data, int row, int required)
+{
+  int column;
+  if (!data)
+    {
+      if (required)
+	{
+	  printf("FAIL: %s row %d was not lent\n", what, row);
+	  return 1;
+	}
+      return 0;
+    }
+  for (column = LEFT_TRIM; column < WIDTH; column++)
+    if (data[column - LEFT_TRIM] != pixel(row, column))
+      {
+	printf("FAIL: %s row %d, column %d is %d, should be %d\n", what, row,
+	       column, data[column - LEFT_TRIM], pixel(row, column));
+	return 1;
+      }
+  return 0;
+}
+
+/* Some rows are borrowed more than once, and some are skipped */
+static const int borrowed_rows[] = { 0, 0, 1, 1, 1, 4, 4, 5, 9, 9 };
+
+int
+main(void)
+{
+  FILE *fp = tmpfile();
+  cups_image_t cups;
+  const unsigned char *data;
+  unsigned char buf[WIDTH];
+  int tests = 0;
+  int failures = 0;
+  size_t i;
+
+  suppress_messages = 1;
+  suppress_verbose_messages = 1;
+  if (!fp || write_raster(fileno(fp)) != 0 ||
+      lseek(fileno(fp), 0, SEEK_SET) != 0)
+    {
+      printf("FAIL: cannot write the raster\n");
+      return 1;
+    }
+
+  memset(&cups, 0, sizeof(cups));
+  cups.ras = cupsRasterOpen(fileno(fp), CUPS_RASTER_READ);
+  if (!cups.ras || !CUPS_READ_HEADER(cups.ras, &cups.header))
+    {
+      printf("FAIL: cannot read the raster header\n");
+      return 1;
+    }
+  cups.left_trim = LEFT_TRIM;
+  cups.adjusted_width = WIDTH - LEFT_TRIM;
+  cups.line_row = -1;
+  theImage.rep = &cups;
+
+  for (i = 0; i < sizeof(borrowed_rows) / sizeof(borrowed_rows[0]); i++)
+    {
+      int row = borrowed_rows[i];
+      if (Image_borrow_row(&theImage, &data, WIDTH - LEFT_TRIM, row)
+	  != STP_IMAGE_STATUS_OK)
+	{
+	  printf("FAIL: borrowing row %d aborted\n", row);
+	  failures++;
+	}
+      else
+	failures += check_row("borrowed", data, row, 1);
+      tests++;
+    }
+
+  /*
+   * Once a row has been copied out, the last line borrowed is no longer
+   * the current one; the row may be refused, but must not be wrong.
+   */
+  if (Image_get_row(&theImage, buf, WIDTH - LEFT_TRIM, 10)
+      != STP_IMAGE_STATUS_OK)
+    {
+      printf("FAIL: copying row 10 aborted\n");
+      failures++;
+    }
+  else
+    failures += check_row("copied", buf, 10, 1);
+  tests++;
+  Image_borrow_row(&theImage, &data, WIDTH - LEFT_TRIM, 10);
+  failures += check_row("borrowed after copying", data, 10, 0);
+  tests++;
+  Image_borrow_row(&theImage, &data, WIDTH - LEFT_TRIM, 11);
+  failures += check_row("borrowed after copying", data, 11, 1);
+  tests++;
+  Image_borrow_row(&theImage, &data, WIDTH - LEFT_TRIM, 11);
+  failures += check_row("borrowed after copying", data, 11, 1);
+  tests++;
+
+  cupsRasterClose(cups.ras);
+  fclose(fp);
+  free(cups.line);
+  if (failures)
+    printf("%d of %d tests failed\n", failures, tests);
+  else
+    printf("All %d tests passed\n", tests);
+  return failures ? 1 : 0;
+}
@@ -1181,9 +1181,13 @@ stp_pack_uncompressed(stp_vars_t *v,
 		      int *first,
 		      int *last)
 {
+  stpi_profile_mark_t mark;
+  stpi_profile_t *profile = stpi_profile_begin(v, &mark);
   find_first_and_last(line, length, first, last);
   memcpy(comp_buf, line, length);
   *comp_ptr = comp_buf + length;
+  if (profile)
+    stpi_profile_end(profile, STPI_PROFILE_PACK, &mark);
   if (first && last && *first > *last)
     return 0;
   else
@@ -1200,6 +1204,8 @@ stp_pack_tiff(stp_vars_t *v,
 	      int *last)
 {
   unsigned char *comp_pti = comp_buf;
+  stpi_profile_mark_t mark;
+  stpi_profile_t *profile = stpi_profile_begin(v, &mark);
   if (first && last)
     find_first_and_last(line, length, first, last);
 
@@ -1281,6 +1287,8 @@ stp_pack_tiff(stp_vars_t *v,
 	}
     }
   (*comp_ptr) = comp_pti;
+  if (profile)
+    stpi_profile_end(profile, STPI_PROFILE_PACK, &mark);
 
   if (first && last && *first > *last)
     return 0;
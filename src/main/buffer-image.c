@@ -27,6 +27,7 @@ struct buffered_image_priv
 {
 	stp_image_t* image;
 	unsigned char** buf;
+	unsigned char* data;
 	unsigned int flags;
 };
 
@@ -61,6 +62,26 @@ buffered_image_get_appname(stp_image_t *image)
 }
 
 
+static stp_image_status_t
+buffered_image_fill(stp_image_t* image, size_t byte_limit)
+{
+	struct buffered_image_priv *priv = image->rep;
+	int height = buffered_image_height(image);
+	int i;
+	if(!priv->buf){
+		priv->buf = stp_zalloc((sizeof(unsigned short*) + 1) * height);
+		if(!priv->buf){
+			return STP_IMAGE_STATUS_ABORT;
+		}
+		priv->data = stp_malloc(byte_limit * height);
+		for(i=0;i<height;i++)
+			priv->buf[i] = priv->data + byte_limit * i;
+		if(STP_IMAGE_STATUS_OK != stp_image_get_rows(priv->image,priv->data,byte_limit,byte_limit,0,height))
+			return STP_IMAGE_STATUS_ABORT;
+	}
+	return STP_IMAGE_STATUS_OK;
+}
+
 static stp_image_status_t
 buffered_image_get_row(stp_image_t* image,unsigned char *data, size_t byte_limit, int row)
 {
@@ -73,17 +94,8 @@ buffered_image_get_row(stp_image_t* image,unsigned char *data, size_t byte_limit
 	unsigned char* src;
 	int i;
 	/* fill buffer */
-	if(!priv->buf){
-		priv->buf = stp_zalloc((sizeof(unsigned short*) + 1) * height);
-		if(!priv->buf){
-			return STP_IMAGE_STATUS_ABORT;
-		}
-		for(i=0;i<height;i++){
-			priv->buf[i] = stp_malloc(byte_limit);
-			if(STP_IMAGE_STATUS_OK != priv->image->get_row(priv->image,priv->buf[i],byte_limit,i))
-				return STP_IMAGE_STATUS_ABORT;
-		}
-	}
+	if(STP_IMAGE_STATUS_OK != buffered_image_fill(image, byte_limit))
+		return STP_IMAGE_STATUS_ABORT;
 	if(priv->flags & BUFFER_FLAG_FLIP_Y)
 		row = height - row - 1;
 
@@ -103,18 +115,32 @@ buffered_image_get_row(stp_image_t* image,unsigned char *data, size_t byte_limit
 	return STP_IMAGE_STATUS_OK;
 }
 
+/* Rows that aren't mirrored can be read straight out of the buffer */
+static stp_image_status_t
+buffered_image_borrow_row(stp_image_t* image, const unsigned char **data, size_t byte_limit, int row)
+{
+	struct buffered_image_priv *priv = image->rep;
+	int height = buffered_image_height(image);
+	*data = NULL;
+	if(priv->flags & BUFFER_FLAG_FLIP_X)
+		return STP_IMAGE_STATUS_OK;
+	if(STP_IMAGE_STATUS_OK != buffered_image_fill(image, byte_limit))
+		return STP_IMAGE_STATUS_ABORT;
+	if(priv->flags & BUFFER_FLAG_FLIP_Y)
+		row = height - row - 1;
+	*data = priv->buf[row];
+	return STP_IMAGE_STATUS_OK;
+}
+
 static void
 buffered_image_conclude(stp_image_t * image)
 {
 	struct buffered_image_priv *priv = image->rep;
 	if(priv->buf){
-		int i = 0;
-		while(priv->buf[i]){
-			stp_free(priv->buf[i]);
-			++i;
-		}
+		stp_free(priv->data);
 		stp_free(priv->buf);
 		priv->buf = NULL;
+		priv->data = NULL;
 	}
 	if(priv->image->conclude)
 		priv->image->conclude(priv->image);
@@ -147,7 +173,7 @@ stpi_buffer_image(stp_image_t* image, unsigned int flags)
 	priv->flags = flags;
 	if(image->get_appname)
 		buffered_image->get_appname = buffered_image_get_appname;
-
+	buffered_image->borrow_row = buffered_image_borrow_row;
 
 	return buffered_image;
 }
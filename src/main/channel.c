@@ -32,7 +32,17 @@
 #include <limits.h>
 #endif
 #include <math.h>
+#include <stdlib.h>
 #include <string.h>
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
+/* The AVX2 channel split is used if stpi_kernel_level() allows it */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define X86_SPLIT
+#include <immintrin.h>
+#endif
 
 #ifdef __GNUC__
 #define inline __inline__
@@ -58,7 +68,9 @@ typedef struct
 {
   unsigned subchannel_count;
   stpi_subchannel_t *sc;
-  unsigned short *lut;
+  const unsigned short *lut;
+  struct subchannel_table *table; /* Shared table that lut points into */
+  int lut_compact;		/* lut holds COMPACT_LUT_STRIDE per subchannel */
   const double *hue_map;
   size_t h_count;
   stp_curve_t *curve;
@@ -79,7 +91,18 @@ typedef struct
   unsigned short *alloc_data_2;
   unsigned short *alloc_data_3;
   unsigned char *output_data_8bit;
+  unsigned short *planar_data;	/* Output with one row per channel */
+  unsigned short *alloc_planar;
+  size_t plane_stride;		/* Distance between rows of planar_data */
+  unsigned empty_planes;	/* Channels that are all zero in this row */
+  int planar;
+  unsigned short *dest_data;	/* Where the last step stores each row */
+  size_t pixel_step;		/* Distance between pixels of dest_data */
+  size_t channel_step;		/* and between channels of a pixel */
+  int output_stale;		/* output_data is behind planar_data */
   size_t width;
+  size_t block_width;		/* Pixels converted in one pass */
+  struct split_lanes *split_lanes; /* Set if the AVX2 split is usable */
   double cyan_balance;
   double magenta_balance;
   double yellow_balance;
@@ -98,11 +121,106 @@ typedef struct
 } stpi_channel_group_t;
 
 
+/*
+ * The split between the subchannels of a channel depends only on their
+ * values and cutoffs, which are the same on every page of every job
+ * printed with the same inks, so subchannel tables are kept for the
+ * life of the process and shared by every channel that uses them.
+ * Tables that are no longer in use are kept too, up to
+ * SUBCHANNEL_TABLE_SPARE of them, and the least recently used is
+ * dropped first.  Channel groups of different jobs may be set up and
+ * torn down on different threads, so the list and the reference counts
+ * are only touched with this lock held.
+ */
+#define SUBCHANNEL_TABLE_SPARE 8
+
+/*
+ * A compact table holds COMPACT_LUT_POINTS evenly spaced points of each
+ * subchannel's curve, plus a copy of the last one so that interpolation
+ * can always read the next point, instead of all 65536 input values.
+ */
+#define COMPACT_LUT_BITS 12
+#define COMPACT_LUT_POINTS ((1 << COMPACT_LUT_BITS) + 1)
+#define COMPACT_LUT_STRIDE (COMPACT_LUT_POINTS + 1)
+
+/*
+ * Interpolation can't follow a table that jumps, as one does if the
+ * subchannels aren't in order of increasing value, so a compact table
+ * that strays further than this from the full one isn't used.
+ */
+#define COMPACT_LUT_TOLERANCE 256
+
+typedef struct subchannel_table
+{
+  struct subchannel_table *next;
+  unsigned refcount;
+  unsigned subchannel_count;
+  int compact;			/* A compact table was asked for */
+  int interpolated;		/* and data holds one */
+  double *key;			/* Value and cutoff of each subchannel */
+  const unsigned short *data;
+  unsigned short *alloc_data;
+  stpi_lut_cache_entry_t *entry; /* Set if data is in the disk cache */
+} subchannel_table_t;
+
+static subchannel_table_t *subchannel_tables = NULL;
+
+#ifdef HAVE_PTHREAD_H
+static pthread_mutex_t subchannel_table_lock = PTHREAD_MUTEX_INITIALIZER;
+#define LOCK_TABLES() pthread_mutex_lock(&subchannel_table_lock)
+#define UNLOCK_TABLES() pthread_mutex_unlock(&subchannel_table_lock)
+#else
+#define LOCK_TABLES() do {} while (0)
+#define UNLOCK_TABLES() do {} while (0)
+#endif
+
+static void
+free_subchannel_table(subchannel_table_t *table)
+{
+  stpi_lut_cache_entry_release(table->entry);
+  STP_SAFE_FREE(table->alloc_data);
+  stp_free(table->key);
+  stp_free(table);
+}
+
+/*
+ * Drop unused tables beyond the spares.  Called with the lock held.
+ */
+static void
+trim_subchannel_tables(void)
+{
+  subchannel_table_t **prev = &subchannel_tables;
+  int spare = 0;
+  while (*prev)
+    {
+      subchannel_table_t *table = *prev;
+      if (table->refcount == 0 && ++spare > SUBCHANNEL_TABLE_SPARE)
+	{
+	  *prev = table->next;
+	  free_subchannel_table(table);
+	}
+      else
+	prev = &(table->next);
+    }
+}
+
+static void
+release_subchannel_table(subchannel_table_t *table)
+{
+  if (table)
+    {
+      LOCK_TABLES();
+      table->refcount--;
+      trim_subchannel_tables();
+      UNLOCK_TABLES();
+    }
+}
+
 static stpi_channel_group_t *
 get_channel_group(const stp_vars_t *v)
 {
   stpi_channel_group_t *cg =
-    ((stpi_channel_group_t *) stp_get_component_data(v, "Channel"));
+    ((stpi_channel_group_t *) stpi_get_component(v, STPI_COMPONENT_CHANNEL));
   return cg;
 }
 
@@ -112,7 +230,10 @@ clear_a_channel(stpi_channel_group_t *cg, int channel)
   if (channel < cg->channel_count)
     {
       STP_SAFE_FREE(cg->c[channel].sc);
-      STP_SAFE_FREE(cg->c[channel].lut);
+      release_subchannel_table(cg->c[channel].table);
+      cg->c[channel].table = NULL;
+      cg->c[channel].lut = NULL;
+      cg->c[channel].lut_compact = 0;
       if (cg->c[channel].curve)
 	{
 	  stp_curve_destroy(cg->c[channel].curve);
@@ -134,6 +255,12 @@ stpi_channel_clear(void *vc)
   STP_SAFE_FREE(cg->alloc_data_1);
   STP_SAFE_FREE(cg->alloc_data_2);
   STP_SAFE_FREE(cg->alloc_data_3);
+  STP_SAFE_FREE(cg->alloc_planar);
+  cg->planar_data = NULL;
+  cg->planar = 0;
+  cg->dest_data = NULL;
+  cg->output_stale = 0;
+  STP_SAFE_FREE(cg->split_lanes);
   STP_SAFE_FREE(cg->c);
   if (cg->gcr_curve)
     {
@@ -492,10 +619,20 @@ stp_dump_channels(const stp_vars_t *v)
   stp_dprintf(STP_DBG_INK, v, "   alloc_data_1   %p\n", (void *) cg->alloc_data_1);
   stp_dprintf(STP_DBG_INK, v, "   alloc_data_2   %p\n", (void *) cg->alloc_data_2);
   stp_dprintf(STP_DBG_INK, v, "   alloc_data_3   %p\n", (void *) cg->alloc_data_3);
+  stp_dprintf(STP_DBG_INK, v, "   planar_data    %p\n", (void *) cg->planar_data);
+  stp_dprintf(STP_DBG_INK, v, "   plane_stride   %lu\n",
+	      (unsigned long) cg->plane_stride);
+  stp_dprintf(STP_DBG_INK, v, "   block_width    %lu\n",
+	      (unsigned long) cg->block_width);
+  stp_dprintf(STP_DBG_INK, v, "   split_lanes    %p\n",
+	      (void *) cg->split_lanes);
   stp_dprintf(STP_DBG_INK, v, "   gcr_curve      %p\n", (void *) cg->gcr_curve);
   for (i = 0; i < cg->channel_count; i++)
     {
       stp_dprintf(STP_DBG_INK, v, "   Channel %d:\n", i);
+      if (cg->c[i].subchannel_count > 1)
+	stp_dprintf(STP_DBG_INK, v, "      compact table  %d\n",
+		    cg->c[i].lut_compact);
       for (j = 0; j < cg->c[i].subchannel_count; j++)
 	{
 	  stpi_subchannel_t *sch = &(cg->c[i].sc[j]);
@@ -509,6 +646,344 @@ stp_dump_channels(const stp_vars_t *v)
     }
 }
 
+static void
+compute_subchannel_lut(const stpi_channel_t *c, unsigned short *lut)
+{
+  int sc = c->subchannel_count;
+  int k;
+  int val = 0;
+  int next_breakpoint;
+  next_breakpoint = c->sc[0].value * 65535 * c->sc[0].cutoff;
+  if (next_breakpoint > 65535)
+    next_breakpoint = 65535;
+  while (val <= next_breakpoint)
+    {
+      int value = (int) ((double) val / c->sc[0].value);
+      lut[val * sc + sc - 1] = value;
+      val++;
+    }
+
+  for (k = 0; k < sc - 1; k++)
+    {
+      double this_val = c->sc[k].value;
+      double next_val = c->sc[k + 1].value;
+      double this_cutoff = c->sc[k].cutoff;
+      double next_cutoff = c->sc[k + 1].cutoff;
+      int range;
+      int base = val;
+      double cutoff = sqrt(this_cutoff * next_cutoff);
+      next_breakpoint = next_val * 65535 * cutoff;
+      if (next_breakpoint > 65535)
+	next_breakpoint = 65535;
+      range = next_breakpoint - val;
+      while (val <= next_breakpoint)
+	{
+	  double where = ((double) val - base) / (double) range;
+	  double lower_val = base * (1.0 - where);
+	  double lower_amount = lower_val / this_val;
+	  double upper_amount = (val - lower_val) / next_val;
+	  if (lower_amount > 65535.0)
+	    lower_amount = 65535.0;
+	  lut[val * sc + sc - k - 2] = upper_amount;
+	  lut[val * sc + sc - k - 1] = lower_amount;
+	  val++;
+	}
+    }
+  while (val <= 65535)
+    {
+      lut[val * sc] = val / c->sc[sc - 1].value;
+      val++;
+    }
+}
+
+/*
+ * Look a value up in one subchannel's row of a compact table.  The
+ * position between points is worked out to 15 bits: val * 2^27 / 65535
+ * is val * 2^11 plus (val * 2^11) / 65535, and the latter is done with
+ * the same shifts as the divisions by 65535 elsewhere.
+ */
+static inline unsigned
+compact_lut_value(const unsigned short *row, unsigned val)
+{
+  unsigned x = val << (COMPACT_LUT_BITS - 1);
+  unsigned pos = x + ((x + (x >> 16) + 1) >> 16);
+  unsigned i = pos >> 15;
+  int frac = pos & 0x7fff;
+  return row[i] + ((((int) row[i + 1] - (int) row[i]) * frac) >> 15);
+}
+
+/*
+ * Each point of a compact table is interpolated from the entries of the
+ * full table on either side of it.  Returns whether the compact table
+ * stays within COMPACT_LUT_TOLERANCE of the full one.
+ */
+static int
+compute_compact_subchannel_lut(unsigned sc, const unsigned short *lut,
+			       unsigned short *compact)
+{
+  unsigned k, p;
+  for (k = 0; k < sc; k++)
+    {
+      unsigned short *row = compact + k * COMPACT_LUT_STRIDE;
+      for (p = 0; p < COMPACT_LUT_POINTS; p++)
+	{
+	  unsigned where = p * 65535;
+	  unsigned val = where >> COMPACT_LUT_BITS;
+	  unsigned frac = where & ((1 << COMPACT_LUT_BITS) - 1);
+	  double y = lut[val * sc + k];
+	  if (frac)
+	    y += (lut[(val + 1) * sc + k] - y) * frac / (1 << COMPACT_LUT_BITS);
+	  row[p] = y + 0.5;
+	}
+      row[COMPACT_LUT_POINTS] = row[COMPACT_LUT_POINTS - 1];
+      for (p = 0; p < 65536; p++)
+	{
+	  int error = (int) compact_lut_value(row, p) - lut[p * sc + k];
+	  if (error > COMPACT_LUT_TOLERANCE || error < -COMPACT_LUT_TOLERANCE)
+	    return 0;
+	}
+    }
+  return 1;
+}
+
+/*
+ * Find the table for a channel's subchannels, or make it.  A full table
+ * comes from the lookup table cache if it can; a compact one is made
+ * from the full one.  The table is made with the lock held, so that two
+ * threads never make the same one.
+ */
+static void
+set_subchannel_lut(stpi_channel_t *c, int compact)
+{
+  unsigned sc = c->subchannel_count;
+  size_t key_size = sizeof(double) * 2 * sc;
+  double *key = stp_malloc(key_size);
+  subchannel_table_t **prev;
+  subchannel_table_t *table = NULL;
+  unsigned k;
+  for (k = 0; k < sc; k++)
+    {
+      key[2 * k] = c->sc[k].value;
+      key[2 * k + 1] = c->sc[k].cutoff;
+    }
+  LOCK_TABLES();
+  for (prev = &subchannel_tables; *prev; prev = &((*prev)->next))
+    {
+      if ((*prev)->subchannel_count == sc && (*prev)->compact == compact &&
+	  memcmp((*prev)->key, key, key_size) == 0)
+	{
+	  table = *prev;
+	  *prev = table->next;
+	  stp_free(key);
+	  break;
+	}
+    }
+  if (!table)
+    {
+      size_t bytes = sizeof(unsigned short) * sc * 65536;
+      stpi_lut_cache_key_t *cache_key =
+	stpi_lut_cache_key_create("subchannel");
+      stpi_lut_cache_entry_t *entry;
+      const unsigned short *lut;
+      unsigned short *alloc_lut = NULL;
+      table = stp_zalloc(sizeof(subchannel_table_t));
+      table->subchannel_count = sc;
+      table->compact = compact;
+      table->key = key;
+      stpi_lut_cache_key_add(cache_key, &sc, sizeof(sc));
+      for (k = 0; k < sc; k++)
+	{
+	  stpi_lut_cache_key_add(cache_key, &(c->sc[k].value), sizeof(double));
+	  stpi_lut_cache_key_add(cache_key, &(c->sc[k].cutoff),
+				 sizeof(double));
+	}
+      entry = stpi_lut_cache_lookup(cache_key, bytes);
+      if (entry)
+	lut = stpi_lut_cache_entry_data(entry);
+      else
+	{
+	  alloc_lut = stp_zalloc(bytes);
+	  compute_subchannel_lut(c, alloc_lut);
+	  stpi_lut_cache_store(cache_key, alloc_lut, bytes);
+	  lut = alloc_lut;
+	}
+      stpi_lut_cache_key_destroy(cache_key);
+      if (compact)
+	{
+	  unsigned short *data =
+	    stp_malloc(sizeof(unsigned short) * sc * COMPACT_LUT_STRIDE);
+	  if (compute_compact_subchannel_lut(sc, lut, data))
+	    {
+	      table->data = table->alloc_data = data;
+	      table->interpolated = 1;
+	      stpi_lut_cache_entry_release(entry);
+	      STP_SAFE_FREE(alloc_lut);
+	    }
+	  else
+	    stp_free(data);
+	}
+      if (!table->interpolated)
+	{
+	  table->data = lut;
+	  table->alloc_data = alloc_lut;
+	  table->entry = entry;
+	}
+    }
+  table->next = subchannel_tables;
+  subchannel_tables = table;
+  table->refcount++;
+  UNLOCK_TABLES();
+  c->table = table;
+  c->lut = table->data;
+  c->lut_compact = table->interpolated;
+}
+
+#ifdef X86_SPLIT
+/*
+ * The AVX2 split computes every output channel of a pixel at once, one
+ * per lane, so it handles up to 8 input and 8 output channels.  Lanes
+ * fed by a channel with several subchannels look up their values with
+ * a gather.  Each gather reads the 32 bits ending at the entry wanted,
+ * which never reaches past the end of the table, or with compact tables
+ * the two points to interpolate between.
+ *
+ * The divisions are replaced by multiplications: o * i / l is estimated
+ * in single precision and then corrected by one if need be, which is
+ * always enough since the quotient is below 65536, and x / 65535 is
+ * (x + (x >> 16) + 1) >> 16, which holds for every x up to 65535 * 65535.
+ * The results are therefore exactly those of split_channels().
+ */
+struct split_lanes
+{
+  int src[8];			/* Input channel feeding each lane */
+  int split[8];			/* -1 if the lane uses a subchannel table */
+  int add_black[8];		/* -1 if black is added before the lookup */
+  int valid[8];			/* -1 for lanes that are output channels */
+  int s_count[8];
+  int k_minus_1[8];
+  int density[8];
+  long long lut_offset[8];	/* Offset of the lane's table from lut_base */
+  const unsigned short *lut_base;
+  int compact;			/* Tables are compact */
+  unsigned short in_mask[8];	/* 0xffff for lanes that are input */
+  unsigned short vb_mask[8];	/* 0xffff for lanes not in virtual black */
+};
+
+static void
+setup_split_lanes(stpi_channel_group_t *cg)
+{
+  struct split_lanes *sl;
+  int lane = 0;
+  int src = 0;
+  int i, k;
+  STP_SAFE_FREE(cg->split_lanes);
+  if (stpi_kernel_level() < STPI_KERNEL_AVX2 || cg->total_channels > 8 ||
+      cg->aux_output_channels > 8 || cg->aux_output_channels < 1)
+    return;
+  sl = stp_zalloc(sizeof(struct split_lanes));
+  for (i = 0; i < 8; i++)
+    {
+      sl->in_mask[i] = i < cg->aux_output_channels ? 0xffff : 0;
+      sl->vb_mask[i] =
+	(i >= cg->aux_output_channels || i == cg->black_channel) ? 0xffff : 0;
+    }
+  for (i = 0; i < cg->channel_count; i++)
+    {
+      const stpi_channel_t *c = &(cg->c[i]);
+      int s_count = c->subchannel_count;
+      if (s_count < 1)
+	continue;
+      /* Anything else would read into the next pixel or mix table kinds */
+      if (src >= cg->aux_output_channels || (s_count > 1 && !c->lut) ||
+	  (s_count > 1 && sl->lut_base && c->lut_compact != sl->compact))
+	{
+	  stp_free(sl);
+	  return;
+	}
+      if (s_count > 1 && !sl->lut_base)
+	{
+	  sl->lut_base = c->lut;
+	  sl->compact = c->lut_compact;
+	}
+      for (k = 0; k < s_count; k++, lane++)
+	{
+	  sl->src[lane] = src;
+	  sl->split[lane] = s_count > 1 ? -1 : 0;
+	  sl->add_black[lane] =
+	    (s_count > 1 && i != cg->black_channel) ? -1 : 0;
+	  sl->valid[lane] = -1;
+	  sl->s_count[lane] = s_count;
+	  sl->k_minus_1[lane] = k - 1;
+	  sl->density[lane] = c->sc[k].s_density;
+	  if (s_count > 1 && sl->compact)
+	    sl->lut_offset[lane] = (long long)
+	      ((size_t) (c->lut + k * COMPACT_LUT_STRIDE) -
+	       (size_t) sl->lut_base);
+	  else if (s_count > 1)
+	    sl->lut_offset[lane] =
+	      (long long) ((size_t) c->lut - (size_t) sl->lut_base);
+	}
+      src++;
+    }
+  cg->split_lanes = sl;
+}
+
+#else
+static void
+setup_split_lanes(stpi_channel_group_t *cg)
+{
+}
+#endif
+
+/*
+ * Planar output holds each physical channel in a row of its own,
+ * aligned to PLANE_ALIGN shorts, so that the dither can work through
+ * one channel at a time with unit stride and skip empty channels
+ * entirely.  With a single channel the output is already planar.
+ * Otherwise the last steps of the conversion store their results
+ * straight into the planes, and output_data is only brought up to date
+ * if somebody asks for it.
+ */
+#define PLANE_ALIGN 16
+
+#define CONVERT_BLOCK_BYTES 16384
+
+static void
+allocate_planes(stpi_channel_group_t *cg)
+{
+  if (cg->total_channels == 1)
+    {
+      cg->plane_stride = cg->width;
+      cg->planar_data = cg->output_data;
+      return;
+    }
+  cg->plane_stride = (cg->width + PLANE_ALIGN - 1) & ~(size_t) (PLANE_ALIGN - 1);
+  cg->alloc_planar =
+    stp_malloc(sizeof(unsigned short) *
+	       (cg->plane_stride * cg->total_channels + PLANE_ALIGN));
+  cg->planar_data = (unsigned short *)
+    (((size_t) cg->alloc_planar + sizeof(unsigned short) * PLANE_ALIGN - 1) &
+     ~(sizeof(unsigned short) * PLANE_ALIGN - 1));
+}
+
+static void
+set_output_layout(stpi_channel_group_t *cg)
+{
+  if (cg->planar_data && cg->planar_data != cg->output_data)
+    {
+      cg->dest_data = cg->planar_data;
+      cg->pixel_step = 1;
+      cg->channel_step = cg->plane_stride;
+    }
+  else
+    {
+      cg->dest_data = cg->output_data;
+      cg->pixel_step = cg->total_channels;
+      cg->channel_step = 1;
+    }
+  cg->output_stale = 0;
+}
+
 void
 stp_channel_initialize(stp_vars_t *v, stp_image_t *image,
 		       int input_channel_count)
@@ -516,7 +991,8 @@ stp_channel_initialize(stp_vars_t *v, stp_image_t *image,
   stpi_channel_group_t *cg = get_channel_group(v);
   int width = stp_image_width(image);
   int curve_count = 0;
-  int i, j, k;
+  int compact = 0;
+  int i, j;
   if (!cg)
     {
       cg = stp_zalloc(sizeof(stpi_channel_group_t));
@@ -529,6 +1005,10 @@ stp_channel_initialize(stp_vars_t *v, stp_image_t *image,
   cg->max_density = 0;
   if (cg->black_channel < -1 || cg->black_channel >= cg->channel_count)
     cg->black_channel = -1;
+  if (stp_check_boolean_parameter(v, "CompactSubchannelTables",
+				  STP_PARAMETER_ACTIVE) &&
+      stp_get_boolean_parameter(v, "CompactSubchannelTables"))
+    compact = 1;
   for (i = 0; i < cg->channel_count; i++)
     {
       stpi_channel_t *c = &(cg->c[i]);
@@ -541,52 +1021,7 @@ stp_channel_initialize(stp_vars_t *v, stp_image_t *image,
 	  cg->curve_count++;
 	}
       if (sc > 1)
-	{
-	  int val = 0;
-	  int next_breakpoint;
-	  c->lut = stp_zalloc(sizeof(unsigned short) * sc * 65536);
-	  next_breakpoint = c->sc[0].value * 65535 * c->sc[0].cutoff;
-	  if (next_breakpoint > 65535)
-	    next_breakpoint = 65535;
-	  while (val <= next_breakpoint)
-	    {
-	      int value = (int) ((double) val / c->sc[0].value);
-	      c->lut[val * sc + sc - 1] = value;
-	      val++;
-	    }
-
-	  for (k = 0; k < sc - 1; k++)
-	    {
-	      double this_val = c->sc[k].value;
-	      double next_val = c->sc[k + 1].value;
-	      double this_cutoff = c->sc[k].cutoff;
-	      double next_cutoff = c->sc[k + 1].cutoff;
-	      int range;
-	      int base = val;
-	      double cutoff = sqrt(this_cutoff * next_cutoff);
-	      next_breakpoint = next_val * 65535 * cutoff;
-	      if (next_breakpoint > 65535)
-		next_breakpoint = 65535;
-	      range = next_breakpoint - val;
-	      while (val <= next_breakpoint)
-		{
-		  double where = ((double) val - base) / (double) range;
-		  double lower_val = base * (1.0 - where);
-		  double lower_amount = lower_val / this_val;
-		  double upper_amount = (val - lower_val) / next_val;
-		  if (lower_amount > 65535.0)
-		    lower_amount = 65535.0;
-		  c->lut[val * sc + sc - k - 2] = upper_amount;
-		  c->lut[val * sc + sc - k - 1] = lower_amount;
-		  val++;
-		}
-	    }
-	  while (val <= 65535)
-	    {
-	      c->lut[val * sc] = val / c->sc[sc - 1].value;
-	      val++;
-	    }
-	}
+	set_subchannel_lut(c, compact);
       if (cg->gloss_channel != i && c->subchannel_count > 0)
 	cg->aux_output_channels++;
       cg->total_channels += c->subchannel_count;
@@ -608,6 +1043,9 @@ stp_channel_initialize(stp_vars_t *v, stp_image_t *image,
   cg->alloc_data_1 =
     stp_malloc(sizeof(unsigned short) * cg->total_channels * width);
   cg->output_data = cg->alloc_data_1;
+  if (cg->planar && cg->total_channels > 0)
+    allocate_planes(cg);
+  set_output_layout(cg);
   if (curve_count == 0)
     {
       cg->gcr_channels = cg->input_channels;
@@ -655,6 +1093,19 @@ stp_channel_initialize(stp_vars_t *v, stp_image_t *image,
 	}
       cg->gcr_channels = cg->aux_output_channels;
     }
+  /*
+   * Size the blocks that stp_channel_convert() works on so that the
+   * input, intermediate and output data for a block stay in the L1
+   * cache from one step to the next.
+   */
+  cg->block_width = CONVERT_BLOCK_BYTES /
+    (sizeof(unsigned short) *
+     (cg->input_channels + cg->aux_output_channels + cg->total_channels));
+  cg->block_width &= ~(size_t) 7;
+  if (cg->block_width < 64)
+    cg->block_width = 64;
+  if (input_needs_splitting(cg))
+    setup_split_lanes(cg);
   cg->cyan_balance = stp_get_float_parameter(v, "CyanBalance");
   cg->magenta_balance = stp_get_float_parameter(v, "MagentaBalance");
   cg->yellow_balance = stp_get_float_parameter(v, "YellowBalance");
@@ -673,36 +1124,49 @@ clear_channel(unsigned short *data, unsigned width, unsigned depth)
 }
 
 static int NOINLINE
-scale_channel(unsigned short *data, unsigned width, unsigned depth,
-	      unsigned short density)
+scale_channel(const unsigned short *in, unsigned short *out, unsigned width,
+	      unsigned in_step, unsigned out_step, unsigned short density)
 {
   int i;
   int retval = 0;
   unsigned short previous_data = 0;
   unsigned short previous_value = 0;
-  width *= depth;
-  for (i = 0; i < width; i += depth)
+  for (i = 0; i < width; i++, in += in_step, out += out_step)
     {
-      if (data[i] == previous_data)
-	data[i] = previous_value;
-      else if (data[i] == (unsigned short) 65535)
+      unsigned short val = *in;
+      if (val == previous_data)
+	*out = previous_value;
+      else if (val == (unsigned short) 65535)
 	{
-	  data[i] = density;
+	  *out = density;
 	  retval = 1;
 	}
-      else if (data[i] > 0)
+      else if (val > 0)
 	{
-	  unsigned short tval = (32767u + data[i] * density) / 65535u;
-	  previous_data = data[i];
+	  unsigned short tval = (32767u + val * density) / 65535u;
+	  previous_data = val;
 	  if (tval)
 	    retval = 1;
 	  previous_value = (unsigned short) tval;
-	  data[i] = (unsigned short) tval;
+	  *out = (unsigned short) tval;
 	}
+      else
+	*out = 0;
     }
   return retval;
 }
 
+static int NOINLINE
+copy_channel(const unsigned short *in, unsigned short *out, unsigned width,
+	     unsigned in_step)
+{
+  int i;
+  unsigned short nonzero = 0;
+  for (i = 0; i < width; i++, in += in_step)
+    nonzero |= out[i] = *in;
+  return nonzero != 0;
+}
+
 static int NOINLINE
 scan_channel(unsigned short *data, unsigned width, unsigned depth)
 {
@@ -717,28 +1181,28 @@ scan_channel(unsigned short *data, unsigned width, unsigned depth)
 }
 
 static inline unsigned
-ink_sum(const unsigned short *data, int total_channels)
+ink_sum(const unsigned short *data, int total_channels, size_t step)
 {
   int j;
   unsigned total_ink = 0;
   for (j = 0; j < total_channels; j++)
-    total_ink += data[j];
+    total_ink += data[j * step];
   return total_ink;
 }
 
 static int NOINLINE
-limit_ink(stpi_channel_group_t *cg)
+limit_ink(stpi_channel_group_t *cg, size_t start, size_t end)
 {
-  int i;
+  size_t i;
   int retval = 0;
   unsigned short *ptr;
   if (!cg || cg->ink_limit == 0 || cg->ink_limit >= cg->max_density)
     return 0;
   cg->valid_8bit = 0;
-  ptr = cg->output_data;
-  for (i = 0; i < cg->width; i++)
+  ptr = cg->dest_data + start * cg->pixel_step;
+  for (i = start; i < end; i++)
     {
-      int total_ink = ink_sum(ptr, cg->total_channels);
+      int total_ink = ink_sum(ptr, cg->total_channels, cg->channel_step);
       if (total_ink > cg->ink_limit) /* Need to limit ink? */
 	{
 	  int j;
@@ -747,10 +1211,10 @@ limit_ink(stpi_channel_group_t *cg)
 	   */
 	  double ratio = (double) cg->ink_limit / (double) total_ink;
 	  for (j = 0; j < cg->total_channels; j++)
-	    ptr[j] *= ratio;
+	    ptr[j * cg->channel_step] *= ratio;
 	  retval = 1;
 	}
-      ptr += cg->total_channels;
+      ptr += cg->pixel_step;
    }
   return retval;
 }
@@ -781,17 +1245,30 @@ short_copy(unsigned short *out, const unsigned short *in, size_t count)
 #endif
 }
 
+static inline void
+copy_pixel(unsigned short *out, const unsigned short *in, size_t count,
+	   size_t step)
+{
+  int i;
+  if (step == 1)
+    memcpy(out, in, count * sizeof(unsigned short));
+  else
+    for (i = 0; i < count; i++)
+      out[i * step] = in[i * step];
+}
+
 static void NOINLINE
-copy_channels(stpi_channel_group_t *cg)
+copy_channels(stpi_channel_group_t *cg, size_t start, size_t end)
 {
-  int i, j, k;
+  size_t i;
+  int j, k;
   const unsigned short *input;
   unsigned short *output;
   if (!cg)
     return;
-  input = cg->input_data;
-  output = cg->output_data;
-  for (i = 0; i < cg->width; i++)
+  input = cg->input_data + start * cg->input_channels;
+  output = cg->output_data + start * cg->total_channels;
+  for (i = start; i < end; i++)
     {
       for (j = 0; j < cg->channel_count; j++)
 	{
@@ -838,9 +1315,10 @@ interpolate_value(const double *vec, double val)
 }
 
 static void NOINLINE
-generate_special_channels(stpi_channel_group_t *cg)
+generate_special_channels(stpi_channel_group_t *cg, size_t start, size_t end)
 {
-  int i, j;
+  size_t i;
+  int j;
   const unsigned short *input_cache = NULL;
   const unsigned short *output_cache = NULL;
   const unsigned short *input;
@@ -850,11 +1328,11 @@ generate_special_channels(stpi_channel_group_t *cg)
   if (!cg)
     return;
   cg->valid_8bit = 0;
-  input = cg->input_data;
-  output = cg->multi_tmp;
+  input = cg->input_data + start * cg->input_channels;
+  output = cg->multi_tmp + start * cg->aux_output_channels;
   offset = (cg->black_channel >= 0 ? 0 : -1);
   outbytes = cg->aux_output_channels * sizeof(unsigned short);
-  for (i = 0; i < cg->width;
+  for (i = start; i < end;
        input += cg->input_channels, output += cg->aux_output_channels, i++)
     {
       if (input_cache && short_eq(input_cache, input, cg->input_channels))
@@ -912,12 +1390,199 @@ generate_special_channels(stpi_channel_group_t *cg)
     }
 }
 
+#ifdef X86_SPLIT
+static inline void __attribute__ ((target ("avx2")))
+store_pixel_avx2(unsigned short *output, __m128i result, int total,
+		 size_t step)
+{
+  if (step == 1)
+    _mm_storeu_si128((__m128i *) output, result);
+  else
+    {
+      unsigned short lanes[8];
+      int j;
+      _mm_storeu_si128((__m128i *) lanes, result);
+      for (j = 0; j < total; j++)
+	output[j * step] = lanes[j];
+    }
+}
+
+/*
+ * Returns the pixel at which it stopped; the last few pixels of the row
+ * are left to split_channels(), since whole vectors are loaded and
+ * stored for each pixel.
+ */
+static size_t __attribute__ ((target ("avx2")))
+split_channels_avx2(stpi_channel_group_t *cg, size_t start, size_t end,
+		    int *nz)
+{
+  const struct split_lanes *sl = cg->split_lanes;
+  int aux = cg->aux_output_channels;
+  int total = cg->total_channels;
+  size_t step = cg->channel_step;
+  size_t tail = FMAX((8 + aux - 1) / aux, (8 + total - 1) / total);
+  size_t stop = cg->width >= tail ? cg->width - tail + 1 : 0;
+  const unsigned short *input = cg->split_input + start * aux;
+  unsigned short *output = cg->dest_data + start * cg->pixel_step;
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i one = _mm256_set1_epi32(1);
+  const __m256i max_value = _mm256_set1_epi32(65535);
+  const __m256i low_half = max_value;
+  const __m256i fraction = _mm256_set1_epi32(0x7fff);
+  const __m256i src = _mm256_loadu_si256((const __m256i *) sl->src);
+  const __m256i split = _mm256_loadu_si256((const __m256i *) sl->split);
+  const __m256i add_black =
+    _mm256_loadu_si256((const __m256i *) sl->add_black);
+  const __m256i valid = _mm256_loadu_si256((const __m256i *) sl->valid);
+  const __m256i s_count = _mm256_loadu_si256((const __m256i *) sl->s_count);
+  const __m256i k_minus_1 =
+    _mm256_loadu_si256((const __m256i *) sl->k_minus_1);
+  const __m256i density = _mm256_loadu_si256((const __m256i *) sl->density);
+  const __m256i offset_lo =
+    _mm256_loadu_si256((const __m256i *) sl->lut_offset);
+  const __m256i offset_hi =
+    _mm256_loadu_si256((const __m256i *) (sl->lut_offset + 4));
+  const __m128i in_mask = _mm_loadu_si128((const __m128i *) sl->in_mask);
+  const __m128i vb_mask = _mm_loadu_si128((const __m128i *) sl->vb_mask);
+  const int valid_bits = (1 << total) - 1;
+  __m128i previous = _mm_setzero_si128();
+  __m128i result = _mm_setzero_si128();
+  __m256i acc = zero;
+  int have_previous = 0;
+  int lanes[8];
+  size_t i;
+  int j;
+
+  if (stop > end)
+    stop = end;
+  for (i = start; i < stop; i++, input += aux, output += cg->pixel_step)
+    {
+      __m128i in =
+	_mm_and_si128(_mm_loadu_si128((const __m128i *) input), in_mask);
+      __m256i i_val, l_val, nonzero, gather_mask, index, gathered, o_val;
+      __m256i x, q, r, l_nz, pos = zero;
+      __m128i g_lo, g_hi;
+      unsigned black_value = 0;
+      int nonzero_bits;
+      if (have_previous &&
+	  _mm_movemask_epi8(_mm_cmpeq_epi16(in, previous)) == 0xffff)
+	{
+	  store_pixel_avx2(output, result, total, step);
+	  continue;
+	}
+      previous = in;
+      have_previous = 1;
+      if (cg->black_channel >= 0)
+	black_value = input[cg->black_channel];
+      black_value +=
+	(_mm_cvtsi128_si32(_mm_minpos_epu16(_mm_or_si128(in, vb_mask))) &
+	 0xffff) / 4;
+
+      i_val = _mm256_permutevar8x32_epi32(_mm256_cvtepu16_epi32(in), src);
+      l_val = _mm256_min_epu32
+	(_mm256_add_epi32(i_val, _mm256_and_si256
+			  (_mm256_set1_epi32(black_value), add_black)),
+	 max_value);
+      nonzero = _mm256_andnot_si256(_mm256_cmpeq_epi32(i_val, zero), valid);
+      gather_mask = _mm256_and_si256(nonzero, split);
+
+      if (sl->compact)
+	{
+	  /* Points pos >> 15 and the next, see compact_lut_value() */
+	  x = _mm256_slli_epi32(l_val, COMPACT_LUT_BITS - 1);
+	  pos = _mm256_add_epi32
+	    (x, _mm256_srli_epi32
+	     (_mm256_add_epi32(_mm256_add_epi32(x, _mm256_srli_epi32(x, 16)),
+			       one), 16));
+	  index = _mm256_srli_epi32(pos, 15);
+	}
+      else
+	/* Entry l_val * s_count + k, read as the high half of a dword */
+	index =
+	  _mm256_add_epi32(_mm256_mullo_epi32(l_val, s_count), k_minus_1);
+      g_lo = _mm256_mask_i64gather_epi32
+	(_mm_setzero_si128(), (const int *) sl->lut_base,
+	 _mm256_add_epi64(_mm256_slli_epi64
+			  (_mm256_cvtepu32_epi64(_mm256_castsi256_si128(index)),
+			   1), offset_lo),
+	 _mm256_castsi256_si128(gather_mask), 1);
+      g_hi = _mm256_mask_i64gather_epi32
+	(_mm_setzero_si128(), (const int *) sl->lut_base,
+	 _mm256_add_epi64(_mm256_slli_epi64
+			  (_mm256_cvtepu32_epi64
+			   (_mm256_extracti128_si256(index, 1)), 1), offset_hi),
+	 _mm256_extracti128_si256(gather_mask, 1), 1);
+      gathered =
+	_mm256_inserti128_si256(_mm256_castsi128_si256(g_lo), g_hi, 1);
+      if (sl->compact)
+	{
+	  __m256i lo = _mm256_and_si256(gathered, low_half);
+	  __m256i hi = _mm256_srli_epi32(gathered, 16);
+	  gathered = _mm256_add_epi32
+	    (lo, _mm256_srai_epi32
+	     (_mm256_mullo_epi32(_mm256_sub_epi32(hi, lo),
+				 _mm256_and_si256(pos, fraction)), 15));
+	}
+      else
+	gathered = _mm256_srli_epi32(gathered, 16);
+      o_val = _mm256_blendv_epi8(i_val, gathered, split);
+
+      /* o_val * i_val / l_val */
+      l_nz = _mm256_max_epu32(l_val, one);
+      x = _mm256_mullo_epi32(o_val, i_val);
+      q = _mm256_cvttps_epi32
+	(_mm256_div_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(o_val),
+				     _mm256_cvtepi32_ps(i_val)),
+		       _mm256_cvtepi32_ps(l_nz)));
+      r = _mm256_sub_epi32(x, _mm256_mullo_epi32(q, l_nz));
+      q = _mm256_add_epi32(q, _mm256_cmpgt_epi32(zero, r));
+      q = _mm256_sub_epi32(q, _mm256_cmpgt_epi32
+			   (r, _mm256_sub_epi32(l_nz, one)));
+
+      /* q * density / 65535 */
+      x = _mm256_mullo_epi32(q, density);
+      o_val = _mm256_srli_epi32
+	(_mm256_add_epi32(_mm256_add_epi32(x, _mm256_srli_epi32(x, 16)), one),
+	 16);
+      o_val = _mm256_and_si256(o_val, nonzero);
+
+      result = _mm256_castsi256_si128
+	(_mm256_permute4x64_epi64(_mm256_packus_epi32(o_val, o_val),
+				  _MM_SHUFFLE(3, 1, 2, 0)));
+      store_pixel_avx2(output, result, total, step);
+
+      /*
+       * split_channels() only counts the outputs of channels whose input
+       * isn't zero when it works out which channels are in use, so the
+       * outputs after such a channel are counted against the channels
+       * before them.  Do the same.
+       */
+      nonzero_bits = _mm256_movemask_ps(_mm256_castsi256_ps(nonzero));
+      if (nonzero_bits == valid_bits)
+	acc = _mm256_or_si256(acc, o_val);
+      else if (!_mm256_testz_si256(o_val, o_val))
+	{
+	  int zero_ptr = 0;
+	  for (j = 0; j < total; j++)
+	    if (nonzero_bits & (1 << j))
+	      nz[zero_ptr++] |= output[j * step];
+	}
+    }
+  _mm256_storeu_si256((__m256i *) lanes, acc);
+  for (j = 0; j < total; j++)
+    nz[j] |= lanes[j];
+  return i > start ? i : start;
+}
+#endif
+
 static void NOINLINE
-split_channels(stpi_channel_group_t *cg, unsigned *zero_mask)
+split_channels(stpi_channel_group_t *cg, size_t start, size_t end,
+	       unsigned short *row_nz)
 {
-  int i, j, k;
+  size_t i;
+  int j, k;
   int nz[STP_CHANNEL_LIMIT];
-  int outbytes;
+  size_t step;
   const unsigned short *input_cache = NULL;
   const unsigned short *output_cache = NULL;
   const unsigned short *input;
@@ -925,19 +1590,23 @@ split_channels(stpi_channel_group_t *cg, unsigned *zero_mask)
   if (!cg)
     return;
   cg->valid_8bit = 0;
-  outbytes = cg->total_channels * sizeof(unsigned short);
-  input = cg->split_input;
-  output = cg->output_data;
-  for (i = 0; i < cg->total_channels; i++)
-    nz[i] = 0;
-  for (i = 0; i < cg->width; i++)
+  step = cg->channel_step;
+  for (j = 0; j < cg->total_channels; j++)
+    nz[j] = 0;
+#ifdef X86_SPLIT
+  if (cg->split_lanes)
+    start = split_channels_avx2(cg, start, end, nz);
+#endif
+  input = cg->split_input + start * cg->aux_output_channels;
+  output = cg->dest_data + start * cg->pixel_step;
+  for (i = start; i < end; i++, output += cg->pixel_step)
     {
       int zero_ptr = 0;
+      unsigned short *out = output;
       if (input_cache && short_eq(input_cache, input, cg->aux_output_channels))
 	{
-	  memcpy(output, output_cache, outbytes);
+	  copy_pixel(output, output_cache, cg->total_channels, step);
 	  input += cg->aux_output_channels;
-	  output += cg->total_channels;
 	}
       else
 	{
@@ -962,14 +1631,15 @@ split_channels(stpi_channel_group_t *cg, unsigned *zero_mask)
 		  unsigned i_val = *input++;
 		  if (i_val == 0)
 		    {
-		      for (k = 0; k < s_count; k++)
-			*(output++) = 0;
+		      for (k = 0; k < s_count; k++, out += step)
+			*out = 0;
 		    }
 		  else if (s_count == 1)
 		    {
 		      if (c->sc[0].s_density < 65535)
 			i_val = i_val * c->sc[0].s_density / 65535;
-		      nz[zero_ptr++] |= *(output++) = i_val;
+		      nz[zero_ptr++] |= *out = i_val;
+		      out += step;
 		    }
 		  else
 		    {
@@ -987,7 +1657,11 @@ split_channels(stpi_channel_group_t *cg, unsigned *zero_mask)
 			  unsigned o_val;
 			  if (c->sc[k].s_density > 0)
 			    {
-			      o_val = c->lut[offset + k];
+			      if (c->lut_compact)
+				o_val = compact_lut_value
+				  (c->lut + k * COMPACT_LUT_STRIDE, l_val);
+			      else
+				o_val = c->lut[offset + k];
 			      if (i_val != l_val)
 				o_val = o_val * i_val / l_val;
 			      if (c->sc[k].s_density < 65535)
@@ -995,7 +1669,8 @@ split_channels(stpi_channel_group_t *cg, unsigned *zero_mask)
 			    }
 			  else
 			    o_val = 0;
-			  *output++ = o_val;
+			  *out = o_val;
+			  out += step;
 			  nz[zero_ptr++] |= o_val;
 			}
 		    }
@@ -1003,77 +1678,85 @@ split_channels(stpi_channel_group_t *cg, unsigned *zero_mask)
 	    }
 	}
     }
-  if (zero_mask)
-    {
-      *zero_mask = 0;
-      for (i = 0; i < cg->total_channels; i++)
-	if (!nz[i])
-	  *zero_mask |= 1 << i;
-    }
+  for (j = 0; j < cg->total_channels; j++)
+    row_nz[j] |= nz[j];
 }
 
 static void NOINLINE
-scale_channels(stpi_channel_group_t *cg, unsigned *zero_mask,
-	       int zero_mask_valid)
+scale_channels(stpi_channel_group_t *cg, size_t start, size_t end,
+	       int scan, unsigned *checked, unsigned *nonzero)
 {
   int i, j;
   int physical_channel = 0;
+  unsigned width = end - start;
   if (!cg)
     return;
   cg->valid_8bit = 0;
-  if (zero_mask)
-    *zero_mask = 0;
   for (i = 0; i < cg->channel_count; i++)
     {
       stpi_channel_t *ch = &(cg->c[i]);
       if (ch->subchannel_count > 0)
 	for (j = 0; j < ch->subchannel_count; j++)
 	  {
+	    unsigned short *input = cg->output_data + physical_channel +
+	      start * cg->total_channels;
+	    unsigned short *output = cg->dest_data +
+	      physical_channel * cg->channel_step + start * cg->pixel_step;
 	    if (cg->gloss_channel != i)
 	      {
 		stpi_subchannel_t *sch = &(ch->sc[j]);
 		unsigned density = sch->s_density;
-		unsigned short *output = cg->output_data + physical_channel;
+		unsigned bit = 1 << physical_channel;
 		if (density == 0)
 		  {
-		    clear_channel(output, cg->width, cg->total_channels);
-		    if (zero_mask)
-		      *zero_mask |= 1 << physical_channel;
+		    clear_channel(output, width, cg->pixel_step);
+		    *checked |= bit;
 		  }
 		else if (density != 65535)
 		  {
-		    if (scale_channel(output, cg->width, cg->total_channels,
-				      density) == 0)
-		      if (zero_mask)
-			*zero_mask |= 1 << physical_channel;
+		    if (scale_channel(input, output, width, cg->total_channels,
+				      cg->pixel_step, density))
+		      *nonzero |= bit;
+		    *checked |= bit;
 		  }
-		else if (zero_mask && ! zero_mask_valid)
+		else if (output != input)
 		  {
-		    if (scan_channel(output, cg->width, cg->total_channels)==0)
-		      *zero_mask |= 1 << physical_channel;
+		    if (copy_channel(input, output, width, cg->total_channels))
+		      *nonzero |= bit;
+		    if (scan)
+		      *checked |= bit;
+		  }
+		else if (scan)
+		  {
+		    if (!(*nonzero & bit) &&
+			scan_channel(output, width, cg->total_channels))
+		      *nonzero |= bit;
+		    *checked |= bit;
 		  }
 	      }
+	    else if (output != input)
+	      (void) copy_channel(input, output, width, cg->total_channels);
 	    physical_channel++;
 	  }
     }
 }
 
-static void NOINLINE
-generate_gloss(stpi_channel_group_t *cg, unsigned *zero_mask)
+static int NOINLINE
+generate_gloss(stpi_channel_group_t *cg, size_t start, size_t end)
 {
   unsigned short *output;
-  unsigned gloss_mask;
-  int i, j, k;
+  int retval = 0;
+  size_t i;
+  int j, k;
   if (!cg || cg->gloss_channel == -1 || cg->gloss_limit <= 0)
-    return;
+    return 0;
   cg->valid_8bit = 0;
-  output = cg->output_data;
-  gloss_mask = ~(1 << cg->gloss_physical_channel);
-  for (i = 0; i < cg->width; i++)
+  output = cg->dest_data + start * cg->pixel_step;
+  for (i = start; i < end; i++)
     {
       int physical_channel = 0;
       unsigned channel_sum = 0;
-      output[cg->gloss_physical_channel] = 0;
+      output[cg->gloss_physical_channel * cg->channel_step] = 0;
       for (j = 0; j < cg->channel_count; j++)
 	{
 	  stpi_channel_t *ch = &(cg->c[j]);
@@ -1081,7 +1764,8 @@ generate_gloss(stpi_channel_group_t *cg, unsigned *zero_mask)
 	    {
 	      if (cg->gloss_channel != j)
 		{
-		  channel_sum += (unsigned) output[physical_channel];
+		  channel_sum +=
+		    (unsigned) output[physical_channel * cg->channel_step];
 		  if (channel_sum >= cg->gloss_limit)
 		    goto next;
 		}
@@ -1093,36 +1777,29 @@ generate_gloss(stpi_channel_group_t *cg, unsigned *zero_mask)
 	  unsigned gloss_required = cg->gloss_limit - channel_sum;
 	  if (gloss_required > 65535)
 	    gloss_required = 65535;
-	  output[cg->gloss_physical_channel] = gloss_required;
-	  if (zero_mask)
-	    *zero_mask &= gloss_mask;
+	  output[cg->gloss_physical_channel * cg->channel_step] =
+	    gloss_required;
+	  retval = 1;
 	}
     next:
-      output += cg->total_channels;
+      output += cg->pixel_step;
     }
+  return retval;
 }
 
 static void NOINLINE
-do_gcr(stpi_channel_group_t *cg, unsigned *zero_mask)
+do_gcr(stpi_channel_group_t *cg, size_t start, size_t end,
+       const unsigned short *gcr_lookup)
 {
-  const unsigned short *gcr_lookup;
   unsigned short *output;
-  size_t count;
-  int i;
-  union {
-    unsigned short nz[4];
-    unsigned long long nzl;
-  } nzx;
+  size_t i;
 
-  nzx.nzl = 0ull;
   if (!cg)
     return;
   cg->valid_8bit = 0;
 
-  output = cg->gcr_data;
-  stp_curve_resample(cg->gcr_curve, 65536);
-  gcr_lookup = stp_curve_get_ushort_data(cg->gcr_curve, &count);
-  for (i = 0; i < cg->width; i++)
+  output = cg->gcr_data + start * cg->gcr_channels;
+  for (i = start; i < end; i++)
     {
       unsigned k = output[0];
       if (k > 0)
@@ -1136,40 +1813,136 @@ do_gcr(stpi_channel_group_t *cg, unsigned *zero_mask)
 	  output[1] += ck * cg->cyan_balance;
 	  output[2] += ck * cg->magenta_balance;
 	  output[3] += ck * cg->yellow_balance;
-	  nzx.nzl |= *(unsigned long long *) output;
 	}
       output += cg->gcr_channels;
     }
-  *zero_mask = 0;
-  for (i = 0; i < 4; i++)
-    if (nzx.nz[i] == 0)
-      *zero_mask |= (1 << i);
 }
 
+static void NOINLINE
+scan_planes(stpi_channel_group_t *cg, size_t start, size_t end,
+	    unsigned short *nz)
+{
+  int i;
+  size_t j;
+  for (i = 0; i < cg->total_channels; i++)
+    {
+      const unsigned short *plane = cg->planar_data + i * cg->plane_stride;
+      unsigned short pnz = 0;
+      for (j = start; j < end; j++)
+	pnz |= plane[j];
+      nz[i] |= pnz;
+    }
+}
+
+/*
+ * Fill in output_data from the planes, for callers that want the
+ * interleaved row after the planes were written directly.
+ */
+static void
+update_output(stpi_channel_group_t *cg)
+{
+  int i;
+  size_t j;
+  if (!cg->output_stale)
+    return;
+  for (i = 0; i < cg->total_channels; i++)
+    {
+      const unsigned short *plane = cg->planar_data + i * cg->plane_stride;
+      unsigned short *output = cg->output_data + i;
+      for (j = 0; j < cg->width; j++, output += cg->total_channels)
+	*output = plane[j];
+    }
+  cg->output_stale = 0;
+}
+
+/*
+ * Everything that has to be carried from one block of a row to the next
+ * in order to compute the zero mask for the row.
+ */
+typedef struct
+{
+  unsigned short split_nz[STP_CHANNEL_LIMIT];
+  unsigned scale_checked;
+  unsigned scale_nonzero;
+  int gloss_added;
+  unsigned short plane_nz[STP_CHANNEL_LIMIT];
+} convert_state_t;
+
 void
 stp_channel_convert(const stp_vars_t *v, unsigned *zero_mask)
 {
   int zero_mask_valid = 1;
   stpi_channel_group_t *cg =
-    ((stpi_channel_group_t *) stp_get_component_data(v, "Channel"));
-  if (input_has_special_channels(cg))
+    ((stpi_channel_group_t *) stpi_get_component(v, STPI_COMPONENT_CHANNEL));
+  int special = input_has_special_channels(cg);
+  int copy = !special && output_has_gloss(cg) && !input_needs_splitting(cg);
+  int gcr = output_needs_gcr(cg);
+  int split = input_needs_splitting(cg);
+  const unsigned short *gcr_lookup = NULL;
+  convert_state_t state;
+  size_t start;
+  int i;
+
+  memset(&state, 0, sizeof(state));
+  if (special || copy)
+    zero_mask_valid = 0;
+  if (gcr)
     {
-      generate_special_channels(cg);
-      zero_mask_valid = 0;
+      size_t count;
+      stp_curve_resample(cg->gcr_curve, 65536);
+      gcr_lookup = stp_curve_get_ushort_data(cg->gcr_curve, &count);
     }
-  else if (output_has_gloss(cg) && !input_needs_splitting(cg))
+  cg->valid_8bit = 0;
+  /*
+   * Each step only looks at one pixel at a time, so rather than make a
+   * pass over the whole row for each step, run all of the steps over a
+   * block that fits in cache before moving on to the next block.
+   */
+  for (start = 0; start < cg->width; start += cg->block_width)
     {
-      copy_channels(cg);
-      zero_mask_valid = 0;
+      size_t end = start + cg->block_width;
+      if (end > cg->width)
+	end = cg->width;
+      if (special)
+	generate_special_channels(cg, start, end);
+      else if (copy)
+	copy_channels(cg, start, end);
+      if (gcr)
+	do_gcr(cg, start, end, gcr_lookup);
+      if (split)
+	split_channels(cg, start, end, state.split_nz);
+      else
+	scale_channels(cg, start, end, zero_mask && !zero_mask_valid,
+		       &state.scale_checked, &state.scale_nonzero);
+      (void) limit_ink(cg, start, end);
+      if (generate_gloss(cg, start, end))
+	state.gloss_added = 1;
+      if (cg->planar_data)
+	scan_planes(cg, start, end, state.plane_nz);
+    }
+  cg->output_stale = cg->dest_data != cg->output_data;
+
+  if (zero_mask)
+    {
+      *zero_mask = 0;
+      if (split)
+	{
+	  for (i = 0; i < cg->total_channels; i++)
+	    if (!state.split_nz[i])
+	      *zero_mask |= 1 << i;
+	}
+      else
+	*zero_mask = state.scale_checked & ~state.scale_nonzero;
+      if (state.gloss_added)
+	*zero_mask &= ~(1 << cg->gloss_physical_channel);
+    }
+  if (cg->planar_data)
+    {
+      cg->empty_planes = 0;
+      for (i = 0; i < cg->total_channels; i++)
+	if (!state.plane_nz[i])
+	  cg->empty_planes |= 1 << i;
     }
-  if (output_needs_gcr(cg))
-    do_gcr(cg, zero_mask);
-  if (input_needs_splitting(cg))
-    split_channels(cg, zero_mask);
-  else
-    scale_channels(cg, zero_mask, zero_mask_valid);
-  (void) limit_ink(cg);
-  (void) generate_gloss(cg, zero_mask);
 }
 
 unsigned short *
@@ -1178,6 +1951,9 @@ stp_channel_get_input(const stp_vars_t *v)
   stpi_channel_group_t *cg = get_channel_group(v);
   if (!cg)
     return NULL;
+  /* The next row overwrites the last one, as it would if not planar */
+  if (cg->input_data == cg->output_data)
+    cg->output_stale = 0;
   return (unsigned short *) cg->input_data;
 }
 
@@ -1187,9 +1963,66 @@ stp_channel_get_output(const stp_vars_t *v)
   stpi_channel_group_t *cg = get_channel_group(v);
   if (!cg)
     return NULL;
+  update_output(cg);
   return cg->output_data;
 }
 
+size_t
+stp_channel_get_output_size(const stp_vars_t *v)
+{
+  stpi_channel_group_t *cg = get_channel_group(v);
+  if (!cg)
+    return 0;
+  return cg->total_channels * cg->width;
+}
+
+void
+stpi_channel_set_planar_output(stp_vars_t *v, int planar)
+{
+  stpi_channel_group_t *cg = get_channel_group(v);
+  if (!cg)
+    {
+      cg = stp_zalloc(sizeof(stpi_channel_group_t));
+      cg->black_channel = -1;
+      cg->gloss_channel = -1;
+      stp_allocate_component_data(v, "Channel", NULL, stpi_channel_free, cg);
+    }
+  cg->planar = planar;
+  if (!planar)
+    {
+      update_output(cg);
+      STP_SAFE_FREE(cg->alloc_planar);
+      cg->planar_data = NULL;
+    }
+  else if (cg->initialized && !cg->planar_data && cg->total_channels > 0)
+    allocate_planes(cg);
+  if (cg->initialized)
+    set_output_layout(cg);
+}
+
+const unsigned short *
+stpi_channel_get_planar_output(const stp_vars_t *v, size_t *plane_stride,
+			       unsigned *empty_planes)
+{
+  stpi_channel_group_t *cg = get_channel_group(v);
+  if (!cg || !cg->planar_data)
+    return NULL;
+  if (plane_stride)
+    *plane_stride = cg->plane_stride;
+  if (empty_planes)
+    *empty_planes = cg->empty_planes;
+  return cg->planar_data;
+}
+
+size_t
+stpi_channel_get_planar_output_size(const stp_vars_t *v)
+{
+  stpi_channel_group_t *cg = get_channel_group(v);
+  if (!cg || !cg->planar_data)
+    return 0;
+  return cg->total_channels * cg->plane_stride;
+}
+
 unsigned char *
 stp_channel_get_output_8bit(const stp_vars_t *v)
 {
@@ -1198,6 +2031,7 @@ stp_channel_get_output_8bit(const stp_vars_t *v)
     return NULL;
   if (cg->valid_8bit)
     return cg->output_data_8bit;
+  update_output(cg);
   if (! cg->output_data_8bit)
     cg->output_data_8bit = stp_malloc(sizeof(unsigned char) *
 				      cg->total_channels * cg->width);
@@ -132,6 +132,32 @@ typedef struct
   size_t bits;
 } channel_depth_t;
 
+typedef struct
+{
+  const char *name;
+  const char *text;
+  unsigned nodes;
+} color_lut_size_t;
+
+typedef struct
+{
+  const char *name;
+  const char *text;
+  unsigned points;
+} curve_table_size_t;
+
+/*
+ * Direct-mapped cache of recent conversion results, for images with
+ * a limited number of distinct colors spread across each row.
+ */
+#define COLOR_MEMO_BITS 10
+
+typedef struct
+{
+  unsigned long long key;	/* Packed input color, or ~0 if unused */
+  unsigned short out[3];
+} color_memo_entry_t;
+
 typedef struct
 {
   unsigned steps;
@@ -154,6 +180,8 @@ typedef struct
   double screen_gamma;
   double contrast;
   double brightness;
+  stpi_parameter_handle_t saturation;
+  stpi_parameter_handle_t user_brightness;
   int linear_contrast_adjustment;
   int printed_colorfunc;
   int simple_gamma_correction;
@@ -163,6 +191,24 @@ typedef struct
   unsigned short *gray_tmp;	/* Color -> Gray */
   unsigned short *cmy_tmp;	/* CMY -> CMYK */
   unsigned char *in_data;
+  unsigned char *in_rows;	/* Block of rows from get_rows() */
+  size_t in_row_stride;
+  int image_height;
+  int in_rows_first;
+  int in_rows_count;
+  int image_lends_rows;		/* Image has a borrow_row() callback */
+  unsigned color_lut_nodes;	/* Points per axis of color_lut, or 0 */
+  unsigned short *color_lut;	/* Baked color -> color/KCMY results */
+  unsigned *color_lut_pos;	/* Input value -> color_lut cell */
+  int fixed_point_hsl;		/* Use the fixed point HSL adjustments */
+  int *fixed_hue_map;		/* hue_map, lum_map and sat_map in */
+  int *fixed_lum_map;		/* 16.16 fixed point */
+  int *fixed_sat_map;
+  color_memo_entry_t *color_memo; /* 1 << COLOR_MEMO_BITS entries */
+  unsigned long color_memo_lookups;
+  unsigned long color_memo_hits;
+  unsigned curve_table_points;	/* Intervals in 16-bit curves, or 0 */
+  unsigned long long curve_table_scale; /* 32.32 input -> curve position */
 } lut_t;
 
 extern unsigned stpi_color_convert_to_gray(const stp_vars_t *v,
@@ -177,6 +223,36 @@ extern unsigned stpi_color_convert_to_kcmy(const stp_vars_t *v,
 extern unsigned stpi_color_convert_raw(const stp_vars_t *v,
 				       const unsigned char *,
 				       unsigned short *);
+extern void stpi_color_prepare_fixed_hsl(lut_t *lut);
+
+/*
+ * Inner loops shared by several conversions, with SIMD versions chosen
+ * when the module is initialized (color-kernels.c).  Every version
+ * gives the same results.  Each kernel returns a mask of the channels
+ * (sample index modulo channels, which may be 1, 3 or 4) that have any
+ * nonzero output.
+ */
+typedef struct
+{
+  const char *name;
+  /* out[i] = (in[i] * scale) ^ mask */
+  unsigned (*scale_8)(const unsigned char *in, unsigned short *out,
+		      size_t count, unsigned scale, unsigned mask,
+		      int channels);
+  unsigned (*scale_16)(const unsigned short *in, unsigned short *out,
+		       size_t count, unsigned scale, unsigned mask,
+		       int channels);
+  /* out[i] = 65535 if the high bit of in[i] is match, otherwise 0 */
+  unsigned (*threshold_8)(const unsigned char *in, unsigned short *out,
+			  size_t count, unsigned match, int channels);
+  unsigned (*threshold_16)(const unsigned short *in, unsigned short *out,
+			   size_t count, unsigned match, int channels);
+  /* Move the common part of C, M and Y in KCMY pixels into K */
+  unsigned (*black)(unsigned short *kcmy, size_t width);
+} stpi_color_kernels_t;
+
+extern const stpi_color_kernels_t *stpi_color_kernels;
+extern void stpi_init_color_kernels(void);
 
 #ifdef __cplusplus
   }
@@ -218,9 +218,40 @@ interpolate_value(const double *vec, double val)
   return lval;
 }
 
+/*
+ * Look up a 16-bit value in a curve.  If CurveTableSize is set, 16-bit
+ * input uses curves resampled to lut->curve_table_points + 1 points
+ * rather than 65536 (8 or 2 KB rather than 128 KB per curve), and
+ * scale is the 32.32 fixed point step from input value to table
+ * position.  Values between points are interpolated linearly.
+ * Against the full tables, converted values differ by about 1/65535
+ * on average and at most about 30/65535 (with strong gamma and
+ * brightness curves); 1024 points is not measurably worse than 4096
+ * since the curves are smooth.  The interpolation costs a few cycles
+ * per lookup, so this only pays off when the full tables would not
+ * stay in cache, e.g. with several render threads or a small L2.
+ * With scale 0 the table has one entry per input value.
+ */
+static inline unsigned short
+curve_lookup(const unsigned short *table, unsigned long long scale,
+	     unsigned x)
+{
+  if (scale)
+    {
+      unsigned long long pos = x * scale;
+      unsigned i = pos >> 32;
+      int frac = (pos >> 17) & 0x7fff;
+      int lo = table[i];
+      int hi = table[i + (frac != 0)];
+      return lo + (((hi - lo) * frac) >> 15);
+    }
+  return table[x];
+}
+
 static inline void
 update_saturation_from_rgb(unsigned short *rgb,
 			   const unsigned short *brightness_lookup,
+			   unsigned long long brightness_scale,
 			   double adjust, double isat, int do_usermap)
 {
   double h, s, l;
@@ -228,7 +259,8 @@ update_saturation_from_rgb(unsigned short *rgb,
   if (do_usermap)
     {
       unsigned short ub = (unsigned short) (l * 65535);
-      unsigned short val = brightness_lookup[ub];
+      unsigned short val = curve_lookup(brightness_lookup, brightness_scale,
+					ub);
       l = ((double) val) / 65535;
       if (val < ub)
 	s = s * (65535 - ub) / (65535 - val);
@@ -251,7 +283,11 @@ adjust_hue(const double *hue_map, double hue, size_t points)
   return hue;
 }
 
-static inline void
+/*
+ * adjust_hsl and adjust_hsl_fixed are called from every color
+ * conversion loop; inlining both there exceeds the unit growth limit.
+ */
+static void NOINLINE
 adjust_hsl(unsigned short *rgbout, lut_t *lut, double ssat, double isat,
 	   int split_saturation, int adjust_hue_only, int bright_colors)
 {
@@ -326,12 +362,300 @@ adjust_hsl(unsigned short *rgbout, lut_t *lut, double ssat, double isat,
   rgbout[2] ^= 65535;
 }
 
+/*
+ * Fixed point versions of the HSL adjustments, used for 8-bit input
+ * when FixedPointHSL is set.  Hue is in 16.16 fixed point (0 to 6),
+ * saturation is 0 to 65536, and lightness is kept as max + min of the
+ * 16-bit components (0 to 131070) so that it loses nothing.  Each
+ * component agrees with the floating point versions to within 7/65535
+ * (test/fixed-hsl.c checks this).
+ */
+
+#define HSL_ONE 65536
+
+static inline void
+calc_rgb_to_hsl_fixed(const unsigned short *rgb, int *hue, unsigned *sat,
+		      unsigned *lightness2)
+{
+  unsigned red = rgb[0];
+  unsigned green = rgb[1];
+  unsigned blue = rgb[2];
+  unsigned max, min, delta;
+  int maxval;
+  int h = 0;
+  unsigned s = 0;
+
+  /* Pick the same component as calc_rgb_to_hsl when there are ties */
+  if (red > green)
+    {
+      if (red > blue)
+	{
+	  max = red;
+	  maxval = 0;
+	}
+      else
+	{
+	  max = blue;
+	  maxval = 2;
+	}
+      min = FMIN(green, blue);
+    }
+  else
+    {
+      if (green > blue)
+	{
+	  max = green;
+	  maxval = 1;
+	}
+      else
+	{
+	  max = blue;
+	  maxval = 2;
+	}
+      min = FMIN(red, blue);
+    }
+  delta = max - min;
+
+  if (delta > 0)
+    {
+      if (max + min <= 65535)
+	s = (delta << 16) / (max + min);
+      else
+	s = (delta << 16) / (131070 - max - min);
+
+      /* |a - b| <= delta, so the shifted difference fits in 32 bits */
+#define HSL_HUE_PART(a, b)						\
+      ((a) >= (b) ? (int) ((((a) - (b)) << 16) / delta) :		\
+       -(int) ((((b) - (a)) << 16) / delta))
+      if (maxval == 0)
+	h = HSL_HUE_PART(green, blue);
+      else if (maxval == 1)
+	h = 2 * HSL_ONE + HSL_HUE_PART(blue, red);
+      else
+	h = 4 * HSL_ONE + HSL_HUE_PART(red, green);
+#undef HSL_HUE_PART
+
+      if (h < 0)
+	h += 6 * HSL_ONE;
+      else if (h > 6 * HSL_ONE)
+	h -= 6 * HSL_ONE;
+    }
+
+  *hue = h;
+  *sat = s;
+  *lightness2 = max + min;
+}
+
+static inline unsigned
+hsl_value_fixed(unsigned n1, unsigned n2, int hue)
+{
+  if (hue < 0)
+    hue += 6 * HSL_ONE;
+  else if (hue > 6 * HSL_ONE)
+    hue -= 6 * HSL_ONE;
+  /* n2 >= n1 always */
+  if (hue < HSL_ONE)
+    return n1 + (((n2 - n1) * (unsigned) hue) >> 16);
+  else if (hue < 3 * HSL_ONE)
+    return n2;
+  else if (hue < 4 * HSL_ONE)
+    return n1 + (((n2 - n1) * (unsigned) (4 * HSL_ONE - hue)) >> 16);
+  else
+    return n1;
+}
+
+static inline void
+calc_hsl_to_rgb_fixed(unsigned short *rgb, int h, unsigned s, unsigned l2)
+{
+  if (l2 > 131070)
+    l2 = 131070;
+  if (s == 0)
+    {
+      rgb[0] = l2 / 2;
+      rgb[1] = l2 / 2;
+      rgb[2] = l2 / 2;
+    }
+  else
+    {
+      unsigned m1, m2;
+      if (l2 < 65535)
+	m2 = ((unsigned long long) l2 * (HSL_ONE + s)) >> 17;
+      else
+	m2 = (((unsigned long long) l2 << 16) +
+	      (unsigned long long) s * (131070 - l2)) >> 17;
+      m1 = l2 > m2 ? l2 - m2 : 0;
+      if (m1 > m2)
+	m1 = m2;
+      rgb[0] = hsl_value_fixed(m1, m2, h + 2 * HSL_ONE);
+      rgb[1] = hsl_value_fixed(m1, m2, h);
+      rgb[2] = hsl_value_fixed(m1, m2, h - 2 * HSL_ONE);
+    }
+}
+
+static inline unsigned
+update_saturation_fixed(unsigned sat, unsigned adjust, unsigned isat,
+			int bright_colors)
+{
+  unsigned long long s1 = ((unsigned long long) sat * adjust) >> 16;
+  if (bright_colors || adjust < HSL_ONE)
+    sat = FMIN(s1, HSL_ONE);
+  else if (adjust > HSL_ONE)
+    {
+      unsigned s2 = HSL_ONE - (((HSL_ONE - sat) * (unsigned long long) isat)
+			       >> 16);
+      sat = FMIN(s1, s2);
+    }
+  if (sat > HSL_ONE)
+    sat = HSL_ONE;
+  return sat;
+}
+
+static inline int
+interpolate_value_fixed(const int *vec, size_t count, int hue)
+{
+  unsigned long long where = (unsigned long long) hue * count / 6;
+  unsigned ibase = where >> 16;
+  unsigned frac = where & 0xffff;
+  int lval = vec[ibase];
+  if (frac > 0)
+    lval += ((long long) (vec[ibase + 1] - lval) * frac) >> 16;
+  return lval;
+}
+
+static inline void
+update_saturation_from_rgb_fixed(unsigned short *rgb,
+				 const unsigned short *brightness_lookup,
+				 unsigned adjust, unsigned isat,
+				 int do_usermap)
+{
+  int h;
+  unsigned s, l2;
+  calc_rgb_to_hsl_fixed(rgb, &h, &s, &l2);
+  if (do_usermap)
+    {
+      unsigned ub = l2 / 2;
+      unsigned val = brightness_lookup[ub];
+      l2 = val * 2;
+      if (val < ub)
+	s = s * (unsigned long long) (65535 - ub) / (65535 - val);
+    }
+  s = update_saturation_fixed(s, adjust, isat, 0);
+  calc_hsl_to_rgb_fixed(rgb, h, s, l2);
+}
+
+static void NOINLINE
+adjust_hsl_fixed(unsigned short *rgbout, const lut_t *lut, unsigned ssat,
+		 unsigned isat, int adjust_hue_only, int bright_colors)
+{
+  size_t hue_count = CURVE_CACHE_FAST_COUNT(&(lut->hue_map));
+  size_t lum_count = CURVE_CACHE_FAST_COUNT(&(lut->lum_map));
+  size_t sat_count = CURVE_CACHE_FAST_COUNT(&(lut->sat_map));
+  int h, oh;
+  unsigned s, l2;
+  rgbout[0] ^= 65535;
+  rgbout[1] ^= 65535;
+  rgbout[2] ^= 65535;
+  calc_rgb_to_hsl_fixed(rgbout, &h, &s, &l2);
+  s = update_saturation_fixed(s, ssat, isat, 0);
+  if (!adjust_hue_only && lut->fixed_sat_map)
+    {
+      int tmp = interpolate_value_fixed(lut->fixed_sat_map, sat_count, h);
+      /* Same tolerance as adjust_hsl */
+      if (tmp < 65530 || tmp > 65542)
+	s = update_saturation_fixed(s, tmp, tmp > HSL_ONE ?
+				    (unsigned) (((unsigned long long) HSL_ONE
+						 << 16) / tmp) : HSL_ONE,
+				    bright_colors);
+    }
+  oh = h;
+  if (lut->fixed_hue_map)
+    {
+      h += interpolate_value_fixed(lut->fixed_hue_map, hue_count, h);
+      if (h < 0)
+	h += 6 * HSL_ONE;
+      else if (h >= 6 * HSL_ONE)
+	h -= 6 * HSL_ONE;
+    }
+  calc_hsl_to_rgb_fixed(rgbout, h, s, l2);
+
+  if (!adjust_hue_only && s > 0)
+    {
+      /*
+       * As in adjust_hsl, adjust the luminosity of the color component
+       * only and add the gray back at the end.
+       */
+      unsigned gray = FMIN(rgbout[0], FMIN(rgbout[1], rgbout[2]));
+      int i;
+      if (gray > 0)
+	for (i = 0; i < 3; i++)
+	  rgbout[i] = (rgbout[i] - gray) * 65535u / (65535 - gray);
+
+      if (lut->fixed_lum_map)
+	{
+	  calc_rgb_to_hsl_fixed(rgbout, &h, &s, &l2);
+	  if (l2 > 1 && l2 < 131069)
+	    {
+	      int oel = interpolate_value_fixed(lut->fixed_lum_map,
+						lum_count, oh);
+	      if (oel <= HSL_ONE)
+		l2 = ((unsigned long long) l2 * (oel > 0 ? oel : 0)) >> 16;
+	      else
+		{
+		  /* Rare enough not to be worth a fixed point pow() */
+		  double l = l2 / 131070.0;
+		  double foel = oel / 65536.0;
+		  double g1 = pow(l, 1.0 / foel);
+		  double g2 = 1.0 - pow(1.0 - l, foel);
+		  l2 = FMIN(g1, g2) * 131070;
+		}
+	      calc_hsl_to_rgb_fixed(rgbout, h, s, l2);
+	    }
+	}
+      if (gray > 0)
+	for (i = 0; i < 3; i++)
+	  rgbout[i] = gray + rgbout[i] * (65535 - gray) / 65535;
+    }
+
+  rgbout[0] ^= 65535;
+  rgbout[1] ^= 65535;
+  rgbout[2] ^= 65535;
+}
+
+static int *
+fixed_hsl_map(stp_cached_curve_t *cache)
+{
+  const double *data = stp_curve_cache_get_double_data(cache);
+  size_t count = CURVE_CACHE_FAST_COUNT(cache);
+  int *map;
+  size_t i;
+  if (!data)
+    return NULL;
+  /* interpolate_value may read one point past the end */
+  map = stp_malloc(sizeof(int) * (count + 1));
+  for (i = 0; i < count; i++)
+    map[i] = floor(data[i] * HSL_ONE + .5);
+  if (stp_curve_get_wrap(stp_curve_cache_get_curve(cache)) ==
+      STP_CURVE_WRAP_AROUND)
+    map[count] = floor(data[count] * HSL_ONE + .5);
+  else
+    map[count] = map[count - 1];
+  return map;
+}
+
+void
+stpi_color_prepare_fixed_hsl(lut_t *lut)
+{
+  lut->fixed_hue_map = fixed_hsl_map(&(lut->hue_map));
+  lut->fixed_lum_map = fixed_hsl_map(&(lut->lum_map));
+  lut->fixed_sat_map = fixed_hsl_map(&(lut->sat_map));
+}
+
 #define GENERIC_COLOR_FUNC(fromname, toname)				\
 CFUNC									\
 fromname##_to_##toname(const stp_vars_t *vars, const unsigned char *in,	\
 		       unsigned short *out)				\
 {									\
-  lut_t *lut = (lut_t *)(stp_get_component_data(vars, "Color"));	\
+  lut_t *lut = (lut_t *)(stpi_get_component(vars, STPI_COMPONENT_COLOR)); \
   if (!lut->printed_colorfunc)						\
     {									\
       lut->printed_colorfunc = 1;					\
@@ -350,15 +674,49 @@ fromname##_to_##toname(const stp_vars_t *vars, const unsigned char *in,	\
 
 #define BD(bits) (65535u / (unsigned) MAXB(bits))
 
-#define COLOR_TO_COLOR_FUNC(T, bits)					\
+/*
+ * The color memo remembers the result of the per-pixel chain for
+ * recently seen input colors.  It is only consulted when the chain
+ * includes the saturation or HSL adjustments; otherwise the
+ * conversion is just a few table lookups.  A pixel identical to the
+ * one before it is still handled without consulting the memo.
+ */
+
+#define COLOR_MEMO_KEY(a, b, c)						\
+  ((unsigned long long) (a) | ((unsigned long long) (b) << 16) |	\
+   ((unsigned long long) (c) << 32))
+
+static void
+color_memo_init(lut_t *lut)
+{
+  if (!lut->color_memo)
+    {
+      size_t bytes = sizeof(color_memo_entry_t) << COLOR_MEMO_BITS;
+      lut->color_memo = stp_malloc(bytes);
+      /* Sets every key to ~0, which no input color can match */
+      memset(lut->color_memo, 0xff, bytes);
+    }
+}
+
+static inline color_memo_entry_t *
+color_memo_find(color_memo_entry_t *memo, unsigned long long key)
+{
+  return memo + ((key * 0x9e3779b97f4a7c15ull) >> (64 - COLOR_MEMO_BITS));
+}
+
+#define COLOR_TO_COLOR_ROW_FUNC(T, bits)				\
 CFUNC									\
-color_##bits##_to_color(const stp_vars_t *vars, const unsigned char *in, \
-			unsigned short *out)				\
+color_##bits##_to_color_row(const stp_vars_t *vars,			\
+			    const unsigned char *in,			\
+			    unsigned short *out, int width)		\
 {									\
   int i;								\
   double isat = 1.0;							\
-  double ssat = stp_get_float_parameter(vars, "Saturation");		\
-  double sbright = stp_get_float_parameter(vars, "Brightness");		\
+  lut_t *lut = (lut_t *)(stpi_get_component(vars, STPI_COMPONENT_COLOR)); \
+  double ssat =							\
+    stpi_get_float_parameter_by_handle(vars, &(lut->saturation));	\
+  double sbright =							\
+    stpi_get_float_parameter_by_handle(vars, &(lut->user_brightness)); \
   int i0 = -1;								\
   int i1 = -1;								\
   int i2 = -1;								\
@@ -374,12 +732,21 @@ color_##bits##_to_color(const stp_vars_t *vars, const unsigned char *in, \
   const unsigned short *brightness;					\
   const unsigned short *contrast;					\
   const T *s_in = (const T *) in;					\
-  lut_t *lut = (lut_t *)(stp_get_component_data(vars, "Color"));	\
   int compute_saturation = ssat <= .99999 || ssat >= 1.00001;		\
   int split_saturation = ssat > 1.4;					\
   int bright_color_adjustment = 0;					\
   int hue_only_color_adjustment = 0;					\
   int do_user_adjustment = 0;						\
+  int fixed_hsl = bits == 8 && lut->fixed_point_hsl;			\
+  int use_memo;								\
+  color_memo_entry_t *memo = NULL;					\
+  unsigned long long memo_key = 0;					\
+  unsigned long memo_lookups = 0;					\
+  unsigned long memo_hits = 0;						\
+  unsigned fssat;							\
+  unsigned fisat;							\
+  unsigned long long curve_scale = bits == 16 ? lut->curve_table_scale : 0; \
+  size_t curve_points = curve_scale ? lut->curve_table_points + 1 : 1 << bits; \
   if (lut->color_correction->correction == COLOR_CORRECTION_BRIGHT)	\
     bright_color_adjustment = 1;					\
   if (lut->color_correction->correction == COLOR_CORRECTION_HUE)	\
@@ -390,11 +757,12 @@ color_##bits##_to_color(const stp_vars_t *vars, const unsigned char *in, \
 									\
   for (i = CHANNEL_C; i <= CHANNEL_Y; i++)				\
     stp_curve_resample(stp_curve_cache_get_curve(&(lut->channel_curves[i])), \
-		       1 << bits);					\
+		       curve_points);					\
   stp_curve_resample							\
-    (stp_curve_cache_get_curve(&(lut->brightness_correction)), 65536);	\
+    (stp_curve_cache_get_curve(&(lut->brightness_correction)),		\
+     curve_scale ? curve_points : 65536);				\
   stp_curve_resample							\
-    (stp_curve_cache_get_curve(&(lut->contrast_correction)), 1 << bits); \
+    (stp_curve_cache_get_curve(&(lut->contrast_correction)), curve_points); \
   red =									\
     stp_curve_cache_get_ushort_data(&(lut->channel_curves[CHANNEL_C]));	\
   green =								\
@@ -416,6 +784,281 @@ color_##bits##_to_color(const stp_vars_t *vars, const unsigned char *in, \
     ssat = sqrt(ssat);							\
   if (ssat > 1)								\
     isat = 1.0 / ssat;							\
+  fssat = ssat * 65536 + .5;						\
+  fisat = isat * 65536 + .5;						\
+  use_memo = compute_saturation || split_saturation ||			\
+    lum_map || hue_map || sat_map;					\
+  if (use_memo)								\
+    color_memo_init(lut);						\
+  for (i = 0; i < width; i++)					\
+    {									\
+      if (i0 == s_in[0] && i1 == s_in[1] && i2 == s_in[2])		\
+	{								\
+	  out[0] = o0;							\
+	  out[1] = o1;							\
+	  out[2] = o2;							\
+	}								\
+      else								\
+	{								\
+	  i0 = s_in[0];							\
+	  i1 = s_in[1];							\
+	  i2 = s_in[2];							\
+	  if (use_memo)							\
+	    {								\
+	      memo_key = COLOR_MEMO_KEY(i0, i1, i2);			\
+	      memo = color_memo_find(lut->color_memo, memo_key);	\
+	      memo_lookups++;						\
+	    }								\
+	  if (memo && memo->key == memo_key)				\
+	    {								\
+	      out[0] = memo->out[0];					\
+	      out[1] = memo->out[1];					\
+	      out[2] = memo->out[2];					\
+	      memo_hits++;						\
+	    }								\
+	  else								\
+	    {								\
+	      out[0] = curve_lookup(contrast, curve_scale, i0);		\
+	      out[1] = curve_lookup(contrast, curve_scale, i1);		\
+	      out[2] = curve_lookup(contrast, curve_scale, i2);		\
+	      if ((compute_saturation) && fixed_hsl)			\
+		update_saturation_from_rgb_fixed(out, brightness, fssat, fisat, \
+						 do_user_adjustment);	\
+	      else if ((compute_saturation))				\
+		update_saturation_from_rgb(out, brightness, curve_scale, \
+					   ssat, isat, do_user_adjustment); \
+	      if ((split_saturation || lum_map || hue_map || sat_map) && \
+		  (out[0] != out[1] || out[0] != out[2]))		\
+		{							\
+		  if (fixed_hsl)					\
+		    adjust_hsl_fixed(out, lut, fssat, fisat,		\
+				     hue_only_color_adjustment,		\
+				     bright_color_adjustment);		\
+		  else							\
+		    adjust_hsl(out, lut, ssat, isat, split_saturation,	\
+			       hue_only_color_adjustment,		\
+			       bright_color_adjustment);		\
+		}							\
+	      out[0] = curve_lookup(red, curve_scale, out[0] / BD(bits)); \
+	      out[1] = curve_lookup(green, curve_scale, out[1] / BD(bits)); \
+	      out[2] = curve_lookup(blue, curve_scale, out[2] / BD(bits)); \
+	      if (memo)							\
+		{							\
+		  memo->key = memo_key;					\
+		  memo->out[0] = out[0];				\
+		  memo->out[1] = out[1];				\
+		  memo->out[2] = out[2];				\
+		}							\
+	    }								\
+	  o0 = out[0];							\
+	  o1 = out[1];							\
+	  o2 = out[2];							\
+	  nz0 |= o0;							\
+	  nz1 |= o1;							\
+	  nz2 |= o2;							\
+	}								\
+      s_in += 3;							\
+      out += 3;								\
+    }									\
+  lut->color_memo_lookups += memo_lookups;				\
+  lut->color_memo_hits += memo_hits;					\
+  return (nz0 ? 0 : 1) +  (nz1 ? 0 : 2) +  (nz2 ? 0 : 4);		\
+}
+
+COLOR_TO_COLOR_ROW_FUNC(unsigned char, 8) // color_8_to_color_row
+COLOR_TO_COLOR_ROW_FUNC(unsigned short, 16) // color_16_to_color_row
+
+/*
+ * Optional 3D lookup table for the color to color and color to KCMY
+ * paths.  The table holds the result of the full per-pixel chain
+ * (contrast, brightness, saturation, HSL maps and channel curves) at
+ * nodes x nodes x nodes evenly spaced input values; pixels are
+ * tetrahedrally interpolated between the nodes.
+ *
+ * color_lut_pos[] maps each input value to its cell, packed as
+ * (cell << 17) | weight, where the weight is the position within the
+ * cell scaled to 0..65536.
+ */
+
+typedef unsigned (*color_row_func_t)(const stp_vars_t *,
+				     const unsigned char *,
+				     unsigned short *, int);
+
+static int
+color_lut_prepare(const stp_vars_t *vars, lut_t *lut, int bits,
+		  color_row_func_t row_func)
+{
+  unsigned nodes = lut->color_lut_nodes;
+  unsigned maxval = MAXB(bits);
+  unsigned points;
+  unsigned r, g, b, i;
+  unsigned char *in;
+
+  if (lut->color_lut)
+    return 1;
+  if (nodes < 2)
+    return 0;
+  points = nodes * nodes * nodes;
+  /*
+   * Baking the table costs about as much as converting that many
+   * pixels, so it isn't worth it for small images.
+   */
+  if ((double) lut->image_width * lut->image_height < points)
+    {
+      stp_dprintf(STP_DBG_COLORFUNC, vars,
+		  "Colorfunc: image too small for %u point color table\n",
+		  nodes);
+      lut->color_lut_nodes = 0;
+      return 0;
+    }
+
+  lut->color_lut_pos = stp_malloc(sizeof(unsigned) << bits);
+  for (i = 0; i < nodes - 1; i++)
+    {
+      unsigned lo = (i * maxval + (nodes - 1) / 2) / (nodes - 1);
+      unsigned hi = ((i + 1) * maxval + (nodes - 1) / 2) / (nodes - 1);
+      unsigned x;
+      for (x = lo; x < hi; x++)
+	lut->color_lut_pos[x] = (i << 17) | (((x - lo) << 16) / (hi - lo));
+    }
+  lut->color_lut_pos[maxval] = ((nodes - 2) << 17) | 65536;
+
+  in = stp_malloc(points * 3 * (bits / 8));
+  i = 0;
+  for (r = 0; r < nodes; r++)
+    for (g = 0; g < nodes; g++)
+      for (b = 0; b < nodes; b++, i += 3)
+	{
+	  unsigned rgb[3];
+	  rgb[0] = (r * maxval + (nodes - 1) / 2) / (nodes - 1);
+	  rgb[1] = (g * maxval + (nodes - 1) / 2) / (nodes - 1);
+	  rgb[2] = (b * maxval + (nodes - 1) / 2) / (nodes - 1);
+	  if (bits == 8)
+	    {
+	      in[i] = rgb[0];
+	      in[i + 1] = rgb[1];
+	      in[i + 2] = rgb[2];
+	    }
+	  else
+	    {
+	      unsigned short *s_in = (unsigned short *) in;
+	      s_in[i] = rgb[0];
+	      s_in[i + 1] = rgb[1];
+	      s_in[i + 2] = rgb[2];
+	    }
+	}
+  lut->color_lut = stp_malloc(points * 3 * sizeof(unsigned short));
+  (void) (*row_func)(vars, in, lut->color_lut, points);
+  stp_free(in);
+  stp_dprintf(STP_DBG_COLORFUNC, vars,
+	      "Colorfunc: using %u point color table\n", nodes);
+  return 1;
+}
+
+static inline void
+color_lut_interpolate(const lut_t *lut, unsigned r, unsigned g, unsigned b,
+		      unsigned short *out)
+{
+  unsigned nodes = lut->color_lut_nodes;
+  unsigned pr = lut->color_lut_pos[r];
+  unsigned pg = lut->color_lut_pos[g];
+  unsigned pb = lut->color_lut_pos[b];
+  unsigned fr = pr & 0x1ffff;
+  unsigned fg = pg & 0x1ffff;
+  unsigned fb = pb & 0x1ffff;
+  unsigned sr = 3 * nodes * nodes;
+  unsigned sg = 3 * nodes;
+  unsigned sb = 3;
+  const unsigned short *p0 =
+    lut->color_lut + sr * (pr >> 17) + sg * (pg >> 17) + sb * (pb >> 17);
+  const unsigned short *p1;
+  const unsigned short *p2;
+  const unsigned short *p3 = p0 + sr + sg + sb;
+  unsigned w0, w1, w2, w3;
+  int i;
+
+  if (fr >= fg)
+    {
+      if (fg >= fb)
+	{
+	  p1 = p0 + sr;
+	  p2 = p1 + sg;
+	  w0 = 65536 - fr;
+	  w1 = fr - fg;
+	  w2 = fg - fb;
+	  w3 = fb;
+	}
+      else if (fr >= fb)
+	{
+	  p1 = p0 + sr;
+	  p2 = p1 + sb;
+	  w0 = 65536 - fr;
+	  w1 = fr - fb;
+	  w2 = fb - fg;
+	  w3 = fg;
+	}
+      else
+	{
+	  p1 = p0 + sb;
+	  p2 = p1 + sr;
+	  w0 = 65536 - fb;
+	  w1 = fb - fr;
+	  w2 = fr - fg;
+	  w3 = fg;
+	}
+    }
+  else
+    {
+      if (fr >= fb)
+	{
+	  p1 = p0 + sg;
+	  p2 = p1 + sr;
+	  w0 = 65536 - fg;
+	  w1 = fg - fr;
+	  w2 = fr - fb;
+	  w3 = fb;
+	}
+      else if (fg >= fb)
+	{
+	  p1 = p0 + sg;
+	  p2 = p1 + sb;
+	  w0 = 65536 - fg;
+	  w1 = fg - fb;
+	  w2 = fb - fr;
+	  w3 = fr;
+	}
+      else
+	{
+	  p1 = p0 + sb;
+	  p2 = p1 + sg;
+	  w0 = 65536 - fb;
+	  w1 = fb - fg;
+	  w2 = fg - fr;
+	  w3 = fr;
+	}
+    }
+  /* The weights sum to 65536, so this can't overflow 32 bits */
+  for (i = 0; i < 3; i++)
+    out[i] = (p0[i] * w0 + p1[i] * w1 + p2[i] * w2 + p3[i] * w3 +
+	      32768) >> 16;
+}
+
+#define COLOR_LUT_FUNC(T, bits)						\
+static unsigned NOINLINE						\
+color_##bits##_lut_to_color(const lut_t *lut, const unsigned char *in,	\
+			    unsigned short *out)			\
+{									\
+  int i;								\
+  int i0 = -1;								\
+  int i1 = -1;								\
+  int i2 = -1;								\
+  unsigned short o0 = 0;						\
+  unsigned short o1 = 0;						\
+  unsigned short o2 = 0;						\
+  unsigned short nz0 = 0;						\
+  unsigned short nz1 = 0;						\
+  unsigned short nz2 = 0;						\
+  const T *s_in = (const T *) in;					\
   for (i = 0; i < lut->image_width; i++)				\
     {									\
       if (i0 == s_in[0] && i1 == s_in[1] && i2 == s_in[2])		\
@@ -429,19 +1072,7 @@ color_##bits##_to_color(const stp_vars_t *vars, const unsigned char *in, \
 	  i0 = s_in[0];							\
 	  i1 = s_in[1];							\
 	  i2 = s_in[2];							\
-	  out[0] = contrast[i0];					\
-	  out[1] = contrast[i1];					\
-	  out[2] = contrast[i2];				 	\
-	  if ((compute_saturation))					\
-	    update_saturation_from_rgb(out, brightness, ssat, isat,	\
-				       do_user_adjustment);		\
-	  if ((split_saturation || lum_map || hue_map || sat_map) &&	\
-	      (out[0] != out[1] || out[0] != out[2]))			\
-	    adjust_hsl(out, lut, ssat, isat, split_saturation,		\
-		       hue_only_color_adjustment, bright_color_adjustment); \
-	  out[0] = red[out[0] / BD(bits)];				\
-	  out[1] = green[out[1] / BD(bits)];				\
-	  out[2] = blue[out[2] / BD(bits)];				\
+	  color_lut_interpolate(lut, i0, i1, i2, out);			\
 	  o0 = out[0];							\
 	  o1 = out[1];							\
 	  o2 = out[2];							\
@@ -453,12 +1084,54 @@ color_##bits##_to_color(const stp_vars_t *vars, const unsigned char *in, \
       out += 3;								\
     }									\
   return (nz0 ? 0 : 1) +  (nz1 ? 0 : 2) +  (nz2 ? 0 : 4);		\
+}									\
+									\
+static unsigned NOINLINE						\
+color_##bits##_lut_to_kcmy(const lut_t *lut, const unsigned char *in,	\
+			   unsigned short *out)				\
+{									\
+  int i;								\
+  union {								\
+    unsigned short nz[4];						\
+    unsigned long long nzl;						\
+  } nzx;								\
+  unsigned retval = 0;							\
+  const T *s_in = (const T *) in;					\
+  nzx.nzl = 0ull;							\
+  for (i = 0; i < lut->image_width; i++, out += 4, s_in += 3)		\
+    {									\
+      color_lut_interpolate(lut, s_in[0], s_in[1], s_in[2], out + 1);	\
+      out[0] = FMIN(out[1], FMIN(out[2], out[3]));			\
+      out[1] -= out[0];							\
+      out[2] -= out[0];							\
+      out[3] -= out[0];							\
+      nzx.nzl |= *(unsigned long long *) out;				\
+    }									\
+  for (i = 0; i < 4; i++)						\
+    if (nzx.nz[i] == 0)							\
+      retval |= (1 << i);						\
+  return retval;							\
+}
+
+COLOR_LUT_FUNC(unsigned char, 8) // color_8_lut_to_color, color_8_lut_to_kcmy
+COLOR_LUT_FUNC(unsigned short, 16) // color_16_lut_to_color, color_16_lut_to_kcmy
+
+#define COLOR_TO_COLOR_FUNC(T, bits)					\
+CFUNC									\
+color_##bits##_to_color(const stp_vars_t *vars, const unsigned char *in, \
+			unsigned short *out)				\
+{									\
+  lut_t *lut = (lut_t *)(stpi_get_component(vars, STPI_COMPONENT_COLOR)); \
+  if (color_lut_prepare(vars, lut, bits, color_##bits##_to_color_row))	\
+    return color_##bits##_lut_to_color(lut, in, out);			\
+  return color_##bits##_to_color_row(vars, in, out, lut->image_width);	\
 }
 
 COLOR_TO_COLOR_FUNC(unsigned char, 8) // color_8_to_color
 COLOR_TO_COLOR_FUNC(unsigned short, 16) // color_16_to_color
 GENERIC_COLOR_FUNC(color, color)
 
+
 #define COLOR_TO_KCMY_FUNC(T, bits)					\
 CFUNC									\
 color_##bits##_to_kcmy(const stp_vars_t *vars, const unsigned char *in,	\
@@ -466,8 +1139,11 @@ color_##bits##_to_kcmy(const stp_vars_t *vars, const unsigned char *in,	\
 {									\
   int i;								\
   double isat = 1.0;							\
-  double ssat = stp_get_float_parameter(vars, "Saturation");		\
-  double sbright = stp_get_float_parameter(vars, "Brightness");		\
+  lut_t *lut = (lut_t *)(stpi_get_component(vars, STPI_COMPONENT_COLOR)); \
+  double ssat =							\
+    stpi_get_float_parameter_by_handle(vars, &(lut->saturation));	\
+  double sbright =							\
+    stpi_get_float_parameter_by_handle(vars, &(lut->user_brightness)); \
   union {								\
     unsigned short nz[4];						\
     unsigned long long nzl;						\
@@ -479,12 +1155,21 @@ color_##bits##_to_kcmy(const stp_vars_t *vars, const unsigned char *in,	\
   const unsigned short *brightness;					\
   const unsigned short *contrast;					\
   const T *s_in = (const T *) in;					\
-  lut_t *lut = (lut_t *)(stp_get_component_data(vars, "Color"));	\
   int compute_saturation = ssat <= .99999 || ssat >= 1.00001;		\
   int split_saturation = ssat > 1.4;					\
   int bright_color_adjustment = 0;					\
   int hue_only_color_adjustment = 0;					\
   int do_user_adjustment = 0;						\
+  int fixed_hsl = bits == 8 && lut->fixed_point_hsl;			\
+  int use_memo;								\
+  color_memo_entry_t *memo = NULL;					\
+  unsigned long long memo_key = 0;					\
+  unsigned long memo_lookups = 0;					\
+  unsigned long memo_hits = 0;						\
+  unsigned fssat;							\
+  unsigned fisat;							\
+  unsigned long long curve_scale = bits == 16 ? lut->curve_table_scale : 0; \
+  size_t curve_points = curve_scale ? lut->curve_table_points + 1 : 1 << bits; \
   if (lut->color_correction->correction == COLOR_CORRECTION_BRIGHT)	\
     bright_color_adjustment = 1;					\
   if (lut->color_correction->correction == COLOR_CORRECTION_HUE)	\
@@ -492,15 +1177,18 @@ color_##bits##_to_kcmy(const stp_vars_t *vars, const unsigned char *in,	\
   if (sbright != 1)							\
     do_user_adjustment = 1;						\
   compute_saturation |= do_user_adjustment;				\
+  if (color_lut_prepare(vars, lut, bits, color_##bits##_to_color_row))	\
+    return color_##bits##_lut_to_kcmy(lut, in, out);			\
   nzx.nzl = 0ull;							\
 									\
   for (i = CHANNEL_C; i <= CHANNEL_Y; i++)				\
     stp_curve_resample(stp_curve_cache_get_curve(&(lut->channel_curves[i])), \
-		       1 << bits);					\
+		       curve_points);					\
   stp_curve_resample							\
-    (stp_curve_cache_get_curve(&(lut->brightness_correction)), 65536);	\
+    (stp_curve_cache_get_curve(&(lut->brightness_correction)),		\
+     curve_scale ? curve_points : 65536);				\
   stp_curve_resample							\
-    (stp_curve_cache_get_curve(&(lut->contrast_correction)), 1 << bits); \
+    (stp_curve_cache_get_curve(&(lut->contrast_correction)), curve_points); \
   red =									\
     stp_curve_cache_get_ushort_data(&(lut->channel_curves[CHANNEL_C]));	\
   green =								\
@@ -522,27 +1210,68 @@ color_##bits##_to_kcmy(const stp_vars_t *vars, const unsigned char *in,	\
     ssat = sqrt(ssat);							\
   if (ssat > 1)								\
     isat = 1.0 / ssat;							\
+  fssat = ssat * 65536 + .5;						\
+  fisat = isat * 65536 + .5;						\
+  use_memo = compute_saturation || split_saturation ||			\
+    lum_map || hue_map || sat_map;					\
+  if (use_memo)								\
+    color_memo_init(lut);						\
   for (i = 0; i < lut->image_width; i++, out += 4, s_in += 3)		\
     {									\
-      out[1] = contrast[s_in[0]];				\
-      out[2] = contrast[s_in[1]];				\
-      out[3] = contrast[s_in[2]];				\
-      if ((compute_saturation))						\
-	update_saturation_from_rgb(out + 1, brightness, ssat, isat,	\
-				   do_user_adjustment);			\
-      if ((split_saturation || lum_map || hue_map || sat_map) &&	\
-	  (out[1] != out[2] || out[1] != out[3]))			\
-	adjust_hsl(out + 1, lut, ssat, isat, split_saturation,		\
-		   hue_only_color_adjustment, bright_color_adjustment);	\
-      out[1] = red[out[1] / BD(bits)];					\
-      out[2] = green[out[2] / BD(bits)];				\
-      out[3] = blue[out[3] / BD(bits)];					\
+      if (use_memo)							\
+	{								\
+	  memo_key = COLOR_MEMO_KEY(s_in[0], s_in[1], s_in[2]);		\
+	  memo = color_memo_find(lut->color_memo, memo_key);		\
+	  memo_lookups++;						\
+	}								\
+      if (memo && memo->key == memo_key)				\
+	{								\
+	  out[1] = memo->out[0];					\
+	  out[2] = memo->out[1];					\
+	  out[3] = memo->out[2];					\
+	  memo_hits++;							\
+	}								\
+      else								\
+	{								\
+	  out[1] = curve_lookup(contrast, curve_scale, s_in[0]);	\
+	  out[2] = curve_lookup(contrast, curve_scale, s_in[1]);	\
+	  out[3] = curve_lookup(contrast, curve_scale, s_in[2]);	\
+	  if ((compute_saturation) && fixed_hsl)			\
+	    update_saturation_from_rgb_fixed(out + 1, brightness, fssat, fisat, \
+					     do_user_adjustment);	\
+	  else if ((compute_saturation))				\
+	    update_saturation_from_rgb(out + 1, brightness, curve_scale, \
+				       ssat, isat, do_user_adjustment);	\
+	  if ((split_saturation || lum_map || hue_map || sat_map) &&	\
+	      (out[1] != out[2] || out[1] != out[3]))			\
+	    {								\
+	      if (fixed_hsl)						\
+		adjust_hsl_fixed(out + 1, lut, fssat, fisat,		\
+				 hue_only_color_adjustment,		\
+				 bright_color_adjustment);		\
+	      else							\
+		adjust_hsl(out + 1, lut, ssat, isat, split_saturation,	\
+			   hue_only_color_adjustment, bright_color_adjustment); \
+	    }								\
+	  out[1] = curve_lookup(red, curve_scale, out[1] / BD(bits));	\
+	  out[2] = curve_lookup(green, curve_scale, out[2] / BD(bits));	\
+	  out[3] = curve_lookup(blue, curve_scale, out[3] / BD(bits));	\
+	  if (memo)							\
+	    {								\
+	      memo->key = memo_key;					\
+	      memo->out[0] = out[1];					\
+	      memo->out[1] = out[2];					\
+	      memo->out[2] = out[3];					\
+	    }								\
+	}								\
       out[0] = FMIN(out[1], FMIN(out[2], out[3]));			\
       out[1] -= out[0];							\
       out[2] -= out[0];							\
       out[3] -= out[0];							\
       nzx.nzl |= *(unsigned long long *) out;				\
     }									\
+  lut->color_memo_lookups += memo_lookups;				\
+  lut->color_memo_hits += memo_hits;					\
   for (i = 0; i < 4; i++)						\
     if (nzx.nz[i] == 0)							\
       retval |= (1 << i);						\
@@ -573,27 +1302,32 @@ color_##bits##_to_color_fast(const stp_vars_t *vars, const unsigned char *in, \
   int nz1 = 0;								\
   int nz2 = 0;								\
   const T *s_in = (const T *) in;					\
-  lut_t *lut = (lut_t *)(stp_get_component_data(vars, "Color"));	\
+  lut_t *lut = (lut_t *)(stpi_get_component(vars, STPI_COMPONENT_COLOR)); \
   const unsigned short *red;						\
   const unsigned short *green;						\
   const unsigned short *blue;						\
   const unsigned short *brightness;					\
   const unsigned short *contrast;					\
   double isat = 1.0;							\
-  double saturation = stp_get_float_parameter(vars, "Saturation");	\
-  double sbright = stp_get_float_parameter(vars, "Brightness");		\
+  double saturation =							\
+    stpi_get_float_parameter_by_handle(vars, &(lut->saturation));	\
+  double sbright =							\
+    stpi_get_float_parameter_by_handle(vars, &(lut->user_brightness)); \
   int compute_saturation = saturation <= .99999 || saturation >= 1.00001; \
   int do_user_adjustment = 0;						\
+  unsigned long long curve_scale = bits == 16 ? lut->curve_table_scale : 0; \
+  size_t curve_points = curve_scale ? lut->curve_table_points + 1 : 65536; \
   if (sbright != 1)							\
     do_user_adjustment = 1;						\
   compute_saturation |= do_user_adjustment;				\
 									\
   for (i = CHANNEL_C; i <= CHANNEL_Y; i++)				\
-    stp_curve_resample(lut->channel_curves[i].curve, 65536);		\
+    stp_curve_resample(lut->channel_curves[i].curve, curve_points);	\
   stp_curve_resample							\
-    (stp_curve_cache_get_curve(&(lut->brightness_correction)), 65536);	\
+    (stp_curve_cache_get_curve(&(lut->brightness_correction)), curve_points); \
   stp_curve_resample							\
-    (stp_curve_cache_get_curve(&(lut->contrast_correction)), 1 << bits); \
+    (stp_curve_cache_get_curve(&(lut->contrast_correction)),		\
+     curve_scale ? curve_points : 1 << bits);				\
   red =									\
     stp_curve_cache_get_ushort_data(&(lut->channel_curves[CHANNEL_C]));	\
   green =								\
@@ -620,14 +1354,15 @@ color_##bits##_to_color_fast(const stp_vars_t *vars, const unsigned char *in, \
 	  i0 = s_in[0];							\
 	  i1 = s_in[1];							\
 	  i2 = s_in[2];							\
-	  out[0] = contrast[s_in[0]];					\
-	  out[1] = contrast[s_in[1]];					\
-	  out[2] = contrast[s_in[2]];					\
+	  out[0] = curve_lookup(contrast, curve_scale, s_in[0]);	\
+	  out[1] = curve_lookup(contrast, curve_scale, s_in[1]);	\
+	  out[2] = curve_lookup(contrast, curve_scale, s_in[2]);	\
 	  if ((compute_saturation))					\
-	    update_saturation_from_rgb(out, brightness, saturation, isat, 1); \
-	  out[0] = red[out[0]];						\
-	  out[1] = green[out[1]];					\
-	  out[2] = blue[out[2]];					\
+	    update_saturation_from_rgb(out, brightness, curve_scale,	\
+				       saturation, isat, 1);		\
+	  out[0] = curve_lookup(red, curve_scale, out[0]);		\
+	  out[1] = curve_lookup(green, curve_scale, out[1]);		\
+	  out[2] = curve_lookup(blue, curve_scale, out[2]);		\
 	  o0 = out[0];							\
 	  o1 = out[1];							\
 	  o2 = out[2];							\
@@ -651,35 +1386,35 @@ color_##bits##_to_kcmy_fast(const stp_vars_t *vars, const unsigned char *in, \
 			     unsigned short *out)			\
 {									\
   int i;								\
-  union {								\
-    unsigned short nz[4];						\
-    unsigned long long nzl;						\
-  } nzx;								\
-  unsigned retval = 0;							\
-  unsigned short c, m, y, k;						\
+  unsigned short c, m, y;						\
+  unsigned short *kcmy = out;						\
   const T *s_in = (const T *) in;					\
-  lut_t *lut = (lut_t *)(stp_get_component_data(vars, "Color"));	\
+  lut_t *lut = (lut_t *)(stpi_get_component(vars, STPI_COMPONENT_COLOR)); \
   const unsigned short *red;						\
   const unsigned short *green;						\
   const unsigned short *blue;						\
   const unsigned short *brightness;					\
   const unsigned short *contrast;					\
   double isat = 1.0;							\
-  double saturation = stp_get_float_parameter(vars, "Saturation");	\
-  double sbright = stp_get_float_parameter(vars, "Brightness");		\
+  double saturation =							\
+    stpi_get_float_parameter_by_handle(vars, &(lut->saturation));	\
+  double sbright =							\
+    stpi_get_float_parameter_by_handle(vars, &(lut->user_brightness)); \
   int compute_saturation = saturation <= .99999 || saturation >= 1.00001; \
   int do_user_adjustment = 0;						\
+  unsigned long long curve_scale = bits == 16 ? lut->curve_table_scale : 0; \
+  size_t curve_points = curve_scale ? lut->curve_table_points + 1 : 65536; \
   if (sbright != 1)							\
     do_user_adjustment = 1;						\
   compute_saturation |= do_user_adjustment;				\
-  nzx.nzl = 0ull;							\
 									\
   for (i = CHANNEL_C; i <= CHANNEL_Y; i++)				\
-    stp_curve_resample(lut->channel_curves[i].curve, 65536);		\
+    stp_curve_resample(lut->channel_curves[i].curve, curve_points);	\
   stp_curve_resample							\
-    (stp_curve_cache_get_curve(&(lut->brightness_correction)), 65536);	\
+    (stp_curve_cache_get_curve(&(lut->brightness_correction)), curve_points); \
   stp_curve_resample							\
-    (stp_curve_cache_get_curve(&(lut->contrast_correction)), 1 << bits); \
+    (stp_curve_cache_get_curve(&(lut->contrast_correction)),		\
+     curve_scale ? curve_points : 1 << bits);				\
   red =									\
     stp_curve_cache_get_ushort_data(&(lut->channel_curves[CHANNEL_C]));	\
   green =								\
@@ -695,35 +1430,26 @@ color_##bits##_to_kcmy_fast(const stp_vars_t *vars, const unsigned char *in, \
     isat = 1.0 / saturation;						\
   for (i = 0; i < lut->image_width; i++, out += 4, s_in += 3)		\
     {									\
-      c = contrast[s_in[0]];						\
-      m = contrast[s_in[1]];						\
-      y = contrast[s_in[2]];						\
+      c = curve_lookup(contrast, curve_scale, s_in[0]);			\
+      m = curve_lookup(contrast, curve_scale, s_in[1]);			\
+      y = curve_lookup(contrast, curve_scale, s_in[2]);			\
       if (compute_saturation)						\
 	{								\
 	  unsigned short tmp[3];					\
 	  tmp[0] = c;							\
 	  tmp[1] = m;							\
 	  tmp[2] = y;							\
-	  update_saturation_from_rgb(tmp, brightness, saturation,	\
-				     isat, 1);				\
+	  update_saturation_from_rgb(tmp, brightness, curve_scale,	\
+				     saturation, isat, 1);		\
 	  c = tmp[0];							\
 	  m = tmp[1];							\
 	  y = tmp[2];							\
 	}								\
-      c = red[c];							\
-      m = green[m];							\
-      y = blue[y];							\
-      k = FMIN(c, FMIN(m, y));						\
-      out[0] = k;							\
-      out[1] = c - k;							\
-      out[2] = m - k;							\
-      out[3] = y - k;							\
-      nzx.nzl |= *(unsigned long long *) out;				\
+      out[1] = curve_lookup(red, curve_scale, c);			\
+      out[2] = curve_lookup(green, curve_scale, m);			\
+      out[3] = curve_lookup(blue, curve_scale, y);			\
     }									\
-  for (i = 0; i < 4; i++)						\
-    if (nzx.nz[i] == 0)							\
-      retval |= (1 << i);						\
-  return retval;							\
+  return ~stpi_color_kernels->black(kcmy, lut->image_width) & 0xf;	\
 }
 
 FAST_COLOR_TO_KCMY_FUNC(unsigned char, 8) // color_8_to_kcmy_fast
@@ -735,28 +1461,14 @@ CFUNC									    \
 color_##bits##_to_color_raw(const stp_vars_t *vars, const unsigned char *in,\
 			    unsigned short *out)			    \
 {									    \
-  int i;								    \
-  int j;								    \
-  int nz = 0;								    \
   const T *s_in = (const T *) in;					    \
-  lut_t *lut = (lut_t *)(stp_get_component_data(vars, "Color"));	    \
+  lut_t *lut = (lut_t *)(stpi_get_component(vars, STPI_COMPONENT_COLOR)); \
   unsigned mask = 0;							    \
   if (lut->invert_output)						    \
     mask = 0xffff;							    \
 									    \
-  for (i = 0; i < lut->image_width; i++)				    \
-    {									    \
-      unsigned bit = 1;							    \
-      for (j = 0; j < 3; j++, bit += bit)				    \
-	{								    \
-	  out[j] = (s_in[j] * (65535 / ((1 << bits) - 1))) ^ mask;	    \
-	  if (out[j])							    \
-	    nz |= bit;							    \
-	}								    \
-      s_in += 3;							    \
-      out += 3;								    \
-    }									    \
-  return nz;								    \
+  return stpi_color_kernels->scale_##bits				    \
+    (s_in, out, lut->image_width * 3, 65535 / ((1 << bits) - 1), mask, 3);  \
 }
 
 RAW_COLOR_TO_COLOR_FUNC(unsigned char, 8) // color_8_to_color_raw
@@ -769,34 +1481,20 @@ color_##bits##_to_kcmy_raw(const stp_vars_t *vars, const unsigned char *in, \
 			    unsigned short *out)			\
 {									\
   int i;								\
-  union {								\
-    unsigned short nz[4];						\
-    unsigned long long nzl;						\
-  } nzx;								\
-  unsigned retval = 0;							\
   const T *s_in = (const T *) in;					\
-  lut_t *lut = (lut_t *)(stp_get_component_data(vars, "Color"));	\
+  lut_t *lut = (lut_t *)(stpi_get_component(vars, STPI_COMPONENT_COLOR)); \
+  unsigned short *kcmy = out;						\
   unsigned mask = 0;							\
   if (lut->invert_output)						\
     mask = 0xffff;							\
-  nzx.nzl = 0ull;							\
 									\
   for (i = 0; i < lut->image_width; i++, out += 4, s_in += 3)		\
     {									\
-      unsigned c = (s_in[0] * BD(bits)) ^ mask;				\
-      unsigned m = (s_in[1] * BD(bits)) ^ mask;				\
-      unsigned y = (s_in[2] * BD(bits)) ^ mask;				\
-      unsigned k = FMIN(c, FMIN(m, y));					\
-      out[0] = k;							\
-      out[1] = c - k;							\
-      out[2] = m - k;							\
-      out[3] = y - k;							\
-      nzx.nzl |= *(unsigned long long *) out;				\
+      out[1] = (s_in[0] * BD(bits)) ^ mask;				\
+      out[2] = (s_in[1] * BD(bits)) ^ mask;				\
+      out[3] = (s_in[2] * BD(bits)) ^ mask;				\
     }									\
-  for (i = 0; i < 4; i++)						\
-    if (nzx.nz[i] == 0)							\
-      retval |= (1 << i);						\
-  return retval;							\
+  return ~stpi_color_kernels->black(kcmy, lut->image_width) & 0xf;	\
 }
 
 RAW_COLOR_TO_KCMY_FUNC(unsigned char, 8) // color_8_to_kcmy_raw
@@ -821,7 +1519,7 @@ gray_##bits##_to_color(const stp_vars_t *vars, const unsigned char *in,	    \
   int nz1 = 0;								    \
   int nz2 = 0;								    \
   const T *s_in = (const T *) in;					    \
-  lut_t *lut = (lut_t *)(stp_get_component_data(vars, "Color"));	    \
+  lut_t *lut = (lut_t *)(stpi_get_component(vars, STPI_COMPONENT_COLOR)); \
   const unsigned short *red;						    \
   const unsigned short *green;						    \
   const unsigned short *blue;						    \
@@ -877,13 +1575,9 @@ gray_##bits##_to_kcmy(const stp_vars_t *vars, const unsigned char *in,	\
 		      unsigned short *out)				\
 {									\
   int i;								\
-  union {								\
-    unsigned short nz[4];						\
-    unsigned long long nzl;						\
-  } nzx;								\
-  unsigned retval = 0;							\
+  unsigned short *kcmy = out;						\
   const T *s_in = (const T *) in;					\
-  lut_t *lut = (lut_t *)(stp_get_component_data(vars, "Color"));	\
+  lut_t *lut = (lut_t *)(stpi_get_component(vars, STPI_COMPONENT_COLOR)); \
   const unsigned short *red;						\
   const unsigned short *green;						\
   const unsigned short *blue;						\
@@ -907,16 +1601,8 @@ gray_##bits##_to_kcmy(const stp_vars_t *vars, const unsigned char *in,	\
       out[1] = red[user[s_in[0]]];					\
       out[2] = green[user[s_in[0]]];					\
       out[3] = blue[user[s_in[0]]];					\
-      out[0] = FMIN(out[1], FMIN(out[2], out[3]));			\
-      out[1] -= out[0];							\
-      out[2] -= out[0];							\
-      out[3] -= out[0];							\
-      nzx.nzl |= *(unsigned long long *) out;				\
     }									\
-  for (i = 0; i < 4; i++)						\
-    if (nzx.nz[i] == 0)							\
-      retval |= (1 << i);						\
-  return retval;							\
+  return ~stpi_color_kernels->black(kcmy, lut->image_width) & 0xf;	\
 }
 
 GRAY_TO_KCMY_FUNC(unsigned char, 8) // gray_8_to_kcmy
@@ -931,7 +1617,7 @@ gray_##bits##_to_color_raw(const stp_vars_t *vars, const unsigned char *in,\
   int i;								   \
   int nz = 7;								   \
   const T *s_in = (const T *) in;					   \
-  lut_t *lut = (lut_t *)(stp_get_component_data(vars, "Color"));	   \
+  lut_t *lut = (lut_t *)(stpi_get_component(vars, STPI_COMPONENT_COLOR)); \
   unsigned mask = 0;							   \
   if (lut->invert_output)						   \
     mask = 0xffff;							   \
@@ -962,7 +1648,7 @@ gray_##bits##_to_kcmy_raw(const stp_vars_t *vars, const unsigned char *in, \
   int i;								\
   int nz = 7;								\
   const T *s_in = (const T *) in;					\
-  lut_t *lut = (lut_t *)(stp_get_component_data(vars, "Color"));	\
+  lut_t *lut = (lut_t *)(stpi_get_component(vars, STPI_COMPONENT_COLOR)); \
   unsigned mask = 0;							\
   if (lut->invert_output)						\
     mask = 0xffff;							\
@@ -994,7 +1680,7 @@ name##_to_kcmy_threshold(const stp_vars_t *vars,			\
   int z = 15;								\
   const T *s_in = (const T *) in;					\
   unsigned high_bit = ((1 << ((sizeof(T) * 8) - 1)));			\
-  lut_t *lut = (lut_t *)(stp_get_component_data(vars, "Color"));	\
+  lut_t *lut = (lut_t *)(stpi_get_component(vars, STPI_COMPONENT_COLOR)); \
   int width = lut->image_width;						\
   unsigned mask = 0;							\
   memset(out, 0, width * 4 * sizeof(unsigned short));			\
@@ -1052,7 +1738,7 @@ name##_to_kcmy_threshold(const stp_vars_t *vars,			\
   const T *s_in = (const T *) in;					\
   unsigned desired_high_bit = 0;					\
   unsigned high_bit = 1 << ((sizeof(T) * 8) - 1);			\
-  lut_t *lut = (lut_t *)(stp_get_component_data(vars, "Color"));	\
+  lut_t *lut = (lut_t *)(stpi_get_component(vars, STPI_COMPONENT_COLOR)); \
   int width = lut->image_width;						\
   memset(out, 0, width * 4 * sizeof(unsigned short));			\
   if (!lut->invert_output)						\
@@ -1088,44 +1774,24 @@ CMYK_TO_KCMY_THRESHOLD_FUNC(unsigned char, cmyk_8) // cmyk_8_to_kcmy_threshold
 CMYK_TO_KCMY_THRESHOLD_FUNC(unsigned short, cmyk_16) // cmyk_16_to_kcmy_threshodl
 GENERIC_COLOR_FUNC(cmyk, kcmy_threshold)
 
-#define KCMY_TO_KCMY_THRESHOLD_FUNC(T, name)				\
+#define KCMY_TO_KCMY_THRESHOLD_FUNC(T, name, bits)			\
 CFUNC									\
 name##_to_kcmy_threshold(const stp_vars_t *vars,			\
 			 const unsigned char *in,			\
 			 unsigned short *out)				\
 {									\
-  int i;								\
-  int j;								\
-  unsigned nz[4];							\
-  unsigned z = 0xf;							\
   const T *s_in = (const T *) in;					\
   unsigned desired_high_bit = 0;					\
   unsigned high_bit = 1 << ((sizeof(T) * 8) - 1);			\
-  lut_t *lut = (lut_t *)(stp_get_component_data(vars, "Color"));	\
-  int width = lut->image_width;						\
-  memset(out, 0, width * 4 * sizeof(unsigned short));			\
+  lut_t *lut = (lut_t *)(stpi_get_component(vars, STPI_COMPONENT_COLOR)); \
   if (!lut->invert_output)						\
     desired_high_bit = high_bit;					\
-  for (i = 0; i < 4; i++)						\
-    nz[i] = z & ~(1 << i);						\
-									\
-  for (i = 0; i < width; i++)						\
-    {									\
-      for (j = 0; j < 4; j++)						\
-	{								\
-	  if ((*s_in++ & high_bit) == desired_high_bit)			\
-	    {								\
-	      z &= nz[j];						\
-	      *out = 65535;						\
-	    }								\
-	  out++;							\
-	}								\
-    }									\
-  return z;								\
+  return ~stpi_color_kernels->threshold_##bits				\
+    (s_in, out, lut->image_width * 4, desired_high_bit, 4) & 0xf;	\
 }
 
-KCMY_TO_KCMY_THRESHOLD_FUNC(unsigned char, kcmy_8) // kcmy_8_to_kcmy_threshold
-KCMY_TO_KCMY_THRESHOLD_FUNC(unsigned short, kcmy_16) // kcmy_8_to_kcmy_threshold
+KCMY_TO_KCMY_THRESHOLD_FUNC(unsigned char, kcmy_8, 8) // kcmy_8_to_kcmy_threshold
+KCMY_TO_KCMY_THRESHOLD_FUNC(unsigned short, kcmy_16, 16) // kcmy_8_to_kcmy_threshold
 GENERIC_COLOR_FUNC(kcmy, kcmy_threshold)
 
 #define GRAY_TO_COLOR_THRESHOLD_FUNC(T, name, bits, channels)		\
@@ -1139,7 +1805,7 @@ gray_##bits##_to_##name##_threshold(const stp_vars_t *vars,		\
   int desired_high_bit = 0;						\
   unsigned high_bit = 1 << ((sizeof(T) * 8) - 1);			\
   const T *s_in = (const T *) in;					\
-  lut_t *lut = (lut_t *)(stp_get_component_data(vars, "Color"));	\
+  lut_t *lut = (lut_t *)(stpi_get_component(vars, STPI_COMPONENT_COLOR)); \
   int width = lut->image_width;						\
   memset(out, 0, width * channels * sizeof(unsigned short));		\
   if (!lut->invert_output)						\
@@ -1178,7 +1844,7 @@ name##_to_color_threshold(const stp_vars_t *vars,			\
   int desired_high_bit = 0;						\
   unsigned high_bit = ((1 << ((sizeof(T) * 8) - 1)) * 4);		\
   const T *s_in = (const T *) in;					\
-  lut_t *lut = (lut_t *)(stp_get_component_data(vars, "Color"));	\
+  lut_t *lut = (lut_t *)(stpi_get_component(vars, STPI_COMPONENT_COLOR)); \
   int width = lut->image_width;						\
   memset(out, 0, width * 3 * sizeof(unsigned short));			\
   if (!lut->invert_output)						\
@@ -1220,7 +1886,7 @@ name##_to_gray_threshold(const stp_vars_t *vars,			\
   int desired_high_bit = 0;						\
   unsigned high_bit = ((1 << ((sizeof(T) * 8) - 1)));			\
   const T *s_in = (const T *) in;					\
-  lut_t *lut = (lut_t *)(stp_get_component_data(vars, "Color"));	\
+  lut_t *lut = (lut_t *)(stpi_get_component(vars, STPI_COMPONENT_COLOR)); \
   int width = lut->image_width;						\
   memset(out, 0, width * sizeof(unsigned short));			\
   if (!lut->invert_output)						\
@@ -1255,8 +1921,24 @@ COLOR_TO_GRAY_THRESHOLD_FUNC(unsigned char, color_8, 3, 3) // color_8_to_gray_th
 COLOR_TO_GRAY_THRESHOLD_FUNC(unsigned short, color_16, 3, 3) // color_16_to_gray_threshold
 GENERIC_COLOR_FUNC(color, gray_threshold)
 
-COLOR_TO_GRAY_THRESHOLD_FUNC(unsigned char, gray_8, 1, 1) // gray_8_to_gray_threshold
-COLOR_TO_GRAY_THRESHOLD_FUNC(unsigned short, gray_16, 1, 1) // gray_16_to_gray_threshold
+#define GRAY_TO_GRAY_THRESHOLD_FUNC(T, bits)				\
+CFUNC									\
+gray_##bits##_to_gray_threshold(const stp_vars_t *vars,			\
+				const unsigned char *in,		\
+				unsigned short *out)			\
+{									\
+  const T *s_in = (const T *) in;					\
+  unsigned desired_high_bit = 0;					\
+  unsigned high_bit = 1 << ((sizeof(T) * 8) - 1);			\
+  lut_t *lut = (lut_t *)(stpi_get_component(vars, STPI_COMPONENT_COLOR)); \
+  if (!lut->invert_output)						\
+    desired_high_bit = high_bit;					\
+  return !stpi_color_kernels->threshold_##bits				\
+    (s_in, out, lut->image_width, desired_high_bit, 1);			\
+}
+
+GRAY_TO_GRAY_THRESHOLD_FUNC(unsigned char, 8) // gray_8_to_gray_threshold
+GRAY_TO_GRAY_THRESHOLD_FUNC(unsigned short, 16) // gray_16_to_gray_threshold
 GENERIC_COLOR_FUNC(gray, gray_threshold)
 
 #define CMYK_TO_COLOR_FUNC(namein, name2, T, bits, offset)		\
@@ -1265,7 +1947,7 @@ namein##_##bits##_to_##name2(const stp_vars_t *vars, const unsigned char *in, \
 			   unsigned short *out)				\
 {									\
   int i;								\
-  lut_t *lut = (lut_t *)(stp_get_component_data(vars, "Color"));	\
+  lut_t *lut = (lut_t *)(stpi_get_component(vars, STPI_COMPONENT_COLOR)); \
   unsigned status;							\
   size_t real_steps = lut->steps;					\
   const T *s_in = (const T *) in;					\
@@ -1338,7 +2020,7 @@ cmyk_##size##_to_kcmy(const stp_vars_t *vars,				    \
   int j;								    \
   int nz[4];								    \
   const T *s_in = (const T *) in;					    \
-  lut_t *lut = (lut_t *)(stp_get_component_data(vars, "Color"));	    \
+  lut_t *lut = (lut_t *)(stpi_get_component(vars, STPI_COMPONENT_COLOR)); \
   const unsigned short *user;						    \
   const unsigned short *maps[4];					    \
 									    \
@@ -1383,7 +2065,7 @@ kcmy_##size##_to_kcmy(const stp_vars_t *vars,				    \
   int j;								    \
   int nz[4];								    \
   const T *s_in = (const T *) in;					    \
-  lut_t *lut = (lut_t *)(stp_get_component_data(vars, "Color"));	    \
+  lut_t *lut = (lut_t *)(stpi_get_component(vars, STPI_COMPONENT_COLOR)); \
   const unsigned short *user;						    \
   const unsigned short *maps[4];					    \
 									    \
@@ -1428,7 +2110,7 @@ gray_##bits##_to_gray(const stp_vars_t *vars,				   \
   int o0 = 0;								   \
   int nz = 0;								   \
   const T *s_in = (const T *) in;					   \
-  lut_t *lut = (lut_t *)(stp_get_component_data(vars, "Color"));	   \
+  lut_t *lut = (lut_t *)(stpi_get_component(vars, STPI_COMPONENT_COLOR)); \
   int width = lut->image_width;						   \
   const unsigned short *composite;					   \
   const unsigned short *user;						   \
@@ -1474,7 +2156,7 @@ color_##bits##_to_gray(const stp_vars_t *vars,				      \
   int o0 = 0;								      \
   int nz = 0;								      \
   const T *s_in = (const T *) in;					      \
-  lut_t *lut = (lut_t *)(stp_get_component_data(vars, "Color"));	      \
+  lut_t *lut = (lut_t *)(stpi_get_component(vars, STPI_COMPONENT_COLOR)); \
   int l_red = LUM_RED;							      \
   int l_green = LUM_GREEN;						      \
   int l_blue = LUM_BLUE;						      \
@@ -1532,7 +2214,7 @@ cmyk_##bits##_to_gray(const stp_vars_t *vars,				    \
   int o0 = 0;								    \
   int nz = 0;								    \
   const T *s_in = (const T *) in;					    \
-  lut_t *lut = (lut_t *)(stp_get_component_data(vars, "Color"));	    \
+  lut_t *lut = (lut_t *)(stpi_get_component(vars, STPI_COMPONENT_COLOR)); \
   int l_red = LUM_RED;							    \
   int l_green = LUM_GREEN;						    \
   int l_blue = LUM_BLUE;						    \
@@ -1592,7 +2274,7 @@ kcmy_##bits##_to_gray(const stp_vars_t *vars,				    \
   int o0 = 0;								    \
   int nz = 0;								    \
   const T *s_in = (const T *) in;					    \
-  lut_t *lut = (lut_t *)(stp_get_component_data(vars, "Color"));	    \
+  lut_t *lut = (lut_t *)(stpi_get_component(vars, STPI_COMPONENT_COLOR)); \
   int l_red = LUM_RED;							    \
   int l_green = LUM_GREEN;						    \
   int l_blue = LUM_BLUE;						    \
@@ -1644,25 +2326,14 @@ gray_##bits##_to_gray_raw(const stp_vars_t *vars,			\
 			  const unsigned char *in,			\
 			  unsigned short *out)				\
 {									\
-  int i;								\
-  int nz = 0;								\
   const T *s_in = (const T *) in;					\
-  lut_t *lut = (lut_t *)(stp_get_component_data(vars, "Color"));	\
-  int width = lut->image_width;						\
+  lut_t *lut = (lut_t *)(stpi_get_component(vars, STPI_COMPONENT_COLOR)); \
   unsigned mask = 0;							\
   if (lut->invert_output)						\
     mask = 0xffff;							\
 									\
-  memset(out, 0, width * sizeof(unsigned short));			\
-									\
-  for (i = 0; i < lut->image_width; i++)				\
-    {									\
-      out[0] = (s_in[0] * (65535 / ((1 << bits) - 1))) ^ mask;		\
-      nz |= out[0];							\
-      s_in ++;								\
-      out ++;								\
-    }									\
-  return nz == 0;							\
+  return !stpi_color_kernels->scale_##bits				\
+    (s_in, out, lut->image_width, 65535 / ((1 << bits) - 1), mask, 1);	\
 }
 
 GRAY_TO_GRAY_RAW_FUNC(unsigned char, 8) // gray_8_to_gray_raw
@@ -1682,7 +2353,7 @@ color_##bits##_to_gray_##name2(const stp_vars_t *vars,			\
   int o0 = 0;								\
   int nz = 0;								\
   const T *s_in = (const T *) in;					\
-  lut_t *lut = (lut_t *)(stp_get_component_data(vars, "Color"));	\
+  lut_t *lut = (lut_t *)(stpi_get_component(vars, STPI_COMPONENT_COLOR)); \
   int l_red = LUM_RED;							\
   int l_green = LUM_GREEN;						\
   int l_blue = LUM_BLUE;						\
@@ -1739,7 +2410,7 @@ cmyk_##bits##_to_gray_##name2(const stp_vars_t *vars,			    \
   int o0 = 0;								    \
   int nz = 0;								    \
   const T *s_in = (const T *) in;					    \
-  lut_t *lut = (lut_t *)(stp_get_component_data(vars, "Color"));	    \
+  lut_t *lut = (lut_t *)(stpi_get_component(vars, STPI_COMPONENT_COLOR)); \
   int l_red = LUM_RED;							    \
   int l_green = LUM_GREEN;						    \
   int l_blue = LUM_BLUE;						    \
@@ -1799,7 +2470,7 @@ kcmy_##bits##_to_gray_##name2(const stp_vars_t *vars,			    \
   int o0 = 0;								    \
   int nz = 0;								    \
   const T *s_in = (const T *) in;					    \
-  lut_t *lut = (lut_t *)(stp_get_component_data(vars, "Color"));	    \
+  lut_t *lut = (lut_t *)(stpi_get_component(vars, STPI_COMPONENT_COLOR)); \
   int l_red = LUM_RED;							    \
   int l_green = LUM_GREEN;						    \
   int l_blue = LUM_BLUE;						    \
@@ -1856,7 +2527,7 @@ cmyk_##bits##_to_kcmy_raw(const stp_vars_t *vars,			\
   int nz[4];								\
   unsigned retval = 0;							\
   const T *s_in = (const T *) in;					\
-  lut_t *lut = (lut_t *)(stp_get_component_data(vars, "Color"));	\
+  lut_t *lut = (lut_t *)(stpi_get_component(vars, STPI_COMPONENT_COLOR)); \
 									\
   memset(nz, 0, sizeof(nz));						\
   for (i = 0; i < lut->image_width; i++)				\
@@ -1891,7 +2562,7 @@ kcmy_##bits##_to_kcmy_raw(const stp_vars_t *vars,			\
   int nz[4];								\
   unsigned retval = 0;							\
   const T *s_in = (const T *) in;					\
-  lut_t *lut = (lut_t *)(stp_get_component_data(vars, "Color"));	\
+  lut_t *lut = (lut_t *)(stpi_get_component(vars, STPI_COMPONENT_COLOR)); \
 									\
   memset(nz, 0, sizeof(nz));						\
   for (i = 0; i < lut->image_width; i++)				\
@@ -1920,7 +2591,7 @@ name##_##bits##_to_##name2##_desaturated(const stp_vars_t *vars,	   \
 				         const unsigned char *in,	   \
 				         unsigned short *out)		   \
 {									   \
-  lut_t *lut = (lut_t *)(stp_get_component_data(vars, "Color"));	   \
+  lut_t *lut = (lut_t *)(stpi_get_component(vars, STPI_COMPONENT_COLOR)); \
   size_t real_steps = lut->steps;					   \
   unsigned status;							   \
   if (!lut->gray_tmp)							   \
@@ -1958,7 +2629,7 @@ CFUNC									\
 CMYK_to_##name(const stp_vars_t *vars, const unsigned char *in,		\
 	       unsigned short *out)					\
 {									\
-  lut_t *lut = (lut_t *)(stp_get_component_data(vars, "Color"));	\
+  lut_t *lut = (lut_t *)(stpi_get_component(vars, STPI_COMPONENT_COLOR)); \
   if (lut->input_color_description->color_id == COLOR_ID_CMYK)		\
     return cmyk_to_##name(vars, in, out);				\
   else if (lut->input_color_description->color_id == COLOR_ID_KCMY)	\
@@ -1992,7 +2663,7 @@ name##_to_raw_threshold(const stp_vars_t *vars,				\
 {									\
   int i;								\
   int j;								\
-  lut_t *lut = (lut_t *)(stp_get_component_data(vars, "Color"));	\
+  lut_t *lut = (lut_t *)(stpi_get_component(vars, STPI_COMPONENT_COLOR)); \
   unsigned nz[STP_CHANNEL_LIMIT];					\
   unsigned z = (1 << lut->out_channels) - 1;				\
   const T *s_in = (const T *) in;					\
@@ -2035,7 +2706,7 @@ raw_##size##_to_raw(const stp_vars_t *vars,				    \
   int j;								    \
   int nz[STP_CHANNEL_LIMIT];						    \
   const T *s_in = (const T *) in;					    \
-  lut_t *lut = (lut_t *)(stp_get_component_data(vars, "Color"));	    \
+  lut_t *lut = (lut_t *)(stpi_get_component(vars, STPI_COMPONENT_COLOR)); \
   const unsigned short *maps[STP_CHANNEL_LIMIT];			    \
   const unsigned short *user;						    \
 									    \
@@ -2080,7 +2751,7 @@ raw_##bits##_to_raw_raw(const stp_vars_t *vars,				\
   int nz[STP_CHANNEL_LIMIT];						\
   unsigned retval = 0;							\
   const T *s_in = (const T *) in;					\
-  lut_t *lut = (lut_t *)(stp_get_component_data(vars, "Color"));	\
+  lut_t *lut = (lut_t *)(stpi_get_component(vars, STPI_COMPONENT_COLOR)); \
   int colors = lut->in_channels;					\
 									\
   memset(nz, 0, sizeof(nz));						\
@@ -2111,7 +2782,7 @@ generic_##from##_to_##to(const stp_vars_t *v,				\
 			 const unsigned char *in,			\
 			 unsigned short *out)				\
 {									\
-  lut_t *lut = (lut_t *)(stp_get_component_data(v, "Color"));		\
+  lut_t *lut = (lut_t *)(stpi_get_component(v, STPI_COMPONENT_COLOR));	\
   switch (lut->color_correction->correction)				\
     {									\
     case COLOR_CORRECTION_UNCORRECTED:					\
@@ -2149,7 +2820,7 @@ generic_##from##_to_##to(const stp_vars_t *v,				\
 			 const unsigned char *in,			\
 			 unsigned short *out)				\
 {									\
-  lut_t *lut = (lut_t *)(stp_get_component_data(v, "Color"));		\
+  lut_t *lut = (lut_t *)(stpi_get_component(v, STPI_COMPONENT_COLOR));	\
   switch (lut->color_correction->correction)				\
     {									\
     case COLOR_CORRECTION_UNCORRECTED:					\
@@ -2184,7 +2855,7 @@ generic_##from##_to_##to(const stp_vars_t *v,				\
 			 const unsigned char *in,			\
 			 unsigned short *out)				\
 {									\
-  lut_t *lut = (lut_t *)(stp_get_component_data(v, "Color"));		\
+  lut_t *lut = (lut_t *)(stpi_get_component(v, STPI_COMPONENT_COLOR));	\
   switch (lut->color_correction->correction)				\
     {									\
     case COLOR_CORRECTION_UNCORRECTED:					\
@@ -2225,7 +2896,7 @@ stpi_color_convert_to_gray(const stp_vars_t *v,
 			   const unsigned char *in,
 			   unsigned short *out)
 {
-  lut_t *lut = (lut_t *)(stp_get_component_data(v, "Color"));
+  lut_t *lut = (lut_t *)(stpi_get_component(v, STPI_COMPONENT_COLOR));
   switch (lut->input_color_description->color_id)
     {
     case COLOR_ID_GRAY:
@@ -2247,7 +2918,7 @@ stpi_color_convert_to_color(const stp_vars_t *v,
 			    const unsigned char *in,
 			    unsigned short *out)
 {
-  lut_t *lut = (lut_t *)(stp_get_component_data(v, "Color"));
+  lut_t *lut = (lut_t *)(stpi_get_component(v, STPI_COMPONENT_COLOR));
   switch (lut->input_color_description->color_id)
     {
     case COLOR_ID_GRAY:
@@ -2269,7 +2940,7 @@ stpi_color_convert_to_kcmy(const stp_vars_t *v,
 			   const unsigned char *in,
 			   unsigned short *out)
 {
-  lut_t *lut = (lut_t *)(stp_get_component_data(v, "Color"));
+  lut_t *lut = (lut_t *)(stpi_get_component(v, STPI_COMPONENT_COLOR));
   switch (lut->input_color_description->color_id)
     {
     case COLOR_ID_GRAY:
@@ -2291,7 +2962,7 @@ stpi_color_convert_raw(const stp_vars_t *v,
 		       const unsigned char *in,
 		       unsigned short *out)
 {
-  lut_t *lut = (lut_t *)(stp_get_component_data(v, "Color"));
+  lut_t *lut = (lut_t *)(stpi_get_component(v, STPI_COMPONENT_COLOR));
   switch (lut->color_correction->correction)
     {
     case COLOR_CORRECTION_THRESHOLD:
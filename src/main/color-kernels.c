@@ -0,0 +1,464 @@
+/*
+ *   SIMD inner loops for the traditional color conversions
+ *
+ *   Copyright 2026 The Gutenprint Project
+ *
+ *   This program is free software; you can redistribute it and/or modify it
+ *   under the terms of the GNU General Public License as published by the Free
+ *   Software Foundation; either version 2 of the License, or (at your option)
+ *   any later version.
+ *
+ *   This program is distributed in the hope that it will be useful, but
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *   or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *   for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <gutenprint/gutenprint.h>
+#include "gutenprint-internal.h"
+#include <gutenprint/gutenprint-intl-internal.h>
+#include "color-conversion.h"
+
+/*
+ * The x86 versions are compiled with per-function target attributes
+ * so that the library as a whole still runs on any processor; which
+ * set is used follows stpi_kernel_level().
+ */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define X86_KERNELS
+#include <immintrin.h>
+#define SSE2_FUNC static unsigned __attribute__ ((target ("sse2")))
+#define AVX2_FUNC static unsigned __attribute__ ((target ("avx2")))
+#endif
+
+#define FMIN(a, b) ((a) < (b) ? (a) : (b))
+
+static unsigned
+channel_mask(const unsigned short *lanes, int count, int channels)
+{
+  unsigned mask = 0;
+  int i;
+  for (i = 0; i < count; i++)
+    if (lanes[i])
+      mask |= 1 << (i % channels);
+  return mask;
+}
+
+/*
+ * Generic versions.  These are also used for whatever is left over at
+ * the end of a row by the SIMD versions, which always stop at a
+ * multiple of the channel count.
+ */
+
+#define GENERIC_SCALE_FUNC(T, bits)					\
+static unsigned								\
+generic_scale_##bits(const T *in, unsigned short *out, size_t count,	\
+		     unsigned scale, unsigned mask, int channels)	\
+{									\
+  unsigned short nz[4] = { 0, 0, 0, 0 };				\
+  size_t i;								\
+  int j = 0;								\
+  for (i = 0; i < count; i++)						\
+    {									\
+      out[i] = (in[i] * scale) ^ mask;					\
+      nz[j] |= out[i];							\
+      if (++j == channels)						\
+	j = 0;								\
+    }									\
+  return channel_mask(nz, channels, channels);				\
+}
+
+GENERIC_SCALE_FUNC(unsigned char, 8) // generic_scale_8
+GENERIC_SCALE_FUNC(unsigned short, 16) // generic_scale_16
+
+#define GENERIC_THRESHOLD_FUNC(T, bits)					\
+static unsigned								\
+generic_threshold_##bits(const T *in, unsigned short *out, size_t count, \
+			 unsigned match, int channels)			\
+{									\
+  unsigned high_bit = 1 << (bits - 1);					\
+  unsigned short nz[4] = { 0, 0, 0, 0 };				\
+  size_t i;								\
+  int j = 0;								\
+  for (i = 0; i < count; i++)						\
+    {									\
+      out[i] = (in[i] & high_bit) == match ? 65535 : 0;			\
+      nz[j] |= out[i];							\
+      if (++j == channels)						\
+	j = 0;								\
+    }									\
+  return channel_mask(nz, channels, channels);				\
+}
+
+GENERIC_THRESHOLD_FUNC(unsigned char, 8) // generic_threshold_8
+GENERIC_THRESHOLD_FUNC(unsigned short, 16) // generic_threshold_16
+
+static unsigned
+generic_black(unsigned short *kcmy, size_t width)
+{
+  unsigned short nz[4] = { 0, 0, 0, 0 };
+  size_t i;
+  for (i = 0; i < width; i++, kcmy += 4)
+    {
+      unsigned short k = FMIN(kcmy[1], FMIN(kcmy[2], kcmy[3]));
+      kcmy[0] = k;
+      kcmy[1] -= k;
+      kcmy[2] -= k;
+      kcmy[3] -= k;
+      nz[0] |= kcmy[0];
+      nz[1] |= kcmy[1];
+      nz[2] |= kcmy[2];
+      nz[3] |= kcmy[3];
+    }
+  return channel_mask(nz, 4, 4);
+}
+
+static const stpi_color_kernels_t generic_kernels =
+{
+  "generic",
+  generic_scale_8,
+  generic_scale_16,
+  generic_threshold_8,
+  generic_threshold_16,
+  generic_black
+};
+
+#ifdef X86_KERNELS
+
+/*
+ * SSE2 versions.  Rows are taken three vectors (24 samples) at a time,
+ * which is a whole number of pixels for any channel count, and the
+ * nonzero channels are worked out from the three accumulators at the
+ * end.
+ */
+
+SSE2_FUNC
+sse2_scale_8(const unsigned char *in, unsigned short *out, size_t count,
+	     unsigned scale, unsigned mask, int channels)
+{
+  __m128i zero = _mm_setzero_si128();
+  __m128i vscale = _mm_set1_epi16(scale);
+  __m128i vmask = _mm_set1_epi16(mask);
+  __m128i acc[3];
+  unsigned short lanes[24];
+  size_t i;
+  int j;
+  for (j = 0; j < 3; j++)
+    acc[j] = zero;
+  for (i = 0; i + 24 <= count; i += 24)
+    for (j = 0; j < 3; j++)
+      {
+	__m128i x = _mm_loadl_epi64((const __m128i *) (in + i + j * 8));
+	x = _mm_unpacklo_epi8(x, zero);
+	x = _mm_xor_si128(_mm_mullo_epi16(x, vscale), vmask);
+	_mm_storeu_si128((__m128i *) (out + i + j * 8), x);
+	acc[j] = _mm_or_si128(acc[j], x);
+      }
+  for (j = 0; j < 3; j++)
+    _mm_storeu_si128((__m128i *) (lanes + j * 8), acc[j]);
+  return channel_mask(lanes, 24, channels) |
+    generic_scale_8(in + i, out + i, count - i, scale, mask, channels);
+}
+
+SSE2_FUNC
+sse2_scale_16(const unsigned short *in, unsigned short *out, size_t count,
+	      unsigned scale, unsigned mask, int channels)
+{
+  __m128i vscale = _mm_set1_epi16(scale);
+  __m128i vmask = _mm_set1_epi16(mask);
+  __m128i acc[3];
+  unsigned short lanes[24];
+  size_t i;
+  int j;
+  for (j = 0; j < 3; j++)
+    acc[j] = _mm_setzero_si128();
+  for (i = 0; i + 24 <= count; i += 24)
+    for (j = 0; j < 3; j++)
+      {
+	__m128i x = _mm_loadu_si128((const __m128i *) (in + i + j * 8));
+	x = _mm_xor_si128(_mm_mullo_epi16(x, vscale), vmask);
+	_mm_storeu_si128((__m128i *) (out + i + j * 8), x);
+	acc[j] = _mm_or_si128(acc[j], x);
+      }
+  for (j = 0; j < 3; j++)
+    _mm_storeu_si128((__m128i *) (lanes + j * 8), acc[j]);
+  return channel_mask(lanes, 24, channels) |
+    generic_scale_16(in + i, out + i, count - i, scale, mask, channels);
+}
+
+SSE2_FUNC
+sse2_threshold_8(const unsigned char *in, unsigned short *out, size_t count,
+		 unsigned match, int channels)
+{
+  __m128i zero = _mm_setzero_si128();
+  __m128i high_bit = _mm_set1_epi16(0x80);
+  __m128i vmatch = _mm_set1_epi16(match);
+  __m128i acc[3];
+  unsigned short lanes[24];
+  size_t i;
+  int j;
+  for (j = 0; j < 3; j++)
+    acc[j] = zero;
+  for (i = 0; i + 24 <= count; i += 24)
+    for (j = 0; j < 3; j++)
+      {
+	__m128i x = _mm_loadl_epi64((const __m128i *) (in + i + j * 8));
+	x = _mm_unpacklo_epi8(x, zero);
+	x = _mm_cmpeq_epi16(_mm_and_si128(x, high_bit), vmatch);
+	_mm_storeu_si128((__m128i *) (out + i + j * 8), x);
+	acc[j] = _mm_or_si128(acc[j], x);
+      }
+  for (j = 0; j < 3; j++)
+    _mm_storeu_si128((__m128i *) (lanes + j * 8), acc[j]);
+  return channel_mask(lanes, 24, channels) |
+    generic_threshold_8(in + i, out + i, count - i, match, channels);
+}
+
+SSE2_FUNC
+sse2_threshold_16(const unsigned short *in, unsigned short *out,
+		  size_t count, unsigned match, int channels)
+{
+  __m128i high_bit = _mm_set1_epi16((short) 0x8000);
+  __m128i vmatch = _mm_set1_epi16(match);
+  __m128i acc[3];
+  unsigned short lanes[24];
+  size_t i;
+  int j;
+  for (j = 0; j < 3; j++)
+    acc[j] = _mm_setzero_si128();
+  for (i = 0; i + 24 <= count; i += 24)
+    for (j = 0; j < 3; j++)
+      {
+	__m128i x = _mm_loadu_si128((const __m128i *) (in + i + j * 8));
+	x = _mm_cmpeq_epi16(_mm_and_si128(x, high_bit), vmatch);
+	_mm_storeu_si128((__m128i *) (out + i + j * 8), x);
+	acc[j] = _mm_or_si128(acc[j], x);
+      }
+  for (j = 0; j < 3; j++)
+    _mm_storeu_si128((__m128i *) (lanes + j * 8), acc[j]);
+  return channel_mask(lanes, 24, channels) |
+    generic_threshold_16(in + i, out + i, count - i, match, channels);
+}
+
+/*
+ * Two pixels per vector.  SSE2 has no unsigned 16-bit minimum, but
+ * a - (a -sat b) is the same thing.
+ */
+SSE2_FUNC
+sse2_black(unsigned short *kcmy, size_t width)
+{
+  __m128i kmask = _mm_set_epi16(0, 0, 0, -1, 0, 0, 0, -1);
+  __m128i acc = _mm_setzero_si128();
+  unsigned short lanes[8];
+  size_t i;
+  for (i = 0; i + 2 <= width; i += 2)
+    {
+      __m128i x = _mm_loadu_si128((const __m128i *) (kcmy + i * 4));
+      __m128i c = _mm_shufflehi_epi16
+	(_mm_shufflelo_epi16(x, _MM_SHUFFLE(1, 1, 1, 1)),
+	 _MM_SHUFFLE(1, 1, 1, 1));
+      __m128i m = _mm_shufflehi_epi16
+	(_mm_shufflelo_epi16(x, _MM_SHUFFLE(2, 2, 2, 2)),
+	 _MM_SHUFFLE(2, 2, 2, 2));
+      __m128i y = _mm_shufflehi_epi16
+	(_mm_shufflelo_epi16(x, _MM_SHUFFLE(3, 3, 3, 3)),
+	 _MM_SHUFFLE(3, 3, 3, 3));
+      __m128i k = _mm_sub_epi16(m, _mm_subs_epu16(m, y));
+      k = _mm_sub_epi16(c, _mm_subs_epu16(c, k));
+      x = _mm_or_si128(_mm_andnot_si128(kmask, _mm_sub_epi16(x, k)),
+		       _mm_and_si128(kmask, k));
+      _mm_storeu_si128((__m128i *) (kcmy + i * 4), x);
+      acc = _mm_or_si128(acc, x);
+    }
+  _mm_storeu_si128((__m128i *) lanes, acc);
+  return channel_mask(lanes, 8, 4) | generic_black(kcmy + i * 4, width - i);
+}
+
+static const stpi_color_kernels_t sse2_kernels =
+{
+  "sse2",
+  sse2_scale_8,
+  sse2_scale_16,
+  sse2_threshold_8,
+  sse2_threshold_16,
+  sse2_black
+};
+
+/*
+ * AVX2 versions: the same, sixteen samples (four KCMY pixels) at a
+ * time.
+ */
+
+AVX2_FUNC
+avx2_scale_8(const unsigned char *in, unsigned short *out, size_t count,
+	     unsigned scale, unsigned mask, int channels)
+{
+  __m256i vscale = _mm256_set1_epi16(scale);
+  __m256i vmask = _mm256_set1_epi16(mask);
+  __m256i acc[3];
+  unsigned short lanes[48];
+  size_t i;
+  int j;
+  for (j = 0; j < 3; j++)
+    acc[j] = _mm256_setzero_si256();
+  for (i = 0; i + 48 <= count; i += 48)
+    for (j = 0; j < 3; j++)
+      {
+	__m256i x = _mm256_cvtepu8_epi16
+	  (_mm_loadu_si128((const __m128i *) (in + i + j * 16)));
+	x = _mm256_xor_si256(_mm256_mullo_epi16(x, vscale), vmask);
+	_mm256_storeu_si256((__m256i *) (out + i + j * 16), x);
+	acc[j] = _mm256_or_si256(acc[j], x);
+      }
+  for (j = 0; j < 3; j++)
+    _mm256_storeu_si256((__m256i *) (lanes + j * 16), acc[j]);
+  return channel_mask(lanes, 48, channels) |
+    generic_scale_8(in + i, out + i, count - i, scale, mask, channels);
+}
+
+AVX2_FUNC
+avx2_scale_16(const unsigned short *in, unsigned short *out, size_t count,
+	      unsigned scale, unsigned mask, int channels)
+{
+  __m256i vscale = _mm256_set1_epi16(scale);
+  __m256i vmask = _mm256_set1_epi16(mask);
+  __m256i acc[3];
+  unsigned short lanes[48];
+  size_t i;
+  int j;
+  for (j = 0; j < 3; j++)
+    acc[j] = _mm256_setzero_si256();
+  for (i = 0; i + 48 <= count; i += 48)
+    for (j = 0; j < 3; j++)
+      {
+	__m256i x = _mm256_loadu_si256((const __m256i *) (in + i + j * 16));
+	x = _mm256_xor_si256(_mm256_mullo_epi16(x, vscale), vmask);
+	_mm256_storeu_si256((__m256i *) (out + i + j * 16), x);
+	acc[j] = _mm256_or_si256(acc[j], x);
+      }
+  for (j = 0; j < 3; j++)
+    _mm256_storeu_si256((__m256i *) (lanes + j * 16), acc[j]);
+  return channel_mask(lanes, 48, channels) |
+    generic_scale_16(in + i, out + i, count - i, scale, mask, channels);
+}
+
+AVX2_FUNC
+avx2_threshold_8(const unsigned char *in, unsigned short *out, size_t count,
+		 unsigned match, int channels)
+{
+  __m256i high_bit = _mm256_set1_epi16(0x80);
+  __m256i vmatch = _mm256_set1_epi16(match);
+  __m256i acc[3];
+  unsigned short lanes[48];
+  size_t i;
+  int j;
+  for (j = 0; j < 3; j++)
+    acc[j] = _mm256_setzero_si256();
+  for (i = 0; i + 48 <= count; i += 48)
+    for (j = 0; j < 3; j++)
+      {
+	__m256i x = _mm256_cvtepu8_epi16
+	  (_mm_loadu_si128((const __m128i *) (in + i + j * 16)));
+	x = _mm256_cmpeq_epi16(_mm256_and_si256(x, high_bit), vmatch);
+	_mm256_storeu_si256((__m256i *) (out + i + j * 16), x);
+	acc[j] = _mm256_or_si256(acc[j], x);
+      }
+  for (j = 0; j < 3; j++)
+    _mm256_storeu_si256((__m256i *) (lanes + j * 16), acc[j]);
+  return channel_mask(lanes, 48, channels) |
+    generic_threshold_8(in + i, out + i, count - i, match, channels);
+}
+
+AVX2_FUNC
+avx2_threshold_16(const unsigned short *in, unsigned short *out,
+		  size_t count, unsigned match, int channels)
+{
+  __m256i high_bit = _mm256_set1_epi16((short) 0x8000);
+  __m256i vmatch = _mm256_set1_epi16(match);
+  __m256i acc[3];
+  unsigned short lanes[48];
+  size_t i;
+  int j;
+  for (j = 0; j < 3; j++)
+    acc[j] = _mm256_setzero_si256();
+  for (i = 0; i + 48 <= count; i += 48)
+    for (j = 0; j < 3; j++)
+      {
+	__m256i x = _mm256_loadu_si256((const __m256i *) (in + i + j * 16));
+	x = _mm256_cmpeq_epi16(_mm256_and_si256(x, high_bit), vmatch);
+	_mm256_storeu_si256((__m256i *) (out + i + j * 16), x);
+	acc[j] = _mm256_or_si256(acc[j], x);
+      }
+  for (j = 0; j < 3; j++)
+    _mm256_storeu_si256((__m256i *) (lanes + j * 16), acc[j]);
+  return channel_mask(lanes, 48, channels) |
+    generic_threshold_16(in + i, out + i, count - i, match, channels);
+}
+
+AVX2_FUNC
+avx2_black(unsigned short *kcmy, size_t width)
+{
+  __m256i acc = _mm256_setzero_si256();
+  unsigned short lanes[16];
+  size_t i;
+  for (i = 0; i + 4 <= width; i += 4)
+    {
+      __m256i x = _mm256_loadu_si256((const __m256i *) (kcmy + i * 4));
+      __m256i c = _mm256_shufflehi_epi16
+	(_mm256_shufflelo_epi16(x, _MM_SHUFFLE(1, 1, 1, 1)),
+	 _MM_SHUFFLE(1, 1, 1, 1));
+      __m256i m = _mm256_shufflehi_epi16
+	(_mm256_shufflelo_epi16(x, _MM_SHUFFLE(2, 2, 2, 2)),
+	 _MM_SHUFFLE(2, 2, 2, 2));
+      __m256i y = _mm256_shufflehi_epi16
+	(_mm256_shufflelo_epi16(x, _MM_SHUFFLE(3, 3, 3, 3)),
+	 _MM_SHUFFLE(3, 3, 3, 3));
+      __m256i k = _mm256_min_epu16(c, _mm256_min_epu16(m, y));
+      x = _mm256_blend_epi16(_mm256_sub_epi16(x, k), k, 0x11);
+      _mm256_storeu_si256((__m256i *) (kcmy + i * 4), x);
+      acc = _mm256_or_si256(acc, x);
+    }
+  _mm256_storeu_si256((__m256i *) lanes, acc);
+  return channel_mask(lanes, 16, 4) | generic_black(kcmy + i * 4, width - i);
+}
+
+static const stpi_color_kernels_t avx2_kernels =
+{
+  "avx2",
+  avx2_scale_8,
+  avx2_scale_16,
+  avx2_threshold_8,
+  avx2_threshold_16,
+  avx2_black
+};
+
+#endif /* X86_KERNELS */
+
+const stpi_color_kernels_t *stpi_color_kernels = &generic_kernels;
+
+void
+stpi_init_color_kernels(void)
+{
+  stpi_color_kernels = &generic_kernels;
+#ifdef X86_KERNELS
+  switch (stpi_kernel_level())
+    {
+    case STPI_KERNEL_AVX2:
+      stpi_color_kernels = &avx2_kernels;
+      break;
+    case STPI_KERNEL_SSE2:
+      stpi_color_kernels = &sse2_kernels;
+      break;
+    default:
+      break;
+    }
+#endif
+  stp_deprintf(STP_DBG_COLORFUNC, "Color kernels: %s\n",
+	       stpi_color_kernels->name);
+}
@@ -36,6 +36,9 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <strings.h>
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
 
 #ifdef __GNUC__
 #define inline __inline__
@@ -54,6 +57,22 @@ do						\
     STPI_ASSERT((curve)->seq != NULL, NULL);	\
   } while (0)
 
+/*
+ * Curves may be read by several threads at once (as parameters shared
+ * between copies of a vars object, for example), so the deltas, which
+ * are only computed when first needed, are computed under the curve's
+ * own lock.  Once they are there, they are read without the lock.
+ */
+#ifdef HAVE_PTHREAD_H
+#define LOCK_CURVE(c)							\
+  pthread_mutex_lock(&(((stp_curve_t *) stpi_cast_safe(c))->lock))
+#define UNLOCK_CURVE(c)							\
+  pthread_mutex_unlock(&(((stp_curve_t *) stpi_cast_safe(c))->lock))
+#else
+#define LOCK_CURVE(c) do {} while (0)
+#define UNLOCK_CURVE(c) do {} while (0)
+#endif
+
 static const int curve_point_limit = 1048576;
 
 struct stp_curve
@@ -66,7 +85,9 @@ struct stp_curve
   stp_sequence_t *seq;          /* Sequence (contains the curve data) */
   double *interval;		/* We allocate an extra slot for the
 				   wrap-around value. */
-
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_t lock;		/* Held while computing the deltas */
+#endif
 };
 
 static const char *const stpi_curve_type_names[] =
@@ -363,7 +384,22 @@ compute_intervals(stp_curve_t *curve)
 	  break;
 	}
     }
-  curve->recompute_interval = 0;
+  STPI_STORE_RELEASE(&(curve->recompute_interval), 0);
+}
+
+/*
+ * Compute the deltas of a curve that is only being read.
+ */
+static void
+update_intervals(const stp_curve_t *curve)
+{
+  if (STPI_LOAD_ACQUIRE(&(curve->recompute_interval), 1))
+    {
+      LOCK_CURVE(curve);
+      if (curve->recompute_interval)
+	compute_intervals(stpi_cast_safe(curve));
+      UNLOCK_CURVE(curve);
+    }
 }
 
 static int
@@ -410,6 +446,9 @@ stpi_curve_set_data(stp_curve_t *curve, size_t points, const double *data)
 static void
 stpi_curve_ctor(stp_curve_t *curve, stp_curve_wrap_mode_t wrap_mode)
 {
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_init(&(curve->lock), NULL);
+#endif
   curve->seq = stp_sequence_create();
   stp_sequence_set_bounds(curve->seq, 0.0, 1.0);
   curve->curve_type = STP_CURVE_TYPE_LINEAR;
@@ -434,13 +473,27 @@ stp_curve_create(stp_curve_wrap_mode_t wrap_mode)
   return ret;
 }
 
+/*
+ * Free the data of a curve that is about to be replaced, keeping the
+ * curve itself (and its lock).
+ */
 static void
-curve_dtor(stp_curve_t *curve)
+curve_clear(stp_curve_t *curve)
 {
   CHECK_CURVE(curve);
   clear_curve_data(curve);
   if (curve->seq)
     stp_sequence_destroy(curve->seq);
+  curve->seq = NULL;
+}
+
+static void
+curve_dtor(stp_curve_t *curve)
+{
+  curve_clear(curve);
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_destroy(&(curve->lock));
+#endif
   memset(curve, 0, sizeof(stp_curve_t));
   curve->curve_type = -1;
 }
@@ -457,7 +510,7 @@ stp_curve_copy(stp_curve_t *dest, const stp_curve_t *source)
 {
   CHECK_CURVE(dest);
   CHECK_CURVE(source);
-  curve_dtor(dest);
+  curve_clear(dest);
   dest->curve_type = source->curve_type;
   dest->wrap_mode = source->wrap_mode;
   dest->gamma = source->gamma;
@@ -481,7 +534,7 @@ stp_curve_reverse(stp_curve_t *dest, const stp_curve_t *source)
 {
   CHECK_CURVE(dest);
   CHECK_CURVE(source);
-  curve_dtor(dest);
+  curve_clear(dest);
   dest->curve_type = source->curve_type;
   dest->wrap_mode = source->wrap_mode;
   dest->gamma = source->gamma;
@@ -1093,8 +1146,7 @@ interpolate_point_internal(const stp_curve_t *curve, double where)
 	return HUGE_VAL; /* Infinity */
       return val;
     }
-  if (curve->recompute_interval)
-    compute_intervals((stpi_cast_safe(curve)));
+  update_intervals(curve);
   if (curve->curve_type == STP_CURVE_TYPE_LINEAR)
     {
       double val;
@@ -1152,6 +1204,36 @@ stp_curve_interpolate_value(const stp_curve_t *curve, double where,
   return 1;
 }
 
+/*
+ * Resampling to a large number of points is expensive enough to be
+ * worth keeping in the lookup table cache.
+ */
+static const size_t curve_cache_min_points = 4096;
+
+static stpi_lut_cache_key_t *
+resample_cache_key(const stp_curve_t *curve, size_t points)
+{
+  stpi_lut_cache_key_t *key = stpi_lut_cache_key_create("curve");
+  const double *data;
+  size_t count;
+  double bounds[2];
+  int type[3];
+  if (!key)
+    return NULL;
+  type[0] = curve->curve_type;
+  type[1] = curve->wrap_mode;
+  type[2] = curve->piecewise;
+  stp_sequence_get_bounds(curve->seq, &bounds[0], &bounds[1]);
+  stp_sequence_get_data(curve->seq, &count, &data);
+  stpi_lut_cache_key_add(key, type, sizeof(type));
+  stpi_lut_cache_key_add(key, &(curve->gamma), sizeof(curve->gamma));
+  stpi_lut_cache_key_add(key, bounds, sizeof(bounds));
+  stpi_lut_cache_key_add(key, &points, sizeof(points));
+  stpi_lut_cache_key_add(key, &count, sizeof(count));
+  stpi_lut_cache_key_add(key, data, sizeof(double) * count);
+  return key;
+}
+
 int
 stp_curve_resample(stp_curve_t *curve, size_t points)
 {
@@ -1159,6 +1241,7 @@ stp_curve_resample(stp_curve_t *curve, size_t points)
   size_t old;
   size_t i;
   double *new_vec;
+  stpi_lut_cache_key_t *key = NULL;
 
   CHECK_CURVE(curve);
 
@@ -1178,6 +1261,22 @@ stp_curve_resample(stp_curve_t *curve, size_t points)
   if (!old)
     old = 1;
 
+  if (limit >= curve_cache_min_points)
+    {
+      stpi_lut_cache_entry_t *entry;
+      key = resample_cache_key(curve, points);
+      entry = stpi_lut_cache_lookup(key, sizeof(double) * limit);
+      if (entry)
+	{
+	  curve->piecewise = 0;
+	  stpi_curve_set_data(curve, points, stpi_lut_cache_entry_data(entry));
+	  curve->recompute_interval = 1;
+	  stpi_lut_cache_entry_release(entry);
+	  stpi_lut_cache_key_destroy(key);
+	  return 1;
+	}
+    }
+
   new_vec = stp_malloc(sizeof(double) * limit);
 
   /*
@@ -1201,6 +1300,7 @@ stp_curve_resample(stp_curve_t *curve, size_t points)
 	  double x_delta;
 	  if (!stp_sequence_get_point(curve->seq, i * 2, &low))
 	    {
+	      stpi_lut_cache_key_destroy(key);
 	      stp_free(new_vec);
 	      return 0;
 	    }
@@ -1208,16 +1308,19 @@ stp_curve_resample(stp_curve_t *curve, size_t points)
 	    high = 1.0;
 	  else if (!stp_sequence_get_point(curve->seq, ((i + 1) * 2), &high))
 	    {
+	      stpi_lut_cache_key_destroy(key);
 	      stp_free(new_vec);
 	      return 0;
 	    }
 	  if (!stp_sequence_get_point(curve->seq, (i * 2) + 1, &low_y))
 	    {
+	      stpi_lut_cache_key_destroy(key);
 	      stp_free(new_vec);
 	      return 0;
 	    }
 	  if (!stp_sequence_get_point(curve->seq, ((i + 1) * 2) + 1, &high_y))
 	    {
+	      stpi_lut_cache_key_destroy(key);
 	      stp_free(new_vec);
 	      return 0;
 	    }
@@ -1277,8 +1380,8 @@ stp_curve_resample(stp_curve_t *curve, size_t points)
       size_t point_count = get_point_count(curve);
       stp_sequence_get_data(curve->seq, &seq_count, &seq_data);
       stp_sequence_get_bounds(curve->seq, &blo, &bhi);
-	if (curve->recompute_interval)
-	  compute_intervals((stpi_cast_safe(curve)));
+      if (curve->recompute_interval)
+	compute_intervals(curve);
       for (i = 0; i < limit; i++)
 	{
 	  double where = ((double) i * (double) old / (double) (limit - 1));
@@ -1304,6 +1407,8 @@ stp_curve_resample(stp_curve_t *curve, size_t points)
 	    }
 	}
     }
+  stpi_lut_cache_store(key, new_vec, sizeof(double) * limit);
+  stpi_lut_cache_key_destroy(key);
   stpi_curve_set_data(curve, points, new_vec);
   curve->recompute_interval = 1;
   stp_free(new_vec);
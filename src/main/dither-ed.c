@@ -396,55 +396,47 @@ shared_ed_deinitializer(stpi_dither_t *d,
   STP_SAFE_FREE(ndither);
 }
 
-void
-stpi_dither_ed(stp_vars_t *v,
-	       int row,
-	       const unsigned short *raw,
-	       int duplicate_line,
-	       int zero_mask,
-	       const unsigned char *mask)
+/*
+ * Dither channels [first_channel, channel_limit) of one row.  Each
+ * channel only ever reads and writes its own error rows and state, so
+ * the channels may be dithered in any order, or in parallel.
+ */
+static void
+dither_ed_channels(stpi_dither_t *d,
+		   int row,
+		   const unsigned short *raw,
+		   const unsigned char *mask,
+		   int direction,
+		   int ***error,
+		   int *ndither,
+		   int first_channel,
+		   int channel_limit)
 {
-  stpi_dither_t *d = (stpi_dither_t *) stp_get_component_data(v, "Dither");
   int		x,
     		length;
   unsigned char	bit;
-  int		i;
-  int		*ndither;
-  int		***error;
-
+  int		i, j;
   int		terminate;
-  int		direction = row & 1 ? 1 : -1;
   int xerror, xstep, xmod;
 
   length = (d->dst_width + 7) / 8;
-  if (d->stpi_dither_type & D_ADAPTIVE_BASE)
-    for (i = 0; i < CHANNEL_COUNT(d); i++)
-      if (CHANNEL(d, i).nlevels > 1)
-	{
-	  stpi_dither_ordered(v, row, raw, duplicate_line, zero_mask, mask);
-	  return;
-	}
-  if (!shared_ed_initializer(d, row, duplicate_line, zero_mask, length,
-			     direction, &error, &ndither))
-    return;
-
   x = (direction == 1) ? 0 : d->dst_width - 1;
   bit = 1 << (7 - (x & 7));
-  xstep  = CHANNEL_COUNT(d) * (d->src_width / d->dst_width);
+  xstep  = INPUT_STEP(d) * (d->src_width / d->dst_width);
   xmod   = d->src_width % d->dst_width;
   xerror = (xmod * x) % d->dst_width;
   terminate = (direction == 1) ? d->dst_width : -1;
 
   if (direction == -1)
-    raw += (CHANNEL_COUNT(d) * (d->src_width - 1));
+    raw += (INPUT_STEP(d) * (d->src_width - 1));
 
   for (; x != terminate; x += direction)
     {
-      for (i = 0; i < CHANNEL_COUNT(d); i++)
+      for (i = first_channel; i < channel_limit; i++)
 	{
 	  if (CHANNEL(d, i).ptr)
 	    {
-	      CHANNEL(d, i).v = raw[i];
+	      CHANNEL(d, i).v = raw[INPUT_CHANNEL(d, i)];
 	      CHANNEL(d, i).o = CHANNEL(d, i).v;
 	      CHANNEL(d, i).b = CHANNEL(d, i).v;
 	      CHANNEL(d, i).v = UPDATE_COLOR(CHANNEL(d, i).v, ndither[i]);
@@ -455,9 +447,91 @@ stpi_dither_ed(stp_vars_t *v,
 					 direction, error[i][0], error[i][1]);
 	    }
 	}
-      ADVANCE_BIDIRECTIONAL(d, bit, raw, direction, CHANNEL_COUNT(d), xerror,
-			    xstep, xmod, error, d->error_rows);
+      for (i = first_channel; i < channel_limit; i++)
+	for (j = 0; j < d->error_rows; j++)
+	  error[i][j] += direction;
+      if (direction == 1)
+	ADVANCE_UNIDIRECTIONAL(d, bit, raw, INPUT_STEP(d), xerror,
+			       xstep, xmod);
+      else
+	ADVANCE_REVERSE(d, bit, raw, INPUT_STEP(d), xerror, xstep, xmod);
+    }
+}
+
+typedef struct
+{
+  stpi_dither_t *d;
+  int row;
+  const unsigned short *raw;
+  const unsigned char *mask;
+  int direction;
+  int ***error;
+  int *ndither;
+  const int *channels;
+} stpi_ed_job_t;
+
+static void
+dither_ed_job(void *data, int job)
+{
+  const stpi_ed_job_t *j = (const stpi_ed_job_t *) data;
+  stpi_dither_t d = *(j->d);	/* Private output position */
+  int channel = j->channels[job];
+  dither_ed_channels(&d, j->row, j->raw, j->mask, j->direction, j->error,
+		     j->ndither, channel, channel + 1);
+}
+
+void
+stpi_dither_ed(stp_vars_t *v,
+	       int row,
+	       const unsigned short *raw,
+	       int duplicate_line,
+	       int zero_mask,
+	       const unsigned char *mask)
+{
+  stpi_dither_t *d =
+    (stpi_dither_t *) stpi_get_component(v, STPI_COMPONENT_DITHER);
+  int		length;
+  int		i;
+  int		*ndither;
+  int		***error;
+  int		direction = row & 1 ? 1 : -1;
+  stpi_thread_pool_t *pool;
+
+  length = (d->dst_width + 7) / 8;
+  if (d->stpi_dither_type & D_ADAPTIVE_BASE)
+    for (i = 0; i < CHANNEL_COUNT(d); i++)
+      if (CHANNEL(d, i).nlevels > 1)
+	{
+	  stpi_dither_ordered(v, row, raw, duplicate_line, zero_mask, mask);
+	  return;
+	}
+  if (!shared_ed_initializer(d, row, duplicate_line, zero_mask, length,
+			     direction, &error, &ndither))
+    return;
+
+  pool = stpi_dither_get_thread_pool(d);
+  if (pool)
+    {
+      stpi_ed_job_t job;
+      int *channels = stp_malloc(CHANNEL_COUNT(d) * sizeof(int));
+      int channel_count = 0;
+      for (i = 0; i < CHANNEL_COUNT(d); i++)
+	if (CHANNEL(d, i).ptr)
+	  channels[channel_count++] = i;
+      job.d = d;
+      job.row = row;
+      job.raw = raw;
+      job.mask = mask;
+      job.direction = direction;
+      job.error = error;
+      job.ndither = ndither;
+      job.channels = channels;
+      stpi_thread_pool_run(pool, channel_count, dither_ed_job, &job);
+      stp_free(channels);
     }
+  else
+    dither_ed_channels(d, row, raw, mask, direction, error, ndither,
+		       0, CHANNEL_COUNT(d));
   shared_ed_deinitializer(d, error, ndither);
   if (direction == -1)
     stpi_dither_reverse_row_ends(d);
@@ -55,6 +55,7 @@ typedef struct
   stpi_dither_channel_t *dummy_channel;
   double transition;		/* Exponential scaling for transition region */
   stp_dither_matrix_impl_t transition_matrix;
+  int *point_errors;		/* Used by the multi-threaded dither */
 } eventone_t;
 
 typedef struct shade_segment
@@ -77,27 +78,16 @@ free_eventone_data(stpi_dither_t *d)
 {
   int i;
   eventone_t *et = (eventone_t *) (d->aux_data);
+  /*
+   * The eventone state and the error rows come from the dither's
+   * arena, and are freed with it.
+   */
   for (i = 0; i < CHANNEL_COUNT(d); i++)
-    {
-      if (CHANNEL(d, i).aux_data)
-	{
-	  shade_distance_t *shade = (shade_distance_t *) CHANNEL(d,i).aux_data;
-	  STP_SAFE_FREE(shade->et_dis);
-	  STP_SAFE_FREE(CHANNEL(d, i).aux_data);
-	}
-    }
+    CHANNEL(d, i).aux_data = NULL;
   if (et->dummy_channel)
-    {
-      stpi_dither_channel_t *dc = et->dummy_channel;
-      shade_distance_t *shade = (shade_distance_t *) dc->aux_data;
-      STP_SAFE_FREE(shade->et_dis);
-      STP_SAFE_FREE(dc->aux_data);
-      stpi_dither_channel_destroy(dc);
-      STP_SAFE_FREE(et->dummy_channel);
-    }
+    stpi_dither_channel_destroy(et->dummy_channel);
   if (d->stpi_dither_type & D_UNITONE)
     stp_dither_matrix_destroy(&(et->transition_matrix));
-  STP_SAFE_FREE(et);
 }
 
 static void
@@ -105,18 +95,20 @@ et_setup(stpi_dither_t *d)
 {
   int size = 2 * MAX_SPREAD + ((d->dst_width + 7) & ~7);
   static const int diff_factors[] = {1, 10, 16, 23, 32};
-  eventone_t *et = stp_zalloc(sizeof(eventone_t));
+  eventone_t *et = stpi_arena_zalloc(d->arena, sizeof(eventone_t));
   int xa, ya;
   int i;
   for (i = 0; i < CHANNEL_COUNT(d); i++)
     {
       CHANNEL(d, i).error_rows = 1;
-      CHANNEL(d, i).errs = stp_zalloc(1 * sizeof(int *));
-      CHANNEL(d, i).errs[0] = stp_zalloc(size * sizeof(int));
+      CHANNEL(d, i).errs = stpi_arena_zalloc(d->arena, 1 * sizeof(int *));
+      CHANNEL(d, i).errs[0] =
+	stpi_arena_zalloc(d->arena, size * sizeof(int));
     }
   if (d->stpi_dither_type & D_UNITONE)
     {
-      stpi_dither_channel_t *dc = stp_zalloc(sizeof(stpi_dither_channel_t));
+      stpi_dither_channel_t *dc =
+	stpi_arena_zalloc(d->arena, sizeof(stpi_dither_channel_t));
       stp_dither_matrix_clone(&(d->dither_matrix), &(dc->dithermat), 0, 0);
       et->transition = 0.7;
       stp_dither_matrix_destroy(&(et->transition_matrix));
@@ -124,8 +116,8 @@ et_setup(stpi_dither_t *d)
       stp_dither_matrix_scale_exponentially(&(et->transition_matrix), et->transition);
       stp_dither_matrix_clone(&(et->transition_matrix), &(dc->pick), 0, 0);
       dc->error_rows = 1;
-      dc->errs = stp_zalloc(1 * sizeof(int *));
-      dc->errs[0] = stp_zalloc(size * sizeof(int));
+      dc->errs = stpi_arena_zalloc(d->arena, 1 * sizeof(int *));
+      dc->errs[0] = stpi_arena_zalloc(d->arena, size * sizeof(int));
       et->dummy_channel = dc;
     }
 
@@ -148,9 +140,11 @@ et_setup(stpi_dither_t *d)
   for (i = 0; i < CHANNEL_COUNT(d); i++)
     {
       int x;
-      shade_distance_t *shade = stp_zalloc(sizeof(shade_distance_t));
+      shade_distance_t *shade =
+	stpi_arena_zalloc(d->arena, sizeof(shade_distance_t));
       shade->dis = et->d_sq;
-      shade->et_dis = stp_malloc(sizeof(distance_t) * d->dst_width);
+      shade->et_dis =
+	stpi_arena_alloc(d->arena, sizeof(distance_t) * d->dst_width);
       if (CHANNEL(d, i).darkness > .1)
 	shade->share_this_channel = 1;
       else
@@ -162,9 +156,11 @@ et_setup(stpi_dither_t *d)
   if (et->dummy_channel)
     {
       int x;
-      shade_distance_t *shade = stp_zalloc(sizeof(shade_distance_t));
+      shade_distance_t *shade =
+	stpi_arena_zalloc(d->arena, sizeof(shade_distance_t));
       shade->dis = et->d_sq;
-      shade->et_dis = stp_malloc(sizeof(distance_t) * d->dst_width);
+      shade->et_dis =
+	stpi_arena_alloc(d->arena, sizeof(distance_t) * d->dst_width);
       for (x = 0; x < d->dst_width; x++)
 	shade->et_dis[x] = et->d_sq;
       et->dummy_channel->aux_data = shade;
@@ -396,6 +392,209 @@ print_ink(stpi_dither_t *d, unsigned char *tptr, const stpi_ink_defn_t *ink,
     }
 }
 
+/*
+ * Dither one pixel of one channel.  point_error carries the error of the
+ * channels already dithered at this pixel; it's the only thing that
+ * links the channels together.
+ */
+static inline void
+et_dither_pixel(stpi_dither_t *d, eventone_t *et, stpi_dither_channel_t *dc,
+		unsigned inkval, int x, int direction, unsigned char bit,
+		int length, const unsigned char *mask, int comparison,
+		int *point_error)
+{
+  int inkspot;
+  int range_point;
+  shade_distance_t *sp = (shade_distance_t *) dc->aux_data;
+  stpi_ink_defn_t *inkp;
+  stpi_ink_defn_t lower, upper;
+
+  advance_eventone_pre(sp, et, x);
+
+  /*
+   * Find which are the two candidate dot sizes.
+   * Rather than use the absolute value of the point to compute
+   * the error, we will use the relative value of the point within
+   * the range to find the two candidate dot sizes.
+   */
+  range_point = find_segment_and_ditherpoint(dc, inkval, &lower, &upper);
+
+  /* Incorporate error data from previous line */
+  dc->v += 2 * range_point + (dc->errs[0][x + MAX_SPREAD] + 8) / 16;
+  inkspot = dc->v - range_point;
+
+  *point_error += eventone_adjust(dc, et, inkspot, range_point);
+
+  /* Determine whether to print the larger or smaller dot */
+  inkp = &lower;
+  if (*point_error >= comparison)
+    {
+      *point_error -= 65535;
+      inkp = &upper;
+      dc->v -= 131070;
+      sp->dis = et->d_sq;
+    }
+
+  /* Adjust the error to reflect the dot choice */
+  if (inkp->bits)
+    {
+      if (!mask || (*(mask + d->ptr_offset) & bit))
+	{
+	  set_row_ends(dc, x);
+
+	  /* Do the printing */
+	  print_ink(d, dc->ptr, inkp, bit, length);
+	}
+    }
+
+  /* Spread the error around to the adjacent dots */
+  eventone_update(dc, et, x, direction);
+  diffuse_error(dc, et, x, direction);
+}
+
+/*
+ * Multi-threaded EvenTone.  Each channel of a pixel depends on the same
+ * channel at the previous pixel (through its error and distance state)
+ * and on the previous channel at the same pixel (through point_error).
+ * The row is cut into blocks, and the pool dithers the (channel, block)
+ * pairs as a wavefront: pairs on the same anti-diagonal are
+ * independent, and each diagonal only needs the one before it.
+ */
+
+#define ET_MIN_BLOCK_WIDTH (256)
+
+typedef struct
+{
+  int step;			/* Pixels into the row, in scan order */
+  int x;
+  int ptr_offset;
+  unsigned char bit;
+  int xerror;
+  const unsigned short *raw;
+} et_block_t;
+
+typedef struct
+{
+  stpi_dither_t *d;
+  eventone_t *et;
+  const unsigned char *mask;
+  int direction;
+  int length;
+  const int *channels;
+  int channel_count;
+  const et_block_t *blocks;
+  int block_count;
+  int *point_errors;		/* Per pixel, carried between channels */
+  int diagonal;
+  int first_channel;		/* First channel on this diagonal */
+} et_wavefront_t;
+
+static void
+et_dither_block(void *data, int job)
+{
+  const et_wavefront_t *wf = (const et_wavefront_t *) data;
+  stpi_dither_t dither = *(wf->d);	/* Private output position and matrix */
+  stpi_dither_t *d = &dither;
+  int c = wf->first_channel + job;
+  int channel = wf->channels[c];
+  stpi_dither_channel_t *dc = &CHANNEL(d, channel);
+  const et_block_t *block = &(wf->blocks[wf->diagonal - c]);
+  int steps = block[1].step - block->step;
+  int x = block->x;
+  unsigned char bit = block->bit;
+  int xerror = block->xerror;
+  const unsigned short *raw = block->raw;
+  int channel_count = CHANNEL_COUNT(d);
+  int xstep  = channel_count * (d->src_width / d->dst_width);
+  int xmod   = d->src_width % d->dst_width;
+  int i;
+
+  d->ptr_offset = block->ptr_offset;
+  for (i = 0; i < steps; i++, x += wf->direction)
+    {
+      int point_error = c == 0 ? 0 : wf->point_errors[x];
+      int comparison = 32768;
+
+      if (d->stpi_dither_type & D_ORDERED_BASE)
+	comparison += (ditherpoint(d, &(d->dither_matrix), x) / 16) - 2048;
+      et_dither_pixel(d, wf->et, dc, raw[channel], x, wf->direction, bit,
+		      wf->length, wf->mask, comparison, &point_error);
+      wf->point_errors[x] = point_error;
+      if (wf->direction == 1)
+	ADVANCE_UNIDIRECTIONAL(d, bit, raw, channel_count, xerror, xstep, xmod);
+      else
+	ADVANCE_REVERSE(d, bit, raw, channel_count, xerror, xstep, xmod);
+    }
+}
+
+static void
+et_dither_wavefront(stpi_dither_t *d, eventone_t *et, stpi_thread_pool_t *pool,
+		    const unsigned short *raw, const unsigned char *mask,
+		    int x, int direction, int length,
+		    const int *channels, int channel_count, int block_count)
+{
+  et_block_t *blocks = stp_malloc(sizeof(et_block_t) * (block_count + 1));
+  et_wavefront_t wf;
+  stpi_dither_t dither = *d;
+  unsigned char bit = 1 << (7 - (x & 7));
+  int xstep  = CHANNEL_COUNT(d) * (d->src_width / d->dst_width);
+  int xmod   = d->src_width % d->dst_width;
+  int xerror = (xmod * x) % d->dst_width;
+  int block = 0;
+  int step;
+
+  /*
+   * Find where each block starts by walking the row the same way the
+   * dither does.
+   */
+  for (step = 0; step < d->dst_width; step++, x += direction)
+    {
+      if (step == (long) d->dst_width * block / block_count)
+	{
+	  blocks[block].step = step;
+	  blocks[block].x = x;
+	  blocks[block].ptr_offset = dither.ptr_offset;
+	  blocks[block].bit = bit;
+	  blocks[block].xerror = xerror;
+	  blocks[block].raw = raw;
+	  block++;
+	}
+      if (direction == 1)
+	ADVANCE_UNIDIRECTIONAL((&dither), bit, raw, CHANNEL_COUNT(d),
+			       xerror, xstep, xmod);
+      else
+	ADVANCE_REVERSE((&dither), bit, raw, CHANNEL_COUNT(d),
+			xerror, xstep, xmod);
+    }
+  blocks[block_count].step = d->dst_width;
+
+  if (!et->point_errors)
+    et->point_errors = stpi_arena_alloc(d->arena, sizeof(int) * d->dst_width);
+  wf.d = d;
+  wf.et = et;
+  wf.mask = mask;
+  wf.direction = direction;
+  wf.length = length;
+  wf.channels = channels;
+  wf.channel_count = channel_count;
+  wf.blocks = blocks;
+  wf.block_count = block_count;
+  wf.point_errors = et->point_errors;
+  for (wf.diagonal = 0; wf.diagonal < channel_count + block_count - 1;
+       wf.diagonal++)
+    {
+      int last_channel = wf.diagonal;
+      wf.first_channel = wf.diagonal - block_count + 1;
+      if (wf.first_channel < 0)
+	wf.first_channel = 0;
+      if (last_channel > channel_count - 1)
+	last_channel = channel_count - 1;
+      stpi_thread_pool_run(pool, last_channel - wf.first_channel + 1,
+			   et_dither_block, &wf);
+    }
+  stp_free(blocks);
+}
+
 void
 stpi_dither_et(stp_vars_t *v,
 	       int row,
@@ -404,7 +603,8 @@ stpi_dither_et(stp_vars_t *v,
 	       int zero_mask,
 	       const unsigned char *mask)
 {
-  stpi_dither_t *d = (stpi_dither_t *) stp_get_component_data(v, "Dither");
+  stpi_dither_t *d =
+    (stpi_dither_t *) stpi_get_component(v, STPI_COMPONENT_DITHER);
   eventone_t *et;
 
   int		x;
@@ -416,6 +616,7 @@ stpi_dither_et(stp_vars_t *v,
   int		direction;
   int		xerror, xstep, xmod;
   int		channel_count = CHANNEL_COUNT(d);
+  stpi_thread_pool_t *pool;
 
   if (!et_initializer(d, duplicate_line, zero_mask))
     return;
@@ -441,6 +642,30 @@ stpi_dither_et(stp_vars_t *v,
       d->ptr_offset = length - 1;
       raw += channel_count * (d->src_width - 1);
     }
+
+  pool = stpi_dither_get_thread_pool(d);
+  if (pool && d->dst_width >= 2 * ET_MIN_BLOCK_WIDTH)
+    {
+      int *channels = stp_malloc(channel_count * sizeof(int));
+      int active_channels = 0;
+      int block_count = 2 * stpi_thread_pool_size(pool);
+      if (block_count > d->dst_width / ET_MIN_BLOCK_WIDTH)
+	block_count = d->dst_width / ET_MIN_BLOCK_WIDTH;
+      for (i = 0; i < channel_count; i++)
+	if (CHANNEL(d, i).ptr)
+	  channels[active_channels++] = i;
+      if (active_channels > 1)
+	{
+	  et_dither_wavefront(d, et, pool, raw, mask, x, direction, length,
+			      channels, active_channels, block_count);
+	  stp_free(channels);
+	  if (direction == -1)
+	    stpi_dither_reverse_row_ends(d);
+	  return;
+	}
+      stp_free(channels);
+    }
+
   bit = 1 << (7 - (x & 7));
   xstep  = channel_count * (d->src_width / d->dst_width);
   xmod   = d->src_width % d->dst_width;
@@ -458,57 +683,8 @@ stpi_dither_et(stp_vars_t *v,
       for (i=0; i < channel_count; i++)
 	{
 	  if (CHANNEL(d, i).ptr)
-	    {
-	      int inkspot;
-	      int range_point;
-	      stpi_dither_channel_t *dc = &CHANNEL(d, i);
-	      shade_distance_t *sp = (shade_distance_t *) dc->aux_data;
-	      stpi_ink_defn_t *inkp;
-	      stpi_ink_defn_t lower, upper;
-
-	      advance_eventone_pre(sp, et, x);
-
-	      /*
-	       * Find which are the two candidate dot sizes.
-	       * Rather than use the absolute value of the point to compute
-	       * the error, we will use the relative value of the point within
-	       * the range to find the two candidate dot sizes.
-	       */
-	      range_point =
-		find_segment_and_ditherpoint(dc, raw[i], &lower, &upper);
-
-	      /* Incorporate error data from previous line */
-	      dc->v += 2 * range_point + (dc->errs[0][x + MAX_SPREAD] + 8) / 16;
-	      inkspot = dc->v - range_point;
-
-	      point_error += eventone_adjust(dc, et, inkspot, range_point);
-
-	      /* Determine whether to print the larger or smaller dot */
-	      inkp = &lower;
-	      if (point_error >= comparison)
-		{
-		  point_error -= 65535;
-		  inkp = &upper;
-		  dc->v -= 131070;
-		  sp->dis = et->d_sq;
-		}
-
-	      /* Adjust the error to reflect the dot choice */
-	      if (inkp->bits)
-		{
-		  if (!mask || (*(mask + d->ptr_offset) & bit))
-		    {
-		      set_row_ends(dc, x);
-
-		      /* Do the printing */
-		      print_ink(d, dc->ptr, inkp, bit, length);
-		    }
-		}
-
-	      /* Spread the error around to the adjacent dots */
-	      eventone_update(dc, et, x, direction);
-	      diffuse_error(dc, et, x, direction);
-	    }
+	    et_dither_pixel(d, et, &CHANNEL(d, i), raw[i], x, direction, bit,
+			    length, mask, comparison, &point_error);
 	}
       if (direction == 1)
 	ADVANCE_UNIDIRECTIONAL(d, bit, raw, channel_count, xerror, xstep, xmod);
@@ -527,7 +703,8 @@ stpi_dither_ut(stp_vars_t *v,
 	       int zero_mask,
 	       const unsigned char *mask)
 {
-  stpi_dither_t *d = (stpi_dither_t *) stp_get_component_data(v, "Dither");
+  stpi_dither_t *d =
+    (stpi_dither_t *) stpi_get_component(v, STPI_COMPONENT_DITHER);
   eventone_t *et;
 
   int		x;
@@ -173,11 +173,39 @@ typedef struct dither
   stpi_ditherfunc_t *ditherfunc;
   void *aux_data;
   void (*aux_freefunc)(struct dither *);
+
+  int thread_count;		/* Threads allowed for dithering */
+  stpi_thread_pool_t *thread_pool;
+  int band_count;
+  struct dither_band *bands;
+  stpi_arena_t *arena;		/* Error rows and other per-page buffers */
+  int planar;			/* Algorithm accepts planar input */
+  size_t plane_stride;		/* Current row is planar, with channels */
+				/* this far apart; 0 if interleaved */
+  unsigned empty_planes;	/* Planar channels that are all zero */
 } stpi_dither_t;
 
+/*
+ * Dither the columns [x_start, x_end) of one row.  raw points to the
+ * input pixel for x_start, and xerror is the horizontal scaling error
+ * accumulated by the time x_start is reached.  d->ptr_offset has been
+ * set to the output byte for x_start.
+ */
+typedef void stpi_dither_bandfunc_t(stpi_dither_t *d, int row,
+				    const unsigned short *raw,
+				    const unsigned char *mask,
+				    int x_start, int x_end, int xerror);
+
 #define CHANNEL(d, c) ((d)->channel[(c)])
 #define CHANNEL_COUNT(d) ((d)->total_channel_count)
 
+/*
+ * Distance between successive input pixels of one channel, and offset
+ * of the first input pixel of channel c, for either input layout.
+ */
+#define INPUT_STEP(d) ((d)->plane_stride ? 1 : CHANNEL_COUNT(d))
+#define INPUT_CHANNEL(d, c) ((d)->plane_stride ? (c) * (d)->plane_stride : (c))
+
 #define USMIN(a, b) ((a) < (b) ? (a) : (b))
 
 
@@ -189,6 +217,11 @@ extern stpi_ditherfunc_t stpi_dither_et;
 extern stpi_ditherfunc_t stpi_dither_ut;
 
 extern void stpi_dither_reverse_row_ends(stpi_dither_t *d);
+extern stpi_thread_pool_t *stpi_dither_get_thread_pool(stpi_dither_t *d);
+extern void stpi_dither_bands(stpi_dither_t *d, int row,
+			      const unsigned short *raw,
+			      const unsigned char *mask,
+			      stpi_dither_bandfunc_t *func);
 extern int stpi_dither_translate_channel(stp_vars_t *v, unsigned channel,
 					 unsigned subchannel);
 extern void stpi_dither_channel_destroy(stpi_dither_channel_t *channel);
@@ -40,7 +40,8 @@ int
 stpi_dither_translate_channel(stp_vars_t *v, unsigned channel,
 			      unsigned subchannel)
 {
-  stpi_dither_t *d = (stpi_dither_t *) stp_get_component_data(v, "Dither");
+  stpi_dither_t *d =
+    (stpi_dither_t *) stpi_get_component(v, STPI_COMPONENT_DITHER);
   unsigned chan_idx;
   if (!d)
     return -1;
@@ -55,7 +56,8 @@ stpi_dither_translate_channel(stp_vars_t *v, unsigned channel,
 unsigned char *
 stp_dither_get_channel(stp_vars_t *v, unsigned channel, unsigned subchannel)
 {
-  stpi_dither_t *d = (stpi_dither_t *) stp_get_component_data(v, "Dither");
+  stpi_dither_t *d =
+    (stpi_dither_t *) stpi_get_component(v, STPI_COMPONENT_DITHER);
   int place = stpi_dither_translate_channel(v, channel, subchannel);
   if (place >= 0)
     return d->channel[place].ptr;
@@ -87,14 +89,9 @@ insert_channel(stp_vars_t *v, stpi_dither_t *d, int channel)
 void
 stpi_dither_channel_destroy(stpi_dither_channel_t *channel)
 {
-  int i;
   STP_SAFE_FREE(channel->ink_list);
-  if (channel->errs)
-    {
-      for (i = 0; i < channel->error_rows; i++)
-	STP_SAFE_FREE(channel->errs[i]);
-      STP_SAFE_FREE(channel->errs);
-    }
+  /* Error rows belong to the dither's arena */
+  channel->errs = NULL;
   STP_SAFE_FREE(channel->ranges);
   stp_dither_matrix_destroy(&(channel->pick));
   stp_dither_matrix_destroy(&(channel->dithermat));
@@ -103,7 +100,8 @@ stpi_dither_channel_destroy(stpi_dither_channel_t *channel)
 static void
 initialize_channel(stp_vars_t *v, int channel, int subchannel)
 {
-  stpi_dither_t *d = (stpi_dither_t *) stp_get_component_data(v, "Dither");
+  stpi_dither_t *d =
+    (stpi_dither_t *) stpi_get_component(v, STPI_COMPONENT_DITHER);
   int idx = stpi_dither_translate_channel(v, channel, subchannel);
   stpi_dither_channel_t *dc = &(CHANNEL(d, idx));
   stp_shade_t shade;
@@ -161,7 +159,8 @@ insert_subchannel(stp_vars_t *v, stpi_dither_t *d, int channel, int subchannel)
 void
 stpi_dither_finalize(stp_vars_t *v)
 {
-  stpi_dither_t *d = (stpi_dither_t *) stp_get_component_data(v, "Dither");
+  stpi_dither_t *d =
+    (stpi_dither_t *) stpi_get_component(v, STPI_COMPONENT_DITHER);
   if (!d->finalized)
     {
       int i;
@@ -184,7 +183,8 @@ void
 stp_dither_add_channel(stp_vars_t *v, unsigned char *data,
 		       unsigned channel, unsigned subchannel)
 {
-  stpi_dither_t *d = (stpi_dither_t *) stp_get_component_data(v, "Dither");
+  stpi_dither_t *d =
+    (stpi_dither_t *) stpi_get_component(v, STPI_COMPONENT_DITHER);
   int idx;
   if (channel >= d->channel_count)
     insert_channel(v, d, channel);
@@ -198,7 +198,8 @@ stp_dither_add_channel(stp_vars_t *v, unsigned char *data,
 static void
 stpi_dither_finalize_ranges(stp_vars_t *v, stpi_dither_channel_t *dc)
 {
-  stpi_dither_t *d = (stpi_dither_t *) stp_get_component_data(v, "Dither");
+  stpi_dither_t *d =
+    (stpi_dither_t *) stpi_get_component(v, STPI_COMPONENT_DITHER);
   int i;
   unsigned lbit = dc->bit_max;
   dc->signif_bits = 0;
@@ -257,7 +258,8 @@ static void
 stpi_dither_set_ranges(stp_vars_t *v, int color, const stp_shade_t *shade,
 		       double density, double darkness)
 {
-  stpi_dither_t *d = (stpi_dither_t *) stp_get_component_data(v, "Dither");
+  stpi_dither_t *d =
+    (stpi_dither_t *) stpi_get_component(v, STPI_COMPONENT_DITHER);
   stpi_dither_channel_t *dc = &(CHANNEL(d, color));
   const stp_dotsize_t *ranges = shade->dot_sizes;
   int nlevels = shade->numsizes;
@@ -105,6 +105,15 @@ static const stp_parameter_t dither_parameters[] =
     STP_PARAMETER_TYPE_STRING_LIST, STP_PARAMETER_CLASS_OUTPUT,
     STP_PARAMETER_LEVEL_ADVANCED, 1, 1, STP_CHANNEL_NONE, 1, 0
   },
+  {
+    "PlanarDither", N_("Planar Dither Input"), "Color=No,Category=Advanced Output Control",
+    N_("Hand the dither stage one contiguous row per ink rather than "
+       "interleaved pixels.  Inks that are not used on a row are skipped "
+       "entirely by the ordered and very fast dithers.  The output is "
+       "unchanged."),
+    STP_PARAMETER_TYPE_BOOLEAN, STP_PARAMETER_CLASS_OUTPUT,
+    STP_PARAMETER_LEVEL_ADVANCED4, 0, 1, STP_CHANNEL_NONE, 1, 0
+  },
 };
 
 static const int dither_parameter_count =
@@ -150,6 +159,11 @@ stp_dither_describe_parameter(const stp_vars_t *v, const char *name,
       description->deflt.str =
 	stp_string_list_param(description->bounds.str, 0)->name;
     }
+  else if (strcmp(name, "PlanarDither") == 0)
+    {
+      stp_fill_parameter_settings(description, &(dither_parameters[2]));
+      description->deflt.boolean = 0;
+    }
   else
     return;
 }
@@ -168,7 +182,8 @@ stpi_set_dither_function(stp_vars_t *v)
   const char *image_type = stp_get_string_parameter(v, "ImageType");
   const char *color_correction = stp_get_string_parameter(v,"ColorCorrection");
   const char *algorithm = stp_get_string_parameter(v, "DitherAlgorithm");
-  stpi_dither_t *d = (stpi_dither_t *) stp_get_component_data(v, "Dither");
+  stpi_dither_t *d =
+    (stpi_dither_t *) stpi_get_component(v, STPI_COMPONENT_DITHER);
   int i;
   d->stpi_dither_type = -1;
   if (stp_check_string_parameter(v, "Quality", STP_PARAMETER_ACTIVE))
@@ -280,14 +295,24 @@ stpi_set_dither_function(stp_vars_t *v)
 void
 stp_dither_set_adaptive_limit(stp_vars_t *v, double limit)
 {
-  stpi_dither_t *d = (stpi_dither_t *) stp_get_component_data(v, "Dither");
+  stpi_dither_t *d =
+    (stpi_dither_t *) stpi_get_component(v, STPI_COMPONENT_DITHER);
   d->adaptive_limit = limit;
 }
 
+void
+stpi_dither_set_thread_count(stp_vars_t *v, int threads)
+{
+  stpi_dither_t *d =
+    (stpi_dither_t *) stpi_get_component(v, STPI_COMPONENT_DITHER);
+  d->thread_count = threads > 1 ? threads : 1;
+}
+
 void
 stp_dither_set_ink_spread(stp_vars_t *v, int spread)
 {
-  stpi_dither_t *d = (stpi_dither_t *) stp_get_component_data(v, "Dither");
+  stpi_dither_t *d =
+    (stpi_dither_t *) stpi_get_component(v, STPI_COMPONENT_DITHER);
   STP_SAFE_FREE(d->offset0_table);
   STP_SAFE_FREE(d->offset1_table);
   if (spread >= 16)
@@ -314,17 +339,55 @@ stp_dither_set_ink_spread(stp_vars_t *v, int spread)
 void
 stp_dither_set_randomizer(stp_vars_t *v, int i, double val)
 {
-  stpi_dither_t *d = (stpi_dither_t *) stp_get_component_data(v, "Dither");
+  stpi_dither_t *d =
+    (stpi_dither_t *) stpi_get_component(v, STPI_COMPONENT_DITHER);
   if (i < 0 || i >= CHANNEL_COUNT(d))
     return;
   CHANNEL(d, i).randomizer = val * 65535;
 }
 
+/*
+ * Band-parallel dithering, for the algorithms that carry no state from
+ * one pixel to the next.  A row is split into bands of whole output
+ * bytes, and each band is dithered by the pool into the shared output
+ * rows using a private copy of the dither and its channels, so that the
+ * incremental dither matrix state and the row ends don't collide.  The
+ * row ends are then merged back in band order, leaving everything as
+ * the serial code would.
+ */
+
+#define DITHER_MIN_BAND_WIDTH (1024)
+
+typedef struct dither_band
+{
+  stpi_dither_t dither;
+  stpi_dither_channel_t *channels;
+  const unsigned short *raw;
+  int x_start;
+  int x_end;
+  int xerror;
+} stpi_dither_band_t;
+
+typedef struct
+{
+  stpi_dither_t *d;
+  int row;
+  const unsigned char *mask;
+  stpi_dither_bandfunc_t *func;
+} stpi_dither_band_job_t;
+
 static void
 stpi_dither_free(void *vd)
 {
   stpi_dither_t *d = (stpi_dither_t *) vd;
   int j;
+  stpi_thread_pool_destroy(d->thread_pool);
+  if (d->bands)
+    {
+      for (j = 0; j < d->band_count; j++)
+	stp_free(d->bands[j].channels);
+      stp_free(d->bands);
+    }
   if (d->aux_freefunc)
     (d->aux_freefunc)(d);
   for (j = 0; j < CHANNEL_COUNT(d); j++)
@@ -335,6 +398,7 @@ stpi_dither_free(void *vd)
   stp_free(d->channel);
   stp_free(d->channel_index);
   stp_free(d->subchannel_count);
+  stpi_arena_destroy(d->arena);
   stp_free(d);
 }
 
@@ -345,11 +409,15 @@ stp_dither_init(stp_vars_t *v, stp_image_t *image, int out_width,
   int in_width = stp_image_width(image);
   stpi_dither_t *d = stp_zalloc(sizeof(stpi_dither_t));
 
+  d->arena = stpi_arena_create();
   stp_allocate_component_data(v, "Dither", NULL, stpi_dither_free, d);
 
   d->finalized = 0;
   d->error_rows = ERROR_ROWS;
   d->d_cutoff = 4096;
+  d->thread_count = 1;
+  if (stp_check_int_parameter(v, "RenderThreads", STP_PARAMETER_ACTIVE))
+    d->thread_count = stp_get_int_parameter(v, "RenderThreads");
 
   d->offset0_table = NULL;
   d->offset1_table = NULL;
@@ -365,6 +433,15 @@ stp_dither_init(stp_vars_t *v, stp_image_t *image, int out_width,
     }
   d->ditherfunc = stpi_set_dither_function(v);
   d->adaptive_limit = .75 * 65535;
+  if (stp_check_boolean_parameter(v, "PlanarDither", STP_PARAMETER_ACTIVE) &&
+      stp_get_boolean_parameter(v, "PlanarDither") &&
+      (d->ditherfunc == stpi_dither_ordered ||
+       d->ditherfunc == stpi_dither_very_fast ||
+       d->ditherfunc == stpi_dither_ed))
+    {
+      d->planar = 1;
+      stpi_channel_set_planar_output(v, 1);
+    }
 
   /*
    * For hybrid EvenTone we want to use the good matrix.  For regular
@@ -406,6 +483,103 @@ stp_dither_init(stp_vars_t *v, stp_image_t *image, int out_width,
   d->channel_count = 0;
 }
 
+/*
+ * The worker threads are only started the first time an algorithm that
+ * can use them asks for them.
+ */
+stpi_thread_pool_t *
+stpi_dither_get_thread_pool(stpi_dither_t *d)
+{
+  if (!d->thread_pool && d->thread_count > 1)
+    {
+      d->thread_pool = stpi_thread_pool_create(d->thread_count);
+      if (!d->thread_pool)
+	d->thread_count = 1;
+    }
+  return d->thread_pool;
+}
+
+static int
+dither_band_count(stpi_dither_t *d)
+{
+  int i;
+  if (d->thread_count < 2 || d->dst_width < 2 * DITHER_MIN_BAND_WIDTH)
+    return 1;
+  if (!d->bands)
+    {
+      d->band_count =
+	stpi_thread_pool_size(stpi_dither_get_thread_pool(d));
+      if (d->band_count > d->dst_width / DITHER_MIN_BAND_WIDTH)
+	d->band_count = d->dst_width / DITHER_MIN_BAND_WIDTH;
+      d->bands = stp_zalloc(sizeof(stpi_dither_band_t) * d->band_count);
+      for (i = 0; i < d->band_count; i++)
+	d->bands[i].channels =
+	  stp_malloc(sizeof(stpi_dither_channel_t) * CHANNEL_COUNT(d));
+    }
+  return d->band_count;
+}
+
+static void
+dither_band(void *data, int job)
+{
+  const stpi_dither_band_job_t *j = (const stpi_dither_band_job_t *) data;
+  stpi_dither_band_t *b = &(j->d->bands[job]);
+  (j->func)(&(b->dither), j->row, b->raw, j->mask, b->x_start, b->x_end,
+	    b->xerror);
+}
+
+void
+stpi_dither_bands(stpi_dither_t *d, int row, const unsigned short *raw,
+		  const unsigned char *mask, stpi_dither_bandfunc_t *func)
+{
+  int bands = dither_band_count(d);
+  stpi_dither_band_job_t job;
+  int i, j;
+
+  if (bands < 2)
+    {
+      (func)(d, row, raw, mask, 0, d->dst_width, 0);
+      return;
+    }
+  for (i = 0; i < bands; i++)
+    {
+      stpi_dither_band_t *b = &(d->bands[i]);
+      unsigned long long src_x;
+      b->x_start = (d->dst_width * i / bands) & ~7;
+      b->x_end = i == bands - 1 ? d->dst_width :
+	(d->dst_width * (i + 1) / bands) & ~7;
+      src_x = (unsigned long long) b->x_start * d->src_width;
+      b->raw = raw + INPUT_STEP(d) * (src_x / d->dst_width);
+      b->xerror = ((unsigned long long) b->x_start *
+		   (d->src_width % d->dst_width)) % d->dst_width;
+      memcpy(b->channels, d->channel,
+	     sizeof(stpi_dither_channel_t) * CHANNEL_COUNT(d));
+      b->dither = *d;
+      b->dither.channel = b->channels;
+      b->dither.ptr_offset = b->x_start / 8;
+    }
+  job.d = d;
+  job.row = row;
+  job.mask = mask;
+  job.func = func;
+  stpi_thread_pool_run(d->thread_pool, bands, dither_band, &job);
+  for (i = 0; i < CHANNEL_COUNT(d); i++)
+    {
+      stpi_dither_channel_t *dc = &(CHANNEL(d, i));
+      for (j = 0; j < bands; j++)
+	{
+	  const stpi_dither_channel_t *bc = &(d->bands[j].channels[i]);
+	  if (bc->row_ends[0] != -1)
+	    {
+	      if (dc->row_ends[0] == -1)
+		dc->row_ends[0] = bc->row_ends[0];
+	      dc->row_ends[1] = bc->row_ends[1];
+	    }
+	}
+    }
+  d->ptr_offset = d->bands[bands - 1].dither.ptr_offset;
+}
+
 void
 stpi_dither_reverse_row_ends(stpi_dither_t *d)
 {
@@ -422,7 +596,8 @@ stpi_dither_reverse_row_ends(stpi_dither_t *d)
 int
 stp_dither_get_first_position(stp_vars_t *v, int color, int subchannel)
 {
-  stpi_dither_t *d = (stpi_dither_t *) stp_get_component_data(v, "Dither");
+  stpi_dither_t *d =
+    (stpi_dither_t *) stpi_get_component(v, STPI_COMPONENT_DITHER);
   int channel = stpi_dither_translate_channel(v, color, subchannel);
   if (channel < 0)
     return -1;
@@ -432,7 +607,8 @@ stp_dither_get_first_position(stp_vars_t *v, int color, int subchannel)
 int
 stp_dither_get_last_position(stp_vars_t *v, int color, int subchannel)
 {
-  stpi_dither_t *d = (stpi_dither_t *) stp_get_component_data(v, "Dither");
+  stpi_dither_t *d =
+    (stpi_dither_t *) stpi_get_component(v, STPI_COMPONENT_DITHER);
   int channel = stpi_dither_translate_channel(v, color, subchannel);
   if (channel < 0)
     return -1;
@@ -447,23 +623,29 @@ stpi_dither_get_errline(stpi_dither_t *d, int row, int color)
     return NULL;
   dc = &(CHANNEL(d, color));
   if (!dc->errs)
-    dc->errs = stp_zalloc(d->error_rows * sizeof(int *));
+    dc->errs = stpi_arena_zalloc(d->arena, d->error_rows * sizeof(int *));
   if (!dc->errs[row % dc->error_rows])
     {
       int size = 2 * MAX_SPREAD + (16 * ((d->dst_width + 7) / 8));
-      dc->errs[row % dc->error_rows] = stp_zalloc(size * sizeof(int));
+      dc->errs[row % dc->error_rows] =
+	stpi_arena_zalloc(d->arena, size * sizeof(int));
     }
   return dc->errs[row % dc->error_rows] + MAX_SPREAD;
 }
 
-void
-stp_dither_internal(stp_vars_t *v, int row, const unsigned short *input,
-		    int duplicate_line, int zero_mask,
-		    const unsigned char *mask)
+static void
+dither_row(stp_vars_t *v, int row, const unsigned short *input,
+	   size_t plane_stride, unsigned empty_planes, int duplicate_line,
+	   int zero_mask, const unsigned char *mask)
 {
   int i;
-  stpi_dither_t *d = (stpi_dither_t *) stp_get_component_data(v, "Dither");
+  stpi_dither_t *d =
+    (stpi_dither_t *) stpi_get_component(v, STPI_COMPONENT_DITHER);
+  stpi_profile_mark_t mark;
+  stpi_profile_t *profile;
   stpi_dither_finalize(v);
+  d->plane_stride = plane_stride;
+  d->empty_planes = empty_planes;
   stp_dither_matrix_set_row(&(d->dither_matrix), row);
   for (i = 0; i < CHANNEL_COUNT(d); i++)
     {
@@ -478,13 +660,43 @@ stp_dither_internal(stp_vars_t *v, int row, const unsigned short *input,
       stp_dither_matrix_set_row(&(CHANNEL(d, i).pick), row);
     }
   d->ptr_offset = 0;
+  profile = stpi_profile_begin(v, &mark);
   (d->ditherfunc)(v, row, input, duplicate_line, zero_mask, mask);
+  if (profile)
+    stpi_profile_end(profile, STPI_PROFILE_DITHER, &mark);
+}
+
+void
+stp_dither_internal(stp_vars_t *v, int row, const unsigned short *input,
+		    int duplicate_line, int zero_mask,
+		    const unsigned char *mask)
+{
+  dither_row(v, row, input, 0, 0, duplicate_line, zero_mask, mask);
+}
+
+void
+stpi_dither_planar(stp_vars_t *v, int row, const unsigned short *planes,
+		   size_t plane_stride, unsigned empty_planes,
+		   int duplicate_line, int zero_mask, const unsigned char *mask)
+{
+  dither_row(v, row, planes, plane_stride, empty_planes, duplicate_line,
+	     zero_mask, mask);
 }
 
 void
 stp_dither(stp_vars_t *v, int row, int duplicate_line, int zero_mask,
 	   const unsigned char *mask)
 {
-  const unsigned short *input = stp_channel_get_output(v);
-  stp_dither_internal(v, row, input, duplicate_line, zero_mask, mask);
+  stpi_dither_t *d =
+    (stpi_dither_t *) stpi_get_component(v, STPI_COMPONENT_DITHER);
+  size_t plane_stride;
+  unsigned empty_planes;
+  const unsigned short *planes = d->planar ?
+    stpi_channel_get_planar_output(v, &plane_stride, &empty_planes) : NULL;
+  if (planes)
+    stpi_dither_planar(v, row, planes, plane_stride, empty_planes,
+		       duplicate_line, zero_mask, mask);
+  else
+    stp_dither_internal(v, row, stp_channel_get_output(v), duplicate_line,
+			zero_mask, mask);
 }
@@ -31,7 +31,20 @@
 #include <gutenprint/gutenprint-intl-internal.h>
 #include "dither-impl.h"
 #include "dither-inlined-functions.h"
+#include <stdlib.h>
+#include <string.h>
 
+/*
+ * Inks without drop size segmentation have an AVX2 row kernel, which
+ * is used if stpi_kernel_level() allows it.
+ */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define X86_ORDERED
+#include <immintrin.h>
+#endif
+
+/* Most drop sizes plus one that the AVX2 kernel handles */
+#define ORDERED_AVX2_LEVELS 8
 
 typedef struct {
   size_t channels;
@@ -46,6 +59,10 @@ typedef struct {
   stpi_new_ordered_t *ord_new;
 } stpi_ordered_t;
 
+typedef struct {
+  int avx2;			/* The AVX2 row kernel can be used */
+} stpi_ordered_dither_t;
+
 static int
 compare_channels(const stpi_dither_channel_t *dc1,
 		 const stpi_dither_channel_t *dc2)
@@ -290,9 +307,13 @@ static void
 init_dither_ordered(stpi_dither_t *d, stp_vars_t *v)
 {
   int i;
-  d->aux_data = stp_malloc(1);
+  stpi_ordered_dither_t *od = stp_zalloc(sizeof(stpi_ordered_dither_t));
+#ifdef X86_ORDERED
+  od->avx2 = stpi_kernel_level() == STPI_KERNEL_AVX2;
+#endif
+  d->aux_data = od;
   d->aux_freefunc = &free_dither_ordered;
-  stp_dprintf(STP_DBG_INK, v, "init_dither_ordered\n");
+  stp_dprintf(STP_DBG_INK, v, "init_dither_ordered avx2 %d\n", od->avx2);
   for (i = 0; i < CHANNEL_COUNT(d); i++)
     {
       stpi_dither_channel_t *dc = &CHANNEL(d, i);
@@ -326,50 +347,262 @@ init_dither_ordered(stpi_dither_t *d, stp_vars_t *v)
     }
 }
 
-void
-stpi_dither_ordered(stp_vars_t *v,
+static void
+check_channel_levels(const stpi_dither_t *d, int *one_bit_only,
+		     int *one_level_only)
+{
+  int i;
+  *one_bit_only = 1;
+  *one_level_only = 1;
+  for (i = 0; i < CHANNEL_COUNT(d); i++)
+    {
+      const stpi_dither_channel_t *dc = &(CHANNEL(d, i));
+      if (dc->nlevels != 1)
+	*one_level_only = 0;
+      if (dc->nlevels != 1 || dc->ranges[0].upper->bits != 1)
+	*one_bit_only = 0;
+    }
+}
+
+#ifdef X86_ORDERED
+/*
+ * Dither one channel 16 pixels at a time, from x_start (a multiple of 8)
+ * to x_end (a multiple of 16 from it).  The thresholds are read straight
+ * from the current row of the dither matrix, which is contiguous except
+ * where it wraps around; only groups that straddle the wrap are copied.
+ * The lanes hold the pixels in reverse order, so that
+ * _mm256_movemask_ps() gives output bytes with the first pixel in the
+ * top bit.
+ *
+ * print_color_ordered() compares rangepoint, (val - lower) * 65535 /
+ * value_span, against the threshold; here that is (val - lower) * 65535
+ * >= threshold * value_span, which needs no division.  Both sides fit
+ * in 32 bits with the threshold limited to 65536, which changes nothing
+ * since rangepoint never exceeds 65535 in a segment that can be chosen.
+ */
+static void __attribute__ ((target ("avx2")))
+dither_ordered_row_avx2(stpi_dither_t *d, stpi_dither_channel_t *dc,
+			int one_bit, const unsigned short *raw, int stride,
+			const unsigned char *mask, int x_start, int x_end,
+			int length)
+{
+  const stp_dither_matrix_impl_t *mat = &(dc->dithermat);
+  const unsigned *matrix_row = mat->matrix + mat->last_y_mod;
+  const unsigned char *mask_ptr = mask ? mask + d->ptr_offset : NULL;
+  unsigned char *out = dc->ptr + d->ptr_offset;
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i reverse = _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+  const __m256i index = _mm256_mullo_epi32(reverse, _mm256_set1_epi32(stride));
+  const __m256i low_half = _mm256_set1_epi32(0xffff);
+  const __m256i scale = _mm256_set1_epi32(65535);
+  const __m256i limit = _mm256_set1_epi32(65536);
+  int lower[ORDERED_AVX2_LEVELS];
+  int span[ORDERED_AVX2_LEVELS];
+  int upper_bits[ORDERED_AVX2_LEVELS];
+  int lower_bits[ORDERED_AVX2_LEVELS];
+  unsigned wrapped[16];
+  int levels = dc->nlevels;
+  int planes = 0;
+  int p = (x_start + mat->x_offset) % mat->x_size;
+  int x, i, j;
+
+  if (p < 0)
+    p += mat->x_size;
+  for (j = one_bit ? 1 : dc->bit_max; j; j >>= 1)
+    planes++;
+  /* Segments in the order print_color_ordered() tries them */
+  for (i = 0; i < levels; i++)
+    {
+      const stpi_dither_segment_t *dd = &(dc->ranges[levels - 1 - i]);
+      lower[i] = dd->lower->value;
+      span[i] = dd->value_span < 65535 ? dd->value_span : 65535;
+      upper_bits[i] = dd->upper->bits;
+      lower_bits[i] = dd->lower->bits;
+    }
+
+  for (x = x_start; x < x_end; x += 16, raw += 16 * stride, out += 2)
+    {
+      const unsigned *thresholds = matrix_row + p;
+      unsigned plane_bits[8] = { 0 };
+      unsigned any = 0;
+      unsigned m = 0xffff;
+      int h;
+      if (p + 16 > mat->x_size)
+	{
+	  int q = p;
+	  for (j = 0; j < 16; j++)
+	    {
+	      wrapped[j] = matrix_row[q];
+	      if (++q == mat->x_size)
+		q = 0;
+	    }
+	  thresholds = wrapped;
+	}
+      p += 16;
+      if (p >= mat->x_size)
+	p %= mat->x_size;
+
+      for (h = 0; h < 2; h++)
+	{
+	  int shift = 8 - 8 * h;
+	  __m256i v, t, bits;
+	  if (stride == 1)
+	    v = _mm256_permutevar8x32_epi32
+	      (_mm256_cvtepu16_epi32
+	       (_mm_loadu_si128((const __m128i *) (raw + 8 * h))), reverse);
+	  else
+	    v = _mm256_and_si256
+	      (_mm256_i32gather_epi32((const int *) (raw + 8 * h * stride),
+				      index, 2), low_half);
+	  t = _mm256_min_epu32
+	    (_mm256_permutevar8x32_epi32
+	     (_mm256_loadu_si256((const __m256i *) (thresholds + 8 * h)),
+	      reverse), limit);
+	  if (one_bit)
+	    {
+	      bits = _mm256_andnot_si256
+		(_mm256_cmpeq_epi32(v, zero),
+		 _mm256_cmpeq_epi32(_mm256_max_epu32(v, t), v));
+	      plane_bits[0] |=
+		_mm256_movemask_ps(_mm256_castsi256_ps(bits)) << shift;
+	      continue;
+	    }
+	  bits = zero;
+	  {
+	    __m256i done = zero;
+	    for (i = 0; i < levels; i++)
+	      {
+		__m256i l = _mm256_set1_epi32(lower[i]);
+		__m256i chosen =
+		  _mm256_andnot_si256(done, _mm256_cmpgt_epi32(v, l));
+		__m256i a = _mm256_mullo_epi32(_mm256_sub_epi32(v, l), scale);
+		__m256i hit = _mm256_cmpeq_epi32
+		  (_mm256_max_epu32
+		   (a, _mm256_mullo_epi32(t, _mm256_set1_epi32(span[i]))), a);
+		bits = _mm256_or_si256
+		  (bits, _mm256_and_si256
+		   (chosen, _mm256_blendv_epi8
+		    (_mm256_set1_epi32(lower_bits[i]),
+		     _mm256_set1_epi32(upper_bits[i]), hit)));
+		done = _mm256_or_si256(done, chosen);
+	      }
+	  }
+	  for (j = 0; j < planes; j++)
+	    plane_bits[j] |= _mm256_movemask_ps
+	      (_mm256_castsi256_ps
+	       (_mm256_sll_epi32(bits, _mm_cvtsi32_si128(31 - j)))) << shift;
+	}
+
+      /* Bit 15 is the first pixel, as in the output */
+      if (mask_ptr)
+	{
+	  m = (mask_ptr[0] << 8) | mask_ptr[1];
+	  mask_ptr += 2;
+	}
+      for (j = 0; j < planes; j++)
+	{
+	  plane_bits[j] &= m;
+	  any |= plane_bits[j];
+	}
+      if (any)
+	{
+	  if (dc->row_ends[0] == -1)
+	    dc->row_ends[0] = x + __builtin_clz(any) - 16;
+	  dc->row_ends[1] = x + 15 - __builtin_ctz(any);
+	  for (j = 0; j < planes; j++)
+	    {
+	      out[j * length] |= plane_bits[j] >> 8;
+	      out[j * length + 1] |= plane_bits[j] & 0xff;
+	    }
+	}
+    }
+}
+#endif
+
+/*
+ * Dither what the AVX2 kernel can of a band, and return where it
+ * stopped.  That needs every input pixel to make one output pixel, and
+ * inks that are single bits or drop sizes without segmentation.  raw
+ * holds the first channel, and the others follow channel_step apart.
+ */
+static int
+dither_ordered_band_avx2(stpi_dither_t *d, const unsigned short *raw,
+			 size_t channel_step, int stride,
+			 const unsigned char *mask, int x_start, int x_end,
+			 int xstep, int xmod)
+{
+#ifdef X86_ORDERED
+  const stpi_ordered_dither_t *od =
+    (const stpi_ordered_dither_t *) d->aux_data;
+  int length = (d->dst_width + 7) / 8;
+  int one_bit_only;
+  int one_level_only;
+  int stop;
+  int i;
+  if (!od->avx2 || xstep != stride || xmod || (x_start & 7))
+    return x_start;
+  check_channel_levels(d, &one_bit_only, &one_level_only);
+  if (!one_bit_only &&
+      ((d->stpi_dither_type & D_ORDERED_SEGMENTED) ||
+       (!one_level_only && d->stpi_dither_type == D_ORDERED_NEW)))
+    return x_start;
+  for (i = 0; i < CHANNEL_COUNT(d); i++)
+    if (CHANNEL(d, i).nlevels > ORDERED_AVX2_LEVELS)
+      return x_start;
+  stop = x_start + (x_end - x_start) / 16 * 16;
+  /* Gathers read two bytes past the last pixel of the last channel */
+  if (stride > 1 && stop == d->dst_width)
+    stop -= 16;
+  if (stop <= x_start)
+    return x_start;
+  for (i = 0; i < CHANNEL_COUNT(d); i++)
+    {
+      stpi_dither_channel_t *dc = &(CHANNEL(d, i));
+      if (dc->ptr && !(d->plane_stride && (d->empty_planes & (1 << i))))
+	dither_ordered_row_avx2(d, dc, one_bit_only, raw + i * channel_step,
+				stride, mask, x_start, stop, length);
+    }
+  d->ptr_offset += (stop - x_start) / 8;
+  return stop;
+#else
+  return x_start;
+#endif
+}
+
+static void
+dither_ordered_band(stpi_dither_t *d,
 		    int row,
 		    const unsigned short *raw,
-		    int duplicate_line,
-		    int zero_mask,
-		    const unsigned char *mask)
+		    const unsigned char *mask,
+		    int x_start,
+		    int x_end,
+		    int xerror)
 {
-  stpi_dither_t *d = (stpi_dither_t *) stp_get_component_data(v, "Dither");
   int		x,
 		length;
   unsigned char	bit;
   int i;
-  int one_bit_only = 1;
-  int one_level_only = 1;
+  int one_bit_only;
+  int one_level_only;
 
-  int xerror, xstep, xmod;
-
-  if ((zero_mask & ((1 << CHANNEL_COUNT(d)) - 1)) ==
-      ((1 << CHANNEL_COUNT(d)) - 1))
-    return;
+  int xstep, xmod;
 
   length = (d->dst_width + 7) / 8;
 
-  bit = 128;
   xstep  = CHANNEL_COUNT(d) * (d->src_width / d->dst_width);
   xmod   = d->src_width % d->dst_width;
-  xerror = 0;
 
-  for (i = 0; i < CHANNEL_COUNT(d); i++)
-    {
-      stpi_dither_channel_t *dc = &(CHANNEL(d, i));
-      if (dc->nlevels != 1)
-	one_level_only = 0;
-      if (dc->nlevels != 1 || dc->ranges[0].upper->bits != 1)
-	one_bit_only = 0;
-    }
-  if (! one_bit_only && ! d->aux_data &&
-      (d->stpi_dither_type & (D_ORDERED_SEGMENTED | D_ORDERED_NEW)))
-    init_dither_ordered(d, v);
+  x = dither_ordered_band_avx2(d, raw, 1, CHANNEL_COUNT(d), mask,
+			       x_start, x_end, xstep, xmod);
+  raw += (x - x_start) * CHANNEL_COUNT(d);
+  x_start = x;
+  bit = 128 >> (x_start & 7);
+
+  check_channel_levels(d, &one_bit_only, &one_level_only);
 
   if (one_bit_only)
     {
-      for (x = 0; x < d->dst_width; x ++)
+      for (x = x_start; x < x_end; x ++)
 	{
 	  if (!mask || (*(mask + d->ptr_offset) & bit))
 	    {
@@ -389,7 +622,7 @@ stpi_dither_ordered(stp_vars_t *v,
     }
   else if (d->stpi_dither_type & D_ORDERED_SEGMENTED)
     {
-      for (x = 0; x < d->dst_width; x ++)
+      for (x = x_start; x < x_end; x ++)
 	{
 	  if (!mask || (*(mask + d->ptr_offset) & bit))
 	    {
@@ -433,7 +666,7 @@ stpi_dither_ordered(stp_vars_t *v,
     }
   else if (one_level_only || !(d->stpi_dither_type == D_ORDERED_NEW))
     {
-      for (x = 0; x != d->dst_width; x ++)
+      for (x = x_start; x < x_end; x ++)
 	{
 	  if (!mask || (*(mask + d->ptr_offset) & bit))
 	    {
@@ -450,7 +683,7 @@ stpi_dither_ordered(stp_vars_t *v,
     }
   else
     {
-      for (x = 0; x != d->dst_width; x ++)
+      for (x = x_start; x < x_end; x ++)
 	{
 	  if (!mask || (*(mask + d->ptr_offset) & bit))
 	    {
@@ -466,3 +699,170 @@ stpi_dither_ordered(stp_vars_t *v,
 	}
     }
 }
+
+/*
+ * With planar input, work through one channel at a time.  Each channel
+ * only uses its own dither matrix position and output, so the result
+ * is the same as dithering all channels pixel by pixel, but the input
+ * is read with unit stride and channels that are empty across the row
+ * are never read at all.
+ */
+
+#define ORDERED_ONE_BIT 0
+#define ORDERED_SEGMENTED 1
+#define ORDERED_OLD 2
+#define ORDERED_NEW 3
+
+static inline void
+dither_ordered_plane(stpi_dither_t *d, stpi_dither_channel_t *dc, int mode,
+		     int row, const unsigned short *raw,
+		     const unsigned char *mask, int x_start, int x_end,
+		     int xerror, int xstep, int xmod, int length)
+{
+  unsigned char bit = 128 >> (x_start & 7);
+  const stpi_ordered_t *s = (const stpi_ordered_t *) dc->aux_data;
+  int x;
+  for (x = x_start; x < x_end; x ++)
+    {
+      if (raw[0] && (!mask || (*(mask + d->ptr_offset) & bit)))
+	{
+	  switch (mode)
+	    {
+	    case ORDERED_ONE_BIT:
+	      if (raw[0] >= ditherpoint(d, &(dc->dithermat), x))
+		{
+		  set_row_ends(dc, x);
+		  dc->ptr[d->ptr_offset] |= bit;
+		}
+	      break;
+	    case ORDERED_SEGMENTED:
+	      {
+		unsigned short bits = raw[0] >> s->shift;
+		unsigned short val = raw[0] << dc->signif_bits;
+		val |= val >> s->shift;
+
+		if (bits)
+		  {
+		    if (val && val >= ditherpoint(d, &(dc->dithermat), x))
+		      {
+			int j;
+			unsigned char *tptr = dc->ptr + d->ptr_offset;
+			set_row_ends(dc, x);
+			for (j = 1; j <= bits; j += j, tptr += length)
+			  {
+			    if (j & bits)
+			      tptr[0] |= bit;
+			  }
+		      }
+		  }
+		else if (dc->ptr && val)
+		  {
+		    if (d->stpi_dither_type & D_ORDERED_NEW)
+		      print_color_ordered_new(d, dc, val, x, row, bit, length);
+		    else
+		      print_color_ordered(d, dc, val, x, row, bit, length);
+		  }
+	      }
+	      break;
+	    case ORDERED_OLD:
+	      if (dc->ptr)
+		print_color_ordered(d, dc, raw[0], x, row, bit, length);
+	      break;
+	    case ORDERED_NEW:
+	      if (dc->ptr)
+		print_color_ordered_new(d, dc, raw[0], x, row, bit, length);
+	      break;
+	    }
+	}
+      ADVANCE_UNIDIRECTIONAL(d, bit, raw, 1, xerror, xstep, xmod);
+    }
+}
+
+static void
+dither_ordered_planar_band(stpi_dither_t *d,
+			   int row,
+			   const unsigned short *raw,
+			   const unsigned char *mask,
+			   int x_start,
+			   int x_end,
+			   int xerror)
+{
+  int i;
+  int length = (d->dst_width + 7) / 8;
+  int xstep = d->src_width / d->dst_width;
+  int xmod = d->src_width % d->dst_width;
+  int ptr_offset = d->ptr_offset;
+  int one_bit_only;
+  int one_level_only;
+  int mode;
+  int x;
+
+  x = dither_ordered_band_avx2(d, raw, d->plane_stride, 1, mask,
+			       x_start, x_end, xstep, xmod);
+  raw += x - x_start;
+  ptr_offset = d->ptr_offset;
+  x_start = x;
+  check_channel_levels(d, &one_bit_only, &one_level_only);
+  if (one_bit_only)
+    mode = ORDERED_ONE_BIT;
+  else if (d->stpi_dither_type & D_ORDERED_SEGMENTED)
+    mode = ORDERED_SEGMENTED;
+  else if (one_level_only || !(d->stpi_dither_type == D_ORDERED_NEW))
+    mode = ORDERED_OLD;
+  else
+    mode = ORDERED_NEW;
+
+  for (i = 0; i < CHANNEL_COUNT(d); i++)
+    {
+      stpi_dither_channel_t *dc = &(CHANNEL(d, i));
+      const unsigned short *plane = raw + INPUT_CHANNEL(d, i);
+      if (d->empty_planes & (1 << i))
+	continue;
+      d->ptr_offset = ptr_offset;
+      /* Specialize the loop for each mode */
+      switch (mode)
+	{
+	case ORDERED_ONE_BIT:
+	  dither_ordered_plane(d, dc, ORDERED_ONE_BIT, row, plane, mask,
+			       x_start, x_end, xerror, xstep, xmod, length);
+	  break;
+	case ORDERED_SEGMENTED:
+	  dither_ordered_plane(d, dc, ORDERED_SEGMENTED, row, plane, mask,
+			       x_start, x_end, xerror, xstep, xmod, length);
+	  break;
+	case ORDERED_OLD:
+	  dither_ordered_plane(d, dc, ORDERED_OLD, row, plane, mask,
+			       x_start, x_end, xerror, xstep, xmod, length);
+	  break;
+	case ORDERED_NEW:
+	  dither_ordered_plane(d, dc, ORDERED_NEW, row, plane, mask,
+			       x_start, x_end, xerror, xstep, xmod, length);
+	  break;
+	}
+    }
+  d->ptr_offset = ptr_offset + ((x_start & 7) + x_end - x_start) / 8;
+}
+
+void
+stpi_dither_ordered(stp_vars_t *v,
+		    int row,
+		    const unsigned short *raw,
+		    int duplicate_line,
+		    int zero_mask,
+		    const unsigned char *mask)
+{
+  stpi_dither_t *d =
+    (stpi_dither_t *) stpi_get_component(v, STPI_COMPONENT_DITHER);
+
+  if ((zero_mask & ((1 << CHANNEL_COUNT(d)) - 1)) ==
+      ((1 << CHANNEL_COUNT(d)) - 1))
+    return;
+
+  if (! d->aux_data)
+    init_dither_ordered(d, v);
+
+  if (d->plane_stride)
+    stpi_dither_bands(d, row, raw, mask, dither_ordered_planar_band);
+  else
+    stpi_dither_bands(d, row, raw, mask, dither_ordered_band);
+}
@@ -58,7 +58,8 @@ stpi_dither_predithered(stp_vars_t *v,
 			int zero_mask,
 			const unsigned char *mask)
 {
-  stpi_dither_t *d = (stpi_dither_t *) stp_get_component_data(v, "Dither");
+  stpi_dither_t *d =
+    (stpi_dither_t *) stpi_get_component(v, STPI_COMPONENT_DITHER);
   int		x,
 		length;
   unsigned char	bit;
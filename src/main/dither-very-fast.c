@@ -54,15 +54,15 @@ print_color_very_fast(const stpi_dither_t *d, stpi_dither_channel_t *dc,
     }
 }
 
-void
-stpi_dither_very_fast(stp_vars_t *v,
+static void
+dither_very_fast_band(stpi_dither_t *d,
 		      int row,
 		      const unsigned short *raw,
-		      int duplicate_line,
-		      int zero_mask,
-		      const unsigned char *mask)
+		      const unsigned char *mask,
+		      int x_start,
+		      int x_end,
+		      int xerror)
 {
-  stpi_dither_t *d = (stpi_dither_t *) stp_get_component_data(v, "Dither");
   int		x,
 		length;
   unsigned char *bit_patterns;
@@ -70,18 +70,13 @@ stpi_dither_very_fast(stp_vars_t *v,
   int i;
   int one_bit_only = 1;
 
-  int xerror, xstep, xmod;
-
-  if ((zero_mask & ((1 << CHANNEL_COUNT(d)) - 1)) ==
-      ((1 << CHANNEL_COUNT(d)) - 1))
-    return;
+  int xstep, xmod;
 
   length = (d->dst_width + 7) / 8;
 
-  bit = 128;
+  bit = 128 >> (x_start & 7);
   xstep  = CHANNEL_COUNT(d) * (d->src_width / d->dst_width);
   xmod   = d->src_width % d->dst_width;
-  xerror = 0;
 
   bit_patterns = stp_zalloc(sizeof(unsigned char) * CHANNEL_COUNT(d));
   for (i = 0; i < CHANNEL_COUNT(d); i++)
@@ -94,7 +89,7 @@ stpi_dither_very_fast(stp_vars_t *v,
     }
   if (one_bit_only)
     {
-      for (x = 0; x < d->dst_width; x ++)
+      for (x = x_start; x < x_end; x ++)
 	{
 	  if (!mask || (*(mask + d->ptr_offset) & bit))
 	    {
@@ -114,7 +109,7 @@ stpi_dither_very_fast(stp_vars_t *v,
     }
   else
     {
-      for (x = 0; x < d->dst_width; x ++)
+      for (x = x_start; x < x_end; x ++)
 	{
 	  if (!mask || (*(mask + d->ptr_offset) & bit))
 	    {
@@ -131,3 +126,100 @@ stpi_dither_very_fast(stp_vars_t *v,
     }
   stp_free(bit_patterns);
 }
+
+/*
+ * With planar input, dither one channel at a time, skipping channels
+ * that are empty across the row.  The position within the row is kept
+ * in locals rather than in the dither structure, since it's walked once
+ * per channel rather than once per pixel.
+ */
+static void
+dither_very_fast_planar_band(stpi_dither_t *d,
+			     int row,
+			     const unsigned short *raw,
+			     const unsigned char *mask,
+			     int x_start,
+			     int x_end,
+			     int xerror)
+{
+  int length = (d->dst_width + 7) / 8;
+  int xstep = d->src_width / d->dst_width;
+  int xmod = d->src_width % d->dst_width;
+  int dst_width = d->dst_width;
+  int i;
+
+  for (i = 0; i < CHANNEL_COUNT(d); i++)
+    {
+      stpi_dither_channel_t *dc = &(CHANNEL(d, i));
+      const unsigned short *plane = raw + INPUT_CHANNEL(d, i);
+      unsigned char *ptr = dc->ptr;
+      unsigned char bit = 128 >> (x_start & 7);
+      int offset = d->ptr_offset;
+      unsigned bits = 0;
+      int xer = xerror;
+      int x;
+      if ((d->empty_planes & (1 << i)) || !ptr)
+	continue;
+      if (dc->nlevels > 0)
+	bits = dc->ranges[dc->nlevels - 1].upper->bits;
+      if (bits == 0)
+	continue;
+      for (x = x_start; x < x_end; x ++)
+	{
+	  unsigned val = plane[0];
+	  if (val && (!mask || (mask[offset] & bit)) &&
+	      val >= ditherpoint(d, &(dc->dithermat), x))
+	    {
+	      set_row_ends(dc, x);
+	      if (bits == 1)
+		ptr[offset] |= bit;
+	      else
+		{
+		  unsigned char *tptr = ptr + offset;
+		  unsigned j;
+		  for (j = 1; j <= bits; j += j, tptr += length)
+		    if (j & bits)
+		      tptr[0] |= bit;
+		}
+	    }
+	  bit >>= 1;
+	  if (bit == 0)
+	    {
+	      offset++;
+	      bit = 128;
+	    }
+	  plane += xstep;
+	  if (xmod)
+	    {
+	      xer += xmod;
+	      if (xer >= dst_width)
+		{
+		  xer -= dst_width;
+		  plane++;
+		}
+	    }
+	}
+    }
+  d->ptr_offset += ((x_start & 7) + x_end - x_start) / 8;
+}
+
+void
+stpi_dither_very_fast(stp_vars_t *v,
+		      int row,
+		      const unsigned short *raw,
+		      int duplicate_line,
+		      int zero_mask,
+		      const unsigned char *mask)
+{
+  stpi_dither_t *d =
+    (stpi_dither_t *) stpi_get_component(v, STPI_COMPONENT_DITHER);
+
+  if ((zero_mask & ((1 << CHANNEL_COUNT(d)) - 1)) ==
+      ((1 << CHANNEL_COUNT(d)) - 1))
+    return;
+
+  if (d->plane_stride)
+    stpi_dither_bands(d, row, raw, mask, dither_very_fast_planar_band);
+  else
+    stpi_dither_bands(d, row, raw, mask, dither_very_fast_band);
+}
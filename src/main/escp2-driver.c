@@ -40,7 +40,7 @@
 static escp2_privdata_t *
 get_privdata(stp_vars_t *v)
 {
-  return (escp2_privdata_t *) stp_get_component_data(v, "Driver");
+  return (escp2_privdata_t *) stpi_get_component(v, STPI_COMPONENT_DRIVER);
 }
 
 static void
@@ -217,7 +217,10 @@ get_media_type_named(const stp_vars_t *v, const char *name,
   const inklist_t *inklist = stpi_escp2_inklist(v);
   char *media_id = build_media_id(name, inklist, res);
   stp_list_t *cache = get_media_cache(v);
-  stp_list_item_t *li = stp_list_get_item_by_name(cache, media_id);
+  stp_list_item_t *li;
+  /* The media cache belongs to the model, and is shared between jobs */
+  stpi_global_lock();
+  li = stp_list_get_item_by_name(cache, media_id);
   if (li)
     {
       stp_free(media_id);
@@ -242,6 +245,7 @@ get_media_type_named(const stp_vars_t *v, const char *name,
 	  stp_list_item_create(cache, NULL, answer);
 	}
     }
+  stpi_global_unlock();
   return answer;
 }
 
@@ -421,7 +425,9 @@ get_input_slot_named(const stp_vars_t *v, const char *name)
   stpi_escp2_printer_t *printdef = stpi_escp2_get_printer(v);
   const stp_string_list_t *p = printdef->input_slots;
   stp_list_t *cache = get_slots_cache(v);
-  stp_list_item_t *li = stp_list_get_item_by_name(cache, name);
+  stp_list_item_t *li;
+  stpi_global_lock();
+  li = stp_list_get_item_by_name(cache, name);
   if (li)
     answer = (input_slot_t *) stp_list_item_get_data(li);
   else
@@ -440,6 +446,7 @@ get_input_slot_named(const stp_vars_t *v, const char *name)
       if (answer)
 	stp_list_item_create(cache, NULL, answer);
     }
+  stpi_global_unlock();
   return answer;
 }
 
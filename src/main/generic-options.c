@@ -92,6 +92,13 @@ static const stp_parameter_t the_parameters[] =
     STP_PARAMETER_TYPE_BOOLEAN, STP_PARAMETER_CLASS_CORE,
     STP_PARAMETER_LEVEL_INTERNAL, 1, 0, STP_CHANNEL_NONE, 1, 0
   },
+  {
+    "RenderThreads", N_("Rendering Threads"), "Color=No,Category=Job Mode",
+    N_("Maximum number of threads used to render each page; "
+       "1 renders on the calling thread only"),
+    STP_PARAMETER_TYPE_INT, STP_PARAMETER_CLASS_CORE,
+    STP_PARAMETER_LEVEL_INTERNAL, 1, 0, STP_CHANNEL_NONE, 1, 0
+  },
 };
 
 static const int the_parameter_count =
@@ -273,4 +280,10 @@ stpi_describe_generic_parameter(const stp_vars_t *v, const char *name,
     {
       description->deflt.boolean = 0;
     }
+  else if (strcmp(name, "RenderThreads") == 0)
+    {
+      description->deflt.integer = 1;
+      description->bounds.integer.lower = 1;
+      description->bounds.integer.upper = STP_MAX_RENDER_THREADS;
+    }
 }
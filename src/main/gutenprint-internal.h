@@ -248,6 +248,485 @@ extern void stpi_find_duplicate_printers(void);
 
 extern time_t stpi_time(time_t *t);
 
+/**
+ * Acquire the lock protecting shared library state: the XML parser
+ * registries and caches, the refcache, the module list, and data
+ * loaded on first use.  The lock is recursive.  Code that lazily
+ * initializes or modifies anything shared between print jobs must
+ * hold it; code that only reads data set up by stp_init() need not.
+ */
+extern void stpi_global_lock(void);
+
+/**
+ * Release the lock acquired by stpi_global_lock().
+ */
+extern void stpi_global_unlock(void);
+
+/*
+ * Flags and pointers that say whether data computed on first use is
+ * ready, for objects that may be read by several threads at once.  The
+ * thread that computes the data, holding the object's own lock, sets
+ * the flag or pointer with STPI_STORE_RELEASE() last; a thread that then
+ * reads it with STPI_LOAD_ACQUIRE() also sees the data, and may use it
+ * without taking the lock.  Without the compiler's atomic builtins,
+ * STPI_LOAD_ACQUIRE() gives "otherwise", which must be the value that
+ * sends the caller to take the lock and test again.
+ */
+#if defined(__GNUC__) && defined(__ATOMIC_ACQUIRE)
+#define STPI_LOAD_ACQUIRE(ptr, otherwise) \
+  __atomic_load_n((ptr), __ATOMIC_ACQUIRE)
+#define STPI_STORE_RELEASE(ptr, val) \
+  __atomic_store_n((ptr), (val), __ATOMIC_RELEASE)
+#else
+#define STPI_LOAD_ACQUIRE(ptr, otherwise) (otherwise)
+#define STPI_STORE_RELEASE(ptr, val) (*(ptr) = (val))
+#endif
+
+/**
+ * Switch the calling thread to the "C" locale.  Where uselocale() is
+ * available other threads are not affected.
+ * @returns the previous locale, to be passed to stpi_restore_locale().
+ */
+extern void *stpi_set_c_locale(void);
+
+/**
+ * Restore the locale saved by stpi_set_c_locale().
+ * @param saved the value returned by stpi_set_c_locale().
+ */
+extern void stpi_restore_locale(void *saved);
+
+typedef enum
+{
+  STPI_KERNEL_GENERIC,
+  STPI_KERNEL_SSE2,
+  STPI_KERNEL_AVX2
+} stpi_kernel_level_t;
+
+/**
+ * Get the best set of SIMD inner loops that may be used.  This is the
+ * best that the processor supports, unless STP_COLOR_KERNELS names a
+ * lower one ("generic" or "sse2") for testing.  It is decided once, by
+ * stp_init(), and the color kernels, channel splitting and ordered
+ * dither all go by it.
+ * @returns the kernel level.
+ */
+extern stpi_kernel_level_t stpi_kernel_level(void);
+
+typedef struct stpi_arena stpi_arena_t;
+
+/**
+ * Create an arena.  Memory allocated from an arena is handed out from
+ * large blocks and cannot be freed individually; it is all released
+ * together when the arena is destroyed.  Arenas may be used by several
+ * threads at once.
+ * @returns the new arena.
+ */
+extern stpi_arena_t *stpi_arena_create(void);
+
+/**
+ * Allocate memory from an arena.  The memory is aligned to 16 bytes.
+ * Like stp_malloc(), this does not return on failure.
+ * @param arena the arena to allocate from.
+ * @param size the number of bytes needed.
+ * @returns the memory, valid until the arena is destroyed.
+ */
+extern void *stpi_arena_alloc(stpi_arena_t *arena, size_t size);
+
+/**
+ * Allocate zeroed memory from an arena.
+ * @param arena the arena to allocate from.
+ * @param size the number of bytes needed.
+ * @returns the memory, valid until the arena is destroyed.
+ */
+extern void *stpi_arena_zalloc(stpi_arena_t *arena, size_t size);
+
+/**
+ * Destroy an arena and everything allocated from it.
+ * @param arena the arena to destroy; may be NULL.
+ */
+extern void stpi_arena_destroy(stpi_arena_t *arena);
+
+/**
+ * Upper bound on the RenderThreads parameter.
+ */
+#define STP_MAX_RENDER_THREADS (64)
+
+/**
+ * Create a copy of a vars object for use by a rendering thread.
+ * Parameters and output functions are copied, so lookups on the copy
+ * do not touch the original.  Component data (Color, Dither, Weave,
+ * Driver...) is shared with, and remains owned by, the original; each
+ * component must only be used by one thread at a time.  The copy has an
+ * output buffer of its own, which is flushed when it is destroyed.
+ * @param v the vars object to copy.
+ * @returns the new vars object, to be freed with stp_vars_destroy().
+ */
+extern stp_vars_t *stpi_vars_create_worker(const stp_vars_t *v);
+
+/**
+ * Write printer output.  The data is collected in the vars object's
+ * output buffer and only passed to the outfunc in large blocks; see
+ * stp_set_output_buffer_size() and stp_flush_output().
+ * @param v the vars object to write to.
+ * @param data the data to write.
+ * @param bytes the number of bytes to write.
+ */
+extern void stpi_vars_output(const stp_vars_t *v, const char *data,
+			     size_t bytes);
+
+/**
+ * Rendering stages timed by the profiler.
+ */
+typedef enum
+{
+  STPI_PROFILE_IMAGE_FETCH,	/*!< Reading rows from the image */
+  STPI_PROFILE_COLOR_CONVERSION,	/*!< Color conversion function */
+  STPI_PROFILE_CHANNEL_CONVERT,	/*!< stp_channel_convert() */
+  STPI_PROFILE_DITHER,		/*!< Dither function */
+  STPI_PROFILE_WRITE_WEAVE,	/*!< stp_write_weave() */
+  STPI_PROFILE_PACK,		/*!< Packing rows for output */
+  STPI_PROFILE_FLUSH,		/*!< stp_flush_all() */
+  STPI_PROFILE_STAGE_COUNT
+} stpi_profile_stage_t;
+
+typedef struct stpi_profile stpi_profile_t;
+
+/**
+ * The start of a timed interval.
+ */
+typedef struct
+{
+  double wall;
+  double cpu;
+} stpi_profile_mark_t;
+
+/**
+ * Start profiling a page if STP_PROFILE is set in the environment.
+ * The profile is shared with every copy of the vars made while the
+ * page is printed.
+ * @param v the vars object being printed.
+ */
+extern void stpi_profile_page_start(const stp_vars_t *v);
+
+/**
+ * Report the profile of a page, if one was started, and discard it.
+ * @param v the vars object being printed.
+ */
+extern void stpi_profile_page_end(const stp_vars_t *v);
+
+/**
+ * Start timing a stage.
+ * @param v the vars object in use.
+ * @param mark receives the start time.
+ * @returns the active profile, or NULL if the page isn't being
+ * profiled, in which case stpi_profile_end() must not be called.
+ */
+extern stpi_profile_t *stpi_profile_begin(const stp_vars_t *v,
+					  stpi_profile_mark_t *mark);
+
+/**
+ * Finish timing a stage started with stpi_profile_begin().
+ * @param p the profile returned by stpi_profile_begin().
+ * @param stage the stage being timed.
+ * @param mark the start time.
+ */
+extern void stpi_profile_end(stpi_profile_t *p, stpi_profile_stage_t stage,
+			     const stpi_profile_mark_t *mark);
+
+/**
+ * Count a block of output passed to the outfunc.
+ * @param p the active profile.
+ * @param bytes the size of the block.
+ */
+extern void stpi_profile_output(stpi_profile_t *p, size_t bytes);
+
+/**
+ * Count lookups in the color conversion memo.
+ * @param p the active profile.
+ * @param lookups the number of lookups.
+ * @param hits the number of lookups that found a result.
+ */
+extern void stpi_profile_color_memo(stpi_profile_t *p, unsigned long lookups,
+				    unsigned long hits);
+
+/**
+ * Read a monotonic wall clock.
+ * @returns the time in seconds from an arbitrary starting point.
+ */
+extern double stpi_wall_time(void);
+
+extern stpi_profile_t *stpi_vars_get_profile(const stp_vars_t *v);
+extern void stpi_vars_set_profile(const stp_vars_t *v, stpi_profile_t *p);
+
+/**
+ * IDs of the component data that the core allocates, for use with
+ * stpi_get_component().
+ */
+typedef enum
+{
+  STPI_COMPONENT_COLOR,		/*!< "Color" */
+  STPI_COMPONENT_DITHER,	/*!< "Dither" */
+  STPI_COMPONENT_DRIVER,	/*!< "Driver" */
+  STPI_COMPONENT_CHANNEL,	/*!< "Channel" */
+  STPI_COMPONENT_WEAVE,		/*!< "Weave" */
+  STPI_COMPONENT_COUNT
+} stpi_component_id_t;
+
+/**
+ * Get component data without looking it up by name.
+ * @param v the vars holding the data.
+ * @param id the component ID.
+ * @returns the data, or NULL if none is allocated.
+ */
+extern void *stpi_get_component(const stp_vars_t *v, int id);
+
+/**
+ * A numeric parameter looked up once by name, so that code that reads
+ * it for every row does not have to search the parameter list.  The
+ * handle remembers the value it found; it goes stale when any parameter
+ * of the vars changes, and reading a stale handle, or reading it with
+ * different vars, falls back to looking the parameter up by name.  The
+ * name must outlive the handle.
+ */
+typedef struct
+{
+  const char *name;
+  const stp_vars_t *v;
+  unsigned serial;
+  union
+  {
+    int ival;
+    double dval;
+    stp_dimension_t sval;
+  } value;
+} stpi_parameter_handle_t;
+
+/**
+ * Resolve a parameter into a handle.
+ * @param v the vars to look the parameter up in.
+ * @param parameter the name of the parameter.
+ * @param h the handle to fill in.
+ */
+extern void stpi_resolve_int_parameter(const stp_vars_t *v,
+				       const char *parameter,
+				       stpi_parameter_handle_t *h);
+extern void stpi_resolve_boolean_parameter(const stp_vars_t *v,
+					   const char *parameter,
+					   stpi_parameter_handle_t *h);
+extern void stpi_resolve_dimension_parameter(const stp_vars_t *v,
+					     const char *parameter,
+					     stpi_parameter_handle_t *h);
+extern void stpi_resolve_float_parameter(const stp_vars_t *v,
+					 const char *parameter,
+					 stpi_parameter_handle_t *h);
+
+/**
+ * Read a parameter through a handle.  The handle itself is not
+ * modified, so one handle may be read from several threads.
+ * @param v the vars to read the parameter from.
+ * @param h a handle resolved by the matching stpi_resolve function.
+ * @returns the value of the parameter, as stp_get_*_parameter would.
+ */
+extern int stpi_get_int_parameter_by_handle(const stp_vars_t *v,
+					    const stpi_parameter_handle_t *h);
+extern int stpi_get_boolean_parameter_by_handle(const stp_vars_t *v,
+						const stpi_parameter_handle_t *h);
+extern stp_dimension_t
+stpi_get_dimension_parameter_by_handle(const stp_vars_t *v,
+				       const stpi_parameter_handle_t *h);
+extern double stpi_get_float_parameter_by_handle(const stp_vars_t *v,
+						 const stpi_parameter_handle_t *h);
+
+/**
+ * Worker thread pools (internal).
+ *
+ * @defgroup thread_pool thread-pool
+ * @{
+ */
+
+typedef struct stpi_thread_pool stpi_thread_pool_t;
+
+/**
+ * A job run by a thread pool.
+ * @param data the data passed to stpi_thread_pool_run().
+ * @param job the index of the job, from 0 to the number of jobs - 1.
+ */
+typedef void (*stpi_thread_pool_func_t)(void *data, int job);
+
+/**
+ * Create a pool of worker threads.
+ * @param threads the total number of threads to run jobs on, including
+ * the thread calling stpi_thread_pool_run().
+ * @returns the new pool, or NULL if threads is less than 2 or no threads
+ * could be started.  A NULL pool runs all jobs on the calling thread.
+ */
+extern stpi_thread_pool_t *stpi_thread_pool_create(int threads);
+
+/**
+ * Stop the worker threads and free a pool.
+ * @param pool the pool to destroy (may be NULL).
+ */
+extern void stpi_thread_pool_destroy(stpi_thread_pool_t *pool);
+
+/**
+ * Get the number of threads a pool runs jobs on.
+ * @param pool the pool (may be NULL).
+ * @returns the number of threads, including the calling thread.
+ */
+extern int stpi_thread_pool_size(const stpi_thread_pool_t *pool);
+
+/**
+ * Run a batch of independent jobs, and wait for all of them to finish.
+ * Jobs may run in any order and on any thread.
+ * @param pool the pool to use (may be NULL).
+ * @param jobs the number of jobs.
+ * @param func the function to run for each job.
+ * @param data passed to each call of func.
+ */
+extern void stpi_thread_pool_run(stpi_thread_pool_t *pool, int jobs,
+				 stpi_thread_pool_func_t func, void *data);
+
+/** @} */
+
+/**
+ * On-disk cache of computed lookup tables (internal).  The cache is
+ * only used when STP_LUT_CACHE_DIR names a writable directory.
+ *
+ * @defgroup lut_cache lut-cache
+ * @{
+ */
+
+typedef struct stpi_lut_cache_key stpi_lut_cache_key_t;
+typedef struct stpi_lut_cache_entry stpi_lut_cache_entry_t;
+
+/**
+ * Start a cache key.
+ * @param kind a short name for the kind of table, used in the file name.
+ * Must remain valid for the life of the key.
+ * @returns the key, or NULL if the cache is disabled.  All other
+ * functions accept a NULL key and do nothing.
+ */
+extern stpi_lut_cache_key_t *stpi_lut_cache_key_create(const char *kind);
+
+/**
+ * Add an input to a cache key.  Every value that affects the contents
+ * of the table must be added.
+ * @param key the key.
+ * @param data the input.
+ * @param bytes the size of the input.
+ */
+extern void stpi_lut_cache_key_add(stpi_lut_cache_key_t *key,
+				   const void *data, size_t bytes);
+
+/**
+ * Free a cache key.
+ * @param key the key (may be NULL).
+ */
+extern void stpi_lut_cache_key_destroy(stpi_lut_cache_key_t *key);
+
+/**
+ * Map a cached table read-only.
+ * @param key the key.
+ * @param bytes the expected size of the table.
+ * @returns the entry, or NULL if no matching table is cached.
+ */
+extern stpi_lut_cache_entry_t *
+stpi_lut_cache_lookup(const stpi_lut_cache_key_t *key, size_t bytes);
+
+/**
+ * Get the table of a cache entry.  It stays valid until the entry is
+ * released, and must not be modified.
+ * @param entry the entry.
+ */
+extern const void *
+stpi_lut_cache_entry_data(const stpi_lut_cache_entry_t *entry);
+
+/**
+ * Unmap a cached table.
+ * @param entry the entry (may be NULL).
+ */
+extern void stpi_lut_cache_entry_release(stpi_lut_cache_entry_t *entry);
+
+/**
+ * Store a computed table in the cache.  Failures are silently ignored.
+ * @param key the key.
+ * @param data the table.
+ * @param bytes the size of the table.
+ */
+extern void stpi_lut_cache_store(const stpi_lut_cache_key_t *key,
+				 const void *data, size_t bytes);
+
+/** @} */
+
+/**
+ * Planar channel output (internal).  In addition to the usual
+ * interleaved output, the channel code can provide each physical
+ * channel of the converted row in a row of its own, for dither
+ * algorithms that work through one channel at a time.
+ *
+ * @defgroup planar_output planar-output
+ * @{
+ */
+
+/**
+ * Request or stop planar output.  This is normally done when the
+ * dither is initialized.
+ * @param v the vars.
+ * @param planar whether to produce planar output.
+ */
+extern void stpi_channel_set_planar_output(stp_vars_t *v, int planar);
+
+/**
+ * Get the planar output of the last converted row.
+ * @param v the vars.
+ * @param plane_stride receives the distance, in shorts, from the start
+ * of one channel to the start of the next.
+ * @param empty_planes receives a bit for each channel that is zero
+ * across the whole row.
+ * @returns the first channel, or NULL if planar output is not enabled.
+ */
+extern const unsigned short *
+stpi_channel_get_planar_output(const stp_vars_t *v, size_t *plane_stride,
+			       unsigned *empty_planes);
+
+/**
+ * Get the size of the planar output.
+ * @param v the vars.
+ * @returns the size in shorts, or 0 if planar output is not enabled.
+ */
+extern size_t stpi_channel_get_planar_output_size(const stp_vars_t *v);
+
+/**
+ * Dither a row of planar input, as returned by
+ * stpi_channel_get_planar_output().  Only valid if the dither was
+ * initialized for planar input.
+ * @param v the vars.
+ * @param row the row number.
+ * @param planes the first channel of the row.
+ * @param plane_stride the distance from one channel to the next.
+ * @param empty_planes the channels that are zero across the whole row.
+ * @param duplicate_line as for stp_dither().
+ * @param zero_mask as for stp_dither().
+ * @param mask as for stp_dither().
+ */
+extern void stpi_dither_planar(stp_vars_t *v, int row,
+			       const unsigned short *planes,
+			       size_t plane_stride, unsigned empty_planes,
+			       int duplicate_line, int zero_mask,
+			       const unsigned char *mask);
+
+/**
+ * Set the number of threads, counting the one calling stp_dither(),
+ * that rows may be split across.  This is the RenderThreads parameter
+ * unless the driver uses some of those threads itself.  Only valid
+ * before the first row is dithered.
+ * @param v the vars.
+ * @param threads the number of threads.
+ */
+extern void stpi_dither_set_thread_count(stp_vars_t *v, int threads);
+
+/** @} */
+
 #define CAST_IS_SAFE GCC_DIAG_OFF(cast-qual)
 #define CAST_IS_UNSAFE GCC_DIAG_ON(cast-qual)
 
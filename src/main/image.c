@@ -58,6 +58,33 @@ stp_image_get_row(stp_image_t *image, unsigned char *data,
   return image->get_row(image, data, byte_limit, row);
 }
 
+stp_image_status_t
+stp_image_get_rows(stp_image_t *image, unsigned char *data, size_t stride,
+		   size_t byte_limit, int first_row, int count)
+{
+  int i;
+  if (image->get_rows)
+    return image->get_rows(image, data, stride, byte_limit, first_row, count);
+  for (i = 0; i < count; i++)
+    {
+      stp_image_status_t status =
+	image->get_row(image, data + i * stride, byte_limit, first_row + i);
+      if (status != STP_IMAGE_STATUS_OK)
+	return status;
+    }
+  return STP_IMAGE_STATUS_OK;
+}
+
+stp_image_status_t
+stp_image_borrow_row(stp_image_t *image, const unsigned char **data,
+		     size_t byte_limit, int row)
+{
+  *data = NULL;
+  if (image->borrow_row)
+    return image->borrow_row(image, data, byte_limit, row);
+  return STP_IMAGE_STATUS_OK;
+}
+
 const char *
 stp_image_get_appname(stp_image_t *image)
 {
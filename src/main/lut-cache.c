@@ -0,0 +1,272 @@
+/*
+ *   On-disk cache of computed lookup tables for Gutenprint
+ *
+ *   Copyright 2026 The Gutenprint Project
+ *
+ *   This program is free software; you can redistribute it and/or modify it
+ *   under the terms of the GNU General Public License as published by the Free
+ *   Software Foundation; either version 2 of the License, or (at your option)
+ *   any later version.
+ *
+ *   This program is distributed in the hope that it will be useful, but
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *   or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *   for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <gutenprint/gutenprint.h>
+#include "gutenprint-internal.h"
+#include <gutenprint/gutenprint-intl-internal.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#if defined(HAVE_SYS_MMAN_H) && defined(HAVE_UNISTD_H) && defined(HAVE_FCNTL_H)
+#define USE_LUT_CACHE
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+/*
+ * Tables such as resampled curves and subchannel splits depend only on
+ * a handful of settings, but are recomputed for every job.  When
+ * STP_LUT_CACHE_DIR names a writable directory, they are written there
+ * the first time they are computed and mapped read-only by later jobs
+ * (in this or any other process) that compute the same table.
+ *
+ * A table is identified by a key made up of every input it was
+ * computed from.  The file name is a hash of the key; the full key is
+ * stored in the file as well and compared on lookup, so a hash
+ * collision only costs a recomputation.  Files are written to a
+ * temporary name and renamed into place, so readers never see a
+ * partial table.  Any failure simply means the table is computed as
+ * usual.
+ */
+
+#define LUT_CACHE_MAGIC "STPLUT01"
+
+struct stpi_lut_cache_key
+{
+  char *dir;
+  const char *kind;
+  unsigned char *data;
+  size_t bytes;
+  size_t alloc;
+};
+
+struct stpi_lut_cache_entry
+{
+  void *map;
+  size_t map_bytes;
+  const void *data;
+};
+
+typedef struct
+{
+  char magic[8];
+  unsigned long long key_bytes;
+  unsigned long long data_bytes;
+} lut_cache_header_t;
+
+/* Tables are aligned to 16 bytes within the file */
+#define LUT_CACHE_ALIGN(x) (((x) + 15) & ~((size_t) 15))
+
+stpi_lut_cache_key_t *
+stpi_lut_cache_key_create(const char *kind)
+{
+#ifdef USE_LUT_CACHE
+  const char *dir = getenv("STP_LUT_CACHE_DIR");
+  stpi_lut_cache_key_t *key;
+  unsigned endian = 0x01020304;
+  if (!dir || !dir[0])
+    return NULL;
+  key = stp_zalloc(sizeof(stpi_lut_cache_key_t));
+  key->dir = stp_strdup(dir);
+  key->kind = kind;
+  /*
+   * Tables are stored in native byte order and floating point format,
+   * and may change between releases.
+   */
+  stpi_lut_cache_key_add(key, VERSION, strlen(VERSION));
+  stpi_lut_cache_key_add(key, kind, strlen(kind) + 1);
+  stpi_lut_cache_key_add(key, &endian, sizeof(endian));
+  return key;
+#else
+  return NULL;
+#endif
+}
+
+void
+stpi_lut_cache_key_add(stpi_lut_cache_key_t *key, const void *data,
+		       size_t bytes)
+{
+  if (!key || bytes == 0)
+    return;
+  if (key->bytes + bytes > key->alloc)
+    {
+      key->alloc = (key->bytes + bytes) * 2;
+      key->data = stp_realloc(key->data, key->alloc);
+    }
+  memcpy(key->data + key->bytes, data, bytes);
+  key->bytes += bytes;
+}
+
+void
+stpi_lut_cache_key_destroy(stpi_lut_cache_key_t *key)
+{
+  if (!key)
+    return;
+  STP_SAFE_FREE(key->data);
+  STP_SAFE_FREE(key->dir);
+  stp_free(key);
+}
+
+#ifdef USE_LUT_CACHE
+
+static char *
+lut_cache_filename(const stpi_lut_cache_key_t *key)
+{
+  /* 64 bit FNV-1a */
+  unsigned long long hash = 0xcbf29ce484222325ull;
+  char *name;
+  size_t i;
+  for (i = 0; i < key->bytes; i++)
+    {
+      hash ^= key->data[i];
+      hash *= 0x100000001b3ull;
+    }
+  stp_asprintf(&name, "%s/%s-%016llx.lut", key->dir, key->kind, hash);
+  return name;
+}
+
+static size_t
+lut_cache_data_offset(const stpi_lut_cache_key_t *key)
+{
+  return LUT_CACHE_ALIGN(sizeof(lut_cache_header_t) + key->bytes);
+}
+
+#endif
+
+stpi_lut_cache_entry_t *
+stpi_lut_cache_lookup(const stpi_lut_cache_key_t *key, size_t bytes)
+{
+#ifdef USE_LUT_CACHE
+  char *name;
+  int fd;
+  struct stat sb;
+  size_t offset;
+  void *map;
+  const lut_cache_header_t *header;
+  stpi_lut_cache_entry_t *entry;
+
+  if (!key)
+    return NULL;
+  offset = lut_cache_data_offset(key);
+  name = lut_cache_filename(key);
+  fd = open(name, O_RDONLY);
+  stp_free(name);
+  if (fd < 0)
+    return NULL;
+  if (fstat(fd, &sb) < 0 || sb.st_size != (off_t) (offset + bytes))
+    {
+      close(fd);
+      return NULL;
+    }
+  map = mmap(NULL, offset + bytes, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+    return NULL;
+  header = (const lut_cache_header_t *) map;
+  if (memcmp(header->magic, LUT_CACHE_MAGIC, sizeof(header->magic)) != 0 ||
+      header->key_bytes != key->bytes || header->data_bytes != bytes ||
+      memcmp(header + 1, key->data, key->bytes) != 0)
+    {
+      munmap(map, offset + bytes);
+      return NULL;
+    }
+  entry = stp_malloc(sizeof(stpi_lut_cache_entry_t));
+  entry->map = map;
+  entry->map_bytes = offset + bytes;
+  entry->data = (const char *) map + offset;
+  stp_deprintf(STP_DBG_LUT, "LUT cache: mapped %s table (%lu bytes)\n",
+	       key->kind, (unsigned long) bytes);
+  return entry;
+#else
+  return NULL;
+#endif
+}
+
+const void *
+stpi_lut_cache_entry_data(const stpi_lut_cache_entry_t *entry)
+{
+  return entry->data;
+}
+
+void
+stpi_lut_cache_entry_release(stpi_lut_cache_entry_t *entry)
+{
+  if (!entry)
+    return;
+#ifdef USE_LUT_CACHE
+  munmap(entry->map, entry->map_bytes);
+#endif
+  stp_free(entry);
+}
+
+void
+stpi_lut_cache_store(const stpi_lut_cache_key_t *key, const void *data,
+		     size_t bytes)
+{
+#ifdef USE_LUT_CACHE
+  char *name;
+  char *tmpname;
+  int fd;
+  size_t offset;
+  char *buf;
+  lut_cache_header_t *header;
+  size_t written = 0;
+
+  if (!key)
+    return;
+  offset = lut_cache_data_offset(key);
+  buf = stp_zalloc(offset + bytes);
+  header = (lut_cache_header_t *) buf;
+  memcpy(header->magic, LUT_CACHE_MAGIC, sizeof(header->magic));
+  header->key_bytes = key->bytes;
+  header->data_bytes = bytes;
+  memcpy(header + 1, key->data, key->bytes);
+  memcpy(buf + offset, data, bytes);
+
+  name = lut_cache_filename(key);
+  stp_asprintf(&tmpname, "%s.XXXXXX", name);
+  fd = mkstemp(tmpname);
+  if (fd >= 0)
+    {
+      /* The tables aren't private; let other print queues share them */
+      (void) fchmod(fd, 0644);
+      while (written < offset + bytes)
+	{
+	  ssize_t n = write(fd, buf + written, offset + bytes - written);
+	  if (n <= 0)
+	    break;
+	  written += n;
+	}
+      if (close(fd) == 0 && written == offset + bytes &&
+	  rename(tmpname, name) == 0)
+	stp_deprintf(STP_DBG_LUT, "LUT cache: stored %s\n", name);
+      else
+	unlink(tmpname);
+    }
+  stp_free(tmpname);
+  stp_free(name);
+  stp_free(buf);
+#endif
+}
@@ -42,6 +42,7 @@ typedef struct stpi_internal_module_class
 
 static void module_list_freefunc(void *item);
 static int stp_module_register(stp_module_t *module);
+static int module_open(const char *modulename);
 #if defined(MODULE) && defined(USE_DLOPEN)
 static void *stp_dlsym(void *handle, const char *symbol, const char *modulename);
 #endif
@@ -112,7 +113,8 @@ module_list_freefunc(void *item /* module to remove */)
 /*
  * Load all available modules.  Return nonzero on failure.
  */
-int stp_module_load(void)
+static int
+module_load(void)
 {
   /* initialise libltdl */
 #ifdef USE_LTDL
@@ -177,7 +179,7 @@ int stp_module_load(void)
   file = stp_list_get_start(file_list);
   while (file)
     {
-      stp_module_open((const char *) stp_list_item_get_data(file));
+      module_open((const char *) stp_list_item_get_data(file));
       file = stp_list_item_next(file);
     }
 
@@ -195,6 +197,16 @@ int stp_module_load(void)
   return 0;
   }
 
+int
+stp_module_load(void)
+{
+  int status;
+  stpi_global_lock();
+  status = module_load();
+  stpi_global_unlock();
+  return status;
+}
+
 
 /*
  * Unload all modules and clean up.
@@ -202,15 +214,17 @@ int stp_module_load(void)
 int
 stp_module_exit(void)
 {
+  int status = 0;
+  stpi_global_lock();
   /* destroy the module list (modules unloaded by callback) */
   if (module_list)
     stp_list_destroy(module_list);
   /* shut down libltdl (forces close of any unclosed modules) */
 #ifdef USE_LTDL
-  return lt_dlexit();
-#else
-  return 0;
+  status = lt_dlexit();
 #endif
+  stpi_global_unlock();
+  return status;
 }
 
 
@@ -228,6 +242,7 @@ stp_module_get_class(stp_module_class_t class /* Module class */)
   if (!list)
     return NULL;
 
+  stpi_global_lock();
   ln = stp_list_get_start(module_list);
   while (ln)
     {
@@ -236,6 +251,7 @@ stp_module_get_class(stp_module_class_t class /* Module class */)
 	stp_list_item_create(list, NULL, stp_list_item_get_data(ln));
       ln = stp_list_item_next(ln);
     }
+  stpi_global_unlock();
   return list;
 }
 
@@ -243,8 +259,8 @@ stp_module_get_class(stp_module_class_t class /* Module class */)
 /*
  * Open a module.
  */
-int
-stp_module_open(const char *modulename /* Module filename */)
+static int
+module_open(const char *modulename /* Module filename */)
 {
 #if defined(MODULE)
 #ifdef USE_LTDL
@@ -309,6 +325,16 @@ stp_module_open(const char *modulename /* Module filename */)
   return 1;
 }
 
+int
+stp_module_open(const char *modulename /* Module filename */)
+{
+  int status;
+  stpi_global_lock();
+  status = module_open(modulename);
+  stpi_global_unlock();
+  return status;
+}
+
 
 /*
  * Register a loaded module.
@@ -339,6 +365,7 @@ int stp_module_init(void)
   stp_list_item_t *module_item; /* Module list pointer */
   stp_module_t *module;         /* Module to initialise */
 
+  stpi_global_lock();
   module_item = stp_list_get_start(module_list);
   while (module_item)
     {
@@ -357,6 +384,7 @@ int stp_module_init(void)
       module_item = stp_list_item_next(module_item);
     }
   stpi_find_duplicate_printers();
+  stpi_global_unlock();
   return 0;
 }
 
@@ -368,7 +396,11 @@ int stp_module_init(void)
 int
 stp_module_close(stp_list_item_t *module /* Module to close */)
 {
-  return stp_list_item_destroy(module_list, module);
+  int status;
+  stpi_global_lock();
+  status = stp_list_item_destroy(module_list, module);
+  stpi_global_unlock();
+  return status;
 }
 
 
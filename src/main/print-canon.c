@@ -5500,7 +5500,8 @@ static void
 canon_printfunc(stp_vars_t *v)
 {
   int i;
-  canon_privdata_t *pd = (canon_privdata_t *) stp_get_component_data(v, "Driver");
+  canon_privdata_t *pd =
+    (canon_privdata_t *) stpi_get_component(v, STPI_COMPONENT_DRIVER);
   canon_write_line(v);
   for (i = 0; i < pd->num_channels ; i++)
     canon_advance_buffer(pd->channels[i].buf, pd->length, pd->channels[i].delay);
@@ -6606,7 +6607,7 @@ static void
 canon_write_line(stp_vars_t *v)
 {
   canon_privdata_t *pd =
-    (canon_privdata_t *) stp_get_component_data(v, "Driver");
+    (canon_privdata_t *) stpi_get_component(v, STPI_COMPONENT_DRIVER);
   char write_sequence[] = "KYMCymck";
   static const int write_number[] = { 3, 2, 1, 0, 6, 5, 4, 7 };   /* KYMCymc */
   int i;
@@ -6714,7 +6715,8 @@ canon_flush_pass(stp_vars_t *v, int passno, int vertical_subpass)
   const stp_linebufs_t *bufs       = stp_get_linebases_by_pass(v, passno);
   stp_pass_t           *pass       = stp_get_pass_by_pass(v, passno);
   stp_linecount_t      *linecount  = stp_get_linecount_by_pass(v, passno);
-  canon_privdata_t      *pd         = (canon_privdata_t *) stp_get_component_data(v, "Driver");
+  canon_privdata_t      *pd         =
+    (canon_privdata_t *) stpi_get_component(v, STPI_COMPONENT_DRIVER);
   int                    papershift = (pass->logicalpassstart - pd->last_pass_offset);
 
   int color, line, written = 0, linelength = 0, lines = 0;
@@ -42,6 +42,12 @@
 #define inline __inline__
 #endif
 
+/*
+ * Number of input rows fetched at once from images that provide a
+ * get_rows() callback.
+ */
+#define IMAGE_ROW_BATCH 16
+
 static const color_correction_t color_corrections[] =
 {
   { "None",        N_("Default"),          COLOR_CORRECTION_DEFAULT,     1 },
@@ -177,6 +183,27 @@ static const channel_depth_t channel_depths[] =
 static const int channel_depth_count =
 sizeof(channel_depths) / sizeof(channel_depth_t);
 
+static const color_lut_size_t color_lut_sizes[] =
+{
+  { "None", N_("Compute Each Pixel"), 0  },
+  { "17",   N_("17 Points"),          17 },
+  { "33",   N_("33 Points"),          33 },
+  { "65",   N_("65 Points"),          65 }
+};
+
+static const int color_lut_size_count =
+sizeof(color_lut_sizes) / sizeof(color_lut_size_t);
+
+static const curve_table_size_t curve_table_sizes[] =
+{
+  { "Full", N_("Full Precision"), 0    },
+  { "4096", N_("4096 Points"),    4096 },
+  { "1024", N_("1024 Points"),    1024 }
+};
+
+static const int curve_table_size_count =
+sizeof(curve_table_sizes) / sizeof(curve_table_size_t);
+
 
 typedef struct
 {
@@ -217,6 +244,42 @@ static const float_param_t float_parameters[] =
       STP_PARAMETER_LEVEL_BASIC, 1, 1, -1, 1, 0
     }, 0.0, 0.0, 0.0, CMASK_EVERY, 0, -1
   },
+  {
+    {
+      "ColorLUT", N_("Color Lookup Table"), "Color=Yes,Category=Advanced Output Control",
+      N_("Precompute color adjustments into a table with this many points "
+	 "per axis and interpolate between them"),
+      STP_PARAMETER_TYPE_STRING_LIST, STP_PARAMETER_CLASS_OUTPUT,
+      STP_PARAMETER_LEVEL_ADVANCED4, 0, 1, -1, 1, 0
+    }, 0.0, 0.0, 0.0, CMASK_EVERY, 1, -1
+  },
+  {
+    {
+      "CurveTableSize", N_("16-bit Curve Table Size"), "Color=Yes,Category=Advanced Output Control",
+      N_("Store the color curves for 16-bit images at this many points "
+	 "and interpolate between them"),
+      STP_PARAMETER_TYPE_STRING_LIST, STP_PARAMETER_CLASS_OUTPUT,
+      STP_PARAMETER_LEVEL_ADVANCED4, 0, 1, -1, 1, 0
+    }, 0.0, 0.0, 0.0, CMASK_EVERY, 1, -1
+  },
+  {
+    {
+      "FixedPointHSL", N_("Fixed Point Color Adjustment"), "Color=Yes,Category=Advanced Output Control",
+      N_("Use faster but slightly less precise arithmetic for saturation, "
+	 "hue and luminosity adjustments of 8-bit images"),
+      STP_PARAMETER_TYPE_BOOLEAN, STP_PARAMETER_CLASS_OUTPUT,
+      STP_PARAMETER_LEVEL_ADVANCED4, 0, 1, -1, 1, 0
+    }, 0.0, 1.0, 0.0, CMASK_EVERY, 1, -1
+  },
+  {
+    {
+      "CompactSubchannelTables", N_("Compact Light Ink Tables"), "Color=Yes,Category=Advanced Output Control",
+      N_("Split colors between light and dark inks with smaller tables, "
+	 "interpolating between their points"),
+      STP_PARAMETER_TYPE_BOOLEAN, STP_PARAMETER_CLASS_OUTPUT,
+      STP_PARAMETER_LEVEL_ADVANCED4, 0, 1, -1, 1, 0
+    }, 0.0, 1.0, 0.0, CMASK_EVERY, 1, -1
+  },
   {
     {
       "InputImageType", N_("Input Image Type"), "Color=Yes,Category=Core Parameter",
@@ -715,6 +778,32 @@ get_channel_depth(const char *name)
   return NULL;
 }
 
+static const color_lut_size_t *
+get_color_lut_size(const char *name)
+{
+  int i;
+  if (name)
+    for (i = 0; i < color_lut_size_count; i++)
+      {
+	if (strcmp(name, color_lut_sizes[i].name) == 0)
+	  return &(color_lut_sizes[i]);
+      }
+  return NULL;
+}
+
+static const curve_table_size_t *
+get_curve_table_size(const char *name)
+{
+  int i;
+  if (name)
+    for (i = 0; i < curve_table_size_count; i++)
+      {
+	if (strcmp(name, curve_table_sizes[i].name) == 0)
+	  return &(curve_table_sizes[i]);
+      }
+  return NULL;
+}
+
 static const color_correction_t *
 get_color_correction(const char *name)
 {
@@ -744,10 +833,13 @@ get_color_correction_by_tag(color_correction_enum_t correction)
 static void
 initialize_channels(stp_vars_t *v, stp_image_t *image)
 {
-  lut_t *lut = (lut_t *)(stp_get_component_data(v, "Color"));
+  lut_t *lut = (lut_t *)(stpi_get_component(v, STPI_COMPONENT_COLOR));
   if (stp_check_float_parameter(v, "InkLimit", STP_PARAMETER_ACTIVE))
     stp_channel_set_ink_limit(v, stp_get_float_parameter(v, "InkLimit"));
   stp_channel_initialize(v, image, lut->out_channels);
+  /* The color conversion functions read these for every row */
+  stpi_resolve_float_parameter(v, "Saturation", &(lut->saturation));
+  stpi_resolve_float_parameter(v, "Brightness", &(lut->user_brightness));
   lut->channels_are_initialized = 1;
 }
 
@@ -757,19 +849,77 @@ stpi_color_traditional_get_row(stp_vars_t *v,
 			       int row,
 			       unsigned *zero_mask)
 {
-  const lut_t *lut = (const lut_t *)(stp_get_component_data(v, "Color"));
+  lut_t *lut = (lut_t *)(stpi_get_component(v, STPI_COMPONENT_COLOR));
+  size_t byte_limit =
+    lut->image_width * lut->in_channels * lut->channel_depth / 8;
+  const unsigned char *in_data = NULL;
   unsigned zero;
-  if (stp_image_get_row(image, lut->in_data,
-			lut->image_width * lut->in_channels * lut->channel_depth / 8, row)
-      != STP_IMAGE_STATUS_OK)
+  unsigned long memo_lookups;
+  unsigned long memo_hits;
+  stpi_profile_mark_t mark;
+  stpi_profile_t *profile = stpi_profile_begin(v, &mark);
+  /*
+   * Use a row already fetched as part of a block if we have one;
+   * otherwise read the row in place if the image can lend it to us,
+   * and only copy it as a last resort.
+   */
+  if (lut->in_rows_count > 0 && row >= lut->in_rows_first &&
+      row < lut->in_rows_first + lut->in_rows_count)
+    in_data = lut->in_rows + (row - lut->in_rows_first) * lut->in_row_stride;
+  else if (lut->image_lends_rows &&
+	   stp_image_borrow_row(image, &in_data, byte_limit, row)
+	   != STP_IMAGE_STATUS_OK)
     return 2;
+  if (!in_data && lut->in_rows)
+    {
+      int count = lut->image_height - row;
+      if (count > IMAGE_ROW_BATCH)
+	count = IMAGE_ROW_BATCH;
+      else if (count < 1)
+	count = 1;
+      lut->in_rows_count = 0;
+      if (stp_image_get_rows(image, lut->in_rows, lut->in_row_stride,
+			     byte_limit, row, count) != STP_IMAGE_STATUS_OK)
+	return 2;
+      lut->in_rows_first = row;
+      lut->in_rows_count = count;
+      in_data = lut->in_rows;
+    }
+  else if (!in_data)
+    {
+      if (stp_image_get_row(image, lut->in_data, byte_limit, row)
+	  != STP_IMAGE_STATUS_OK)
+	return 2;
+      in_data = lut->in_data;
+    }
+  if (profile)
+    {
+      stpi_profile_end(profile, STPI_PROFILE_IMAGE_FETCH, &mark);
+      stpi_profile_begin(v, &mark);
+    }
   if (!lut->channels_are_initialized)
     initialize_channels(v, image);
+  memo_lookups = lut->color_memo_lookups;
+  memo_hits = lut->color_memo_hits;
   zero = (lut->output_color_description->conversion_function)
-    (v, lut->in_data, stp_channel_get_input(v));
+    (v, in_data, stp_channel_get_input(v));
   if (zero_mask)
     *zero_mask = zero;
+  if (profile)
+    {
+      stpi_profile_end(profile, STPI_PROFILE_COLOR_CONVERSION, &mark);
+      stpi_profile_color_memo(profile,
+			      lut->color_memo_lookups - memo_lookups,
+			      lut->color_memo_hits - memo_hits);
+      stpi_profile_begin(v, &mark);
+    }
+  if (row == lut->image_height - 1 && lut->color_memo_lookups > 0)
+    stp_dprintf(STP_DBG_COLORFUNC, v,
+		"Colorfunc: color memo hits %lu of %lu lookups\n",
+		lut->color_memo_hits, lut->color_memo_lookups);
   stp_channel_convert(v, zero_mask);
+  if (profile)
+    stpi_profile_end(profile, STPI_PROFILE_CHANNEL_CONVERT, &mark);
   return 0;
 }
 
@@ -837,6 +987,8 @@ copy_lut(void *vlut)
   dest->brightness = src->brightness;
   dest->simple_gamma_correction = src->simple_gamma_correction;
   dest->linear_contrast_adjustment = src->linear_contrast_adjustment;
+  dest->saturation = src->saturation;
+  dest->user_brightness = src->user_brightness;
   stp_curve_cache_copy(&(dest->hue_map), &(src->hue_map));
   stp_curve_cache_copy(&(dest->lum_map), &(src->lum_map));
   stp_curve_cache_copy(&(dest->sat_map), &(src->sat_map));
@@ -847,6 +999,29 @@ copy_lut(void *vlut)
       dest->in_data = stp_malloc(src->image_width * src->in_channels);
       memset(dest->in_data, 0, src->image_width * src->in_channels);
     }
+  dest->image_height = src->image_height;
+  dest->in_row_stride = src->in_row_stride;
+  if (src->in_rows)
+    dest->in_rows = stp_zalloc(src->in_row_stride * IMAGE_ROW_BATCH);
+  dest->image_lends_rows = src->image_lends_rows;
+  dest->color_lut_nodes = src->color_lut_nodes;
+  if (src->color_lut)
+    {
+      size_t points = (size_t) src->color_lut_nodes *
+	src->color_lut_nodes * src->color_lut_nodes;
+      size_t positions = (size_t) 1 << src->channel_depth;
+      dest->color_lut = stp_malloc(points * 3 * sizeof(unsigned short));
+      memcpy(dest->color_lut, src->color_lut,
+	     points * 3 * sizeof(unsigned short));
+      dest->color_lut_pos = stp_malloc(positions * sizeof(unsigned));
+      memcpy(dest->color_lut_pos, src->color_lut_pos,
+	     positions * sizeof(unsigned));
+    }
+  dest->curve_table_points = src->curve_table_points;
+  dest->curve_table_scale = src->curve_table_scale;
+  dest->fixed_point_hsl = src->fixed_point_hsl;
+  if (dest->fixed_point_hsl)
+    stpi_color_prepare_fixed_hsl(dest);
   return dest;
 }
 
@@ -864,6 +1039,13 @@ free_lut(void *vlut)
   STP_SAFE_FREE(lut->gray_tmp);
   STP_SAFE_FREE(lut->cmy_tmp);
   STP_SAFE_FREE(lut->in_data);
+  STP_SAFE_FREE(lut->in_rows);
+  STP_SAFE_FREE(lut->color_lut);
+  STP_SAFE_FREE(lut->color_lut_pos);
+  STP_SAFE_FREE(lut->fixed_hue_map);
+  STP_SAFE_FREE(lut->fixed_lum_map);
+  STP_SAFE_FREE(lut->fixed_sat_map);
+  STP_SAFE_FREE(lut->color_memo);
   memset(lut, 0, sizeof(lut_t));
   stp_free(lut);
 }
@@ -872,7 +1054,7 @@ static stp_curve_t *
 compute_gcr_curve(const stp_vars_t *vars)
 {
   stp_curve_t *curve;
-  lut_t *lut = (lut_t *)(stp_get_component_data(vars, "Color"));
+  lut_t *lut = (lut_t *)(stpi_get_component(vars, STPI_COMPONENT_COLOR));
   double k_lower = 0.0;
   double k_upper = 1.0;
   double k_trans = 1.0;
@@ -935,7 +1117,7 @@ compute_gcr_curve(const stp_vars_t *vars)
 static void
 initialize_gcr_curve(stp_vars_t *vars)
 {
-  lut_t *lut = (lut_t *)(stp_get_component_data(vars, "Color"));
+  lut_t *lut = (lut_t *)(stpi_get_component(vars, STPI_COMPONENT_COLOR));
   stp_curve_t *curve = NULL;
   if (stp_check_curve_parameter(vars, "GCRCurve", STP_PARAMETER_DEFAULTED))
     {
@@ -1304,7 +1486,7 @@ compute_one_lut(lut_t *lut, int i)
 static void
 setup_channel(stp_vars_t *v, int i, const channel_param_t *p)
 {
-  lut_t *lut = (lut_t *)(stp_get_component_data(v, "Color"));
+  lut_t *lut = (lut_t *)(stpi_get_component(v, STPI_COMPONENT_COLOR));
   const char *gamma_name =
     (lut->output_color_description->color_model == COLOR_BLACK ?
      p->gamma_name : p->rgb_gamma_name);
@@ -1347,7 +1529,7 @@ static void
 stpi_do_dump_lut_to_file(stp_vars_t *v, FILE *fp)
 {
   int i;
-  lut_t *lut = (lut_t *)(stp_get_component_data(v, "Color"));
+  lut_t *lut = (lut_t *)(stpi_get_component(v, STPI_COMPONENT_COLOR));
   const stp_curve_t *curve;
   fprintf(fp, "Gutenprint LUT dump version 0\n\n");
   fprintf(fp, "Input color description: '%s'\n", lut->input_color_description->name);
@@ -1392,7 +1574,7 @@ static void
 stpi_compute_lut(stp_vars_t *v)
 {
   int i;
-  lut_t *lut = (lut_t *)(stp_get_component_data(v, "Color"));
+  lut_t *lut = (lut_t *)(stpi_get_component(v, STPI_COMPONENT_COLOR));
   double app_gamma_scale = 4.0;
   stp_curve_t *curve;
   stp_dprintf(STP_DBG_LUT, v, "stpi_compute_lut\n");
@@ -1508,6 +1690,10 @@ stpi_color_traditional_init(stp_vars_t *v,
   const char *color_correction = stp_get_string_parameter(v, "ColorCorrection");
   const channel_depth_t *channel_depth =
     get_channel_depth(stp_get_string_parameter(v, "ChannelBitDepth"));
+  const color_lut_size_t *color_lut_size =
+    get_color_lut_size(stp_get_string_parameter(v, "ColorLUT"));
+  const curve_table_size_t *curve_table_size =
+    get_curve_table_size(stp_get_string_parameter(v, "CurveTableSize"));
   size_t total_channel_bits;
 
   if (steps != 256 && steps != 65536)
@@ -1574,18 +1760,49 @@ stpi_color_traditional_init(stp_vars_t *v,
       (get_color_correction_by_tag
        (lut->output_color_description->default_correction));
 
+  if (color_lut_size)
+    lut->color_lut_nodes = color_lut_size->nodes;
+  if (curve_table_size && curve_table_size->points &&
+      lut->channel_depth == 16)
+    {
+      /*
+       * Round the step up, so that 65535 lands exactly on the last
+       * point and lookups never read past the end of the table.
+       */
+      lut->curve_table_points = curve_table_size->points;
+      lut->curve_table_scale =
+	((((unsigned long long) curve_table_size->points) << 32) + 65534) /
+	65535;
+    }
+
   stpi_compute_lut(v);
 
+  if (lut->channel_depth == 8 &&
+      stp_check_boolean_parameter(v, "FixedPointHSL", STP_PARAMETER_ACTIVE) &&
+      stp_get_boolean_parameter(v, "FixedPointHSL"))
+    {
+      lut->fixed_point_hsl = 1;
+      stpi_color_prepare_fixed_hsl(lut);
+    }
+
   lut->image_width = stp_image_width(image);
+  lut->image_height = stp_image_height(image);
   total_channel_bits = lut->in_channels * lut->channel_depth;
   lut->in_data = stp_malloc(((lut->image_width * total_channel_bits) + 7)/8);
   memset(lut->in_data, 0, ((lut->image_width * total_channel_bits) + 7) / 8);
+  lut->image_lends_rows = image->borrow_row != NULL;
+  if (image->get_rows)
+    {
+      lut->in_row_stride = ((lut->image_width * total_channel_bits) + 7) / 8;
+      lut->in_rows = stp_zalloc(lut->in_row_stride * IMAGE_ROW_BATCH);
+    }
   return lut->out_channels;
 }
 
 static void
 initialize_standard_curves(void)
 {
+  stpi_global_lock();
   if (!standard_curves_initialized)
     {
       int i;
@@ -1638,6 +1855,7 @@ initialize_standard_curves(void)
 	 *(curve_parameters[i].defval);
       standard_curves_initialized = 1;
     }
+  stpi_global_unlock();
 }
 
 static stp_parameter_list_t
@@ -1742,6 +1960,26 @@ stpi_color_traditional_describe_parameter(const stp_vars_t *v,
 		  description->deflt.str =
 		    stp_string_list_param(description->bounds.str, 0)->name;
 		}
+	      else if (strcmp(name, "ColorLUT") == 0)
+		{
+		  description->bounds.str = stp_string_list_create();
+		  for (j = 0; j < color_lut_size_count; j++)
+		    stp_string_list_add_string
+		      (description->bounds.str, color_lut_sizes[j].name,
+		       gettext(color_lut_sizes[j].text));
+		  description->deflt.str =
+		    stp_string_list_param(description->bounds.str, 0)->name;
+		}
+	      else if (strcmp(name, "CurveTableSize") == 0)
+		{
+		  description->bounds.str = stp_string_list_create();
+		  for (j = 0; j < curve_table_size_count; j++)
+		    stp_string_list_add_string
+		      (description->bounds.str, curve_table_sizes[j].name,
+		       gettext(curve_table_sizes[j].text));
+		  description->deflt.str =
+		    stp_string_list_param(description->bounds.str, 0)->name;
+		}
 	      else if (strcmp(name, "InputImageType") == 0)
 		{
 		  description->bounds.str = stp_string_list_create();
@@ -1854,6 +2092,7 @@ static stp_color_t stpi_color_traditional_module_data =
 static int
 color_traditional_module_init(void)
 {
+  stpi_init_color_kernels();
   return stp_color_register(&stpi_color_traditional_module_data);
 }
 
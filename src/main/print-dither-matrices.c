@@ -351,7 +351,8 @@ stp_dither_matrix_set_row(stp_dither_matrix_impl_t *mat, int y)
 static void
 preinit_matrix(stp_vars_t *v)
 {
-  stpi_dither_t *d = (stpi_dither_t *) stp_get_component_data(v, "Dither");
+  stpi_dither_t *d =
+    (stpi_dither_t *) stpi_get_component(v, STPI_COMPONENT_DITHER);
   int i;
   for (i = 0; i < CHANNEL_COUNT(d); i++)
     stp_dither_matrix_destroy(&(CHANNEL(d, i).dithermat));
@@ -361,7 +362,8 @@ preinit_matrix(stp_vars_t *v)
 static void
 postinit_matrix(stp_vars_t *v, int x_shear, int y_shear)
 {
-  stpi_dither_t *d = (stpi_dither_t *) stp_get_component_data(v, "Dither");
+  stpi_dither_t *d =
+    (stpi_dither_t *) stpi_get_component(v, STPI_COMPONENT_DITHER);
   unsigned rc = 1 + (unsigned) ceil(sqrt(CHANNEL_COUNT(d)));
   int i, j;
   int color = 0;
@@ -385,7 +387,8 @@ stp_dither_set_iterated_matrix(stp_vars_t *v, size_t edge, size_t iterations,
 			       const unsigned *data, int prescaled,
 			       int x_shear, int y_shear)
 {
-  stpi_dither_t *d = (stpi_dither_t *) stp_get_component_data(v, "Dither");
+  stpi_dither_t *d =
+    (stpi_dither_t *) stpi_get_component(v, STPI_COMPONENT_DITHER);
   preinit_matrix(v);
   stp_dither_matrix_iterated_init(&(d->dither_matrix), edge, iterations, data);
   postinit_matrix(v, x_shear, y_shear);
@@ -395,7 +398,8 @@ void
 stp_dither_set_matrix(stp_vars_t *v, const stp_dither_matrix_generic_t *matrix,
 		      int transposed, int x_shear, int y_shear)
 {
-  stpi_dither_t *d = (stpi_dither_t *) stp_get_component_data(v, "Dither");
+  stpi_dither_t *d =
+    (stpi_dither_t *) stpi_get_component(v, STPI_COMPONENT_DITHER);
   int x = transposed ? matrix->y : matrix->x;
   int y = transposed ? matrix->x : matrix->y;
   preinit_matrix(v);
@@ -415,7 +419,8 @@ stp_dither_set_matrix_from_dither_array(stp_vars_t *v,
 					const stp_array_t *array,
 					int transpose)
 {
-  stpi_dither_t *d = (stpi_dither_t *) stp_get_component_data(v, "Dither");
+  stpi_dither_t *d =
+    (stpi_dither_t *) stpi_get_component(v, STPI_COMPONENT_DITHER);
   preinit_matrix(v);
   stp_dither_matrix_init_from_dither_array(&(d->dither_matrix), array, transpose);
   postinit_matrix(v, 0, 0);
@@ -424,7 +429,8 @@ stp_dither_set_matrix_from_dither_array(stp_vars_t *v,
 void
 stp_dither_set_transition(stp_vars_t *v, double exponent)
 {
-  stpi_dither_t *d = (stpi_dither_t *) stp_get_component_data(v, "Dither");
+  stpi_dither_t *d =
+    (stpi_dither_t *) stpi_get_component(v, STPI_COMPONENT_DITHER);
   unsigned rc = 1 + (unsigned) ceil(sqrt(CHANNEL_COUNT(d)));
   int i, j;
   int color = 0;
@@ -499,8 +505,11 @@ stp_xml_dither_cache_set(int x, int y, const char *filename)
     dither_matrix_cache = stp_list_create();
 
   if (stp_xml_dither_cache_get(x, y))
+    {
       /* Already cached for this x and y aspect */
-    return;
+      stp_xml_exit();
+      return;
+    }
 
   cacheval = stp_malloc(sizeof(stp_xml_dither_cache_t));
   cacheval->x = x;
@@ -653,7 +662,7 @@ stpi_dither_array_create_from_file(const char* file, int x, int y)
 }
 
 static stp_array_t *
-stp_xml_get_dither_array(int x, int y)
+xml_get_dither_array(int x, int y)
 {
   stp_xml_dither_cache_t *cachedval;
   stp_array_t *ret;
@@ -681,6 +690,20 @@ stp_xml_get_dither_array(int x, int y)
   return stp_array_create_copy(ret);
 }
 
+/*
+ * The matrix cache is shared by all print jobs, and filled in on first
+ * use, so lookups must hold the global lock.
+ */
+static stp_array_t *
+stp_xml_get_dither_array(int x, int y)
+{
+  stp_array_t *ret;
+  stpi_global_lock();
+  ret = xml_get_dither_array(x, y);
+  stpi_global_unlock();
+  return ret;
+}
+
 void
 stpi_init_dither(void)
 {
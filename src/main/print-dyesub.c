@@ -379,7 +379,7 @@ static void  dyesub_nputc(stp_vars_t *v, char byte, int count);
 static dyesub_privdata_t *
 get_privdata(stp_vars_t *v)
 {
-  return (dyesub_privdata_t *) stp_get_component_data(v, "Driver");
+  return (dyesub_privdata_t *) stpi_get_component(v, STPI_COMPONENT_DRIVER);
 }
 
 static const ink_t cmy_inks[] =
@@ -51,7 +51,12 @@ static const escp2_printer_attr_t escp2_printer_attrs[] =
   { "roll_only",               15, 1 },
 };
 
-static stpi_escp2_printer_t *escp2_model_capabilities;
+/*
+ * Models are loaded on first use.  Each model is allocated separately
+ * so that pointers handed out stay valid when the table grows, and the
+ * table is only touched under the global lock.
+ */
+static stpi_escp2_printer_t **escp2_model_capabilities;
 
 static int escp2_model_count = 0;
 
@@ -420,31 +425,37 @@ stpi_escp2_load_model(const stp_vars_t *v, int model)
 stpi_escp2_printer_t *
 stpi_escp2_get_printer(const stp_vars_t *v)
 {
+  stpi_escp2_printer_t *printdef;
   int model = stp_get_model_id(v);
   STPI_ASSERT(model >= 0, v);
+  stpi_global_lock();
   if (!escp2_model_capabilities)
     {
       escp2_model_capabilities =
-	stp_zalloc(sizeof(stpi_escp2_printer_t) * (model + 1));
+	stp_zalloc(sizeof(stpi_escp2_printer_t *) * (model + 1));
       escp2_model_count = model + 1;
     }
   else if (model >= escp2_model_count)
     {
       escp2_model_capabilities =
 	stp_realloc(escp2_model_capabilities,
-		    sizeof(stpi_escp2_printer_t) * (model + 1));
+		    sizeof(stpi_escp2_printer_t *) * (model + 1));
       (void) memset(escp2_model_capabilities + escp2_model_count, 0,
-		    sizeof(stpi_escp2_printer_t) * (model + 1 - escp2_model_count));
+		    sizeof(stpi_escp2_printer_t *) * (model + 1 - escp2_model_count));
       escp2_model_count = model + 1;
     }
-  if (!(escp2_model_capabilities[model].active))
+  if (!escp2_model_capabilities[model])
+    escp2_model_capabilities[model] = stp_zalloc(sizeof(stpi_escp2_printer_t));
+  printdef = escp2_model_capabilities[model];
+  if (!(printdef->active))
     {
       stp_xml_init();
-      escp2_model_capabilities[model].active = 1;
+      printdef->active = 1;
       stpi_escp2_load_model(v, model);
       stp_xml_exit();
     }
-  return &(escp2_model_capabilities[model]);
+  stpi_global_unlock();
+  return printdef;
 }
 
 model_featureset_t
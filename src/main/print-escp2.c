@@ -33,6 +33,9 @@
 #include <string.h>
 #include <math.h>
 #include <limits.h>
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
 #include "print-escp2.h"
 
 #ifdef __GNUC__
@@ -1045,7 +1048,7 @@ sizeof(int_parameters) / sizeof(const int_param_t);
 static escp2_privdata_t *
 get_privdata(const stp_vars_t *v)
 {
-  return (escp2_privdata_t *) stp_get_component_data(v, "Driver");
+  return (escp2_privdata_t *) stpi_get_component(v, STPI_COMPONENT_DRIVER);
 }
 
 #define DEF_SIMPLE_ACCESSOR(f, t)					\
@@ -4366,78 +4369,403 @@ set_mask(unsigned char *cd_mask, int x_center, int scaled_x_where,
     }
 }
 
+typedef struct
+{
+  unsigned char *cd_mask;
+  stp_dimension_t outer_r_sq;
+  stp_dimension_t inner_r_sq;
+  int x_center;
+  int errdiv;
+  int errmod;
+  int errval;
+  int errlast;
+  int errline;
+} escp2_row_state_t;
+
+static void
+init_row_state(stp_vars_t *v, stp_image_t *image, escp2_row_state_t *rs)
+{
+  escp2_privdata_t *pd = get_privdata(v);
+  rs->errdiv  = stp_image_height(image) / pd->image_printed_height;
+  rs->errmod  = stp_image_height(image) % pd->image_printed_height;
+  rs->errval  = 0;
+  rs->errlast = -1;
+  rs->errline  = 0;
+  rs->outer_r_sq = 0;
+  rs->inner_r_sq = 0;
+  rs->x_center = pd->cd_x_offset * pd->res->printed_hres / pd->micro_units;
+  rs->cd_mask = NULL;
+  if (pd->cd_outer_radius > 0)
+    {
+      rs->cd_mask = stp_malloc(1 + (pd->image_printed_width + 7) / 8);
+      rs->outer_r_sq = pd->cd_outer_radius * pd->cd_outer_radius;
+      rs->inner_r_sq = pd->cd_inner_radius * pd->cd_inner_radius;
+    }
+}
+
+/*
+ * Fetch and color convert the input row feeding output row y, unless it
+ * is the same input row as last time.  Returns nonzero on error.
+ */
 static int
-escp2_print_data(stp_vars_t *v, stp_image_t *image)
+fetch_row(stp_vars_t *v, stp_image_t *image, escp2_row_state_t *rs,
+	  int *duplicate_line, unsigned *zero_mask)
+{
+  *duplicate_line = 1;
+  if (rs->errline != rs->errlast)
+    {
+      rs->errlast = rs->errline;
+      *duplicate_line = 0;
+      if (stp_color_get_row(v, image, rs->errline, zero_mask))
+	return 1;
+    }
+  return 0;
+}
+
+static void
+compute_cd_mask(const escp2_privdata_t *pd, const escp2_row_state_t *rs,
+		int y, unsigned char *cd_mask)
+{
+  stp_dimension_t y_distance_from_center =
+    pd->cd_outer_radius -
+    ((y + pd->cd_y_offset) * pd->micro_units / pd->res->printed_vres);
+  if (y_distance_from_center < 0)
+    y_distance_from_center = -y_distance_from_center;
+  memset(cd_mask, 0, (pd->image_printed_width + 7) / 8);
+  if (y_distance_from_center < pd->cd_outer_radius)
+    {
+      stp_dimension_t y_sq = y_distance_from_center * y_distance_from_center;
+      stp_dimension_t x_where = sqrt(rs->outer_r_sq - y_sq);
+      int scaled_x_where = x_where * pd->res->printed_hres / pd->micro_units;
+      set_mask(cd_mask, rs->x_center, scaled_x_where,
+	       pd->image_printed_width, 1, 0);
+      if (y_distance_from_center < pd->cd_inner_radius)
+	{
+	  x_where = sqrt(rs->inner_r_sq - y_sq);
+	  scaled_x_where = x_where * pd->res->printed_hres / pd->micro_units;
+	  set_mask(cd_mask, rs->x_center, scaled_x_where,
+		   pd->image_printed_width, 1, 1);
+	}
+    }
+}
+
+static void
+advance_row(const escp2_privdata_t *pd, escp2_row_state_t *rs)
+{
+  rs->errval += rs->errmod;
+  rs->errline += rs->errdiv;
+  if (rs->errval >= pd->image_printed_height)
+    {
+      rs->errval -= pd->image_printed_height;
+      rs->errline ++;
+    }
+}
+
+#ifdef HAVE_PTHREAD_H
+/*
+ * Pipelined rendering.  Color conversion runs on the calling thread,
+ * dithering and weaving each on a thread of their own.  The stages are
+ * connected by a ring of row buffers: the color stage copies the
+ * converted row into a slot, the dither stage dithers it into the
+ * driver's column buffers and copies the result back into the slot, and
+ * the weave stage feeds the slot to the weave code.  Each stage
+ * processes every row in order, so the output is identical to the
+ * serial loop.  Each stage thread uses its own copy of the vars, so
+ * that parameter and component lookups never race.
+ */
+
+#define PIPELINE_DEPTH 8
+#define PIPELINE_THREADS 3	/* One for each stage */
+
+typedef struct
+{
+  int row;
+  int duplicate_line;
+  unsigned zero_mask;
+  unsigned short *input;
+  size_t plane_stride;		/* Nonzero if input holds planar output */
+  unsigned empty_planes;
+  unsigned char *cd_mask;
+  unsigned char **cols;
+} pipeline_row_t;
+
+typedef struct
+{
+  stp_vars_t *dither_v;
+  stp_vars_t *weave_v;
+  escp2_privdata_t *pd;
+  pipeline_row_t rows[PIPELINE_DEPTH];
+  size_t input_size;
+  int line_length;
+  int converted;		/* Rows handed to the dither stage */
+  int dithered;			/* Rows handed to the weave stage */
+  int written;			/* Rows consumed by the weave stage */
+  int convert_done;
+  int dither_done;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+} pipeline_t;
+
+static void *
+pipeline_dither(void *arg)
+{
+  pipeline_t *pl = (pipeline_t *) arg;
+  escp2_privdata_t *pd = pl->pd;
+  while (1)
+    {
+      pipeline_row_t *r;
+      int i;
+      pthread_mutex_lock(&pl->lock);
+      while (pl->dithered == pl->converted && !pl->convert_done)
+	pthread_cond_wait(&pl->cond, &pl->lock);
+      if (pl->dithered == pl->converted)
+	{
+	  pl->dither_done = 1;
+	  pthread_cond_broadcast(&pl->cond);
+	  pthread_mutex_unlock(&pl->lock);
+	  return NULL;
+	}
+      r = &(pl->rows[pl->dithered % PIPELINE_DEPTH]);
+      pthread_mutex_unlock(&pl->lock);
+
+      if (r->plane_stride)
+	stpi_dither_planar(pl->dither_v, r->row, r->input, r->plane_stride,
+			   r->empty_planes, r->duplicate_line, r->zero_mask,
+			   r->cd_mask);
+      else
+	stp_dither_internal(pl->dither_v, r->row, r->input,
+			    r->duplicate_line, r->zero_mask, r->cd_mask);
+      for (i = 0; i < pd->channels_in_use; i++)
+	if (r->cols[i])
+	  memcpy(r->cols[i], pd->cols[i], pl->line_length);
+
+      pthread_mutex_lock(&pl->lock);
+      pl->dithered++;
+      pthread_cond_broadcast(&pl->cond);
+      pthread_mutex_unlock(&pl->lock);
+    }
+}
+
+static void *
+pipeline_weave(void *arg)
+{
+  pipeline_t *pl = (pipeline_t *) arg;
+  while (1)
+    {
+      pipeline_row_t *r;
+      pthread_mutex_lock(&pl->lock);
+      while (pl->written == pl->dithered && !pl->dither_done)
+	pthread_cond_wait(&pl->cond, &pl->lock);
+      if (pl->written == pl->dithered)
+	{
+	  pthread_mutex_unlock(&pl->lock);
+	  return NULL;
+	}
+      r = &(pl->rows[pl->written % PIPELINE_DEPTH]);
+      pthread_mutex_unlock(&pl->lock);
+
+      stp_write_weave(pl->weave_v, r->cols);
+
+      pthread_mutex_lock(&pl->lock);
+      pl->written++;
+      pthread_cond_broadcast(&pl->cond);
+      pthread_mutex_unlock(&pl->lock);
+    }
+}
+
+static void
+free_pipeline(pipeline_t *pl)
+{
+  int i, j;
+  for (i = 0; i < PIPELINE_DEPTH; i++)
+    {
+      pipeline_row_t *r = &(pl->rows[i]);
+      STP_SAFE_FREE(r->input);
+      STP_SAFE_FREE(r->cd_mask);
+      if (r->cols)
+	{
+	  for (j = 0; j < pl->pd->channels_in_use; j++)
+	    STP_SAFE_FREE(r->cols[j]);
+	  stp_free(r->cols);
+	}
+    }
+  if (pl->dither_v)
+    stp_vars_destroy(pl->dither_v);
+  if (pl->weave_v)
+    stp_vars_destroy(pl->weave_v);
+  pthread_cond_destroy(&pl->cond);
+  pthread_mutex_destroy(&pl->lock);
+  stp_free(pl);
+}
+
+static pipeline_t *
+create_pipeline(stp_vars_t *v)
+{
+  escp2_privdata_t *pd = get_privdata(v);
+  pipeline_t *pl = stp_zalloc(sizeof(pipeline_t));
+  int i, j;
+  pthread_mutex_init(&pl->lock, NULL);
+  pthread_cond_init(&pl->cond, NULL);
+  pl->pd = pd;
+  pl->dither_v = stpi_vars_create_worker(v);
+  pl->weave_v = stpi_vars_create_worker(v);
+  pl->line_length = (pd->image_printed_width + 7) / 8 * pd->bitwidth;
+  for (i = 0; i < PIPELINE_DEPTH; i++)
+    {
+      pipeline_row_t *r = &(pl->rows[i]);
+      if (pd->cd_outer_radius > 0)
+	r->cd_mask = stp_malloc(1 + (pd->image_printed_width + 7) / 8);
+      r->cols = stp_zalloc(sizeof(unsigned char *) * pd->channels_in_use);
+      for (j = 0; j < pd->channels_in_use; j++)
+	if (pd->cols[j])
+	  r->cols[j] = stp_zalloc(pl->line_length);
+    }
+  return pl;
+}
+
+static int
+escp2_print_data_pipelined(stp_vars_t *v, stp_image_t *image)
 {
   escp2_privdata_t *pd = get_privdata(v);
-  int errdiv  = stp_image_height(image) / pd->image_printed_height;
-  int errmod  = stp_image_height(image) % pd->image_printed_height;
-  int errval  = 0;
-  int errlast = -1;
-  int errline  = 0;
+  escp2_row_state_t rs;
+  pipeline_t *pl = create_pipeline(v);
+  pthread_t dither_thread, weave_thread;
+  unsigned zero_mask = 0;
+  int status = 1;
   int y;
-  stp_dimension_t outer_r_sq = 0;
-  stp_dimension_t inner_r_sq = 0;
-  int x_center = pd->cd_x_offset * pd->res->printed_hres / pd->micro_units;
-  unsigned char *cd_mask = NULL;
-  if (pd->cd_outer_radius > 0)
+
+  if (pthread_create(&dither_thread, NULL, pipeline_dither, pl) != 0)
+    {
+      free_pipeline(pl);
+      return -1;
+    }
+  if (pthread_create(&weave_thread, NULL, pipeline_weave, pl) != 0)
     {
-      cd_mask = stp_malloc(1 + (pd->image_printed_width + 7) / 8);
-      outer_r_sq = pd->cd_outer_radius * pd->cd_outer_radius;
-      inner_r_sq = pd->cd_inner_radius * pd->cd_inner_radius;
+      pthread_mutex_lock(&pl->lock);
+      pl->convert_done = 1;
+      pthread_cond_broadcast(&pl->cond);
+      pthread_mutex_unlock(&pl->lock);
+      pthread_join(dither_thread, NULL);
+      free_pipeline(pl);
+      return -1;
     }
 
+  init_row_state(v, image, &rs);
   for (y = 0; y < pd->image_printed_height; y ++)
     {
-      int duplicate_line = 1;
-      unsigned zero_mask;
+      pipeline_row_t *r;
+      int duplicate_line;
+      const unsigned short *planes;
+      size_t plane_stride = 0;
+      unsigned empty_planes = 0;
 
-      if (errline != errlast)
+      pthread_mutex_lock(&pl->lock);
+      while (pl->converted - pl->written >= PIPELINE_DEPTH)
+	pthread_cond_wait(&pl->cond, &pl->lock);
+      r = &(pl->rows[pl->converted % PIPELINE_DEPTH]);
+      pthread_mutex_unlock(&pl->lock);
+
+      if (fetch_row(v, image, &rs, &duplicate_line, &zero_mask))
 	{
-	  errlast = errline;
-	  duplicate_line = 0;
-	  if (stp_color_get_row(v, image, errline, &zero_mask))
-	    return 2;
+	  status = 2;
+	  break;
 	}
-
-      if (cd_mask)
+      /*
+       * The channel group is only initialized when the first row is
+       * converted, so the row buffers can't be sized any sooner.  If the
+       * dither stage asked for planar output, hand it that rather than
+       * the interleaved row.
+       */
+      planes = stpi_channel_get_planar_output(v, &plane_stride, &empty_planes);
+      if (!r->input)
 	{
-	  stp_dimension_t y_distance_from_center =
-	    pd->cd_outer_radius -
-	    ((y + pd->cd_y_offset) * pd->micro_units / pd->res->printed_vres);
-	  if (y_distance_from_center < 0)
-	    y_distance_from_center = -y_distance_from_center;
-	  memset(cd_mask, 0, (pd->image_printed_width + 7) / 8);
-	  if (y_distance_from_center < pd->cd_outer_radius)
-	    {
-	      stp_dimension_t y_sq = y_distance_from_center * y_distance_from_center;
-	      stp_dimension_t x_where = sqrt(outer_r_sq - y_sq);
-	      int scaled_x_where = x_where * pd->res->printed_hres / pd->micro_units;
-	      set_mask(cd_mask, x_center, scaled_x_where,
-		       pd->image_printed_width, 1, 0);
-	      if (y_distance_from_center < pd->cd_inner_radius)
-		{
-		  x_where = sqrt(inner_r_sq - y_sq);
-		  scaled_x_where = x_where * pd->res->printed_hres / pd->micro_units;
-		  set_mask(cd_mask, x_center, scaled_x_where,
-			   pd->image_printed_width, 1, 1);
-		}
-	    }
+	  if (planes)
+	    pl->input_size =
+	      stpi_channel_get_planar_output_size(v) * sizeof(unsigned short);
+	  else
+	    pl->input_size =
+	      stp_channel_get_output_size(v) * sizeof(unsigned short);
+	  r->input = stp_malloc(pl->input_size);
 	}
+      memcpy(r->input, planes ? planes : stp_channel_get_output(v),
+	     pl->input_size);
+      r->plane_stride = plane_stride;
+      r->empty_planes = empty_planes;
+      r->row = y;
+      r->duplicate_line = duplicate_line;
+      r->zero_mask = zero_mask;
+      if (r->cd_mask)
+	compute_cd_mask(pd, &rs, y, r->cd_mask);
+      advance_row(pd, &rs);
+
+      pthread_mutex_lock(&pl->lock);
+      pl->converted++;
+      pthread_cond_broadcast(&pl->cond);
+      pthread_mutex_unlock(&pl->lock);
+    }
+
+  pthread_mutex_lock(&pl->lock);
+  pl->convert_done = 1;
+  pthread_cond_broadcast(&pl->cond);
+  pthread_mutex_unlock(&pl->lock);
+  pthread_join(dither_thread, NULL);
+  pthread_join(weave_thread, NULL);
+  STP_SAFE_FREE(rs.cd_mask);
+  free_pipeline(pl);
+  return status;
+}
+#endif /* HAVE_PTHREAD_H */
 
-      stp_dither(v, y, duplicate_line, zero_mask, cd_mask);
+static int
+escp2_print_data(stp_vars_t *v, stp_image_t *image)
+{
+  escp2_privdata_t *pd = get_privdata(v);
+  escp2_row_state_t rs;
+  unsigned zero_mask = 0;
+  int y;
 
-      stp_write_weave(v, pd->cols);
-      errval += errmod;
-      errline += errdiv;
-      if (errval >= pd->image_printed_height)
+#ifdef HAVE_PTHREAD_H
+  /*
+   * RenderThreads is the total number of threads to use.  With too few
+   * for the pipeline, they all go to dithering each row in bands;
+   * otherwise the dither stage gets what the pipeline leaves over.
+   */
+  int threads = 1;
+  if (stp_check_int_parameter(v, "RenderThreads", STP_PARAMETER_ACTIVE))
+    threads = stp_get_int_parameter(v, "RenderThreads");
+  if (threads >= PIPELINE_THREADS)
+    {
+      int status;
+      stpi_dither_set_thread_count(v, threads - PIPELINE_THREADS + 1);
+      status = escp2_print_data_pipelined(v, image);
+      if (status >= 0)
+	return status;
+      stp_dprintf(STP_DBG_ESCP2, v,
+		  "Unable to start rendering threads, printing serially\n");
+      stpi_dither_set_thread_count(v, threads);
+    }
+#endif
+
+  init_row_state(v, image, &rs);
+  for (y = 0; y < pd->image_printed_height; y ++)
+    {
+      int duplicate_line;
+
+      if (fetch_row(v, image, &rs, &duplicate_line, &zero_mask))
 	{
-	  errval -= pd->image_printed_height;
-	  errline ++;
+	  STP_SAFE_FREE(rs.cd_mask);
+	  return 2;
 	}
+
+      if (rs.cd_mask)
+	compute_cd_mask(pd, &rs, y, rs.cd_mask);
+
+      stp_dither(v, y, duplicate_line, zero_mask, rs.cd_mask);
+
+      stp_write_weave(v, pd->cols);
+      advance_row(pd, &rs);
     }
-  if (cd_mask)
-    stp_free(cd_mask);
+  STP_SAFE_FREE(rs.cd_mask);
   return 1;
 }
 
@@ -2689,7 +2689,7 @@ flush_pass(stp_vars_t *v, int passno, int vertical_subpass)
   stp_pass_t           *pass       = stp_get_pass_by_pass(v, passno);
   stp_linecount_t      *linecount  = stp_get_linecount_by_pass(v, passno);
   lexm_privdata_weave *pd =
-    (lexm_privdata_weave *) stp_get_component_data(v, "Driver");
+    (lexm_privdata_weave *) stpi_get_component(v, STPI_COMPONENT_DRIVER);
   int width = pd->width;
   int hoffset = pd->hoffset;
   int model = pd->model;
@@ -35,6 +35,9 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
 
 /** The internal representation of an stp_list_item_t list node. */
 struct stp_list_item
@@ -61,8 +64,45 @@ struct stp_list
   stp_node_sortfunc sortfunc;			/*!< Callback to compare (sort) nodes	*/
   int index_cache;				/*!< Cached node index			*/
   int length;					/*!< Number of nodes			*/
+  struct name_index *name_index;		/*!< Hash index of names, or NULL	*/
+  struct name_index *long_name_index;		/*!< Hash index of long names, or NULL	*/
+  int use_name_index;				/*!< Index names and long names?	*/
 };
 
+/** An entry in a name index. */
+typedef struct index_entry
+{
+  struct stp_list_item *node;	/*!< The node			*/
+  unsigned hash;		/*!< Hash of the node's name	*/
+  struct index_entry *next;	/*!< Next entry in the bucket	*/
+} index_entry_t;
+
+/** A hash index of the names of the nodes in a list. */
+typedef struct name_index
+{
+  index_entry_t **buckets;	/*!< Chains of entries			*/
+  unsigned size;		/*!< Number of buckets (a power of 2)	*/
+  int count;			/*!< Number of entries			*/
+} name_index_t;
+
+#define NAME_INDEX_MIN_SIZE 64
+
+/*
+ * Lookups update the caches below even on const lists, and lists such
+ * as the printer list are searched by every print job, so the caches
+ * are only read or written with this lock held.  The lists themselves
+ * are not protected: a list must not be modified while another thread
+ * may be reading it.
+ */
+#ifdef HAVE_PTHREAD_H
+static pthread_mutex_t list_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+#define LOCK_CACHE() pthread_mutex_lock(&list_cache_lock)
+#define UNLOCK_CACHE() pthread_mutex_unlock(&list_cache_lock)
+#else
+#define LOCK_CACHE() do {} while (0)
+#define UNLOCK_CACHE() do {} while (0)
+#endif
+
 /**
  * Cache a list node by its short name.
  * @param list the list to use.
@@ -108,10 +148,183 @@ set_long_name_cache(stp_list_t *list,
 static inline void
 clear_cache(stp_list_t *list)
 {
+  LOCK_CACHE();
   list->index_cache = 0;
   list->index_cache_node = NULL;
   set_name_cache(list, NULL, NULL);
   set_long_name_cache(list, NULL, NULL);
+  UNLOCK_CACHE();
+}
+
+/*
+ * Name indexes.  Each node appears in the index once, hashed by the
+ * name its data has when it is added; renaming the data of an indexed
+ * node is not supported.  The index is only changed along with the
+ * list itself, so reading it needs no lock.
+ */
+
+static unsigned
+hash_name(const char *name)
+{
+  unsigned hash = 2166136261u;
+  while (*name)
+    {
+      hash ^= (unsigned char) *name++;
+      hash *= 16777619u;
+    }
+  return hash;
+}
+
+static name_index_t *
+name_index_create(void)
+{
+  name_index_t *idx = stp_malloc(sizeof(name_index_t));
+  idx->size = NAME_INDEX_MIN_SIZE;
+  idx->count = 0;
+  idx->buckets = stp_zalloc(idx->size * sizeof(index_entry_t *));
+  return idx;
+}
+
+static void
+name_index_destroy(name_index_t *idx)
+{
+  unsigned i;
+  if (!idx)
+    return;
+  for (i = 0; i < idx->size; i++)
+    {
+      index_entry_t *e = idx->buckets[i];
+      while (e)
+	{
+	  index_entry_t *next = e->next;
+	  stp_free(e);
+	  e = next;
+	}
+    }
+  stp_free(idx->buckets);
+  stp_free(idx);
+}
+
+static void
+name_index_grow(name_index_t *idx)
+{
+  unsigned new_size = idx->size * 2;
+  index_entry_t **buckets = stp_zalloc(new_size * sizeof(index_entry_t *));
+  unsigned i;
+  for (i = 0; i < idx->size; i++)
+    {
+      index_entry_t *e = idx->buckets[i];
+      while (e)
+	{
+	  index_entry_t *next = e->next;
+	  e->next = buckets[e->hash & (new_size - 1)];
+	  buckets[e->hash & (new_size - 1)] = e;
+	  e = next;
+	}
+    }
+  stp_free(idx->buckets);
+  idx->buckets = buckets;
+  idx->size = new_size;
+}
+
+static void
+name_index_add(name_index_t *idx, stp_list_item_t *node, const char *name)
+{
+  index_entry_t *e;
+  if (!idx || !name)
+    return;
+  if (idx->count >= idx->size)
+    name_index_grow(idx);
+  e = stp_malloc(sizeof(index_entry_t));
+  e->node = node;
+  e->hash = hash_name(name);
+  e->next = idx->buckets[e->hash & (idx->size - 1)];
+  idx->buckets[e->hash & (idx->size - 1)] = e;
+  idx->count++;
+}
+
+static void
+name_index_remove(name_index_t *idx, stp_list_item_t *node, const char *name)
+{
+  index_entry_t **ep;
+  if (!idx || !name)
+    return;
+  ep = &(idx->buckets[hash_name(name) & (idx->size - 1)]);
+  while (*ep)
+    {
+      if ((*ep)->node == node)
+	{
+	  index_entry_t *e = *ep;
+	  *ep = e->next;
+	  stp_free(e);
+	  idx->count--;
+	  return;
+	}
+      ep = &((*ep)->next);
+    }
+}
+
+/**
+ * Find a node in a name index.
+ * @param idx the index to search.
+ * @param namefunc the function that names the nodes of the list.
+ * @param name the name to find.
+ * @param ambiguous set if more than one node has the name, in which
+ * case the node returned is not necessarily the first in the list.
+ * @returns a node with the name, or NULL if there is none.
+ */
+static stp_list_item_t *
+name_index_find(const name_index_t *idx, stp_node_namefunc namefunc,
+		const char *name, int *ambiguous)
+{
+  unsigned hash = hash_name(name);
+  const index_entry_t *e = idx->buckets[hash & (idx->size - 1)];
+  stp_list_item_t *found = NULL;
+  *ambiguous = 0;
+  for (; e; e = e->next)
+    {
+      if (e->hash == hash && strcmp(name, namefunc(e->node->data)) == 0)
+	{
+	  if (found)
+	    {
+	      *ambiguous = 1;
+	      break;
+	    }
+	  found = e->node;
+	}
+    }
+  return found;
+}
+
+static name_index_t *
+build_name_index(const stp_list_t *list, stp_node_namefunc namefunc)
+{
+  name_index_t *idx = name_index_create();
+  stp_list_item_t *node = list->start;
+  while (node)
+    {
+      name_index_add(idx, node, namefunc(node->data));
+      node = node->next;
+    }
+  return idx;
+}
+
+/**
+ * Rebuild the name indexes of a list after its naming functions or
+ * its use of indexes change.
+ * @param list the list to use.
+ */
+static void
+update_name_index(stp_list_t *list)
+{
+  name_index_destroy(list->name_index);
+  name_index_destroy(list->long_name_index);
+  list->name_index = NULL;
+  list->long_name_index = NULL;
+  if (list->use_name_index && list->namefunc)
+    list->name_index = build_name_index(list, list->namefunc);
+  if (list->use_name_index && list->long_namefunc)
+    list->long_name_index = build_name_index(list, list->long_namefunc);
 }
 
 void
@@ -150,6 +363,9 @@ stp_list_create(void)
   list->name_cache_node = NULL;
   list->long_name_cache = NULL;
   list->long_name_cache_node = NULL;
+  list->name_index = NULL;
+  list->long_name_index = NULL;
+  list->use_name_index = 0;
 
   stp_deprintf(STP_DBG_LIST, "stp_list_head constructor\n");
   return list;
@@ -172,6 +388,7 @@ stp_list_copy(const stp_list_t *list)
   stp_list_set_namefunc(ret, stp_list_get_namefunc(list));
   stp_list_set_long_namefunc(ret, stp_list_get_long_namefunc(list));
   stp_list_set_sortfunc(ret, stp_list_get_sortfunc(list));
+  stp_list_set_name_index(ret, stp_list_get_name_index(list));
   while (item)
     {
       void *data = item->data;
@@ -193,6 +410,7 @@ stp_list_destroy(stp_list_t *list)
 
   check_list(list);
   clear_cache(list);
+  stp_list_set_name_index(list, 0);
   cur = list->start;
   while(cur)
     {
@@ -243,6 +461,8 @@ stp_list_get_item_by_index(const stp_list_t *list, int idx)
 {
   stp_list_item_t *node = NULL;
   stp_list_t *ulist = deconst_list(list);
+  stp_list_item_t *cache_node;
+  int cache_idx;
   int i; /* current index */
   int d = 0; /* direction of list traversal, 0=forward */
   int c = 0; /* use cache? */
@@ -251,27 +471,33 @@ stp_list_get_item_by_index(const stp_list_t *list, int idx)
   if (idx >= list->length)
     return NULL;
 
+  LOCK_CACHE();
+  cache_idx = ulist->index_cache;
+  cache_node = ulist->index_cache_node;
   /*
    * Optimize the most likely cases of looking for the same, next,
    * or previou item
    * */
-  if (ulist->index_cache_node)
+  if (cache_node)
     {
-      if (idx == ulist->index_cache)
-	return ulist->index_cache_node;
-      else if (idx == ulist->index_cache + 1)
+      if (idx == cache_idx)
+	node = cache_node;
+      else if (idx == cache_idx + 1)
 	{
 	  ulist->index_cache = idx;
-	  ulist->index_cache_node = ulist->index_cache_node->next;
-	  return ulist->index_cache_node;
+	  ulist->index_cache_node = cache_node->next;
+	  node = ulist->index_cache_node;
 	}
-      else if (idx == ulist->index_cache - 1)
+      else if (idx == cache_idx - 1)
 	{
 	  ulist->index_cache = idx;
-	  ulist->index_cache_node = ulist->index_cache_node->prev;
-	  return ulist->index_cache_node;
+	  ulist->index_cache_node = cache_node->prev;
+	  node = ulist->index_cache_node;
 	}
     }
+  UNLOCK_CACHE();
+  if (node)
+    return node;
   /*
    * See if using the cache is worthwhile.  If the desired index is closer
    * to the cached index than it is to the start or end, it will be faster
@@ -279,11 +505,11 @@ stp_list_get_item_by_index(const stp_list_t *list, int idx)
    *
    * Otherwise, decide which direction is best to start from.
    */
-  if (list->index_cache)
+  if (cache_idx)
     {
       if (idx < (list->length/2))
 	{
-	  if (idx > abs(idx - list->index_cache))
+	  if (idx > abs(idx - cache_idx))
 	    c = 1;
 	  else
 	    d = 0;
@@ -291,7 +517,7 @@ stp_list_get_item_by_index(const stp_list_t *list, int idx)
       else
 	{
 	  if (list->length - 1 - idx >
-	      abs (list->length - 1 - idx - list->index_cache))
+	      abs (list->length - 1 - idx - cache_idx))
 	    c = 1;
 	  else
 	    d = 1;
@@ -301,12 +527,12 @@ stp_list_get_item_by_index(const stp_list_t *list, int idx)
   /* use the cached index and node */
   if (c)
     {
-      if (idx > list->index_cache) /* forward */
+      if (idx > cache_idx) /* forward */
 	d = 0;
       else /* backward */
 	d = 1;
-      i = list->index_cache;
-      node = list->index_cache_node;
+      i = cache_idx;
+      node = cache_node;
     }
   else /* start from one end of the list */
     {
@@ -337,8 +563,10 @@ stp_list_get_item_by_index(const stp_list_t *list, int idx)
     }
 
   /* update cache */
+  LOCK_CACHE();
   ulist->index_cache = i;
   ulist->index_cache_node = node;
+  UNLOCK_CACHE();
 
   return node;
 }
@@ -374,6 +602,17 @@ stp_list_get_item_by_name(const stp_list_t *list, const char *name)
   if (!list->namefunc || !name)
     return NULL;
 
+  if (list->name_index)
+    {
+      int ambiguous;
+      node = name_index_find(list->name_index, list->namefunc, name,
+			     &ambiguous);
+      if (ambiguous)
+	node = stp_list_get_item_by_name_internal(list, name);
+      return node;
+    }
+
+  LOCK_CACHE();
   if (list->name_cache && list->name_cache_node)
     {
       const char *new_name;
@@ -381,7 +620,10 @@ stp_list_get_item_by_name(const stp_list_t *list, const char *name)
       /* Is this the item we've cached? */
       if (strcmp(name, list->name_cache) == 0 &&
 	  strcmp(name, list->namefunc(node->data)) == 0)
-	return node;
+	{
+	  UNLOCK_CACHE();
+	  return node;
+	}
 
       /* If not, check the next item in case we're searching the list */
       node = node->next;
@@ -391,6 +633,7 @@ stp_list_get_item_by_name(const stp_list_t *list, const char *name)
 	  if (strcmp(name, new_name) == 0)
 	    {
 	      set_name_cache(ulist, new_name, node);
+	      UNLOCK_CACHE();
 	      return node;
 	    }
 	}
@@ -402,15 +645,21 @@ stp_list_get_item_by_name(const stp_list_t *list, const char *name)
 	  if (strcmp(name, new_name) == 0)
 	    {
 	      set_name_cache(ulist, new_name, node);
+	      UNLOCK_CACHE();
 	      return node;
 	    }
 	}
     }
+  UNLOCK_CACHE();
 
   node = stp_list_get_item_by_name_internal(list, name);
 
   if (node)
-    set_name_cache(ulist, name, node);
+    {
+      LOCK_CACHE();
+      set_name_cache(ulist, name, node);
+      UNLOCK_CACHE();
+    }
 
   return node;
 }
@@ -448,6 +697,17 @@ stp_list_get_item_by_long_name(const stp_list_t *list, const char *long_name)
   if (!list->long_namefunc || !long_name)
     return NULL;
 
+  if (list->long_name_index)
+    {
+      int ambiguous;
+      node = name_index_find(list->long_name_index, list->long_namefunc,
+			     long_name, &ambiguous);
+      if (ambiguous)
+	node = stp_list_get_item_by_long_name_internal(list, long_name);
+      return node;
+    }
+
+  LOCK_CACHE();
   if (list->long_name_cache && list->long_name_cache_node)
     {
       const char *new_long_name;
@@ -455,7 +715,10 @@ stp_list_get_item_by_long_name(const stp_list_t *list, const char *long_name)
       /* Is this the item we've cached? */
       if (strcmp(long_name, list->long_name_cache) == 0 &&
 	  strcmp(long_name, list->long_namefunc(node->data)) == 0)
-	return node;
+	{
+	  UNLOCK_CACHE();
+	  return node;
+	}
 
       /* If not, check the next item in case we're searching the list */
       node = node->next;
@@ -465,6 +728,7 @@ stp_list_get_item_by_long_name(const stp_list_t *list, const char *long_name)
 	  if (strcmp(long_name, new_long_name) == 0)
 	    {
 	      set_long_name_cache(ulist, new_long_name, node);
+	      UNLOCK_CACHE();
 	      return node;
 	    }
 	}
@@ -476,15 +740,21 @@ stp_list_get_item_by_long_name(const stp_list_t *list, const char *long_name)
 	  if (strcmp(long_name, new_long_name) == 0)
 	    {
 	      set_long_name_cache(ulist, new_long_name, node);
+	      UNLOCK_CACHE();
 	      return node;
 	    }
 	}
     }
+  UNLOCK_CACHE();
 
   node = stp_list_get_item_by_long_name_internal(list, long_name);
 
   if (node)
-    set_long_name_cache(ulist, long_name, node);
+    {
+      LOCK_CACHE();
+      set_long_name_cache(ulist, long_name, node);
+      UNLOCK_CACHE();
+    }
 
   return node;
 }
@@ -526,6 +796,7 @@ stp_list_set_namefunc(stp_list_t *list, stp_node_namefunc namefunc)
 {
   check_list(list);
   list->namefunc = namefunc;
+  update_name_index(list);
 }
 
 stp_node_namefunc
@@ -541,6 +812,7 @@ stp_list_set_long_namefunc(stp_list_t *list, stp_node_namefunc long_namefunc)
 {
   check_list(list);
   list->long_namefunc = long_namefunc;
+  update_name_index(list);
 }
 
 stp_node_namefunc
@@ -565,6 +837,22 @@ stp_list_get_sortfunc(const stp_list_t *list)
   return list->sortfunc;
 }
 
+/* hash index for lookups by name and long name */
+void
+stp_list_set_name_index(stp_list_t *list, int use_index)
+{
+  check_list(list);
+  list->use_name_index = use_index;
+  update_name_index(list);
+}
+
+int
+stp_list_get_name_index(const stp_list_t *list)
+{
+  check_list(list);
+  return list->use_name_index;
+}
+
 
 /* list item functions */
 
@@ -649,6 +937,11 @@ stp_list_item_create(stp_list_t *list,
   /* increment reference count */
   list->length++;
 
+  if (list->name_index)
+    name_index_add(list->name_index, ln, list->namefunc(ln->data));
+  if (list->long_name_index)
+    name_index_add(list->long_name_index, ln, list->long_namefunc(ln->data));
+
   stp_deprintf(STP_DBG_LIST, "stp_list_node constructor\n");
   return 0;
 }
@@ -663,6 +956,11 @@ stp_list_item_destroy(stp_list_t *list, stp_list_item_t *item)
   /* decrement reference count */
   list->length--;
 
+  if (list->name_index)
+    name_index_remove(list->name_index, item, list->namefunc(item->data));
+  if (list->long_name_index)
+    name_index_remove(list->long_name_index, item,
+		      list->long_namefunc(item->data));
   if (list->freefunc)
     list->freefunc((void *) item->data);
   if (item->prev)
@@ -114,6 +114,7 @@ stpi_create_papersize_list(void)
   stp_list_set_freefunc(papersize_list, stpi_papersize_freefunc);
   stp_list_set_namefunc(papersize_list, stpi_papersize_namefunc);
   stp_list_set_long_namefunc(papersize_list, stpi_papersize_long_namefunc);
+  stp_list_set_name_index(papersize_list, 1);
   return (stp_papersize_list_t *) papersize_list;
 }
 
@@ -459,6 +460,7 @@ stpi_get_papersize_list_named(const char *name, const char *file)
   stp_list_item_t *item;
   papersize_list_impl_t *impl;
 
+  stpi_global_lock();
   check_list_of_papersize_lists();
   item = stp_list_get_item_by_name(list_of_papersize_lists, name);
   if (item)
@@ -471,7 +473,10 @@ stpi_get_papersize_list_named(const char *name, const char *file)
       stp_deprintf(STP_DBG_PAPER, "Loading paper list %s from %s\n",
 		   name, file ? file : "(null)");
       if (! file)
-	return NULL;
+	{
+	  stpi_global_unlock();
+	  return NULL;
+	}
       else if (!strcmp(file, ""))
 	(void) snprintf(buf, MAXPATHLEN, "papers/%s.xml", name);
       else
@@ -487,6 +492,7 @@ stpi_get_papersize_list_named(const char *name, const char *file)
       stp_list_item_create(list_of_papersize_lists, NULL, impl);
       stp_xml_process_papersize_def(node, buf, impl->list);
     }
+  stpi_global_unlock();
   return impl->list;
 }
 
@@ -494,7 +500,9 @@ stp_papersize_list_t *
 stpi_find_papersize_list_named(const char *name)
 {
   stp_list_item_t *item;
+  stp_papersize_list_t *answer = NULL;
 
+  stpi_global_lock();
   check_list_of_papersize_lists();
   item = stp_list_get_item_by_name(list_of_papersize_lists, name);
   if (item)
@@ -502,9 +510,10 @@ stpi_find_papersize_list_named(const char *name)
       papersize_list_impl_t *impl =
 	(papersize_list_impl_t *) stp_list_item_get_data(item);
       if (impl)
-	return impl->list;
+	answer = impl->list;
     }
-  return NULL;
+  stpi_global_unlock();
+  return answer;
 }
 
 stp_papersize_list_t *
@@ -513,14 +522,19 @@ stpi_new_papersize_list(const char *name)
   stp_list_item_t *item;
   papersize_list_impl_t *impl;
 
+  stpi_global_lock();
   check_list_of_papersize_lists();
   item = stp_list_get_item_by_name(list_of_papersize_lists, name);
   if (item)
-    return NULL;
+    {
+      stpi_global_unlock();
+      return NULL;
+    }
   impl = stp_malloc(sizeof(papersize_list_impl_t));
   impl->name = stp_strdup(name);
   impl->list = stpi_create_papersize_list();
   stp_list_item_create(list_of_papersize_lists, NULL, impl);
+  stpi_global_unlock();
   return impl->list;
 }
 
@@ -2555,7 +2555,8 @@ pcl_describe_papersize(const stp_vars_t *v, const char *name)
 static void
 pcl_printfunc(stp_vars_t *v)
 {
-  pcl_privdata_t *pd = (pcl_privdata_t *) stp_get_component_data(v, "Driver");
+  pcl_privdata_t *pd =
+    (pcl_privdata_t *) stpi_get_component(v, STPI_COMPONENT_DRIVER);
   int do_blank = pd->do_blank;
   unsigned char *black = stp_dither_get_channel(v, STP_ECOLOR_K, 0);
   unsigned char *cyan = stp_dither_get_channel(v, STP_ECOLOR_C, 0);
@@ -3699,7 +3700,7 @@ pcl_mode2(stp_vars_t *v,		/* I - Print file or command */
           int           last_plane)	/* I - True if this is the last plane */
 {
   pcl_privdata_t *privdata =
-    (pcl_privdata_t *) stp_get_component_data(v, "Driver");
+    (pcl_privdata_t *) stpi_get_component(v, STPI_COMPONENT_DRIVER);
   unsigned char *comp_buf = privdata->comp_buf;
   unsigned char	*comp_ptr;		/* Current slot in buffer */
 
@@ -46,20 +46,12 @@
 #define strcasecmp(s,t) _stricmp(s,t)
 #endif
 
-/*
- * Local variables...
- */
-
-static char *m_ppd_file = NULL;
-static stp_mxml_node_t *m_ppd = NULL;
-
-
 /*
  * Local functions...
  */
 
 static void	ps_hex(const stp_vars_t *, unsigned short *, int);
-static void	ps_ascii85(const stp_vars_t *, unsigned short *, int, int);
+static void	ps_ascii85(const stp_vars_t *, unsigned short *, int, int, int *);
 
 static const stp_parameter_t the_parameters[] =
 {
@@ -193,49 +185,45 @@ ppd_whitespace_callback(stp_mxml_node_t *node, int where)
   return 0;
 }
 
-static int
+/*
+ * Parsed PPD files are kept in a refcache rather than in a static
+ * variable, so that jobs running concurrently with different PPD files
+ * each see their own.  The trees are never modified once loaded.
+ */
+static stp_mxml_node_t *
 check_ppd_file(const stp_vars_t *v)
 {
+  static const char *ppd_cache = "psPPDFiles";
   const char *ppd_file = stp_get_file_parameter(v, "PPDFile");
+  stp_mxml_node_t *ppd;
 
   if (ppd_file == NULL || ppd_file[0] == 0)
     {
       stp_dprintf(STP_DBG_PS, v, "Empty PPD file\n");
-      return 0;
-    }
-  else if (m_ppd_file && strcmp(m_ppd_file, ppd_file) == 0)
-    {
-      stp_dprintf(STP_DBG_PS, v, "Not replacing PPD file %s\n", m_ppd_file);
-      return 1;
+      return NULL;
     }
+  stpi_global_lock();
+  ppd = (stp_mxml_node_t *) stp_refcache_find_item(ppd_cache, ppd_file);
+  if (ppd)
+    stp_dprintf(STP_DBG_PS, v, "Using loaded PPD file %s\n", ppd_file);
   else
     {
-      stp_dprintf(STP_DBG_PS, v, "Replacing PPD file %s with %s\n",
-		  m_ppd_file ? m_ppd_file : "(null)",
-		  ppd_file ? ppd_file : "(null)");
-      if (m_ppd != NULL)
-	stp_mxmlDelete(m_ppd);
-      m_ppd = NULL;
-
-      if (m_ppd_file)
-	stp_free(m_ppd_file);
-      m_ppd_file = NULL;
-
-      if ((m_ppd = stpi_xmlppd_read_ppd_file(ppd_file)) == NULL)
-	{
-	  stp_eprintf(v, "Unable to open PPD file %s\n", ppd_file);
-	  return 0;
-	}
-      if (stp_get_debug_level() & STP_DBG_PS)
+      stp_dprintf(STP_DBG_PS, v, "Loading PPD file %s\n", ppd_file);
+      if ((ppd = stpi_xmlppd_read_ppd_file(ppd_file)) == NULL)
+	stp_eprintf(v, "Unable to open PPD file %s\n", ppd_file);
+      else
 	{
-	  char *ppd_stuff = stp_mxmlSaveAllocString(m_ppd, ppd_whitespace_callback);
-	  stp_dprintf(STP_DBG_PS, v, "%s", ppd_stuff);
-	  stp_free(ppd_stuff);
+	  if (stp_get_debug_level() & STP_DBG_PS)
+	    {
+	      char *ppd_stuff = stp_mxmlSaveAllocString(ppd, ppd_whitespace_callback);
+	      stp_dprintf(STP_DBG_PS, v, "%s", ppd_stuff);
+	      stp_free(ppd_stuff);
+	    }
+	  stp_refcache_add_item(ppd_cache, ppd_file, ppd);
 	}
-
-      m_ppd_file = stp_strdup(ppd_file);
-      return 1;
     }
+  stpi_global_unlock();
+  return ppd;
 }
 
 
@@ -245,22 +233,23 @@ ps_list_parameters(const stp_vars_t *v)
   stp_parameter_list_t *ret = stp_parameter_list_create();
   stp_mxml_node_t *option;
   int i;
-  int status = check_ppd_file(v);
+  stp_mxml_node_t *ppd = check_ppd_file(v);
   stp_dprintf(STP_DBG_PS, v, "Adding parameters from %s (%d)\n",
-	      m_ppd_file ? m_ppd_file : "(null)", status);
+	      ppd ? stp_get_file_parameter(v, "PPDFile") : "(null)",
+	      ppd != NULL);
 
   for (i = 0; i < the_parameter_count; i++)
     stp_parameter_list_add_param(ret, &(the_parameters[i]));
 
-  if (status)
+  if (ppd)
     {
-      int num_options = stpi_xmlppd_find_option_count(m_ppd);
+      int num_options = stpi_xmlppd_find_option_count(ppd);
       stp_dprintf(STP_DBG_PS, v, "Found %d parameters\n", num_options);
       for (i=0; i < num_options; i++)
 	{
 	  /* MEMORY LEAK!!! */
 	  stp_parameter_t *param = stp_malloc(sizeof(stp_parameter_t));
-	  option = stpi_xmlppd_find_option_index(m_ppd, i);
+	  option = stpi_xmlppd_find_option_index(ppd, i);
 	  if (option)
 	    {
 	      ps_option_to_param(v, param, option);
@@ -286,7 +275,7 @@ ps_parameters_internal(const stp_vars_t *v, const char *name,
 {
   int		i;
   stp_mxml_node_t *option;
-  int status = 0;
+  stp_mxml_node_t *ppd;
   int num_choices;
   const char *defchoice;
 
@@ -297,7 +286,7 @@ ps_parameters_internal(const stp_vars_t *v, const char *name,
   if (name == NULL)
     return;
 
-  status = check_ppd_file(v);
+  ppd = check_ppd_file(v);
 
   for (i = 0; i < the_parameter_count; i++)
   {
@@ -310,8 +299,8 @@ ps_parameters_internal(const stp_vars_t *v, const char *name,
 	  {
 	    const char *nickname;
 	    description->bounds.str = stp_string_list_create();
-	    if (m_ppd && stp_mxmlElementGetAttr(m_ppd, "nickname"))
-	      nickname = stp_mxmlElementGetAttr(m_ppd, "nickname");
+	    if (ppd && stp_mxmlElementGetAttr(ppd, "nickname"))
+	      nickname = stp_mxmlElementGetAttr(ppd, "nickname");
 	    else
 	      nickname = _("None; please provide a PPD file");
 	    stp_string_list_add_string_unsafe(description->bounds.str,
@@ -322,7 +311,7 @@ ps_parameters_internal(const stp_vars_t *v, const char *name,
 	  }
 	else if (strcmp(name, "PrintingMode") == 0)
 	  {
-	    if (! m_ppd || strcmp(stp_mxmlElementGetAttr(m_ppd, "color"), "1") == 0)
+	    if (! ppd || strcmp(stp_mxmlElementGetAttr(ppd, "color"), "1") == 0)
 	      {
 		description->bounds.str = stp_string_list_create();
 		stp_string_list_add_string
@@ -340,9 +329,9 @@ ps_parameters_internal(const stp_vars_t *v, const char *name,
       }
   }
 
-  if (!status && strcmp(name, "PageSize") != 0)
+  if (!ppd && strcmp(name, "PageSize") != 0)
     return;
-  if ((option = stpi_xmlppd_find_option_named(m_ppd, name)) == NULL)
+  if ((option = stpi_xmlppd_find_option_named(ppd, name)) == NULL)
   {
     if (strcmp(name, "PageSize") == 0)
       {
@@ -364,7 +353,7 @@ ps_parameters_internal(const stp_vars_t *v, const char *name,
 	char *tmp = stp_malloc(strlen(name) + 4);
 	strcpy(tmp, "Stp");
 	strncat(tmp, name, strlen(name) + 3);
-	if ((option = stpi_xmlppd_find_option_named(m_ppd, tmp)) == NULL)
+	if ((option = stpi_xmlppd_find_option_named(ppd, tmp)) == NULL)
 	  {
 	    stp_dprintf(STP_DBG_PS, v, "no parameter %s", name);
 	    stp_free(tmp);
@@ -419,15 +408,9 @@ static void
 ps_parameters(const stp_vars_t *v, const char *name,
 	      stp_parameter_t *description)
 {
-#ifdef HAVE_LOCALE_H
-  char *locale = stp_strdup(setlocale(LC_ALL, NULL));
-  setlocale(LC_ALL, "C");
-#endif
+  void *locale = stpi_set_c_locale();
   ps_parameters_internal(v, name, description);
-#ifdef HAVE_LOCALE_H
-  setlocale(LC_ALL, locale);
-  stp_free(locale);
-#endif
+  stpi_restore_locale(locale);
 }
 
 /*
@@ -440,20 +423,20 @@ ps_media_size_internal(const stp_vars_t *v,		/* I */
 		       stp_dimension_t  *height)		/* O - Height in points */
 {
   const char *pagesize = stp_get_string_parameter(v, "PageSize");
-  int status = check_ppd_file(v);
+  stp_mxml_node_t *ppd = check_ppd_file(v);
   if (!pagesize)
     pagesize = "";
 
   stp_dprintf(STP_DBG_PS, v,
 	      "ps_media_size(%d, \'%s\', \'%s\', %p, %p)\n",
-	      stp_get_model_id(v), m_ppd_file, pagesize,
-	      (void *) width, (void *) height);
+	      stp_get_model_id(v), stp_get_file_parameter(v, "PPDFile"),
+	      pagesize, (void *) width, (void *) height);
 
   stp_default_media_size(v, width, height);
 
-  if (status)
+  if (ppd)
     {
-      stp_mxml_node_t *paper = stpi_xmlppd_find_page_size(m_ppd, pagesize);
+      stp_mxml_node_t *paper = stpi_xmlppd_find_page_size(ppd, pagesize);
       if (paper)
 	{
 	  *width = atoi(stp_mxmlElementGetAttr(paper, "width"));
@@ -473,19 +456,21 @@ ps_media_size_internal(const stp_vars_t *v,		/* I */
 static const stp_papersize_t *
 ps_describe_papersize(const stp_vars_t *v, const char *name)
 {
-  int status = check_ppd_file(v);
-  if (status)
+  stp_mxml_node_t *ppd = check_ppd_file(v);
+  if (ppd)
     {
-      stp_mxml_node_t *paper = stpi_xmlppd_find_page_size(m_ppd, name);
+      stp_mxml_node_t *paper = stpi_xmlppd_find_page_size(ppd, name);
       if (paper)
 	{
-	  const char *papersize_list_name = m_ppd_file ? m_ppd_file : "NOPPD";
-	  stp_papersize_list_t *ourlist =
-	    stpi_find_papersize_list_named(papersize_list_name);
+	  const char *papersize_list_name = stp_get_file_parameter(v, "PPDFile");
+	  stp_papersize_list_t *ourlist;
 	  const stp_papersize_t *papersize;
 	  const stp_papersize_t *standard_papersize =
 	    stpi_get_listed_papersize(name, "standard");
 
+	  /* The list is shared by every job using this PPD file */
+	  stpi_global_lock();
+	  ourlist = stpi_find_papersize_list_named(papersize_list_name);
 	  if (! ourlist)
 	    ourlist = stpi_new_papersize_list(papersize_list_name);
 
@@ -530,8 +515,9 @@ ps_describe_papersize(const stp_vars_t *v, const char *name)
 		  npapersize->paper_size_type = PAPERSIZE_TYPE_STANDARD;
 		}
 	      if (stpi_papersize_create(ourlist, npapersize))
-		return npapersize;
+		papersize = npapersize;
 	    }
+	  stpi_global_unlock();
 	  return papersize;
 	}
     }
@@ -541,15 +527,9 @@ ps_describe_papersize(const stp_vars_t *v, const char *name)
 static void
 ps_media_size(const stp_vars_t *v, stp_dimension_t *width, stp_dimension_t *height)
 {
-#ifdef HAVE_LOCALE_H
-  char *locale = stp_strdup(setlocale(LC_ALL, NULL));
-  setlocale(LC_ALL, "C");
-#endif
+  void *locale = stpi_set_c_locale();
   ps_media_size_internal(v, width, height);
-#ifdef HAVE_LOCALE_H
-  setlocale(LC_ALL, locale);
-  stp_free(locale);
-#endif
+  stpi_restore_locale(locale);
 }
 
 /*
@@ -565,6 +545,7 @@ ps_imageable_area_internal(const stp_vars_t *v,      /* I */
 			   stp_dimension_t  *top)	/* O - Top position in points */
 {
   stp_dimension_t width, height;
+  stp_mxml_node_t *ppd;
   const char *pagesize = stp_get_string_parameter(v, "PageSize");
   if (!pagesize)
     pagesize = "";
@@ -576,9 +557,10 @@ ps_imageable_area_internal(const stp_vars_t *v,      /* I */
   *top    = 0;
   *bottom = height;
 
-  if (check_ppd_file(v))
+  ppd = check_ppd_file(v);
+  if (ppd)
     {
-      stp_mxml_node_t *paper = stpi_xmlppd_find_page_size(m_ppd, pagesize);
+      stp_mxml_node_t *paper = stpi_xmlppd_find_page_size(ppd, pagesize);
       if (paper)
 	{
 	  double pleft = atoi(stp_mxmlElementGetAttr(paper, "left"));
@@ -622,15 +604,9 @@ ps_imageable_area(const stp_vars_t *v,      /* I */
                   stp_dimension_t  *bottom,	/* O - Bottom position in points */
                   stp_dimension_t  *top)	/* O - Top position in points */
 {
-#ifdef HAVE_LOCALE_H
-  char *locale = stp_strdup(setlocale(LC_ALL, NULL));
-  setlocale(LC_ALL, "C");
-#endif
+  void *locale = stpi_set_c_locale();
   ps_imageable_area_internal(v, 0, left, right, bottom, top);
-#ifdef HAVE_LOCALE_H
-  setlocale(LC_ALL, locale);
-  stp_free(locale);
-#endif
+  stpi_restore_locale(locale);
 }
 
 static void
@@ -640,15 +616,9 @@ ps_maximum_imageable_area(const stp_vars_t *v,      /* I */
 			  stp_dimension_t  *bottom,	/* O - Bottom position in points */
 			  stp_dimension_t  *top)	/* O - Top position in points */
 {
-#ifdef HAVE_LOCALE_H
-  char *locale = stp_strdup(setlocale(LC_ALL, NULL));
-  setlocale(LC_ALL, "C");
-#endif
+  void *locale = stpi_set_c_locale();
   ps_imageable_area_internal(v, 1, left, right, bottom, top);
-#ifdef HAVE_LOCALE_H
-  setlocale(LC_ALL, locale);
-  stp_free(locale);
-#endif
+  stpi_restore_locale(locale);
 }
 
 static void
@@ -687,15 +657,9 @@ ps_describe_resolution_internal(const stp_vars_t *v, stp_resolution_t *x, stp_re
 static void
 ps_describe_resolution(const stp_vars_t *v, stp_resolution_t *x, stp_resolution_t *y)
 {
-#ifdef HAVE_LOCALE_H
-  char *locale = stp_strdup(setlocale(LC_ALL, NULL));
-  setlocale(LC_ALL, "C");
-#endif
+  void *locale = stpi_set_c_locale();
   ps_describe_resolution_internal(v, x, y);
-#ifdef HAVE_LOCALE_H
-  setlocale(LC_ALL, locale);
-  stp_free(locale);
-#endif
+  stpi_restore_locale(locale);
 }
 
 static const char *
@@ -719,20 +683,16 @@ static stp_string_list_t *
 ps_external_options(const stp_vars_t *v)
 {
   stp_parameter_list_t param_list = ps_list_parameters(v);
+  stp_mxml_node_t *ppd = check_ppd_file(v);
   stp_string_list_t *answer;
   char *tmp;
   char *ppd_name = NULL;
   int i;
-#ifdef HAVE_LOCALE_H
-  char *locale;
-#endif
+  void *locale;
   if (! param_list)
     return NULL;
   answer = stp_string_list_create();
-#ifdef HAVE_LOCALE_H
-  locale = stp_strdup(setlocale(LC_ALL, NULL));
-  setlocale(LC_ALL, "C");
-#endif
+  locale = stpi_set_c_locale();
   for (i = 0; i < stp_parameter_list_count(param_list); i++)
     {
       const stp_parameter_t *param = stp_parameter_list_param(param_list, i);
@@ -741,13 +701,13 @@ ps_external_options(const stp_vars_t *v)
       if (desc.is_active)
 	{
 	  stp_mxml_node_t *option;
-	  if (m_ppd &&
-	      (option = stpi_xmlppd_find_option_named(m_ppd, desc.name)) == NULL)
+	  if (ppd &&
+	      (option = stpi_xmlppd_find_option_named(ppd, desc.name)) == NULL)
 	    {
 	      ppd_name = stp_malloc(strlen(desc.name) + 4);
 	      strcpy(ppd_name, "Stp");
 	      strncat(ppd_name, desc.name, strlen(desc.name) + 3);
-	      if ((option = stpi_xmlppd_find_option_named(m_ppd, ppd_name)) == NULL)
+	      if ((option = stpi_xmlppd_find_option_named(ppd, ppd_name)) == NULL)
 		{
 		  stp_dprintf(STP_DBG_PS, v, "no parameter %s", desc.name);
 		  STP_SAFE_FREE(ppd_name);
@@ -837,10 +797,7 @@ ps_external_options(const stp_vars_t *v)
 	}
       stp_parameter_description_destroy(&desc);
     }
-#ifdef HAVE_LOCALE_H
-  setlocale(LC_ALL, locale);
-  stp_free(locale);
-#endif
+  stpi_restore_locale(locale);
   return answer;
 }
 
@@ -854,6 +811,7 @@ ps_print_device_settings(stp_vars_t *v)
 {
   int i;
   stp_parameter_list_t param_list = ps_list_parameters(v);
+  stp_mxml_node_t *ppd = check_ppd_file(v);
   if (! param_list)
     return;
   stp_puts("%%BeginSetup\n", v);
@@ -887,10 +845,10 @@ ps_print_device_settings(stp_vars_t *v)
 		/* We only include the option's code if it's set to a value other than the default. */
 		if(val && defval && (strcmp(val,defval)!=0))
 		  {
-		    if(m_ppd)
+		    if(ppd)
 		      {
 			/* If we have a PPD xml tree we hunt for the appropriate "option" and "choice"... */
-			stp_mxml_node_t *node=m_ppd;
+			stp_mxml_node_t *node=ppd;
 			node=stp_mxmlFindElement(node,node, "option", "name", desc.name, STP_MXML_DESCEND);
 			if(node)
 			  {
@@ -967,6 +925,7 @@ static int
 ps_print_internal(stp_vars_t *v, stp_image_t *image)
 {
   int		status = 1;
+  int		column = 0;	/* ASCII85 output column */
   int		model = stp_get_model_id(v);
   const char    *print_mode = stp_get_string_parameter(v, "PrintingMode");
   const char *input_image_type = stp_get_string_parameter(v, "InputImageType");
@@ -1211,12 +1170,12 @@ ps_print_internal(stp_vars_t *v, stp_image_t *image)
 
       if (y < (image_height - 1))
       {
-	ps_ascii85(v, where, out_ps_height & ~3, 0);
+	ps_ascii85(v, where, out_ps_height & ~3, 0, &column);
         out_offset = out_ps_height & 3;
       }
       else
       {
-        ps_ascii85(v, where, out_ps_height, 1);
+        ps_ascii85(v, where, out_ps_height, 1, &column);
         out_offset = 0;
       }
 
@@ -1239,24 +1198,16 @@ static int
 ps_print(const stp_vars_t *v, stp_image_t *image)
 {
   int status;
-#ifdef HAVE_LOCALE_H
-  char *locale;
-#endif
+  void *locale;
   stp_vars_t *nv = stp_vars_create_copy(v);
   if (!stp_verify(nv))
     {
       stp_eprintf(nv, "Print options not verified; cannot print.\n");
       return 0;
     }
-#ifdef HAVE_LOCALE_H
-  locale = stp_strdup(setlocale(LC_ALL, NULL));
-  setlocale(LC_ALL, "C");
-#endif
+  locale = stpi_set_c_locale();
   status = ps_print_internal(nv, image);
-#ifdef HAVE_LOCALE_H
-  setlocale(LC_ALL, locale);
-  stp_free(locale);
-#endif
+  stpi_restore_locale(locale);
   stp_vars_destroy(nv);
   return status;
 }
@@ -1272,6 +1223,7 @@ ps_hex(const stp_vars_t *v,	/* I - File to print to */
        int              length)	/* I - Number of bytes to print */
 {
   int		col;		/* Current column */
+  char		line[73];	/* Line of hex characters */
   static const char	*hex = "0123456789ABCDEF";
 
   col = 0;
@@ -1279,26 +1231,29 @@ ps_hex(const stp_vars_t *v,	/* I - File to print to */
   {
     unsigned char pixel = (*data & 0xff00) >> 8;
    /*
-    * Put the hex chars out to the file; note that we don't use stp_zprintf()
-    * for speed reasons...
+    * Collect a line of hex chars before writing it; note that we don't
+    * use stp_zprintf() for speed reasons...
     */
 
-    stp_putc(hex[pixel >> 4], v);
-    stp_putc(hex[pixel & 15], v);
+    line[col++] = hex[pixel >> 4];
+    line[col++] = hex[pixel & 15];
 
     data ++;
     length --;
 
-    col += 2;
     if (col >= 72)
     {
+      line[col++] = '\n';
+      stp_zfwrite(line, col, 1, v);
       col = 0;
-      stp_putc('\n', v);
     }
   }
 
   if (col > 0)
-    stp_putc('\n', v);
+  {
+    line[col++] = '\n';
+    stp_zfwrite(line, col, 1, v);
+  }
 }
 
 
@@ -1310,12 +1265,13 @@ static void
 ps_ascii85(const stp_vars_t *v,	/* I - File to print to */
 	   unsigned short *data,	/* I - Data to print */
 	   int            length,	/* I - Number of bytes to print */
-	   int            last_line)	/* I - Last line of raster data? */
+	   int            last_line,	/* I - Last line of raster data? */
+	   int            *columnp)	/* IO - Current column */
 {
   int		i;			/* Looping var */
   unsigned	b;			/* Binary data word */
   unsigned char	c[5];			/* ASCII85 encoded chars */
-  static int	column = 0;		/* Current column */
+  int		column = *columnp;	/* Current column */
 
 #define OUTBUF_SIZE 4096
   unsigned char outbuffer[OUTBUF_SIZE+10];
@@ -1391,6 +1347,7 @@ ps_ascii85(const stp_vars_t *v,	/* I - File to print to */
     stp_puts("~>\n", v);
     column = 0;
   }
+  *columnp = column;
 }
 
 
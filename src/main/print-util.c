@@ -43,6 +43,9 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
 #include "generic-options.h"
 
 #define FMIN(a, b) ((a) < (b) ? (a) : (b))
@@ -95,7 +98,7 @@ stp_zprintf(const stp_vars_t *v, const char *format, ...)
   char *result;
   int bytes;
   STPI_VASPRINTF(result, bytes, format);
-  (stp_get_outfunc(v))((void *)(stp_get_outdata(v)), result, bytes);
+  stpi_vars_output(v, result, bytes);
   stp_free(result);
 }
 
@@ -124,20 +127,20 @@ stp_catprintf(char **strp, const char *format, ...)
 void
 stp_zfwrite(const char *buf, size_t bytes, size_t nitems, const stp_vars_t *v)
 {
-  (stp_get_outfunc(v))((void *)(stp_get_outdata(v)), buf, bytes * nitems);
+  stpi_vars_output(v, buf, bytes * nitems);
 }
 
 void
 stp_write_raw(const stp_raw_t *raw, const stp_vars_t *v)
 {
-  (stp_get_outfunc(v))((void *)(stp_get_outdata(v)), raw->data, raw->bytes);
+  stpi_vars_output(v, raw->data, raw->bytes);
 }
 
 void
 stp_putc(int ch, const stp_vars_t *v)
 {
-  unsigned char a = (unsigned char) ch;
-  (stp_get_outfunc(v))((void *)(stp_get_outdata(v)), (char *) &a, 1);
+  char a = (char) ch;
+  stpi_vars_output(v, &a, 1);
 }
 
 #define BYTE(expr, byteno) (((expr) >> (8 * byteno)) & 0xff)
@@ -145,45 +148,53 @@ stp_putc(int ch, const stp_vars_t *v)
 void
 stp_put16_le(unsigned short sh, const stp_vars_t *v)
 {
-  stp_putc(BYTE(sh, 0), v);
-  stp_putc(BYTE(sh, 1), v);
+  char a[2];
+  a[0] = BYTE(sh, 0);
+  a[1] = BYTE(sh, 1);
+  stpi_vars_output(v, a, 2);
 }
 
 void
 stp_put16_be(unsigned short sh, const stp_vars_t *v)
 {
-  stp_putc(BYTE(sh, 1), v);
-  stp_putc(BYTE(sh, 0), v);
+  char a[2];
+  a[0] = BYTE(sh, 1);
+  a[1] = BYTE(sh, 0);
+  stpi_vars_output(v, a, 2);
 }
 
 void
 stp_put32_le(unsigned int in, const stp_vars_t *v)
 {
-  stp_putc(BYTE(in, 0), v);
-  stp_putc(BYTE(in, 1), v);
-  stp_putc(BYTE(in, 2), v);
-  stp_putc(BYTE(in, 3), v);
+  char a[4];
+  a[0] = BYTE(in, 0);
+  a[1] = BYTE(in, 1);
+  a[2] = BYTE(in, 2);
+  a[3] = BYTE(in, 3);
+  stpi_vars_output(v, a, 4);
 }
 
 void
 stp_put32_be(unsigned int in, const stp_vars_t *v)
 {
-  stp_putc(BYTE(in, 3), v);
-  stp_putc(BYTE(in, 2), v);
-  stp_putc(BYTE(in, 1), v);
-  stp_putc(BYTE(in, 0), v);
+  char a[4];
+  a[0] = BYTE(in, 3);
+  a[1] = BYTE(in, 2);
+  a[2] = BYTE(in, 1);
+  a[3] = BYTE(in, 0);
+  stpi_vars_output(v, a, 4);
 }
 
 void
 stp_puts(const char *s, const stp_vars_t *v)
 {
-  (stp_get_outfunc(v))((void *)(stp_get_outdata(v)), s, strlen(s));
+  stpi_vars_output(v, s, strlen(s));
 }
 
 void
 stp_putraw(const stp_raw_t *r, const stp_vars_t *v)
 {
-  (stp_get_outfunc(v))((void *)(stp_get_outdata(v)), r->data, r->bytes);
+  stpi_vars_output(v, r->data, r->bytes);
 }
 
 void
@@ -533,16 +544,60 @@ void *(*stp_malloc_func)(size_t size) = malloc;
 void *(*stpi_realloc_func)(void *ptr, size_t size) = realloc;
 void (*stpi_free_func)(void *ptr) = free;
 
+/*
+ * Allocation statistics are only collected when STP_ALLOC_STATS is set
+ * in the environment when the library is initialized, since timing
+ * every allocation is not free.
+ */
+static int alloc_stats_enabled = 0;
+static stp_allocation_stats_t alloc_stats;
+#ifdef HAVE_PTHREAD_H
+static pthread_mutex_t alloc_stats_lock = PTHREAD_MUTEX_INITIALIZER;
+#define LOCK_ALLOC_STATS() pthread_mutex_lock(&alloc_stats_lock)
+#define UNLOCK_ALLOC_STATS() pthread_mutex_unlock(&alloc_stats_lock)
+#else
+#define LOCK_ALLOC_STATS() do {} while (0)
+#define UNLOCK_ALLOC_STATS() do {} while (0)
+#endif
+
+static void
+count_allocation(double start, size_t bytes, int is_free)
+{
+  double elapsed = stpi_wall_time() - start;
+  LOCK_ALLOC_STATS();
+  if (is_free)
+    alloc_stats.frees++;
+  else
+    {
+      alloc_stats.allocations++;
+      alloc_stats.bytes_allocated += bytes;
+    }
+  alloc_stats.seconds += elapsed;
+  UNLOCK_ALLOC_STATS();
+}
+
+int
+stp_get_allocation_stats(stp_allocation_stats_t *stats)
+{
+  LOCK_ALLOC_STATS();
+  *stats = alloc_stats;
+  UNLOCK_ALLOC_STATS();
+  return alloc_stats_enabled;
+}
+
 void *
 stp_malloc (size_t size)
 {
   register void *memptr = NULL;
+  double start = alloc_stats_enabled ? stpi_wall_time() : 0;
 
   if ((memptr = stp_malloc_func (size)) == NULL)
     {
       fputs("Virtual memory exhausted.\n", stderr);
       stp_abort();
     }
+  if (alloc_stats_enabled)
+    count_allocation(start, size, 0);
   return (memptr);
 }
 
@@ -558,25 +613,269 @@ void *
 stp_realloc (void *ptr, size_t size)
 {
   register void *memptr = NULL;
+  double start = alloc_stats_enabled ? stpi_wall_time() : 0;
 
   if (size > 0 && ((memptr = stpi_realloc_func (ptr, size)) == NULL))
     {
       fputs("Virtual memory exhausted.\n", stderr);
       stp_abort();
     }
+  if (alloc_stats_enabled)
+    count_allocation(start, size, 0);
   return (memptr);
 }
 
 void
 stp_free(void *ptr)
 {
+  double start = alloc_stats_enabled ? stpi_wall_time() : 0;
   stpi_free_func(ptr);
+  if (alloc_stats_enabled)
+    count_allocation(start, 0, 1);
+}
+
+/*
+ * Arenas hand out memory from large chunks, and give it all back at
+ * once when they are destroyed.  They suit the many small buffers that
+ * a dither or weave allocates as it starts up and keeps until the page
+ * is done.
+ */
+#define ARENA_CHUNK_SIZE (64 * 1024)
+#define ARENA_ALIGN 16
+#define ARENA_ROUND(x) (((x) + ARENA_ALIGN - 1) & ~((size_t) ARENA_ALIGN - 1))
+
+typedef struct arena_chunk
+{
+  struct arena_chunk *next;
+  size_t size;			/* Usable bytes */
+  size_t used;			/* Bytes handed out */
+} arena_chunk_t;
+
+#define ARENA_CHUNK_HEADER ARENA_ROUND(sizeof(arena_chunk_t))
+
+struct stpi_arena
+{
+  arena_chunk_t *chunks;	/* Most recent chunk with room first */
+  size_t reserved;
+  size_t used;
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_t lock;
+#endif
+};
+
+static void
+count_arena(long arenas, unsigned long allocations,
+	    long long reserved, long long used)
+{
+  LOCK_ALLOC_STATS();
+  alloc_stats.arenas += arenas;
+  alloc_stats.arena_allocations += allocations;
+  alloc_stats.arena_bytes_reserved += reserved;
+  alloc_stats.arena_bytes_used += used;
+  UNLOCK_ALLOC_STATS();
+}
+
+stpi_arena_t *
+stpi_arena_create(void)
+{
+  stpi_arena_t *arena = stp_zalloc(sizeof(stpi_arena_t));
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_init(&(arena->lock), NULL);
+#endif
+  if (alloc_stats_enabled)
+    count_arena(1, 0, 0, 0);
+  return arena;
+}
+
+void *
+stpi_arena_alloc(stpi_arena_t *arena, size_t size)
+{
+  arena_chunk_t *chunk;
+  void *ret;
+  size_t reserved = 0;
+  size = ARENA_ROUND(size ? size : 1);
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_lock(&(arena->lock));
+#endif
+  chunk = arena->chunks;
+  if (!chunk || chunk->size - chunk->used < size)
+    {
+      /*
+       * Large requests get a chunk of their own behind the current
+       * one, so that the space left in it is not wasted.
+       */
+      size_t chunk_size = size > ARENA_CHUNK_SIZE / 4 ? size : ARENA_CHUNK_SIZE;
+      chunk = stp_malloc(ARENA_CHUNK_HEADER + chunk_size);
+      chunk->size = chunk_size;
+      chunk->used = 0;
+      if (arena->chunks && chunk_size == size)
+	{
+	  chunk->next = arena->chunks->next;
+	  arena->chunks->next = chunk;
+	}
+      else
+	{
+	  chunk->next = arena->chunks;
+	  arena->chunks = chunk;
+	}
+      reserved = chunk_size;
+      arena->reserved += chunk_size;
+    }
+  ret = (char *) chunk + ARENA_CHUNK_HEADER + chunk->used;
+  chunk->used += size;
+  arena->used += size;
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_unlock(&(arena->lock));
+#endif
+  if (alloc_stats_enabled)
+    count_arena(0, 1, reserved, size);
+  return ret;
+}
+
+void *
+stpi_arena_zalloc(stpi_arena_t *arena, size_t size)
+{
+  void *ret = stpi_arena_alloc(arena, size);
+  memset(ret, 0, size);
+  return ret;
+}
+
+void
+stpi_arena_destroy(stpi_arena_t *arena)
+{
+  arena_chunk_t *chunk;
+  if (!arena)
+    return;
+  chunk = arena->chunks;
+  while (chunk)
+    {
+      arena_chunk_t *next = chunk->next;
+      stp_free(chunk);
+      chunk = next;
+    }
+  if (alloc_stats_enabled)
+    count_arena(-1, 0, -(long long) arena->reserved, -(long long) arena->used);
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_destroy(&(arena->lock));
+#endif
+  stp_free(arena);
+}
+
+/*
+ * Shared library state (registries, caches, lazily loaded data) is
+ * protected by a single recursive lock.  It is recursive because the
+ * loaders call each other freely (XML parsing populates caches, which
+ * may in turn parse more XML).
+ */
+#ifdef HAVE_PTHREAD_H
+static pthread_once_t global_lock_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t global_lock;
+
+static void
+init_global_lock(void)
+{
+  pthread_mutexattr_t attr;
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+  pthread_mutex_init(&global_lock, &attr);
+  pthread_mutexattr_destroy(&attr);
+}
+
+void
+stpi_global_lock(void)
+{
+  pthread_once(&global_lock_once, init_global_lock);
+  pthread_mutex_lock(&global_lock);
+}
+
+void
+stpi_global_unlock(void)
+{
+  pthread_mutex_unlock(&global_lock);
+}
+#else
+void
+stpi_global_lock(void)
+{
+}
+
+void
+stpi_global_unlock(void)
+{
+}
+#endif
+
+/*
+ * Numbers in XML data and in PostScript output must always use the "C"
+ * locale.  Where uselocale() exists, only the calling thread is
+ * switched; setlocale() would change it under every other thread too.
+ */
+#if defined(HAVE_LOCALE_H) && defined(HAVE_USELOCALE)
+static locale_t c_locale;
+#endif
+
+void *
+stpi_set_c_locale(void)
+{
+#if defined(HAVE_LOCALE_H) && defined(HAVE_USELOCALE)
+  stpi_global_lock();
+  if (! c_locale)
+    c_locale = newlocale(LC_ALL_MASK, "C", (locale_t) 0);
+  stpi_global_unlock();
+  if (c_locale)
+    return (void *) uselocale(c_locale);
+  return NULL;
+#elif defined(HAVE_LOCALE_H)
+  char *locale = stp_strdup(setlocale(LC_ALL, NULL));
+  setlocale(LC_ALL, "C");
+  return locale;
+#else
+  return NULL;
+#endif
+}
+
+void
+stpi_restore_locale(void *saved)
+{
+#if defined(HAVE_LOCALE_H) && defined(HAVE_USELOCALE)
+  if (saved)
+    uselocale((locale_t) saved);
+#elif defined(HAVE_LOCALE_H)
+  setlocale(LC_ALL, (const char *) saved);
+  stp_free(saved);
+#endif
+}
+
+static stpi_kernel_level_t kernel_level = STPI_KERNEL_GENERIC;
+
+static void
+init_kernel_level(void)
+{
+  const char *request = getenv("STP_COLOR_KERNELS");
+  kernel_level = STPI_KERNEL_GENERIC;
+  if (request && strcmp(request, "generic") == 0)
+    return;
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2") &&
+      (!request || strcmp(request, "sse2") != 0))
+    kernel_level = STPI_KERNEL_AVX2;
+  else if (__builtin_cpu_supports("sse2"))
+    kernel_level = STPI_KERNEL_SSE2;
+#endif
+}
+
+stpi_kernel_level_t
+stpi_kernel_level(void)
+{
+  return kernel_level;
 }
 
 int
 stp_init(void)
 {
   static int stpi_is_initialised = 0;
+  stpi_global_lock();
   if (!stpi_is_initialised)
     {
       /* Things that are only initialised once */
@@ -592,23 +891,36 @@ stp_init(void)
       stp_free(locale);
 #endif
       stpi_init_debug();
+      if (getenv("STP_ALLOC_STATS"))
+	alloc_stats_enabled = 1;
+      init_kernel_level();
       stp_xml_preinit();
       stpi_init_printer();
       stpi_init_dither();
       /* Load modules */
       if (stp_module_load())
-	return 1;
+	{
+	  stpi_global_unlock();
+	  return 1;
+	}
       /* Load XML data */
       if (stp_xml_init_defaults())
-	return 1;
+	{
+	  stpi_global_unlock();
+	  return 1;
+	}
       /* Initialise modules */
       if (stp_module_init())
-	return 1;
+	{
+	  stpi_global_unlock();
+	  return 1;
+	}
       /* Set up defaults for core parameters */
       stp_initialize_printer_defaults();
     }
 
   stpi_is_initialised = 1;
+  stpi_global_unlock();
   return 0;
 }
 
@@ -36,12 +36,24 @@
 #include "gutenprint-internal.h"
 #include <gutenprint/gutenprint-intl-internal.h>
 #include "generic-options.h"
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
 
+/*
+ * Parameter values are shared between copies of a vars object, and are
+ * never changed while more than one list refers to them: a vars object
+ * about to change a shared value replaces it with a copy of its own.
+ * The parameter lists themselves are shared in the same way, so that
+ * copying a vars object, or creating one from the printer defaults,
+ * costs almost nothing until parameters start to be set.
+ */
 typedef struct
 {
   char *name;
   stp_parameter_type_t typ;
   stp_parameter_activity_t active;
+  unsigned refcount;		/* Lists that hold this value */
   union
   {
     int ival;
@@ -54,6 +66,25 @@ typedef struct
   } value;
 } value_t;
 
+typedef struct
+{
+  stp_list_t *list;
+  unsigned refcount;		/* Vars objects that share this list */
+} param_list_t;
+
+/*
+ * Copies of a vars object may be used, and destroyed, on different
+ * threads, so reference counts are only changed with this lock held.
+ */
+#ifdef HAVE_PTHREAD_H
+static pthread_mutex_t shared_params_lock = PTHREAD_MUTEX_INITIALIZER;
+#define LOCK_SHARED() pthread_mutex_lock(&shared_params_lock)
+#define UNLOCK_SHARED() pthread_mutex_unlock(&shared_params_lock)
+#else
+#define LOCK_SHARED() do {} while (0)
+#define UNLOCK_SHARED() do {} while (0)
+#endif
+
 struct stp_compdata
 {
   char *name;
@@ -62,6 +93,15 @@ struct stp_compdata
   void *data;
 };
 
+typedef struct
+{
+  char *data;
+  size_t size;			/* Capacity; 0 passes output straight through */
+  size_t bytes;			/* Output not yet passed to outfunc */
+} output_buffer_t;
+
+#define DEFAULT_OUTPUT_BUFFER_SIZE (64 * 1024)
+
 struct stp_vars			/* Plug-in variables */
 {
   char *driver;			/* Name of printer "driver" */
@@ -72,7 +112,7 @@ struct stp_vars			/* Plug-in variables */
   stp_dimension_t	height;		/* ... */
   stp_dimension_t	page_width;	/* Width of page in points */
   stp_dimension_t	page_height;	/* Height of page in points */
-  stp_list_t *params[STP_PARAMETER_TYPE_INVALID];
+  param_list_t *params[STP_PARAMETER_TYPE_INVALID];
   stp_list_t *internal_data;
   void (*outfunc)(void *data, const char *buffer, size_t bytes);
   void *outdata;
@@ -80,6 +120,10 @@ struct stp_vars			/* Plug-in variables */
   void *errdata;
   void (*dbgfunc)(void *data, const char *buffer, size_t bytes);
   void *dbgdata;
+  output_buffer_t *outbuf;	/* Printer output not yet written */
+  void *components[STPI_COMPONENT_COUNT]; /* Component data by ID */
+  stpi_profile_t *profile;	/* Profile of the page being printed */
+  unsigned serial;		/* Changes whenever a parameter may change */
   int verified;			/* Ensure that params are OK! */
 };
 
@@ -122,9 +166,8 @@ value_namefunc(const void *item)
 }
 
 static void
-value_freefunc(void *item)
+value_free_data(value_t *v)
 {
-  value_t *v = (value_t *) (item);
   switch (v->typ)
     {
     case STP_PARAMETER_TYPE_STRING_LIST:
@@ -137,11 +180,45 @@ value_freefunc(void *item)
 	stp_curve_destroy(v->value.cval);
       break;
     case STP_PARAMETER_TYPE_ARRAY:
-      stp_array_destroy(v->value.aval);
+      if (v->value.aval)
+	stp_array_destroy(v->value.aval);
       break;
     default:
       break;
     }
+  memset(&(v->value), 0, sizeof(v->value));
+}
+
+static value_t *
+value_ref(value_t *v)
+{
+  LOCK_SHARED();
+  v->refcount++;
+  UNLOCK_SHARED();
+  return v;
+}
+
+static int
+value_is_shared(const value_t *v)
+{
+  int shared;
+  LOCK_SHARED();
+  shared = v->refcount > 1;
+  UNLOCK_SHARED();
+  return shared;
+}
+
+static void
+value_freefunc(void *item)
+{
+  value_t *v = (value_t *) (item);
+  unsigned refcount;
+  LOCK_SHARED();
+  refcount = --v->refcount;
+  UNLOCK_SHARED();
+  if (refcount > 0)
+    return;
+  value_free_data(v);
   stp_free(v->name);
   stp_free(v);
 }
@@ -172,13 +249,15 @@ copy_to_raw(stp_raw_t *raw, const void *data, size_t bytes)
 }
 
 static value_t *
-value_copy(const void *item)
+value_copy(const value_t *v, int copy_data)
 {
-  value_t *ret = stp_malloc(sizeof(value_t));
-  const value_t *v = (const value_t *) (item);
+  value_t *ret = stp_zalloc(sizeof(value_t));
   ret->name = stp_strdup(v->name);
   ret->typ = v->typ;
   ret->active = v->active;
+  ret->refcount = 1;
+  if (!copy_data)
+    return ret;
   switch (v->typ)
     {
     case STP_PARAMETER_TYPE_CURVE:
@@ -215,12 +294,105 @@ copy_value_list(const stp_list_t *src)
   const stp_list_item_t *item = stp_list_get_start((const stp_list_t *)src);
   while (item)
     {
-      stp_list_item_create(ret, NULL, value_copy(stp_list_item_get_data(item)));
+      stp_list_item_create(ret, NULL, value_ref(stp_list_item_get_data(item)));
       item = stp_list_item_next(item);
     }
   return ret;
 }
 
+/*
+ * Create a new value in a list that is not shared.
+ */
+static value_t *
+new_value(stp_list_t *list, const char *parameter, int typ,
+	  stp_parameter_activity_t active)
+{
+  value_t *val = stp_zalloc(sizeof(value_t));
+  val->name = stp_strdup(parameter);
+  val->typ = typ;
+  val->active = active;
+  val->refcount = 1;
+  stp_list_item_create(list, NULL, val);
+  return val;
+}
+
+/*
+ * Get the value of an item, in a list that is not shared, so that it
+ * may be changed.  If the value is shared with other lists, the item
+ * gets a copy of it instead.  Unless keep_data is set, the curve, array
+ * or raw data of the value is discarded, to be replaced by the caller.
+ */
+static value_t *
+modify_value(stp_list_item_t *item, int keep_data)
+{
+  value_t *val = (value_t *) stp_list_item_get_data(item);
+  if (value_is_shared(val))
+    {
+      value_t *nval = value_copy(val, keep_data);
+      stp_list_item_set_data(item, nval);
+      value_freefunc(val);
+      return nval;
+    }
+  if (!keep_data)
+    value_free_data(val);
+  return val;
+}
+
+static param_list_t *
+create_param_list(stp_list_t *list)
+{
+  param_list_t *ret = stp_malloc(sizeof(param_list_t));
+  ret->list = list;
+  ret->refcount = 1;
+  return ret;
+}
+
+static param_list_t *
+share_param_list(param_list_t *params)
+{
+  LOCK_SHARED();
+  params->refcount++;
+  UNLOCK_SHARED();
+  return params;
+}
+
+static void
+release_param_list(param_list_t *params)
+{
+  unsigned refcount;
+  if (!params)
+    return;
+  LOCK_SHARED();
+  refcount = --params->refcount;
+  UNLOCK_SHARED();
+  if (refcount == 0)
+    {
+      stp_list_destroy(params->list);
+      stp_free(params);
+    }
+}
+
+/*
+ * Get a parameter list of a vars object that is about to be changed,
+ * first giving the vars its own copy of the list if it is shared.
+ * The values in the copy are still shared.
+ */
+static stp_list_t *
+modify_params(stp_vars_t *v, stp_parameter_type_t p_type)
+{
+  param_list_t *params = v->params[p_type];
+  int shared;
+  LOCK_SHARED();
+  shared = params->refcount > 1;
+  UNLOCK_SHARED();
+  if (shared)
+    {
+      v->params[p_type] = create_param_list(copy_value_list(params->list));
+      release_param_list(params);
+    }
+  return v->params[p_type]->list;
+}
+
 static const char *
 compdata_namefunc(const void *item)
 {
@@ -242,10 +414,57 @@ static void *
 compdata_copyfunc(const void *item)
 {
   const compdata_t *cd = (const compdata_t *) (item);
+  compdata_t *ncd = stp_malloc(sizeof(compdata_t));
+  ncd->name = stp_strdup(cd->name);
+  ncd->copyfunc = cd->copyfunc;
+  ncd->freefunc = cd->freefunc;
   if (cd->copyfunc)
-    return (cd->copyfunc)(cd->data);
+    ncd->data = (cd->copyfunc)(cd->data);
   else
-    return cd->data;
+    {
+      /* Shared data; the original remains responsible for it */
+      ncd->data = cd->data;
+      ncd->freefunc = NULL;
+    }
+  return ncd;
+}
+
+/*
+ * Component IDs index the components array of every vars.  Data
+ * allocated under any other name is only found by name.
+ */
+static const char *const component_names[STPI_COMPONENT_COUNT] =
+{
+  "Color",
+  "Dither",
+  "Driver",
+  "Channel",
+  "Weave"
+};
+
+static int
+get_component_id(const char *name)
+{
+  int i;
+  for (i = 0; i < STPI_COMPONENT_COUNT; i++)
+    if (strcmp(component_names[i], name) == 0)
+      return i;
+  return -1;
+}
+
+static void
+index_component_data(stp_vars_t *v)
+{
+  const stp_list_item_t *item = stp_list_get_start(v->internal_data);
+  memset(v->components, 0, sizeof(v->components));
+  while (item)
+    {
+      const compdata_t *cd = (const compdata_t *) stp_list_item_get_data(item);
+      int id = get_component_id(cd->name);
+      if (id >= 0)
+	v->components[id] = cd->data;
+      item = stp_list_item_next(item);
+    }
 }
 
 void
@@ -257,6 +476,7 @@ stp_allocate_component_data(stp_vars_t *v,
 {
   compdata_t *cd;
   stp_list_item_t *item;
+  int id;
   CHECK_VARS(v);
   cd = stp_malloc(sizeof(compdata_t));
   item = stp_list_get_item_by_name(v->internal_data, name);
@@ -267,16 +487,23 @@ stp_allocate_component_data(stp_vars_t *v,
   cd->freefunc = freefunc;
   cd->data = data;
   stp_list_item_create(v->internal_data, NULL, cd);
+  id = get_component_id(name);
+  if (id >= 0)
+    v->components[id] = data;
 }
 
 void
 stp_destroy_component_data(stp_vars_t *v, const char *name)
 {
   stp_list_item_t *item;
+  int id;
   CHECK_VARS(v);
   item = stp_list_get_item_by_name(v->internal_data, name);
   if (item)
     stp_list_item_destroy(v->internal_data, item);
+  id = get_component_id(name);
+  if (id >= 0)
+    v->components[id] = NULL;
 }
 
 void *
@@ -291,6 +518,12 @@ stp_get_component_data(const stp_vars_t *v, const char *name)
     return NULL;
 }
 
+void *
+stpi_get_component(const stp_vars_t *v, int id)
+{
+  return v->components[id];
+}
+
 static stp_list_t *
 create_compdata_list(void)
 {
@@ -307,7 +540,8 @@ copy_compdata_list(const stp_list_t *src)
   const stp_list_item_t *item = stp_list_get_start(src);
   while (item)
     {
-      stp_list_item_create(ret, NULL, compdata_copyfunc(item));
+      stp_list_item_create(ret, NULL,
+			   compdata_copyfunc(stp_list_item_get_data(item)));
       item = stp_list_item_next(item);
     }
   return ret;
@@ -316,16 +550,18 @@ copy_compdata_list(const stp_list_t *src)
 static void
 initialize_standard_vars(void)
 {
+  stpi_global_lock();
   if (!standard_vars_initialized)
     {
       int i;
       for (i = 0; i < STP_PARAMETER_TYPE_INVALID; i++)
-	default_vars.params[i] = create_vars_list();
+	default_vars.params[i] = create_param_list(create_vars_list());
       default_vars.driver = stp_strdup("ps2");
       default_vars.color_conversion = stp_strdup("traditional");
       default_vars.internal_data = create_compdata_list();
       standard_vars_initialized = 1;
     }
+  stpi_global_unlock();
 }
 
 const stp_vars_t *
@@ -342,8 +578,10 @@ stp_vars_create(void)
   stp_vars_t *retval = stp_zalloc(sizeof(stp_vars_t));
   initialize_standard_vars();
   for (i = 0; i < STP_PARAMETER_TYPE_INVALID; i++)
-    retval->params[i] = create_vars_list();
+    retval->params[i] = create_param_list(create_vars_list());
   retval->internal_data = create_compdata_list();
+  retval->outbuf = stp_zalloc(sizeof(output_buffer_t));
+  retval->outbuf->size = DEFAULT_OUTPUT_BUFFER_SIZE;
   stp_vars_copy(retval, (stp_vars_t *)&default_vars);
   return (retval);
 }
@@ -354,10 +592,13 @@ stp_vars_destroy(stp_vars_t *v)
   int i;
   CHECK_VARS(v);
   for (i = 0; i < STP_PARAMETER_TYPE_INVALID; i++)
-    stp_list_destroy(v->params[i]);
+    release_param_list(v->params[i]);
   stp_list_destroy(v->internal_data);
   STP_SAFE_FREE(v->driver);
   STP_SAFE_FREE(v->color_conversion);
+  stp_flush_output(v);
+  STP_SAFE_FREE(v->outbuf->data);
+  stp_free(v->outbuf);
   stp_free(v);
 }
 
@@ -377,6 +618,7 @@ pre##_set_##s(stp_vars_t *v, const char *val)				\
   STP_SAFE_FREE(v->s);							\
   v->s = stp_strdup(val);						\
   v->verified = 0;							\
+  v->serial++;								\
 }									\
 									\
 void									\
@@ -388,6 +630,7 @@ pre##_set_##s##_n(stp_vars_t *v, const char *val, int n)		\
   STP_SAFE_FREE(v->s);							\
   v->s = stp_strndup(val, n);						\
   v->verified = 0;							\
+  v->serial++;								\
 }									\
 									\
 const char *								\
@@ -421,18 +664,140 @@ DEF_FUNCS(width, stp_dimension_t, stp)
 DEF_FUNCS(height, stp_dimension_t, stp)
 DEF_FUNCS(page_width, stp_dimension_t, stp)
 DEF_FUNCS(page_height, stp_dimension_t, stp)
-DEF_FUNCS(outdata, void *, stp)
 DEF_FUNCS(errdata, void *, stp)
 DEF_FUNCS(dbgdata, void *, stp)
-DEF_FUNCS(outfunc, stp_outfunc_t, stp)
 DEF_FUNCS(errfunc, stp_outfunc_t, stp)
 DEF_FUNCS(dbgfunc, stp_outfunc_t, stp)
 
+/*
+ * Anything already buffered belongs to the old destination, so it has
+ * to go out before the output function or its data change.
+ */
+void
+stp_set_outdata(stp_vars_t *v, void *val)
+{
+  CHECK_VARS(v);
+  if (v->outdata != val)
+    stp_flush_output(v);
+  v->verified = 0;
+  v->outdata = val;
+}
+
+void *
+stp_get_outdata(const stp_vars_t *v)
+{
+  CHECK_VARS(v);
+  return v->outdata;
+}
+
+void
+stp_set_outfunc(stp_vars_t *v, stp_outfunc_t val)
+{
+  CHECK_VARS(v);
+  if (v->outfunc != val)
+    stp_flush_output(v);
+  v->verified = 0;
+  v->outfunc = val;
+}
+
+stp_outfunc_t
+stp_get_outfunc(const stp_vars_t *v)
+{
+  CHECK_VARS(v);
+  return v->outfunc;
+}
+
+void
+stp_set_output_buffer_size(stp_vars_t *v, size_t size)
+{
+  CHECK_VARS(v);
+  stp_flush_output(v);
+  if (v->outbuf->size != size)
+    {
+      STP_SAFE_FREE(v->outbuf->data);
+      v->outbuf->size = size;
+    }
+}
+
+size_t
+stp_get_output_buffer_size(const stp_vars_t *v)
+{
+  CHECK_VARS(v);
+  return v->outbuf ? v->outbuf->size : DEFAULT_OUTPUT_BUFFER_SIZE;
+}
+
+stpi_profile_t *
+stpi_vars_get_profile(const stp_vars_t *v)
+{
+  return v->profile;
+}
+
+/*
+ * The profile belongs to the page being printed rather than to the
+ * settings, so it can be attached to the caller's (const) vars and is
+ * shared, not copied, by stp_vars_copy().
+ */
+void
+stpi_vars_set_profile(const stp_vars_t *v, stpi_profile_t *p)
+{
+  ((stp_vars_t *) stpi_cast_safe(v))->profile = p;
+}
+
+static void
+vars_write_output(const stp_vars_t *v, const char *data, size_t bytes)
+{
+  if (v->profile)
+    stpi_profile_output(v->profile, bytes);
+  (v->outfunc)(v->outdata, data, bytes);
+}
+
+void
+stp_flush_output(const stp_vars_t *v)
+{
+  output_buffer_t *ob;
+  CHECK_VARS(v);
+  ob = v->outbuf;
+  if (ob && ob->bytes > 0)
+    {
+      size_t bytes = ob->bytes;
+      ob->bytes = 0;
+      vars_write_output(v, ob->data, bytes);
+    }
+}
+
+void
+stpi_vars_output(const stp_vars_t *v, const char *data, size_t bytes)
+{
+  output_buffer_t *ob = v->outbuf;
+  if (!ob || ob->size == 0)
+    {
+      vars_write_output(v, data, bytes);
+      return;
+    }
+  if (bytes > ob->size - ob->bytes)
+    {
+      stp_flush_output(v);
+      /* Large blocks go straight through rather than being copied */
+      if (bytes >= ob->size)
+	{
+	  vars_write_output(v, data, bytes);
+	  return;
+	}
+    }
+  if (!ob->data)
+    ob->data = stp_malloc(ob->size);
+  memcpy(ob->data + ob->bytes, data, bytes);
+  ob->bytes += bytes;
+}
+
 void
 stp_set_verified(stp_vars_t *v, int val)
 {
   CHECK_VARS(v);
   v->verified = val;
+  /* Every change to a parameter unverifies the vars */
+  if (!val)
+    v->serial++;
 }
 
 int
@@ -449,11 +814,7 @@ set_default_raw_parameter(stp_list_t *list, const char *parameter,
   stp_list_item_t *item = stp_list_get_item_by_name(list, parameter);
   if (value && !item)
     {
-      value_t *val = stp_malloc(sizeof(value_t));
-      val->name = stp_strdup(parameter);
-      val->typ = typ;
-      val->active = STP_PARAMETER_DEFAULTED;
-      stp_list_item_create(list, NULL, val);
+      value_t *val = new_value(list, parameter, typ, STP_PARAMETER_DEFAULTED);
       copy_to_raw(&(val->value.rval), value, bytes);
     }
 }
@@ -468,19 +829,12 @@ set_raw_parameter(stp_list_t *list, const char *parameter, const char *value,
       value_t *val;
       if (item)
 	{
-	  val = (value_t *) stp_list_item_get_data(item);
+	  val = modify_value(item, 0);
 	  if (val->active == STP_PARAMETER_DEFAULTED)
 	    val->active = STP_PARAMETER_ACTIVE;
-	  stp_free(stpi_cast_safe(val->value.rval.data));
 	}
       else
-	{
-	  val = stp_malloc(sizeof(value_t));
-	  val->name = stp_strdup(parameter);
-	  val->typ = typ;
-	  val->active = STP_PARAMETER_ACTIVE;
-	  stp_list_item_create(list, NULL, val);
-	}
+	val = new_value(list, parameter, typ, STP_PARAMETER_ACTIVE);
       copy_to_raw(&(val->value.rval), value, bytes);
     }
   else if (item)
@@ -491,7 +845,7 @@ void
 stp_set_string_parameter_n(stp_vars_t *v, const char *parameter,
 			   const char *value, size_t bytes)
 {
-  stp_list_t *list = v->params[STP_PARAMETER_TYPE_STRING_LIST];
+  stp_list_t *list = modify_params(v, STP_PARAMETER_TYPE_STRING_LIST);
   if (value)
     stp_dprintf(STP_DBG_VARS, v, "stp_set_string_parameter(0x%p, %s, %s)\n",
 		 (const void *) v, parameter, value);
@@ -520,7 +874,7 @@ void
 stp_set_default_string_parameter_n(stp_vars_t *v, const char *parameter,
 				   const char *value, size_t bytes)
 {
-  stp_list_t *list = v->params[STP_PARAMETER_TYPE_STRING_LIST];
+  stp_list_t *list = modify_params(v, STP_PARAMETER_TYPE_STRING_LIST);
   stp_dprintf(STP_DBG_VARS, v, "stp_set_default_string_parameter(0x%p, %s, %s)\n",
 	       (const void *) v, parameter, value ? value : "NULL");
   set_default_raw_parameter(list, parameter, value, bytes,
@@ -548,12 +902,12 @@ stp_clear_string_parameter(stp_vars_t *v, const char *parameter)
 const char *
 stp_get_string_parameter(const stp_vars_t *v, const char *parameter)
 {
-  stp_list_t *list = v->params[STP_PARAMETER_TYPE_STRING_LIST];
-  value_t *val;
-  stp_list_item_t *item = stp_list_get_item_by_name(list, parameter);
+  const stp_list_t *list = v->params[STP_PARAMETER_TYPE_STRING_LIST]->list;
+  const value_t *val;
+  const stp_list_item_t *item = stp_list_get_item_by_name(list, parameter);
   if (item)
     {
-      val = (value_t *) stp_list_item_get_data(item);
+      val = (const value_t *) stp_list_item_get_data(item);
       return val->value.rval.data;
     }
   else
@@ -564,7 +918,7 @@ void
 stp_set_raw_parameter(stp_vars_t *v, const char *parameter,
 		      const void *value, size_t bytes)
 {
-  stp_list_t *list = v->params[STP_PARAMETER_TYPE_RAW];
+  stp_list_t *list = modify_params(v, STP_PARAMETER_TYPE_RAW);
   set_raw_parameter(list, parameter, value, bytes, STP_PARAMETER_TYPE_RAW);
   stp_set_verified(v, 0);
 }
@@ -573,7 +927,7 @@ void
 stp_set_default_raw_parameter(stp_vars_t *v, const char *parameter,
 			      const void *value, size_t bytes)
 {
-  stp_list_t *list = v->params[STP_PARAMETER_TYPE_RAW];
+  stp_list_t *list = modify_params(v, STP_PARAMETER_TYPE_RAW);
   set_default_raw_parameter(list, parameter, value, bytes,
 			    STP_PARAMETER_TYPE_RAW);
   stp_set_verified(v, 0);
@@ -588,7 +942,7 @@ stp_clear_raw_parameter(stp_vars_t *v, const char *parameter)
 const stp_raw_t *
 stp_get_raw_parameter(const stp_vars_t *v, const char *parameter)
 {
-  const stp_list_t *list = v->params[STP_PARAMETER_TYPE_RAW];
+  const stp_list_t *list = v->params[STP_PARAMETER_TYPE_RAW]->list;
   const value_t *val;
   const stp_list_item_t *item = stp_list_get_item_by_name(list, parameter);
   if (item)
@@ -604,7 +958,7 @@ void
 stp_set_file_parameter(stp_vars_t *v, const char *parameter,
 		       const char *value)
 {
-  stp_list_t *list = v->params[STP_PARAMETER_TYPE_FILE];
+  stp_list_t *list = modify_params(v, STP_PARAMETER_TYPE_FILE);
   size_t byte_count = 0;
   if (value)
     byte_count = strlen(value);
@@ -619,7 +973,7 @@ void
 stp_set_file_parameter_n(stp_vars_t *v, const char *parameter,
 			 const char *value, size_t byte_count)
 {
-  stp_list_t *list = v->params[STP_PARAMETER_TYPE_FILE];
+  stp_list_t *list = modify_params(v, STP_PARAMETER_TYPE_FILE);
   stp_dprintf(STP_DBG_VARS, v, "stp_set_file_parameter(0x%p, %s, %s)\n",
 	       (const void *) v, parameter, value ? value : "NULL");
   set_raw_parameter(list, parameter, value, byte_count,
@@ -631,7 +985,7 @@ void
 stp_set_default_file_parameter(stp_vars_t *v, const char *parameter,
 			       const char *value)
 {
-  stp_list_t *list = v->params[STP_PARAMETER_TYPE_FILE];
+  stp_list_t *list = modify_params(v, STP_PARAMETER_TYPE_FILE);
   size_t byte_count = 0;
   if (value)
     byte_count = strlen(value);
@@ -646,7 +1000,7 @@ void
 stp_set_default_file_parameter_n(stp_vars_t *v, const char *parameter,
 				 const char *value, size_t byte_count)
 {
-  stp_list_t *list = v->params[STP_PARAMETER_TYPE_FILE];
+  stp_list_t *list = modify_params(v, STP_PARAMETER_TYPE_FILE);
   stp_dprintf(STP_DBG_VARS, v, "stp_set_default_file_parameter(0x%p, %s, %s)\n",
 	       (const void *) v, parameter, value ? value : "NULL");
   set_default_raw_parameter(list, parameter, value, byte_count,
@@ -663,7 +1017,7 @@ stp_clear_file_parameter(stp_vars_t *v, const char *parameter)
 const char *
 stp_get_file_parameter(const stp_vars_t *v, const char *parameter)
 {
-  const stp_list_t *list = v->params[STP_PARAMETER_TYPE_FILE];
+  const stp_list_t *list = v->params[STP_PARAMETER_TYPE_FILE]->list;
   const value_t *val;
   const stp_list_item_t *item = stp_list_get_item_by_name(list, parameter);
   if (item)
@@ -679,7 +1033,7 @@ void
 stp_set_curve_parameter(stp_vars_t *v, const char *parameter,
 			const stp_curve_t *curve)
 {
-  stp_list_t *list = v->params[STP_PARAMETER_TYPE_CURVE];
+  stp_list_t *list = modify_params(v, STP_PARAMETER_TYPE_CURVE);
   stp_list_item_t *item = stp_list_get_item_by_name(list, parameter);
   stp_dprintf(STP_DBG_VARS, v, "stp_set_curve_parameter(0x%p, %s)\n",
 	       (const void *) v, parameter);
@@ -688,20 +1042,14 @@ stp_set_curve_parameter(stp_vars_t *v, const char *parameter,
       value_t *val;
       if (item)
 	{
-	  val = (value_t *) stp_list_item_get_data(item);
+	  val = modify_value(item, 0);
 	  if (val->active == STP_PARAMETER_DEFAULTED)
 	    val->active = STP_PARAMETER_ACTIVE;
-	  if (val->value.cval)
-	    stp_curve_destroy(val->value.cval);
 	}
       else
-	{
-	  val = stp_malloc(sizeof(value_t));
-	  val->name = stp_strdup(parameter);
-	  val->typ = STP_PARAMETER_TYPE_CURVE;
-	  val->active = STP_PARAMETER_ACTIVE;
-	  stp_list_item_create(list, NULL, val);
-	}
+	val =
+	  new_value(list, parameter, STP_PARAMETER_TYPE_CURVE,
+		    STP_PARAMETER_ACTIVE);
       val->value.cval = stp_curve_create_copy(curve);
     }
   else if (item)
@@ -713,7 +1061,7 @@ void
 stp_set_default_curve_parameter(stp_vars_t *v, const char *parameter,
 				const stp_curve_t *curve)
 {
-  stp_list_t *list = v->params[STP_PARAMETER_TYPE_CURVE];
+  stp_list_t *list = modify_params(v, STP_PARAMETER_TYPE_CURVE);
   stp_list_item_t *item = stp_list_get_item_by_name(list, parameter);
   stp_dprintf(STP_DBG_VARS, v, "stp_set_default_curve_parameter(0x%p, %s)\n",
 	       (const void *) v, parameter);
@@ -721,12 +1069,9 @@ stp_set_default_curve_parameter(stp_vars_t *v, const char *parameter,
     {
       if (curve)
 	{
-	  value_t *val;
-	  val = stp_malloc(sizeof(value_t));
-	  val->name = stp_strdup(parameter);
-	  val->typ = STP_PARAMETER_TYPE_CURVE;
-	  val->active = STP_PARAMETER_DEFAULTED;
-	  stp_list_item_create(list, NULL, val);
+	  value_t *val =
+	    new_value(list, parameter, STP_PARAMETER_TYPE_CURVE,
+		      STP_PARAMETER_DEFAULTED);
 	  val->value.cval = stp_curve_create_copy(curve);
 	}
     }
@@ -742,7 +1087,7 @@ stp_clear_curve_parameter(stp_vars_t *v, const char *parameter)
 const stp_curve_t *
 stp_get_curve_parameter(const stp_vars_t *v, const char *parameter)
 {
-  const stp_list_t *list = v->params[STP_PARAMETER_TYPE_CURVE];
+  const stp_list_t *list = v->params[STP_PARAMETER_TYPE_CURVE]->list;
   const value_t *val;
   const stp_list_item_t *item = stp_list_get_item_by_name(list, parameter);
   if (item)
@@ -758,7 +1103,7 @@ void
 stp_set_array_parameter(stp_vars_t *v, const char *parameter,
 			const stp_array_t *array)
 {
-  stp_list_t *list = v->params[STP_PARAMETER_TYPE_ARRAY];
+  stp_list_t *list = modify_params(v, STP_PARAMETER_TYPE_ARRAY);
   stp_list_item_t *item = stp_list_get_item_by_name(list, parameter);
   stp_dprintf(STP_DBG_VARS, v, "stp_set_array_parameter(0x%p, %s)\n",
 	       (const void *) v, parameter);
@@ -767,19 +1112,14 @@ stp_set_array_parameter(stp_vars_t *v, const char *parameter,
       value_t *val;
       if (item)
 	{
-	  val = (value_t *) stp_list_item_get_data(item);
+	  val = modify_value(item, 0);
 	  if (val->active == STP_PARAMETER_DEFAULTED)
 	    val->active = STP_PARAMETER_ACTIVE;
-	  stp_array_destroy(val->value.aval);
 	}
       else
-	{
-	  val = stp_malloc(sizeof(value_t));
-	  val->name = stp_strdup(parameter);
-	  val->typ = STP_PARAMETER_TYPE_ARRAY;
-	  val->active = STP_PARAMETER_ACTIVE;
-	  stp_list_item_create(list, NULL, val);
-	}
+	val =
+	  new_value(list, parameter, STP_PARAMETER_TYPE_ARRAY,
+		    STP_PARAMETER_ACTIVE);
       val->value.aval = stp_array_create_copy(array);
     }
   else if (item)
@@ -791,7 +1131,7 @@ void
 stp_set_default_array_parameter(stp_vars_t *v, const char *parameter,
 				const stp_array_t *array)
 {
-  stp_list_t *list = v->params[STP_PARAMETER_TYPE_ARRAY];
+  stp_list_t *list = modify_params(v, STP_PARAMETER_TYPE_ARRAY);
   stp_list_item_t *item = stp_list_get_item_by_name(list, parameter);
   stp_dprintf(STP_DBG_VARS, v, "stp_set_default_array_parameter(0x%p, %s)\n",
 	       (const void *) v, parameter);
@@ -799,12 +1139,9 @@ stp_set_default_array_parameter(stp_vars_t *v, const char *parameter,
     {
       if (array)
 	{
-	  value_t *val;
-	  val = stp_malloc(sizeof(value_t));
-	  val->name = stp_strdup(parameter);
-	  val->typ = STP_PARAMETER_TYPE_ARRAY;
-	  val->active = STP_PARAMETER_DEFAULTED;
-	  stp_list_item_create(list, NULL, val);
+	  value_t *val =
+	    new_value(list, parameter, STP_PARAMETER_TYPE_ARRAY,
+		      STP_PARAMETER_DEFAULTED);
 	  val->value.aval = stp_array_create_copy(array);
 	}
     }
@@ -820,7 +1157,7 @@ stp_clear_array_parameter(stp_vars_t *v, const char *parameter)
 const stp_array_t *
 stp_get_array_parameter(const stp_vars_t *v, const char *parameter)
 {
-  const stp_list_t *list = v->params[STP_PARAMETER_TYPE_ARRAY];
+  const stp_list_t *list = v->params[STP_PARAMETER_TYPE_ARRAY]->list;
   const value_t *val;
   const stp_list_item_t *item = stp_list_get_item_by_name(list, parameter);
   if (item)
@@ -835,25 +1172,20 @@ stp_get_array_parameter(const stp_vars_t *v, const char *parameter)
 void
 stp_set_int_parameter(stp_vars_t *v, const char *parameter, int ival)
 {
-  stp_list_t *list = v->params[STP_PARAMETER_TYPE_INT];
+  stp_list_t *list = modify_params(v, STP_PARAMETER_TYPE_INT);
   value_t *val;
   stp_list_item_t *item = stp_list_get_item_by_name(list, parameter);
   stp_dprintf(STP_DBG_VARS, v, "stp_set_int_parameter(0x%p, %s, %d)\n",
 	       (const void *) v, parameter, ival);
   if (item)
     {
-      val = (value_t *) stp_list_item_get_data(item);
+      val = modify_value(item, 0);
       if (val->active == STP_PARAMETER_DEFAULTED)
 	val->active = STP_PARAMETER_ACTIVE;
     }
   else
-    {
-      val = stp_malloc(sizeof(value_t));
-      val->name = stp_strdup(parameter);
-      val->typ = STP_PARAMETER_TYPE_INT;
-      val->active = STP_PARAMETER_ACTIVE;
-      stp_list_item_create(list, NULL, val);
-    }
+    val =
+      new_value(list, parameter, STP_PARAMETER_TYPE_INT, STP_PARAMETER_ACTIVE);
   val->value.ival = ival;
   stp_set_verified(v, 0);
 }
@@ -861,18 +1193,16 @@ stp_set_int_parameter(stp_vars_t *v, const char *parameter, int ival)
 void
 stp_set_default_int_parameter(stp_vars_t *v, const char *parameter, int ival)
 {
-  stp_list_t *list = v->params[STP_PARAMETER_TYPE_INT];
+  stp_list_t *list = modify_params(v, STP_PARAMETER_TYPE_INT);
   value_t *val;
   stp_list_item_t *item = stp_list_get_item_by_name(list, parameter);
   stp_dprintf(STP_DBG_VARS, v, "stp_set_default_int_parameter(0x%p, %s, %d)\n",
 	       (const void *) v, parameter, ival);
   if (!item)
     {
-      val = stp_malloc(sizeof(value_t));
-      val->name = stp_strdup(parameter);
-      val->typ = STP_PARAMETER_TYPE_INT;
-      val->active = STP_PARAMETER_DEFAULTED;
-      stp_list_item_create(list, NULL, val);
+      val =
+	new_value(list, parameter, STP_PARAMETER_TYPE_INT,
+		  STP_PARAMETER_DEFAULTED);
       val->value.ival = ival;
     }
   stp_set_verified(v, 0);
@@ -881,7 +1211,7 @@ stp_set_default_int_parameter(stp_vars_t *v, const char *parameter, int ival)
 void
 stp_clear_int_parameter(stp_vars_t *v, const char *parameter)
 {
-  stp_list_t *list = v->params[STP_PARAMETER_TYPE_INT];
+  stp_list_t *list = modify_params(v, STP_PARAMETER_TYPE_INT);
   stp_list_item_t *item = stp_list_get_item_by_name(list, parameter);
   stp_dprintf(STP_DBG_VARS, v, "stp_clear_int_parameter(0x%p, %s)\n",
 	       (const void *) v, parameter);
@@ -893,7 +1223,7 @@ stp_clear_int_parameter(stp_vars_t *v, const char *parameter)
 int
 stp_get_int_parameter(const stp_vars_t *v, const char *parameter)
 {
-  const stp_list_t *list = v->params[STP_PARAMETER_TYPE_INT];
+  const stp_list_t *list = v->params[STP_PARAMETER_TYPE_INT]->list;
   const stp_list_item_t *item = stp_list_get_item_by_name(list, parameter);
   if (item)
     {
@@ -924,25 +1254,21 @@ stp_get_int_parameter(const stp_vars_t *v, const char *parameter)
 void
 stp_set_boolean_parameter(stp_vars_t *v, const char *parameter, int ival)
 {
-  stp_list_t *list = v->params[STP_PARAMETER_TYPE_BOOLEAN];
+  stp_list_t *list = modify_params(v, STP_PARAMETER_TYPE_BOOLEAN);
   value_t *val;
   stp_list_item_t *item = stp_list_get_item_by_name(list, parameter);
   stp_dprintf(STP_DBG_VARS, v, "stp_set_boolean_parameter(0x%p, %s, %d)\n",
 	       (const void *) v, parameter, ival);
   if (item)
     {
-      val = (value_t *) stp_list_item_get_data(item);
+      val = modify_value(item, 0);
       if (val->active == STP_PARAMETER_DEFAULTED)
 	val->active = STP_PARAMETER_ACTIVE;
     }
   else
-    {
-      val = stp_malloc(sizeof(value_t));
-      val->name = stp_strdup(parameter);
-      val->typ = STP_PARAMETER_TYPE_BOOLEAN;
-      val->active = STP_PARAMETER_ACTIVE;
-      stp_list_item_create(list, NULL, val);
-    }
+    val =
+      new_value(list, parameter, STP_PARAMETER_TYPE_BOOLEAN,
+		STP_PARAMETER_ACTIVE);
   if (ival)
     val->value.ival = 1;
   else
@@ -954,18 +1280,16 @@ void
 stp_set_default_boolean_parameter(stp_vars_t *v, const char *parameter,
 				  int ival)
 {
-  stp_list_t *list = v->params[STP_PARAMETER_TYPE_BOOLEAN];
+  stp_list_t *list = modify_params(v, STP_PARAMETER_TYPE_BOOLEAN);
   value_t *val;
   stp_list_item_t *item = stp_list_get_item_by_name(list, parameter);
   stp_dprintf(STP_DBG_VARS, v, "stp_set_default_boolean_parameter(0x%p, %s, %d)\n",
 	       (const void *) v, parameter, ival);
   if (!item)
     {
-      val = stp_malloc(sizeof(value_t));
-      val->name = stp_strdup(parameter);
-      val->typ = STP_PARAMETER_TYPE_BOOLEAN;
-      val->active = STP_PARAMETER_DEFAULTED;
-      stp_list_item_create(list, NULL, val);
+      val =
+	new_value(list, parameter, STP_PARAMETER_TYPE_BOOLEAN,
+		  STP_PARAMETER_DEFAULTED);
       if (ival)
 	val->value.ival = 1;
       else
@@ -977,7 +1301,7 @@ stp_set_default_boolean_parameter(stp_vars_t *v, const char *parameter,
 void
 stp_clear_boolean_parameter(stp_vars_t *v, const char *parameter)
 {
-  stp_list_t *list = v->params[STP_PARAMETER_TYPE_BOOLEAN];
+  stp_list_t *list = modify_params(v, STP_PARAMETER_TYPE_BOOLEAN);
   stp_list_item_t *item = stp_list_get_item_by_name(list, parameter);
   stp_dprintf(STP_DBG_VARS, v, "stp_clear_boolean_parameter(0x%p, %s)\n",
 	       (const void *) v, parameter);
@@ -989,7 +1313,7 @@ stp_clear_boolean_parameter(stp_vars_t *v, const char *parameter)
 int
 stp_get_boolean_parameter(const stp_vars_t *v, const char *parameter)
 {
-  const stp_list_t *list = v->params[STP_PARAMETER_TYPE_BOOLEAN];
+  const stp_list_t *list = v->params[STP_PARAMETER_TYPE_BOOLEAN]->list;
   const stp_list_item_t *item = stp_list_get_item_by_name(list, parameter);
   if (item)
     {
@@ -1020,25 +1344,21 @@ stp_get_boolean_parameter(const stp_vars_t *v, const char *parameter)
 void
 stp_set_dimension_parameter(stp_vars_t *v, const char *parameter, stp_dimension_t sval)
 {
-  stp_list_t *list = v->params[STP_PARAMETER_TYPE_DIMENSION];
+  stp_list_t *list = modify_params(v, STP_PARAMETER_TYPE_DIMENSION);
   value_t *val;
   stp_list_item_t *item = stp_list_get_item_by_name(list, parameter);
   stp_dprintf(STP_DBG_VARS, v, "stp_set_dimension_parameter(0x%p, %s, %f)\n",
 	       (const void *) v, parameter, sval);
   if (item)
     {
-      val = (value_t *) stp_list_item_get_data(item);
+      val = modify_value(item, 0);
       if (val->active == STP_PARAMETER_DEFAULTED)
 	val->active = STP_PARAMETER_ACTIVE;
     }
   else
-    {
-      val = stp_malloc(sizeof(value_t));
-      val->name = stp_strdup(parameter);
-      val->typ = STP_PARAMETER_TYPE_DIMENSION;
-      val->active = STP_PARAMETER_ACTIVE;
-      stp_list_item_create(list, NULL, val);
-    }
+    val =
+      new_value(list, parameter, STP_PARAMETER_TYPE_DIMENSION,
+		STP_PARAMETER_ACTIVE);
   val->value.sval = sval;
   stp_set_verified(v, 0);
 }
@@ -1047,18 +1367,16 @@ void
 stp_set_default_dimension_parameter(stp_vars_t *v, const char *parameter,
 				    stp_dimension_t sval)
 {
-  stp_list_t *list = v->params[STP_PARAMETER_TYPE_DIMENSION];
+  stp_list_t *list = modify_params(v, STP_PARAMETER_TYPE_DIMENSION);
   value_t *val;
   stp_list_item_t *item = stp_list_get_item_by_name(list, parameter);
   stp_dprintf(STP_DBG_VARS, v, "stp_set_default_dimension_parameter(0x%p, %s, %f)\n",
 	       (const void *) v, parameter, sval);
   if (!item)
     {
-      val = stp_malloc(sizeof(value_t));
-      val->name = stp_strdup(parameter);
-      val->typ = STP_PARAMETER_TYPE_DIMENSION;
-      val->active = STP_PARAMETER_DEFAULTED;
-      stp_list_item_create(list, NULL, val);
+      val =
+	new_value(list, parameter, STP_PARAMETER_TYPE_DIMENSION,
+		  STP_PARAMETER_DEFAULTED);
       val->value.sval = sval;
     }
   stp_set_verified(v, 0);
@@ -1067,7 +1385,7 @@ stp_set_default_dimension_parameter(stp_vars_t *v, const char *parameter,
 void
 stp_clear_dimension_parameter(stp_vars_t *v, const char *parameter)
 {
-  stp_list_t *list = v->params[STP_PARAMETER_TYPE_DIMENSION];
+  stp_list_t *list = modify_params(v, STP_PARAMETER_TYPE_DIMENSION);
   stp_list_item_t *item = stp_list_get_item_by_name(list, parameter);
   stp_dprintf(STP_DBG_VARS, v, "stp_clear_dimension_parameter(0x%p, %s)\n",
 	       (const void *) v, parameter);
@@ -1079,7 +1397,7 @@ stp_clear_dimension_parameter(stp_vars_t *v, const char *parameter)
 stp_dimension_t
 stp_get_dimension_parameter(const stp_vars_t *v, const char *parameter)
 {
-  const stp_list_t *list = v->params[STP_PARAMETER_TYPE_DIMENSION];
+  const stp_list_t *list = v->params[STP_PARAMETER_TYPE_DIMENSION]->list;
   const stp_list_item_t *item = stp_list_get_item_by_name(list, parameter);
   if (item)
     {
@@ -1110,25 +1428,21 @@ stp_get_dimension_parameter(const stp_vars_t *v, const char *parameter)
 void
 stp_set_float_parameter(stp_vars_t *v, const char *parameter, double dval)
 {
-  stp_list_t *list = v->params[STP_PARAMETER_TYPE_DOUBLE];
+  stp_list_t *list = modify_params(v, STP_PARAMETER_TYPE_DOUBLE);
   value_t *val;
   stp_list_item_t *item = stp_list_get_item_by_name(list, parameter);
   stp_dprintf(STP_DBG_VARS, v, "stp_set_float_parameter(0x%p, %s, %f)\n",
 	       (const void *) v, parameter, dval);
   if (item)
     {
-      val = (value_t *) stp_list_item_get_data(item);
+      val = modify_value(item, 0);
       if (val->active == STP_PARAMETER_DEFAULTED)
 	val->active = STP_PARAMETER_ACTIVE;
     }
   else
-    {
-      val = stp_malloc(sizeof(value_t));
-      val->name = stp_strdup(parameter);
-      val->typ = STP_PARAMETER_TYPE_DOUBLE;
-      val->active = STP_PARAMETER_ACTIVE;
-      stp_list_item_create(list, NULL, val);
-    }
+    val =
+      new_value(list, parameter, STP_PARAMETER_TYPE_DOUBLE,
+		STP_PARAMETER_ACTIVE);
   val->value.dval = dval;
   stp_set_verified(v, 0);
 }
@@ -1137,18 +1451,16 @@ void
 stp_set_default_float_parameter(stp_vars_t *v, const char *parameter,
 				double dval)
 {
-  stp_list_t *list = v->params[STP_PARAMETER_TYPE_DOUBLE];
+  stp_list_t *list = modify_params(v, STP_PARAMETER_TYPE_DOUBLE);
   value_t *val;
   stp_list_item_t *item = stp_list_get_item_by_name(list, parameter);
   stp_dprintf(STP_DBG_VARS, v, "stp_set_default_float_parameter(0x%p, %s, %f)\n",
 	       (const void *) v, parameter, dval);
   if (!item)
     {
-      val = stp_malloc(sizeof(value_t));
-      val->name = stp_strdup(parameter);
-      val->typ = STP_PARAMETER_TYPE_DOUBLE;
-      val->active = STP_PARAMETER_DEFAULTED;
-      stp_list_item_create(list, NULL, val);
+      val =
+	new_value(list, parameter, STP_PARAMETER_TYPE_DOUBLE,
+		  STP_PARAMETER_DEFAULTED);
       val->value.dval = dval;
     }
   stp_set_verified(v, 0);
@@ -1157,7 +1469,7 @@ stp_set_default_float_parameter(stp_vars_t *v, const char *parameter,
 void
 stp_clear_float_parameter(stp_vars_t *v, const char *parameter)
 {
-  stp_list_t *list = v->params[STP_PARAMETER_TYPE_DOUBLE];
+  stp_list_t *list = modify_params(v, STP_PARAMETER_TYPE_DOUBLE);
   stp_list_item_t *item = stp_list_get_item_by_name(list, parameter);
   stp_dprintf(STP_DBG_VARS, v, "stp_clear_float_parameter(0x%p, %s)\n",
 	       (const void *) v, parameter);
@@ -1169,7 +1481,7 @@ stp_clear_float_parameter(stp_vars_t *v, const char *parameter)
 double
 stp_get_float_parameter(const stp_vars_t *v, const char *parameter)
 {
-  const stp_list_t *list = v->params[STP_PARAMETER_TYPE_DOUBLE];
+  const stp_list_t *list = v->params[STP_PARAMETER_TYPE_DOUBLE]->list;
   const stp_list_item_t *item = stp_list_get_item_by_name(list, parameter);
   if (item)
     {
@@ -1197,6 +1509,33 @@ stp_get_float_parameter(const stp_vars_t *v, const char *parameter)
     }
 }
 
+#define DEF_PARAMETER_HANDLE_FUNCS(type, t, field)			\
+void									\
+stpi_resolve_##type##_parameter(const stp_vars_t *v,			\
+				const char *parameter,			\
+				stpi_parameter_handle_t *h)		\
+{									\
+  h->name = parameter;							\
+  h->v = v;								\
+  h->serial = v->serial;						\
+  h->value.field = stp_get_##type##_parameter(v, parameter);		\
+}									\
+									\
+t									\
+stpi_get_##type##_parameter_by_handle(const stp_vars_t *v,		\
+				      const stpi_parameter_handle_t *h) \
+{									\
+  if (h->v == v && h->serial == v->serial)				\
+    return h->value.field;						\
+  else									\
+    return stp_get_##type##_parameter(v, h->name);			\
+}
+
+DEF_PARAMETER_HANDLE_FUNCS(int, int, ival)
+DEF_PARAMETER_HANDLE_FUNCS(boolean, int, ival)
+DEF_PARAMETER_HANDLE_FUNCS(dimension, stp_dimension_t, sval)
+DEF_PARAMETER_HANDLE_FUNCS(float, double, dval)
+
 void
 stp_scale_float_parameter(stp_vars_t *v, const char *parameter,
 			  double scale)
@@ -1268,7 +1607,7 @@ stp_check_parameter(const stp_vars_t *v,
   if (p_type >= STP_PARAMETER_TYPE_STRING_LIST &&
       p_type < STP_PARAMETER_TYPE_INVALID)
     {
-      const stp_list_t *list = v->params[p_type];
+      const stp_list_t *list = v->params[p_type]->list;
       const stp_list_item_t *item = stp_list_get_item_by_name(list, parameter);
       if (item &&
 	  active <= ((const value_t *) stp_list_item_get_data(item))->active)
@@ -1303,7 +1642,7 @@ stp_list_parameters(const stp_vars_t *v, stp_parameter_type_t p_type)
   if (p_type >= STP_PARAMETER_TYPE_STRING_LIST &&
       p_type < STP_PARAMETER_TYPE_INVALID)
     {
-      const stp_list_t *list = v->params[p_type];
+      const stp_list_t *list = v->params[p_type]->list;
       stp_string_list_t *answer = stp_string_list_create();
       const stp_list_item_t *li = stp_list_get_start(list);
       while (li)
@@ -1341,7 +1680,7 @@ stp_get_parameter_active(const stp_vars_t *v, const char *parameter,
   if (p_type >= STP_PARAMETER_TYPE_STRING_LIST &&
       p_type < STP_PARAMETER_TYPE_INVALID)
     {
-      const stp_list_t *list = v->params[p_type];
+      const stp_list_t *list = v->params[p_type]->list;
       const stp_list_item_t *item = stp_list_get_item_by_name(list, parameter);
       if (item)
 	return ((const value_t *) stp_list_item_get_data(item))->active;
@@ -1377,11 +1716,16 @@ stp_set_parameter_active(stp_vars_t *v,
   if (p_type >= STP_PARAMETER_TYPE_STRING_LIST &&
       p_type < STP_PARAMETER_TYPE_INVALID)
     {
-      const stp_list_t *list = v->params[p_type];
+      const stp_list_t *list = v->params[p_type]->list;
       const stp_list_item_t *item = stp_list_get_item_by_name(list, parameter);
       if (item && (active == STP_PARAMETER_ACTIVE ||
-		   active == STP_PARAMETER_INACTIVE))
-	((value_t *) stp_list_item_get_data(item))->active = active;
+		   active == STP_PARAMETER_INACTIVE) &&
+	  ((const value_t *) stp_list_item_get_data(item))->active != active)
+	{
+	  stp_list_item_t *mitem =
+	    stp_list_get_item_by_name(modify_params(v, p_type), parameter);
+	  modify_value(mitem, 1)->active = active;
+	}
     }
 }
 
@@ -1430,13 +1774,18 @@ stp_fill_parameter_settings(stp_parameter_t *desc,
     }
 }
 
-void
-stp_vars_copy(stp_vars_t *vd, const stp_vars_t *vs)
+static void
+copy_vars_settings(stp_vars_t *vd, const stp_vars_t *vs)
 {
   int i;
 
-  if (vs == vd)
-    return;
+  /*
+   * The copy gets a buffer of its own, so anything still pending in
+   * the original has to be written before the copy can add to it.
+   */
+  stp_flush_output(vs);
+  stp_set_output_buffer_size(vd, stp_get_output_buffer_size(vs));
+  vd->profile = vs->profile;
   stp_set_outdata(vd, stp_get_outdata(vs));
   stp_set_errdata(vd, stp_get_errdata(vs));
   stp_set_dbgdata(vd, stp_get_dbgdata(vs));
@@ -1453,11 +1802,22 @@ stp_vars_copy(stp_vars_t *vd, const stp_vars_t *vs)
   stp_set_page_height(vd, stp_get_page_height(vs));
   for (i = 0; i < STP_PARAMETER_TYPE_INVALID; i++)
     {
-      stp_list_destroy(vd->params[i]);
-      vd->params[i] = copy_value_list(vs->params[i]);
+      param_list_t *params = share_param_list(vs->params[i]);
+      release_param_list(vd->params[i]);
+      vd->params[i] = params;
     }
+  vd->serial++;
+}
+
+void
+stp_vars_copy(stp_vars_t *vd, const stp_vars_t *vs)
+{
+  if (vs == vd)
+    return;
+  copy_vars_settings(vd, vs);
   stp_list_destroy(vd->internal_data);
   vd->internal_data = copy_compdata_list(vs->internal_data);
+  index_component_data(vd);
   stp_set_verified(vd, stp_get_verified(vs));
 }
 
@@ -1490,7 +1850,7 @@ stp_vars_print_error(const stp_vars_t *v, const char *prefix)
   for (i = 0; i < STP_PARAMETER_TYPE_INVALID; i++)
     {
       const stp_list_item_t *item =
-	stp_list_get_start((const stp_list_t *) v->params[i]);
+	stp_list_get_start(v->params[i]->list);
       while (item)
 	{
 	  char *crep;
@@ -1556,7 +1916,7 @@ stp_prune_inactive_options(stp_vars_t *v)
   int i;
   for (i = 0; i < STP_PARAMETER_TYPE_INVALID; i++)
     {
-      stp_list_t *list = v->params[i];
+      stp_list_t *list = modify_params(v, i);
       stp_list_item_t *item = stp_list_get_start(list);
       while (item)
 	{
@@ -1569,6 +1929,7 @@ stp_prune_inactive_options(stp_vars_t *v)
 	}
     }
   stp_parameter_list_destroy(params);
+  v->serial++;
 }
 
 stp_vars_t *
@@ -1579,6 +1940,29 @@ stp_vars_create_copy(const stp_vars_t *vs)
   return (vd);
 }
 
+stp_vars_t *
+stpi_vars_create_worker(const stp_vars_t *vs)
+{
+  stp_vars_t *vd = stp_vars_create();
+  const stp_list_item_t *item = stp_list_get_start(vs->internal_data);
+  copy_vars_settings(vd, vs);
+  /* Share the component data; the original remains responsible for it */
+  while (item)
+    {
+      const compdata_t *cd = (const compdata_t *) stp_list_item_get_data(item);
+      compdata_t *ncd = stp_malloc(sizeof(compdata_t));
+      ncd->name = stp_strdup(cd->name);
+      ncd->copyfunc = NULL;
+      ncd->freefunc = NULL;
+      ncd->data = cd->data;
+      stp_list_item_create(vd->internal_data, NULL, ncd);
+      item = stp_list_item_next(item);
+    }
+  memcpy(vd->components, vs->components, sizeof(vd->components));
+  stp_set_verified(vd, stp_get_verified(vs));
+  return vd;
+}
+
 static const char *
 param_namefunc(const void *item)
 {
@@ -1900,61 +2284,59 @@ void
 stp_copy_vars_from(stp_vars_t *to, const stp_vars_t *from)
 {
   int i;
-  if (!from || !to)
+  if (!from || !to || from == to)
     return;
+  stp_dprintf(STP_DBG_VARS, to, "stp_copy_vars_from(0x%p, 0x%p)\n",
+	       (const void *) to, (const void *) from);
   for (i = 0; i < STP_PARAMETER_TYPE_INVALID; i++)
     {
-      const stp_list_item_t *item =
-	stp_list_get_start((const stp_list_t *) from->params[i]);
+      const stp_list_item_t *item = stp_list_get_start(from->params[i]->list);
+      stp_list_t *list;
+      if (!item)
+	continue;
+      list = modify_params(to, i);
+      /*
+       * This is the same as setting each parameter in turn, but the
+       * values themselves are shared rather than copied.
+       */
       while (item)
 	{
-	  const value_t *val = (const value_t *) stp_list_item_get_data(item);
-	  switch (val->typ)
+	  value_t *val = (value_t *) stp_list_item_get_data(item);
+	  stp_list_item_t *old = stp_list_get_item_by_name(list, val->name);
+	  stp_parameter_activity_t active = STP_PARAMETER_ACTIVE;
+	  value_t *nval;
+	  if (old)
 	    {
-	    case STP_PARAMETER_TYPE_CURVE:
-	      stp_set_curve_parameter(to, val->name, val->value.cval);
-	      break;
-	    case STP_PARAMETER_TYPE_ARRAY:
-	      stp_set_array_parameter(to, val->name, val->value.aval);
-	      break;
-	    case STP_PARAMETER_TYPE_STRING_LIST:
-	      stp_set_string_parameter(to, val->name, val->value.rval.data);
-	      break;
-	    case STP_PARAMETER_TYPE_FILE:
-	      stp_set_file_parameter(to, val->name, val->value.rval.data);
-	      break;
-	    case STP_PARAMETER_TYPE_RAW:
-	      stp_set_raw_parameter(to, val->name, val->value.rval.data,
-				    val->value.rval.bytes);
-	      break;
-	    case STP_PARAMETER_TYPE_INT:
-	      stp_set_int_parameter(to, val->name, val->value.ival);
-	      break;
-	    case STP_PARAMETER_TYPE_DIMENSION:
-	      stp_set_dimension_parameter(to, val->name, val->value.ival);
-	      break;
-	    case STP_PARAMETER_TYPE_BOOLEAN:
-	      stp_set_boolean_parameter(to, val->name, val->value.bval);
-	      break;
-	    case STP_PARAMETER_TYPE_DOUBLE:
-	      stp_set_float_parameter(to, val->name, val->value.dval);
-	      break;
-	    default:
-	      break;
+	      value_t *oval = (value_t *) stp_list_item_get_data(old);
+	      if (oval->active != STP_PARAMETER_DEFAULTED)
+		active = oval->active;
 	    }
+	  if (val->active == active)
+	    nval = value_ref(val);
+	  else
+	    {
+	      nval = value_copy(val, 1);
+	      nval->active = active;
+	    }
+	  if (old)
+	    {
+	      value_t *oval = (value_t *) stp_list_item_get_data(old);
+	      stp_list_item_set_data(old, nval);
+	      value_freefunc(oval);
+	    }
+	  else
+	    stp_list_item_create(list, NULL, nval);
 	  item = stp_list_item_next(item);
 	}
     }
+  stp_set_verified(to, 0);
 }
 
 static void
 fill_vars_from_xmltree(stp_mxml_node_t *prop, stp_mxml_node_t *root,
 		       stp_vars_t *v)
 {
-#ifdef HAVE_LOCALE_H
-  char *locale = stp_strdup(setlocale(LC_ALL, NULL));
-  setlocale(LC_ALL, "C");
-#endif
+  void *locale = stpi_set_c_locale();
   stp_dprintf(STP_DBG_XML, v, "Enter fill_vars_from_xmltree()\n");
   while (prop)
     {
@@ -2159,10 +2541,7 @@ fill_vars_from_xmltree(stp_mxml_node_t *prop, stp_mxml_node_t *root,
       prop = prop->next;
     }
   stp_dprintf(STP_DBG_XML, v, "End fill_vars_from_xmltree()\n");
-#ifdef HAVE_LOCALE_H
-  setlocale(LC_ALL, locale);
-  stp_free(locale);
-#endif
+  stpi_restore_locale(locale);
 }
 
 void
@@ -99,6 +99,7 @@ typedef struct stpi_softweave
   stp_fillfunc *fillfunc;
   stp_packfunc *pack;
   stp_compute_linewidth_func *compute_linewidth;
+  stpi_arena_t *arena;		/* Buffers that last as long as the weave */
 } stpi_softweave_t;
 
 /* RAW WEAVE */
@@ -881,67 +882,72 @@ stpi_calculate_row_parameters(void *vw,		/* I - weave parameters */
  */
 
 static stp_lineoff_t *
-allocate_lineoff(int count, int ncolors)
+allocate_lineoff(stpi_arena_t *arena, int count, int ncolors)
 {
   int i;
-  stp_lineoff_t *retval = stp_malloc(count * sizeof(stp_lineoff_t));
+  stp_lineoff_t *retval =
+    stpi_arena_alloc(arena, count * sizeof(stp_lineoff_t));
   for (i = 0; i < count; i++)
     {
       retval[i].ncolors = ncolors;
-      retval[i].v = stp_zalloc(ncolors * sizeof(unsigned long));
+      retval[i].v = stpi_arena_zalloc(arena, ncolors * sizeof(unsigned long));
     }
   return (retval);
 }
 
 static stp_lineactive_t *
-allocate_lineactive(int count, int ncolors)
+allocate_lineactive(stpi_arena_t *arena, int count, int ncolors)
 {
   int i;
-  stp_lineactive_t *retval = stp_malloc(count * sizeof(stp_lineactive_t));
+  stp_lineactive_t *retval =
+    stpi_arena_alloc(arena, count * sizeof(stp_lineactive_t));
   for (i = 0; i < count; i++)
     {
       retval[i].ncolors = ncolors;
-      retval[i].v = stp_zalloc(ncolors * sizeof(char));
+      retval[i].v = stpi_arena_zalloc(arena, ncolors * sizeof(char));
     }
   return (retval);
 }
 
 static stp_linecount_t *
-allocate_linecount(int count, int ncolors)
+allocate_linecount(stpi_arena_t *arena, int count, int ncolors)
 {
   int i;
-  stp_linecount_t *retval = stp_malloc(count * sizeof(stp_linecount_t));
+  stp_linecount_t *retval =
+    stpi_arena_alloc(arena, count * sizeof(stp_linecount_t));
   for (i = 0; i < count; i++)
     {
       retval[i].ncolors = ncolors;
-      retval[i].v = stp_zalloc(ncolors * sizeof(int));
+      retval[i].v = stpi_arena_zalloc(arena, ncolors * sizeof(int));
     }
   return (retval);
 }
 
 static stp_linebounds_t *
-allocate_linebounds(int count, int ncolors)
+allocate_linebounds(stpi_arena_t *arena, int count, int ncolors)
 {
   int i;
-  stp_linebounds_t *retval = stp_malloc(count * sizeof(stp_linebounds_t));
+  stp_linebounds_t *retval =
+    stpi_arena_alloc(arena, count * sizeof(stp_linebounds_t));
   for (i = 0; i < count; i++)
     {
       retval[i].ncolors = ncolors;
-      retval[i].start_pos = stp_zalloc(ncolors * sizeof(int));
-      retval[i].end_pos = stp_zalloc(ncolors * sizeof(int));
+      retval[i].start_pos = stpi_arena_zalloc(arena, ncolors * sizeof(int));
+      retval[i].end_pos = stpi_arena_zalloc(arena, ncolors * sizeof(int));
     }
   return (retval);
 }
 
 static stp_linebufs_t *
-allocate_linebuf(int count, int ncolors)
+allocate_linebuf(stpi_arena_t *arena, int count, int ncolors)
 {
   int i;
-  stp_linebufs_t *retval = stp_malloc(count * sizeof(stp_linebufs_t));
+  stp_linebufs_t *retval =
+    stpi_arena_alloc(arena, count * sizeof(stp_linebufs_t));
   for (i = 0; i < count; i++)
     {
       retval[i].ncolors = ncolors;
-      retval[i].v = stp_zalloc(ncolors * sizeof(unsigned char *));
+      retval[i].v = stpi_arena_zalloc(arena, ncolors * sizeof(unsigned char *));
     }
   return (retval);
 }
@@ -964,36 +970,8 @@ allocate_linebuf(int count, int ncolors)
 static void
 stpi_destroy_weave(void *vsw)
 {
-  int i, j;
   stpi_softweave_t *sw = (stpi_softweave_t *) vsw;
-  stp_free(sw->passes);
-  if (sw->fold_buf)
-    stp_free(sw->fold_buf);
-  if (sw->comp_buf)
-    stp_free(sw->comp_buf);
-  for (i = 0; i < STP_MAX_WEAVE; i++)
-    if (sw->s[i])
-      stp_free(sw->s[i]);
-  for (i = 0; i < sw->vmod; i++)
-    {
-      for (j = 0; j < sw->ncolors; j++)
-	{
-	  if (sw->linebases[i].v[j])
-	    stp_free(sw->linebases[i].v[j]);
-	}
-      stp_free(sw->linecounts[i].v);
-      stp_free(sw->linebases[i].v);
-      stp_free(sw->lineactive[i].v);
-      stp_free(sw->lineoffsets[i].v);
-      stp_free(sw->linebounds[i].start_pos);
-      stp_free(sw->linebounds[i].end_pos);
-    }
-  stp_free(sw->linecounts);
-  stp_free(sw->lineactive);
-  stp_free(sw->lineoffsets);
-  stp_free(sw->linebases);
-  stp_free(sw->linebounds);
-  stp_free(sw->head_offset);
+  stpi_arena_destroy(sw->arena);
   stpi_destroy_weave_params(sw->weaveparm);
   stp_free(vsw);
 }
@@ -1074,11 +1052,17 @@ stp_initialize_weave(stp_vars_t *v,
       return;
     }
 
+  /*
+   * Everything allocated from here on lives until the weave is
+   * destroyed, so it comes from an arena and is freed all at once.
+   */
+  sw->arena = stpi_arena_create();
+
   /*
    * setup printhead offsets.
    * for monochrome (bw) printing, the offsets are 0.
    */
-  sw->head_offset = stp_zalloc(ncolors * sizeof(int));
+  sw->head_offset = stpi_arena_zalloc(sw->arena, ncolors * sizeof(int));
   if (ncolors > 1)
     for(i = 0; i < ncolors; i++)
       sw->head_offset[i] = head_offset[i];
@@ -1114,12 +1098,12 @@ stp_initialize_weave(stp_vars_t *v,
   sw->ncolors = ncolors;
   sw->linewidth = linewidth;
   sw->vertical_height = line_count;
-  sw->lineoffsets = allocate_lineoff(sw->vmod, ncolors);
-  sw->lineactive = allocate_lineactive(sw->vmod, ncolors);
-  sw->linebases = allocate_linebuf(sw->vmod, ncolors);
-  sw->linebounds = allocate_linebounds(sw->vmod, ncolors);
-  sw->passes = stp_zalloc(sw->vmod * sizeof(stp_pass_t));
-  sw->linecounts = allocate_linecount(sw->vmod, ncolors);
+  sw->lineoffsets = allocate_lineoff(sw->arena, sw->vmod, ncolors);
+  sw->lineactive = allocate_lineactive(sw->arena, sw->vmod, ncolors);
+  sw->linebases = allocate_linebuf(sw->arena, sw->vmod, ncolors);
+  sw->linebounds = allocate_linebounds(sw->arena, sw->vmod, ncolors);
+  sw->passes = stpi_arena_zalloc(sw->arena, sw->vmod * sizeof(stp_pass_t));
+  sw->linecounts = allocate_linecount(sw->arena, sw->vmod, ncolors);
   sw->rcache = -2;
   sw->vcache = -2;
   sw->fillfunc = fillfunc;
@@ -1204,7 +1188,7 @@ weave_parameters_by_row(const stp_vars_t *v, stpi_softweave_t *sw,
 static stpi_softweave_t *
 get_sw(const stp_vars_t *v)
 {
-  return (stpi_softweave_t *) stp_get_component_data(v, "Weave");
+  return (stpi_softweave_t *) stpi_get_component(v, STPI_COMPONENT_WEAVE);
 }
 
 void
@@ -1313,7 +1297,8 @@ check_linebases(stp_vars_t *v, stpi_softweave_t *sw,
     (stp_linebufs_t *) stpi_get_linebases(v, sw, row, cpass, head_offset);
   if (!(bufs->v[color]))
     bufs->v[color] =
-      stp_zalloc (sw->virtual_jets * sw->bitwidth * sw->horizontal_width);
+      stpi_arena_zalloc(sw->arena, (sw->virtual_jets * sw->bitwidth *
+				    sw->horizontal_width));
 }
 
 /*
@@ -1567,7 +1552,11 @@ stpi_flush_passes(stp_vars_t *v, int flushall)
 void
 stp_flush_all(stp_vars_t *v)
 {
+  stpi_profile_mark_t mark;
+  stpi_profile_t *profile = stpi_profile_begin(v, &mark);
   stpi_flush_passes(v, 1);
+  if (profile)
+    stpi_profile_end(profile, STPI_PROFILE_FLUSH, &mark);
 }
 
 static void
@@ -1611,6 +1600,8 @@ stp_write_weave(stp_vars_t *v, unsigned char *const cols[])
   int setactive;
   int h_passes = sw->horizontal_weave * sw->vertical_subpasses;
   int cpass = sw->current_vertical_subpass * h_passes;
+  stpi_profile_mark_t mark;
+  stpi_profile_t *profile = stpi_profile_begin(v, &mark);
 
   if (!sw->fold_buf)
     {
@@ -1620,15 +1611,16 @@ stp_write_weave(stp_vars_t *v, unsigned char *const cols[])
       stp_dprintf(STP_DBG_WEAVE_PARAMS, v,
 		  "Allocating fold buf %d * %d (%d)\n", ylength, sw->bitwidth,
 		  sw->bitwidth * ylength);
-      sw->fold_buf = stp_zalloc(sw->bitwidth * ylength);
+      sw->fold_buf = stpi_arena_zalloc(sw->arena, sw->bitwidth * ylength);
     }
   if (!sw->comp_buf)
     {
       stp_dprintf(STP_DBG_WEAVE_PARAMS, v,
 		  "Allocating compression buffer based on %d, %d\n",
 		  sw->bitwidth, ylength);
-      sw->comp_buf = stp_zalloc(sw->bitwidth *
-				(sw->compute_linewidth)(v,ylength));
+      sw->comp_buf =
+	stpi_arena_zalloc(sw->arena, (sw->bitwidth *
+				      (sw->compute_linewidth)(v, ylength)));
     }
   if (sw->current_vertical_subpass == 0)
     initialize_row(v, sw, sw->lineno, xlength, cols);
@@ -1645,8 +1637,10 @@ stp_write_weave(stp_vars_t *v, unsigned char *const cols[])
 	      int offset = sw->head_offset[j];
 	      int pass = cpass + i;
 	      if (!sw->s[i])
-		sw->s[i] = stp_zalloc(sw->bitwidth *
-				      (sw->compute_linewidth)(v, ylength));
+		sw->s[i] =
+		  stpi_arena_zalloc(sw->arena,
+				    (sw->bitwidth *
+				     (sw->compute_linewidth)(v, ylength)));
 	      linebounds[i] =
 		stpi_get_linebounds(v, sw, sw->lineno, pass, offset);
 	    }
@@ -1689,6 +1683,8 @@ stp_write_weave(stp_vars_t *v, unsigned char *const cols[])
       sw->lineno++;
       sw->current_vertical_subpass = 0;
     }
+  if (profile)
+    stpi_profile_end(profile, STPI_PROFILE_WRITE_WEAVE, &mark);
 }
 
 #if 0
@@ -102,6 +102,7 @@ stpi_init_printer_list(void)
   stp_list_set_freefunc(printer_list, stpi_printer_freefunc);
   stp_list_set_namefunc(printer_list, stpi_printer_namefunc);
   stp_list_set_long_namefunc(printer_list, stpi_printer_long_namefunc);
+  stp_list_set_name_index(printer_list, 1);
   /* stp_list_set_sortfunc(printer_list, stpi_printer_sortfunc); */
   return 0;
 }
@@ -521,7 +522,12 @@ stp_print(const stp_vars_t *v, stp_image_t *image)
 {
   const stp_printfuncs_t *printfuncs =
     stpi_get_printfuncs(stp_get_printer(v));
-  return (printfuncs->print)(v, image);
+  int status;
+  stpi_profile_page_start(v);
+  status = (printfuncs->print)(v, image);
+  stp_flush_output(v);
+  stpi_profile_page_end(v);
+  return status;
 }
 
 int
@@ -533,7 +539,11 @@ stp_start_job(const stp_vars_t *v, stp_image_t *image)
       strcmp(stp_get_string_parameter(v, "JobMode"), "Page") == 0)
     return 1;
   if (printfuncs->start_job)
-    return (printfuncs->start_job)(v, image);
+    {
+      int status = (printfuncs->start_job)(v, image);
+      stp_flush_output(v);
+      return status;
+    }
   else
     return 1;
 }
@@ -547,7 +557,11 @@ stp_end_job(const stp_vars_t *v, stp_image_t *image)
       strcmp(stp_get_string_parameter(v, "JobMode"), "Page") == 0)
     return 1;
   if (printfuncs->end_job)
-    return (printfuncs->end_job)(v, image);
+    {
+      int status = (printfuncs->end_job)(v, image);
+      stp_flush_output(v);
+      return status;
+    }
   else
     return 1;
 }
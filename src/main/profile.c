@@ -0,0 +1,222 @@
+/*
+ *   Per-page rendering profile for Gutenprint
+ *
+ *   Copyright 2026 The Gutenprint Project
+ *
+ *   This program is free software; you can redistribute it and/or modify it
+ *   under the terms of the GNU General Public License as published by the Free
+ *   Software Foundation; either version 2 of the License, or (at your option)
+ *   any later version.
+ *
+ *   This program is distributed in the hope that it will be useful, but
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *   or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *   for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <gutenprint/gutenprint.h>
+#include "gutenprint-internal.h"
+#include <gutenprint/gutenprint-intl-internal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/time.h>
+
+/*
+ * When STP_PROFILE is set in the environment, stp_print() times each
+ * rendering stage and reports the totals for the page as a single line
+ * of JSON.  If STP_PROFILE is "-", the report goes to the error output
+ * of the vars; otherwise it is appended to the file that it names.
+ *
+ * Stages nest: the weave stage includes packing and the output it
+ * triggers, and the flush stage includes the weave rows it writes out.
+ * Each stage is only ever timed on one thread at a time, so the
+ * counters need no locking; CPU time is that of the timing thread.
+ *
+ * If allocation statistics are being collected (STP_ALLOC_STATS), the
+ * report also shows how they changed over the page.  They are counted
+ * for the whole process, so pages printed at the same time on other
+ * threads are included.
+ *
+ * The report also shows how often the color conversion memo (see
+ * color-conversions.c) found the result for a pixel.
+ */
+
+typedef struct
+{
+  unsigned long calls;
+  double wall;
+  double cpu;
+} profile_counter_t;
+
+struct stpi_profile
+{
+  double start;
+  profile_counter_t stages[STPI_PROFILE_STAGE_COUNT];
+  unsigned long output_calls;
+  unsigned long long output_bytes;
+  unsigned long memo_lookups;
+  unsigned long memo_hits;
+  stp_allocation_stats_t alloc;
+};
+
+static const char *const stage_names[STPI_PROFILE_STAGE_COUNT] =
+{
+  "image_fetch",
+  "color_conversion",
+  "channel_convert",
+  "dither",
+  "write_weave",
+  "pack",
+  "flush"
+};
+
+double
+stpi_wall_time(void)
+{
+#ifdef CLOCK_MONOTONIC
+  struct timespec ts;
+  if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0)
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1000000000.0;
+#endif
+  {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (double) tv.tv_sec + (double) tv.tv_usec / 1000000.0;
+  }
+}
+
+static double
+profile_cpu_time(void)
+{
+#ifdef CLOCK_THREAD_CPUTIME_ID
+  struct timespec ts;
+  if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) == 0)
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1000000000.0;
+#endif
+  return (double) clock() / CLOCKS_PER_SEC;
+}
+
+void
+stpi_profile_page_start(const stp_vars_t *v)
+{
+  stpi_profile_t *p;
+  if (!getenv("STP_PROFILE"))
+    return;
+  p = stp_zalloc(sizeof(stpi_profile_t));
+  p->start = stpi_wall_time();
+  stp_get_allocation_stats(&(p->alloc));
+  stpi_vars_set_profile(v, p);
+}
+
+static void
+profile_report(const stp_vars_t *v, const stpi_profile_t *p,
+	       char *report, size_t size)
+{
+  size_t used;
+  int i;
+  stp_allocation_stats_t alloc;
+  void *locale = stpi_set_c_locale();
+  used = snprintf(report, size, "{\"driver\":\"%.64s\"", stp_get_driver(v));
+  if (stp_check_int_parameter(v, "PageNumber", STP_PARAMETER_ACTIVE))
+    used += snprintf(report + used, size - used, ",\"page\":%d",
+		     stp_get_int_parameter(v, "PageNumber"));
+  used += snprintf(report + used, size - used, ",\"wall\":%.6f,\"stages\":{",
+		   stpi_wall_time() - p->start);
+  for (i = 0; i < STPI_PROFILE_STAGE_COUNT; i++)
+    used += snprintf(report + used, size - used,
+		     "%s\"%s\":{\"calls\":%lu,\"wall\":%.6f,\"cpu\":%.6f}",
+		     i > 0 ? "," : "", stage_names[i], p->stages[i].calls,
+		     p->stages[i].wall, p->stages[i].cpu);
+  used += snprintf(report + used, size - used,
+		   "},\"output\":{\"calls\":%lu,\"bytes\":%llu}",
+		   p->output_calls, p->output_bytes);
+  used += snprintf(report + used, size - used,
+		   ",\"color_memo\":{\"lookups\":%lu,\"hits\":%lu}",
+		   p->memo_lookups, p->memo_hits);
+  if (stp_get_allocation_stats(&alloc))
+    used += snprintf(report + used, size - used,
+		     ",\"alloc\":{\"allocations\":%lu,\"frees\":%lu,"
+		     "\"bytes\":%llu,\"seconds\":%.6f,"
+		     "\"arena_allocations\":%lu}",
+		     alloc.allocations - p->alloc.allocations,
+		     alloc.frees - p->alloc.frees,
+		     alloc.bytes_allocated - p->alloc.bytes_allocated,
+		     alloc.seconds - p->alloc.seconds,
+		     alloc.arena_allocations - p->alloc.arena_allocations);
+  snprintf(report + used, size - used, "}\n");
+  stpi_restore_locale(locale);
+}
+
+void
+stpi_profile_page_end(const stp_vars_t *v)
+{
+  stpi_profile_t *p = stpi_vars_get_profile(v);
+  const char *dest = getenv("STP_PROFILE");
+  char report[2048];
+  if (!p)
+    return;
+  stpi_vars_set_profile(v, NULL);
+  profile_report(v, p, report, sizeof(report));
+  if (!dest || strcmp(dest, "-") == 0)
+    stp_eprintf(v, "%s", report);
+  else
+    {
+      FILE *f;
+      stpi_global_lock();
+      f = fopen(dest, "a");
+      if (f)
+	{
+	  fputs(report, f);
+	  fclose(f);
+	}
+      else
+	stp_eprintf(v, "Unable to open profile output %s\n", dest);
+      stpi_global_unlock();
+    }
+  stp_free(p);
+}
+
+stpi_profile_t *
+stpi_profile_begin(const stp_vars_t *v, stpi_profile_mark_t *mark)
+{
+  stpi_profile_t *p = stpi_vars_get_profile(v);
+  if (p)
+    {
+      mark->wall = stpi_wall_time();
+      mark->cpu = profile_cpu_time();
+    }
+  return p;
+}
+
+void
+stpi_profile_end(stpi_profile_t *p, stpi_profile_stage_t stage,
+		 const stpi_profile_mark_t *mark)
+{
+  profile_counter_t *c = &(p->stages[stage]);
+  c->calls++;
+  c->wall += stpi_wall_time() - mark->wall;
+  c->cpu += profile_cpu_time() - mark->cpu;
+}
+
+void
+stpi_profile_output(stpi_profile_t *p, size_t bytes)
+{
+  p->output_calls++;
+  p->output_bytes += bytes;
+}
+
+void
+stpi_profile_color_memo(stpi_profile_t *p, unsigned long lookups,
+			unsigned long hits)
+{
+  p->memo_lookups += lookups;
+  p->memo_hits += hits;
+}
@@ -30,6 +30,9 @@
 /*
  * Lists aren't exactly the right data structure for this...if we start
  * getting into enough items for it to matter, we'll reimplement it them.
+ *
+ * Caches are shared by all print jobs, so every public function holds
+ * the global lock while it looks at them.
  */
 
 static stp_list_t *global_cache_list = NULL;
@@ -90,8 +93,8 @@ check_stp_cache(void)
     }
 }
 
-int
-stp_refcache_create(const char *name)
+static int
+refcache_create(const char *name)
 {
   check_stp_cache();
   if (stp_list_get_item_by_name(global_cache_list, name))
@@ -104,12 +107,23 @@ stp_refcache_create(const char *name)
       cache->cache_items = stp_string_list_create();
       stp_list_set_namefunc(cache->cache, stp_refcache_item_namefunc);
       stp_list_set_freefunc(cache->cache, stp_refcache_item_freefunc);
+      stp_list_set_name_index(cache->cache, 1);
       stp_list_item_create(global_cache_list, NULL, cache);
       stp_string_list_add_string_unsafe(global_cache_names, name, name);
       return 1;
     }
 }
 
+int
+stp_refcache_create(const char *name)
+{
+  int answer;
+  stpi_global_lock();
+  answer = refcache_create(name);
+  stpi_global_unlock();
+  return answer;
+}
+
 static stp_refcache_t *
 find_cache_named(const char *cache)
 {
@@ -128,7 +142,7 @@ find_or_create_cache_named(const char *cache)
   stp_list_item_t *item = stp_list_get_item_by_name(global_cache_list, cache);
   if (!item)
     {
-      stp_refcache_create(cache);
+      refcache_create(cache);
       item = stp_list_get_item_by_name(global_cache_list, cache);
     }
   return (stp_refcache_t *) stp_list_item_get_data(item);
@@ -137,15 +151,19 @@ find_or_create_cache_named(const char *cache)
 void *
 stp_refcache_find_item(const char *cache, const char *item)
 {
-  stp_refcache_t *cache_impl = find_cache_named(cache);
+  stp_refcache_t *cache_impl;
+  void *answer = NULL;
+  stpi_global_lock();
+  cache_impl = find_cache_named(cache);
   if (cache_impl)
     {
       stp_list_item_t *item_impl =
 	stp_list_get_item_by_name(cache_impl->cache, item);
       if (item_impl)
-	return ((stp_refcache_item_t *)stp_list_item_get_data(item_impl))->content;
+	answer = ((stp_refcache_item_t *)stp_list_item_get_data(item_impl))->content;
     }
-  return NULL;
+  stpi_global_unlock();
+  return answer;
 }
 
 static void
@@ -161,19 +179,25 @@ add_item_to_cache(stp_refcache_t *cache, const char *item, void *data)
 int
 stp_refcache_add_item(const char *cache, const char *item, void *data)
 {
-  stp_refcache_t *cache_impl = find_or_create_cache_named(cache);
+  stp_refcache_t *cache_impl;
+  int answer = 0;
+  stpi_global_lock();
+  cache_impl = find_or_create_cache_named(cache);
   if (!stp_list_get_item_by_name(cache_impl->cache, item))
     {
       add_item_to_cache(cache_impl, item, data);
-      return 1;
+      answer = 1;
     }
-  return 0;
+  stpi_global_unlock();
+  return answer;
 }
 
 void
 stp_refcache_remove_item(const char *cache, const char *item)
 {
-  stp_refcache_t *cache_impl = find_cache_named(cache);
+  stp_refcache_t *cache_impl;
+  stpi_global_lock();
+  cache_impl = find_cache_named(cache);
   if (cache_impl)
     {
       stp_list_item_t *item_impl =
@@ -184,14 +208,17 @@ stp_refcache_remove_item(const char *cache, const char *item)
 	  stp_string_list_remove_string(cache_impl->cache_items, item);
 	}
     }
+  stpi_global_unlock();
 }
 
 void
 stp_refcache_replace_item(const char *cache, const char *item, void *data)
 {
-  stp_refcache_t *cache_impl = find_or_create_cache_named(cache);
-  stp_list_item_t *item_item =
-    stp_list_get_item_by_name(cache_impl->cache, item);
+  stp_refcache_t *cache_impl;
+  stp_list_item_t *item_item;
+  stpi_global_lock();
+  cache_impl = find_or_create_cache_named(cache);
+  item_item = stp_list_get_item_by_name(cache_impl->cache, item);
   if (item_item)
     {
       stp_refcache_item_t *item_impl =
@@ -202,30 +229,39 @@ stp_refcache_replace_item(const char *cache, const char *item, void *data)
     {
       add_item_to_cache(cache_impl, item, data);
     }
+  stpi_global_unlock();
 }
 
 void
 stp_refcache_destroy(const char *cache)
 {
+  stp_list_item_t *item;
+  stpi_global_lock();
   check_stp_cache();
-  stp_list_item_t *item = stp_list_get_item_by_name(global_cache_list, cache);
+  item = stp_list_get_item_by_name(global_cache_list, cache);
   if (item)
     {
       stp_list_item_destroy(global_cache_list, item);
       stp_string_list_remove_string(global_cache_names, cache);
     }
+  stpi_global_unlock();
 }
 
 const stp_string_list_t *
 stp_refcache_list_caches(void)
 {
+  stpi_global_lock();
   check_stp_cache();
+  stpi_global_unlock();
   return global_cache_names;
 }
 
 const stp_string_list_t *
 stp_refcache_list_cache_items(const char *cache)
 {
-  stp_refcache_t *cache_impl = find_cache_named(cache);
+  stp_refcache_t *cache_impl;
+  stpi_global_lock();
+  cache_impl = find_cache_named(cache);
+  stpi_global_unlock();
   return cache_impl ? cache_impl->cache_items : NULL;
 }
@@ -36,6 +36,9 @@
 #include <limits.h>
 #include <errno.h>
 #include <ctype.h>
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
 
 struct stp_sequence
 {
@@ -53,6 +56,9 @@ struct stp_sequence
   unsigned *uint_data;
   short *short_data;
   unsigned short *ushort_data;
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_t lock;	/* Held while filling in the range or converted data */
+#endif
 };
 
 /*
@@ -61,6 +67,23 @@ struct stp_sequence
 
 #define CHECK_SEQUENCE(sequence) STPI_ASSERT(sequence, NULL)
 
+/*
+ * Sequences may be read by several threads at once (as part of curve
+ * and array parameters, or data loaded from XML), so the range and the
+ * converted data, which are only computed when first asked for, are
+ * filled in under the sequence's own lock.  Once they are there, they
+ * are read without the lock.
+ */
+#ifdef HAVE_PTHREAD_H
+#define LOCK_SEQUENCE(s)						\
+  pthread_mutex_lock(&(((stp_sequence_t *) stpi_cast_safe(s))->lock))
+#define UNLOCK_SEQUENCE(s)						\
+  pthread_mutex_unlock(&(((stp_sequence_t *) stpi_cast_safe(s))->lock))
+#else
+#define LOCK_SEQUENCE(s) do {} while (0)
+#define UNLOCK_SEQUENCE(s) do {} while (0)
+#endif
+
 static void
 sequence_ctor(stp_sequence_t *sequence)
 {
@@ -69,6 +92,9 @@ sequence_ctor(stp_sequence_t *sequence)
   sequence->recompute_range = 1;
   sequence->size = 0;
   sequence->data = NULL;
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_init(&(sequence->lock), NULL);
+#endif
 }
 
 stp_sequence_t *
@@ -98,6 +124,9 @@ sequence_dtor(stp_sequence_t *sequence)
   invalidate_auxilliary_data(sequence);
   if (sequence->data)
     stp_free(sequence->data);
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_destroy(&(sequence->lock));
+#endif
   memset(sequence, 0, sizeof(stp_sequence_t));
 }
 
@@ -115,11 +144,10 @@ stp_sequence_copy(stp_sequence_t *dest, const stp_sequence_t *source)
   CHECK_SEQUENCE(dest);
   CHECK_SEQUENCE(source);
 
-  dest->recompute_range = source->recompute_range;
+  stp_sequence_get_range(source, &(dest->rlo), &(dest->rhi));
+  dest->recompute_range = 0;
   dest->blo = source->blo;
   dest->bhi = source->bhi;
-  dest->rlo = source->rlo;
-  dest->rhi = source->rhi;
   dest->size = source->size;
   dest->data = stp_zalloc(sizeof(double) * source->size);
   memcpy(dest->data, source->data, (sizeof(double) * source->size));
@@ -132,11 +160,10 @@ stp_sequence_reverse(stp_sequence_t *dest, const stp_sequence_t *source)
   CHECK_SEQUENCE(dest);
   CHECK_SEQUENCE(source);
 
-  dest->recompute_range = source->recompute_range;
+  stp_sequence_get_range(source, &(dest->rlo), &(dest->rhi));
+  dest->recompute_range = 0;
   dest->blo = source->blo;
   dest->bhi = source->bhi;
-  dest->rlo = source->rlo;
-  dest->rhi = source->rhi;
   dest->size = source->size;
   dest->data = stp_zalloc(sizeof(double) * source->size);
   for (i = 0; i < source->size; i++)
@@ -202,16 +229,25 @@ scan_sequence_range(stp_sequence_t *sequence)
 	if (sequence->data[i] > sequence->rhi)
 	  sequence->rhi = sequence->data[i];
       }
-  sequence->recompute_range = 0; /* Don't recompute unless the data changes */
+  /* Don't recompute unless the data changes */
+  STPI_STORE_RELEASE(&(sequence->recompute_range), 0);
 }
 
 void
 stp_sequence_get_range(const stp_sequence_t *sequence,
 		       double *low, double *high)
 {
-  if (sequence->recompute_range) /* Don't recompute the range if we don't
-			       need to. */
-    scan_sequence_range((stp_sequence_t *) stpi_cast_safe(sequence));
+  if (STPI_LOAD_ACQUIRE(&(sequence->recompute_range), 1))
+    {
+      LOCK_SEQUENCE(sequence);
+      if (sequence->recompute_range) /* Don't recompute the range if we
+					don't need to. */
+	scan_sequence_range((stp_sequence_t *) stpi_cast_safe(sequence));
+      *low = sequence->rlo;
+      *high = sequence->rhi;
+      UNLOCK_SEQUENCE(sequence);
+      return;
+    }
   *low = sequence->rlo;
   *high = sequence->rhi;
 }
@@ -529,18 +565,27 @@ const t *								      \
 stp_sequence_get_##name##_data(const stp_sequence_t *sequence, size_t *count) \
 {									      \
   int i;								      \
+  const t *data;							      \
   CHECK_SEQUENCE(sequence);						      \
   if (sequence->blo < (double) lb || sequence->bhi > (double) ub)	      \
     return NULL;							      \
-  if (!sequence->name##_data)						      \
+  data = STPI_LOAD_ACQUIRE(&(sequence->name##_data), NULL);		      \
+  if (!data)								      \
     {									      \
       stp_sequence_t *seq = (stp_sequence_t *) stpi_cast_safe(sequence);      \
-      seq->name##_data = stp_zalloc(sizeof(t) * sequence->size);	      \
-      for (i = 0; i < sequence->size; i++)				      \
-	seq->name##_data[i] = (t) sequence->data[i];			      \
+      LOCK_SEQUENCE(seq);						      \
+      if (!seq->name##_data)						      \
+	{								      \
+	  t *ndata = stp_zalloc(sizeof(t) * sequence->size);		      \
+	  for (i = 0; i < sequence->size; i++)				      \
+	    ndata[i] = (t) sequence->data[i];				      \
+	  STPI_STORE_RELEASE(&(seq->name##_data), ndata);		      \
+	}								      \
+      data = seq->name##_data;						      \
+      UNLOCK_SEQUENCE(seq);						      \
     }									      \
   *count = sequence->size;						      \
-  return sequence->name##_data;						      \
+  return data;								      \
 }
 
 #ifndef HUGE_VALF /* ISO constant, from <math.h> */
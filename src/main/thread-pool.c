@@ -0,0 +1,188 @@
+/*
+ *   Simple worker thread pool for Gutenprint
+ *
+ *   Copyright 2026 The Gutenprint Project
+ *
+ *   This program is free software; you can redistribute it and/or modify it
+ *   under the terms of the GNU General Public License as published by the Free
+ *   Software Foundation; either version 2 of the License, or (at your option)
+ *   any later version.
+ *
+ *   This program is distributed in the hope that it will be useful, but
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *   or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *   for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <gutenprint/gutenprint.h>
+#include "gutenprint-internal.h"
+#include <gutenprint/gutenprint-intl-internal.h>
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
+/*
+ * The pool runs batches of independent jobs.  The thread calling
+ * stpi_thread_pool_run() takes jobs along with the workers and returns
+ * when every job in the batch has completed, so a pool of N threads
+ * only starts N - 1 of its own.
+ */
+
+#ifdef HAVE_PTHREAD_H
+
+struct stpi_thread_pool
+{
+  int thread_count;		/* Worker threads actually started */
+  pthread_t *threads;
+  pthread_mutex_t lock;
+  pthread_cond_t work_cond;	/* Signaled when a batch is posted */
+  pthread_cond_t done_cond;	/* Signaled when a batch completes */
+  stpi_thread_pool_func_t func;
+  void *data;
+  int job_count;
+  int next_job;
+  int jobs_done;
+  int shutdown;
+};
+
+static void *
+thread_pool_worker(void *arg)
+{
+  stpi_thread_pool_t *pool = (stpi_thread_pool_t *) arg;
+  pthread_mutex_lock(&pool->lock);
+  while (1)
+    {
+      int job;
+      while (!pool->shutdown && pool->next_job >= pool->job_count)
+	pthread_cond_wait(&pool->work_cond, &pool->lock);
+      if (pool->shutdown)
+	break;
+      job = pool->next_job++;
+      pthread_mutex_unlock(&pool->lock);
+      (pool->func)(pool->data, job);
+      pthread_mutex_lock(&pool->lock);
+      if (++pool->jobs_done == pool->job_count)
+	pthread_cond_signal(&pool->done_cond);
+    }
+  pthread_mutex_unlock(&pool->lock);
+  return NULL;
+}
+
+stpi_thread_pool_t *
+stpi_thread_pool_create(int threads)
+{
+  stpi_thread_pool_t *pool;
+  int i;
+  if (threads < 2)
+    return NULL;
+  pool = stp_zalloc(sizeof(stpi_thread_pool_t));
+  pool->threads = stp_zalloc(sizeof(pthread_t) * (threads - 1));
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->work_cond, NULL);
+  pthread_cond_init(&pool->done_cond, NULL);
+  for (i = 0; i < threads - 1; i++)
+    {
+      if (pthread_create(&(pool->threads[i]), NULL, thread_pool_worker,
+			 pool) != 0)
+	break;
+      pool->thread_count++;
+    }
+  if (pool->thread_count == 0)
+    {
+      stpi_thread_pool_destroy(pool);
+      return NULL;
+    }
+  return pool;
+}
+
+void
+stpi_thread_pool_destroy(stpi_thread_pool_t *pool)
+{
+  int i;
+  if (!pool)
+    return;
+  pthread_mutex_lock(&pool->lock);
+  pool->shutdown = 1;
+  pthread_cond_broadcast(&pool->work_cond);
+  pthread_mutex_unlock(&pool->lock);
+  for (i = 0; i < pool->thread_count; i++)
+    pthread_join(pool->threads[i], NULL);
+  pthread_cond_destroy(&pool->done_cond);
+  pthread_cond_destroy(&pool->work_cond);
+  pthread_mutex_destroy(&pool->lock);
+  stp_free(pool->threads);
+  stp_free(pool);
+}
+
+int
+stpi_thread_pool_size(const stpi_thread_pool_t *pool)
+{
+  return pool ? pool->thread_count + 1 : 1;
+}
+
+void
+stpi_thread_pool_run(stpi_thread_pool_t *pool, int jobs,
+		     stpi_thread_pool_func_t func, void *data)
+{
+  int i;
+  if (!pool || jobs < 2)
+    {
+      for (i = 0; i < jobs; i++)
+	(func)(data, i);
+      return;
+    }
+  pthread_mutex_lock(&pool->lock);
+  pool->func = func;
+  pool->data = data;
+  pool->next_job = 0;
+  pool->jobs_done = 0;
+  pool->job_count = jobs;
+  pthread_cond_broadcast(&pool->work_cond);
+  while (pool->next_job < pool->job_count)
+    {
+      int job = pool->next_job++;
+      pthread_mutex_unlock(&pool->lock);
+      (func)(data, job);
+      pthread_mutex_lock(&pool->lock);
+      pool->jobs_done++;
+    }
+  while (pool->jobs_done < pool->job_count)
+    pthread_cond_wait(&pool->done_cond, &pool->lock);
+  pthread_mutex_unlock(&pool->lock);
+}
+
+#else /* !HAVE_PTHREAD_H */
+
+stpi_thread_pool_t *
+stpi_thread_pool_create(int threads)
+{
+  return NULL;
+}
+
+void
+stpi_thread_pool_destroy(stpi_thread_pool_t *pool)
+{
+}
+
+int
+stpi_thread_pool_size(const stpi_thread_pool_t *pool)
+{
+  return 1;
+}
+
+void
+stpi_thread_pool_run(stpi_thread_pool_t *pool, int jobs,
+		     stpi_thread_pool_func_t func, void *data)
+{
+  int i;
+  for (i = 0; i < jobs; i++)
+    (func)(data, i);
+}
+
+#endif /* HAVE_PTHREAD_H */
@@ -85,7 +85,9 @@ void
 stp_register_xml_parser(const char *name, stp_xml_parse_func parse_func)
 {
   stpi_xml_parse_registry *xmlp;
-  stp_list_item_t *item = stp_list_get_item_by_name(stpi_xml_registry, name);
+  stp_list_item_t *item;
+  stpi_global_lock();
+  item = stp_list_get_item_by_name(stpi_xml_registry, name);
   if (item)
     xmlp = (stpi_xml_parse_registry *) stp_list_item_get_data(item);
   else
@@ -95,44 +97,55 @@ stp_register_xml_parser(const char *name, stp_xml_parse_func parse_func)
       stp_list_item_create(stpi_xml_registry, NULL, xmlp);
     }
   xmlp->parse_func = parse_func;
+  stpi_global_unlock();
 }
 
 void
 stp_unregister_xml_parser(const char *name)
 {
-  stp_list_item_t *item = stp_list_get_item_by_name(stpi_xml_registry, name);
+  stp_list_item_t *item;
+  stpi_global_lock();
+  item = stp_list_get_item_by_name(stpi_xml_registry, name);
   if (item)
     stp_list_item_destroy(stpi_xml_registry, item);
+  stpi_global_unlock();
 }
 
 void
 stp_register_xml_preload(const char *filename)
 {
-  stp_list_item_t *item = stp_list_get_item_by_name(stpi_xml_preloads, filename);
+  stp_list_item_t *item;
+  stpi_global_lock();
+  item = stp_list_get_item_by_name(stpi_xml_preloads, filename);
   if (!item)
     {
       char *the_filename = stp_strdup(filename);
       stp_list_item_create(stpi_xml_preloads, NULL, the_filename);
     }
+  stpi_global_unlock();
 }
 
 void
 stp_unregister_xml_preload(const char *name)
 {
-  stp_list_item_t *item = stp_list_get_item_by_name(stpi_xml_preloads, name);
+  stp_list_item_t *item;
+  stpi_global_lock();
+  item = stp_list_get_item_by_name(stpi_xml_preloads, name);
   if (item)
     stp_list_item_destroy(stpi_xml_preloads, item);
+  stpi_global_unlock();
 }
 
 
 static void stpi_xml_process_gutenprint(stp_mxml_node_t *gutenprint, const char *file);
 
-static char *saved_locale;                 /* Saved LC_ALL */
+static void *saved_locale;                 /* Saved locale */
 static int xml_is_initialised;                 /* Flag for init */
 
 void
 stp_xml_preinit(void)
 {
+  stpi_global_lock();
   if (! stpi_xml_registry)
     {
       stpi_xml_registry = stp_list_create();
@@ -150,21 +163,27 @@ stp_xml_preinit(void)
       stpi_xml_files_loaded = stp_list_create();
       stp_list_set_freefunc(stpi_xml_files_loaded, xml_preload_freefunc);
       stp_list_set_namefunc(stpi_xml_files_loaded, xml_preload_namefunc);
+      stp_list_set_name_index(stpi_xml_files_loaded, 1);
     }
   if (! cached_xml_files)
     {
       cached_xml_files = stp_string_list_create();
     }
+  stpi_global_unlock();
 }
 
 /*
  * Call before using any of the static functions in this file.  All
  * public functions should call this before using any mxml
  * functions.
+ *
+ * The global lock is held from the outermost stp_xml_init() until the
+ * matching stp_xml_exit(), so only one thread parses XML at a time.
  */
 void
 stp_xml_init(void)
 {
+  stpi_global_lock();
   stp_deprintf(STP_DBG_XML, "stp_xml_init: entering at level %d\n",
 	       xml_is_initialised);
   if (xml_is_initialised >= 1)
@@ -174,11 +193,7 @@ stp_xml_init(void)
     }
 
   /* Set some locale facets to "C" */
-#ifdef HAVE_LOCALE_H
-  saved_locale = stp_strdup(setlocale(LC_ALL, NULL));
-  stp_deprintf(STP_DBG_XML, "stp_xml_init: saving locale %s\n", saved_locale);
-  setlocale(LC_ALL, "C");
-#endif
+  saved_locale = stpi_set_c_locale();
 
   xml_is_initialised = 1;
 }
@@ -195,6 +210,7 @@ stp_xml_exit(void)
   if (xml_is_initialised > 1) /* don't restore original state */
     {
       xml_is_initialised--;
+      stpi_global_unlock();
       return;
     }
   else if (xml_is_initialised < 1)
@@ -204,13 +220,10 @@ stp_xml_exit(void)
     }
 
   /* Restore locale */
-#ifdef HAVE_LOCALE_H
-  stp_deprintf(STP_DBG_XML, "stp_xml_exit: restoring locale %s\n", saved_locale);
-  setlocale(LC_ALL, saved_locale);
-  stp_free(saved_locale);
+  stpi_restore_locale(saved_locale);
   saved_locale = NULL;
-#endif
   xml_is_initialised = 0;
+  stpi_global_unlock();
 }
 
 void
@@ -218,6 +231,7 @@ stp_xml_parse_file_named(const char *name)
 {
   stp_xml_preinit();
   stp_deprintf(STP_DBG_XML, "stp_xml_parse_file_named(%s)\n", name);
+  stpi_global_lock();
   if (! stp_list_get_item_by_name(stpi_xml_files_loaded, name))
     {
       char *file_name = stp_path_find_file(NULL, name);
@@ -227,6 +241,7 @@ stp_xml_parse_file_named(const char *name)
 	  free(file_name);
 	}
     }
+  stpi_global_unlock();
 }
 
 /*
@@ -324,6 +339,7 @@ xml_cache_file(const char *name, const char *cache, stp_mxml_node_t *node)
    * it's possible that different nodes of the same file will be in different
    * caches.
    */
+  stpi_global_lock();
   STPI_ASSERT(!stp_string_list_is_present(cached_xml_files, addr_string), NULL);
   if (cache)
     {
@@ -332,6 +348,7 @@ xml_cache_file(const char *name, const char *cache, stp_mxml_node_t *node)
     }
   else
     stp_string_list_add_string_unsafe(cached_xml_files, addr_string, "");
+  stpi_global_unlock();
   stp_free(addr_string);
 }
 
@@ -398,9 +415,11 @@ stp_xml_parse_file_from_path(const char *name, const char *topnodename,
   void *data;
   stp_asprintf(&cache, "%s_%s_%s", "xml_cache", topnodename,
 	       path ? path : "DEFAULT");
+  stpi_global_lock();
   data = stp_refcache_find_item(cache, name);
   if (! data)
     data = xml_parse_file_from_path(name, topnodename, path, cache);
+  stpi_global_unlock();
   stp_free(cache);
   return (stp_mxml_node_t *) data;
 }
@@ -427,6 +446,7 @@ stp_xml_free_parsed_file(stp_mxml_node_t *node)
   if (! node)
     return;
   stp_asprintf(&addr_string, "%p", (void *) node);
+  stpi_global_lock();
   stp_param_string_t *cache_entry =
     stp_string_list_find(cached_xml_files, addr_string);
   if (! cache_entry)
@@ -437,6 +457,7 @@ stp_xml_free_parsed_file(stp_mxml_node_t *node)
   if (cache_entry->text && cache_entry->text[0] != '\0')
     stp_refcache_remove_item(cache_entry->text, addr_string);
   stp_string_list_remove_string(cached_xml_files, addr_string);
+  stpi_global_unlock();
   stp_free(addr_string);
   while (node->parent && node->parent != node)
     node = node->parent;
@@ -50,6 +50,10 @@ static void Image_init(stp_image_t *image);
 static stp_image_status_t Image_get_row(stp_image_t *image,
 					unsigned char *data,
 					size_t byte_limit, int row);
+static stp_image_status_t Image_get_rows(stp_image_t *image,
+					 unsigned char *data,
+					 size_t stride, size_t byte_limit,
+					 int first_row, int count);
 static int Image_height(stp_image_t *image);
 static void Image_reset(stp_image_t *image);
 static int Image_width(stp_image_t *image);
@@ -63,7 +67,8 @@ static stp_image_t theImage =
   Image_get_row,
   Image_get_appname,
   Image_conclude,
-  NULL
+  NULL,
+  Image_get_rows
 };
 stp_vars_t *global_vars = NULL;
 
@@ -1179,67 +1184,108 @@ fill_pattern(testpattern_t *p, unsigned char *data, size_t width,
 }
 
 
+/*
+ * Fill one row of a synthetic test pattern.  Returns the band whose
+ * pattern was drawn, or -1 if the row is white or a black separator.
+ */
+static int
+fill_row(unsigned char *data, int row)
+{
+  static int previous_band = -1;
+  static int printed_blackline = 0;
+  int band = row / global_band_height;
+  if (row == global_printer_height - 1 && ! global_noblackline)
+    fill_black(data, global_printer_width, global_steps,
+	       global_bit_depth / 8);
+  else if (band >= global_n_testpatterns)
+    fill_white(data, global_printer_width, global_steps,
+	       global_bit_depth / 8);
+  else
+    {
+      if (band != previous_band)
+	{
+	  if (! global_noblackline && printed_blackline == 0)
+	    {
+	      fill_black(data, global_printer_width, global_steps,
+			 global_bit_depth / 8);
+	      printed_blackline = 1;
+	      return -1;
+	    }
+	  else
+	    {
+	      previous_band = band;
+	      printed_blackline = 0;
+	      if (! global_quiet)
+		fputc('.', stderr);
+	    }
+	}
+      fill_pattern(&(static_testpatterns[band]), data,
+		   global_printer_width, global_steps, global_channel_depth,
+		   global_bit_depth / 8);
+      return band;
+    }
+  return -1;
+}
+
 static stp_image_status_t
-Image_get_row(stp_image_t *image, unsigned char *data,
-	      size_t byte_limit, int row)
+Image_get_rows(stp_image_t *image, unsigned char *data, size_t stride,
+	       size_t byte_limit, int first_row, int count)
 {
   int depth = global_channel_depth;
+  int i;
   if (! Image_is_valid)
     {
-      fputs("Calling Image_get_row with invalid image!\n", stderr);
+      fputs("Calling Image_get_rows with invalid image!\n", stderr);
       abort();
     }
   if (static_testpatterns[0].type == E_IMAGE)
     {
       testpattern_t *t = &(static_testpatterns[0]);
-      int total_read = fread(data, 1, t->d.image.x * depth * global_bit_depth / 8,
-			     yyin);
-      if (total_read != t->d.image.x * depth * global_bit_depth / 8)
+      size_t row_bytes = t->d.image.x * depth * global_bit_depth / 8;
+      size_t total_read;
+      if (stride == row_bytes)
+	total_read = fread(data, 1, row_bytes * count, yyin);
+      else
+	for (i = 0, total_read = 0; i < count; i++)
+	  total_read += fread(data + i * stride, 1, row_bytes, yyin);
+      if (total_read != row_bytes * count)
 	{
 	  fputs("Read failed!\n", stderr);
 	  return STP_IMAGE_STATUS_ABORT;
 	}
       if (!global_quiet)
-	fputc('.', stderr);
+	for (i = 0; i < count; i++)
+	  fputc('.', stderr);
     }
   else
     {
-      static int previous_band = -1;
-      static int printed_blackline = 0;
-      int band = row / global_band_height;
-      if (row == global_printer_height - 1 && ! global_noblackline)
-	fill_black(data, global_printer_width, global_steps,
-		   global_bit_depth / 8);
-      else if (band >= global_n_testpatterns)
-	fill_white(data, global_printer_width, global_steps,
-		   global_bit_depth / 8);
-      else
+      /*
+       * Every row of a band after the first is identical, so copy the
+       * row above rather than drawing the pattern again.
+       */
+      size_t row_bytes = global_printer_width * depth * global_bit_depth / 8;
+      int last_band = -1;
+      for (i = 0; i < count; i++)
 	{
-	  if (band != previous_band)
-	    {
-	      if (! global_noblackline && printed_blackline == 0)
-		{
-		  fill_black(data, global_printer_width, global_steps,
-			     global_bit_depth / 8);
-		  printed_blackline = 1;
-		  return STP_IMAGE_STATUS_OK;
-		}
-	      else
-		{
-		  previous_band = band;
-		  printed_blackline = 0;
-		  if (! global_quiet)
-		    fputc('.', stderr);
-		}
-	    }
-	  fill_pattern(&(static_testpatterns[band]), data,
-		       global_printer_width, global_steps, depth,
-		       global_bit_depth / 8);
+	  unsigned char *row_data = data + i * stride;
+	  int row = first_row + i;
+	  if (last_band >= 0 && row / global_band_height == last_band &&
+	      row != global_printer_height - 1)
+	    memcpy(row_data, row_data - stride, row_bytes);
+	  else
+	    last_band = fill_row(row_data, row);
 	}
     }
   return STP_IMAGE_STATUS_OK;
 }
 
+static stp_image_status_t
+Image_get_row(stp_image_t *image, unsigned char *data,
+	      size_t byte_limit, int row)
+{
+  return Image_get_rows(image, data, byte_limit, byte_limit, row, 1);
+}
+
 static void
 check_valid_image(const char *s)
 {
@@ -0,0 +1,206 @@
+/*
+ *   Compare the SIMD color conversion kernels against the generic ones.
+ *
+ *   This program is free software; you can redistribute it and/or modify it
+ *   under the terms of the GNU General Public License as published by the Free
+ *   Software Foundation; either version 2 of the License, or (at your option)
+ *   any later version.
+ *
+ *   This program is distributed in the hope that it will be useful, but
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *   or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *   for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * The kernel sets are static, and the color module may not be linked
+ * into libgutenprint, so its source is compiled in directly.  Every set
+ * the processor can run is compared, whatever STP_COLOR_KERNELS says;
+ * the set chosen for the color conversions is then checked against
+ * STP_COLOR_KERNELS, which the test driver sets to each value in turn.
+ */
+#include "../src/main/color-kernels.c"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define TEST_CASES 2000
+#define MAX_COUNT 400
+#define GUARD 0xdead		/* Must survive past the end of the output */
+
+static const int channel_counts[] = { 1, 3, 4 };
+
+/* Indexed by stpi_kernel_level_t */
+static const char *const level_names[] = { "generic", "sse2", "avx2" };
+
+static unsigned short
+random_value(int bits)
+{
+  unsigned top = (1 << bits) - 1;
+  switch (rand() % 4)
+    {
+    case 0:
+      return 0;
+    case 1:
+      return top;
+    default:
+      return rand() & top;
+    }
+}
+
+static int
+compare_output(const char *name, const char *kernel, int n,
+	       const unsigned short *vector, const unsigned short *generic,
+	       size_t count, unsigned vector_nz, unsigned generic_nz)
+{
+  size_t i;
+  if (vector_nz != generic_nz)
+    {
+      printf("FAIL: %s %s case %d: nonzero mask %x, should be %x\n",
+	     kernel, name, n, vector_nz, generic_nz);
+      return 1;
+    }
+  for (i = 0; i <= count; i++)
+    if (vector[i] != generic[i])
+      {
+	printf("FAIL: %s %s case %d (%lu samples): sample %lu is %d, "
+	       "should be %d\n", kernel, name, n, (unsigned long) count,
+	       (unsigned long) i, vector[i], generic[i]);
+	return 1;
+      }
+  return 0;
+}
+
+static int
+run_test(const stpi_color_kernels_t *k, int n)
+{
+  int channels = channel_counts[rand() % 3];
+  size_t count = channels * (rand() % (MAX_COUNT / 4 + 1));
+  size_t width = count / 4;
+  unsigned scale = rand() % 3 ? 257 : 1 + rand() % 65535;
+  unsigned mask = rand() % 2 ? 0 : 65535;
+  unsigned match = rand() % 2;
+  unsigned char in_8[MAX_COUNT];
+  unsigned short in_16[MAX_COUNT];
+  unsigned short vector[MAX_COUNT + 1];
+  unsigned short generic[MAX_COUNT + 1];
+  unsigned vector_nz, generic_nz;
+  size_t i;
+  int status = 0;
+
+  for (i = 0; i < count; i++)
+    {
+      in_8[i] = random_value(8);
+      in_16[i] = random_value(16);
+    }
+  vector[count] = GUARD;
+  generic[count] = GUARD;
+
+  vector_nz = (k->scale_8)(in_8, vector, count, scale, mask, channels);
+  generic_nz = generic_scale_8(in_8, generic, count, scale, mask, channels);
+  status |= compare_output("scale_8", k->name, n, vector, generic, count,
+			   vector_nz, generic_nz);
+
+  vector_nz = (k->scale_16)(in_16, vector, count, 1, mask, channels);
+  generic_nz = generic_scale_16(in_16, generic, count, 1, mask, channels);
+  status |= compare_output("scale_16", k->name, n, vector, generic, count,
+			   vector_nz, generic_nz);
+
+  vector_nz = (k->threshold_8)(in_8, vector, count, match << 7, channels);
+  generic_nz = generic_threshold_8(in_8, generic, count, match << 7,
+				   channels);
+  status |= compare_output("threshold_8", k->name, n, vector, generic, count,
+			   vector_nz, generic_nz);
+
+  vector_nz = (k->threshold_16)(in_16, vector, count, match << 15,
+				 channels);
+  generic_nz = generic_threshold_16(in_16, generic, count, match << 15,
+				    channels);
+  status |= compare_output("threshold_16", k->name, n, vector, generic,
+			   count, vector_nz, generic_nz);
+
+  /* The black kernel works in place on whole KCMY pixels */
+  memcpy(vector, in_16, width * 4 * sizeof(unsigned short));
+  memcpy(generic, in_16, width * 4 * sizeof(unsigned short));
+  vector[width * 4] = GUARD;
+  generic[width * 4] = GUARD;
+  vector_nz = (k->black)(vector, width);
+  generic_nz = generic_black(generic, width);
+  status |= compare_output("black", k->name, n, vector, generic, width * 4,
+			   vector_nz, generic_nz);
+  return status;
+}
+
+/*
+ * STP_COLOR_KERNELS=generic and =sse2 cap the kernels used; anything
+ * else lets the best the processor has be used.
+ */
+static int
+check_selection(void)
+{
+  const char *request = getenv("STP_COLOR_KERNELS");
+  stpi_kernel_level_t level = stpi_kernel_level();
+  stpi_kernel_level_t limit = STPI_KERNEL_AVX2;
+  if (request && strcmp(request, "generic") == 0)
+    limit = STPI_KERNEL_GENERIC;
+  else if (request && strcmp(request, "sse2") == 0)
+    limit = STPI_KERNEL_SSE2;
+  printf("STP_COLOR_KERNELS=%s: using %s kernels\n",
+	 request ? request : "", stpi_color_kernels->name);
+  if (level > limit)
+    {
+      printf("FAIL: %s kernels used, but %s asked for\n",
+	     level_names[level], level_names[limit]);
+      return 1;
+    }
+  if (strcmp(stpi_color_kernels->name, level_names[level]) != 0)
+    {
+      printf("FAIL: %s kernels used, should be %s\n",
+	     stpi_color_kernels->name, level_names[level]);
+      return 1;
+    }
+  return 0;
+}
+
+int
+main(int argc, char **argv)
+{
+  const stpi_color_kernels_t *sets[2];
+  int nsets = 0;
+  unsigned seed = 1;
+  int tests = 0;
+  int failures = 0;
+  int i, j;
+
+  if (argc > 1)
+    seed = strtoul(argv[1], NULL, 0);
+  stp_init();
+  stpi_init_color_kernels();
+  failures += check_selection();
+  tests++;
+
+#ifdef X86_KERNELS
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("sse2"))
+    sets[nsets++] = &sse2_kernels;
+  if (__builtin_cpu_supports("avx2"))
+    sets[nsets++] = &avx2_kernels;
+#endif
+
+  for (j = 0; j < nsets; j++)
+    {
+      srand(seed);
+      for (i = 0; i < TEST_CASES; i++)
+	{
+	  failures += run_test(sets[j], i);
+	  tests++;
+	}
+    }
+  if (failures)
+    printf("%d of %d tests failed\n", failures, tests);
+  else
+    printf("All %d tests passed\n", tests);
+  return failures ? 1 : 0;
+}
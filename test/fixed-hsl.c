@@ -0,0 +1,166 @@
+/*
+ *   Compare the fixed point HSL adjustments against the floating point
+ *   versions.
+ *
+ *   This program is free software; you can redistribute it and/or modify it
+ *   under the terms of the GNU General Public License as published by the Free
+ *   Software Foundation; either version 2 of the License, or (at your option)
+ *   any later version.
+ *
+ *   This program is distributed in the hope that it will be useful, but
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *   or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *   for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * The HSL routines are static, and the color module may not be linked
+ * into libgutenprint, so its sources are compiled in directly.
+ */
+#include "../src/main/color-conversions.c"
+#include "../src/main/color-kernels.c"
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+ * Largest difference allowed between the two versions in any 16-bit
+ * output component.  Keep this in step with the comment on the fixed
+ * point HSL functions in color-conversions.c.
+ */
+#define MAX_ERROR 7
+
+/* Sampling step through each 8-bit input component */
+#define GRID_STEP 5
+
+static const double saturations[] = { 0.5, 1.0, 1.2, 1.7, 3.0 };
+static const double hue_data[6] = { 0.1, -0.2, 0.3, 0, -0.1, 0.2 };
+static const double sat_data[6] = { 1.2, 0.8, 1.5, 1, 0.7, 1.1 };
+static const double lum_data[6] = { 0.9, 1.3, 0.8, 1, 1.6, 0.95 };
+
+static const char *modes[] = { "normal", "hue only", "bright" };
+
+static stp_curve_t *
+make_map(double lo, double hi, const double *data)
+{
+  stp_curve_t *curve = stp_curve_create(STP_CURVE_WRAP_AROUND);
+  stp_curve_set_bounds(curve, lo, hi);
+  stp_curve_set_data(curve, 6, data);
+  stp_curve_resample(curve, 384);
+  return curve;
+}
+
+static int
+grid_value(int i)
+{
+  int val = i * GRID_STEP;
+  return val > 255 ? 255 : val;
+}
+
+static int
+run_test(int maps, int mode, double saturation)
+{
+  lut_t lut;
+  double ssat = saturation;
+  double isat = 1.0;
+  int split_saturation = ssat > 1.4;
+  unsigned fssat, fisat;
+  int steps = 255 / GRID_STEP + 2;
+  int r, g, b, i;
+  int max_error = 0;
+  int worst[3] = { 0, 0, 0 };
+
+  memset(&lut, 0, sizeof(lut));
+  if (maps & 1)
+    stp_curve_cache_set_curve(&(lut.hue_map), make_map(-6, 6, hue_data));
+  if (maps & 2)
+    stp_curve_cache_set_curve(&(lut.sat_map), make_map(0, 4, sat_data));
+  if (maps & 4)
+    stp_curve_cache_set_curve(&(lut.lum_map), make_map(0, 4, lum_data));
+  stpi_color_prepare_fixed_hsl(&lut);
+
+  /* Derive the parameters the same way as the color conversions do */
+  if (split_saturation)
+    ssat = sqrt(ssat);
+  if (ssat > 1)
+    isat = 1.0 / ssat;
+  fssat = ssat * 65536 + .5;
+  fisat = isat * 65536 + .5;
+
+  for (r = 0; r < steps; r++)
+    for (g = 0; g < steps; g++)
+      for (b = 0; b < steps; b++)
+	{
+	  unsigned short in[3];
+	  unsigned short fp[6];
+	  unsigned short fixed[6];
+	  in[0] = grid_value(r) * 257;
+	  in[1] = grid_value(g) * 257;
+	  in[2] = grid_value(b) * 257;
+	  if (in[0] == in[1] && in[0] == in[2])
+	    continue;
+	  /* Each pair of functions is given the same input */
+	  memcpy(fp, in, sizeof(in));
+	  memcpy(fixed, in, sizeof(in));
+	  update_saturation_from_rgb(fp, NULL, 0, ssat, isat, 0);
+	  update_saturation_from_rgb_fixed(fixed, NULL, fssat, fisat, 0);
+	  memcpy(fp + 3, in, sizeof(in));
+	  memcpy(fixed + 3, in, sizeof(in));
+	  adjust_hsl(fp + 3, &lut, ssat, isat, split_saturation,
+		     mode == 1, mode == 2);
+	  adjust_hsl_fixed(fixed + 3, &lut, fssat, fisat,
+			   mode == 1, mode == 2);
+	  for (i = 0; i < 6; i++)
+	    {
+	      int error = abs((int) fp[i] - (int) fixed[i]);
+	      if (error > max_error)
+		{
+		  max_error = error;
+		  worst[0] = grid_value(r);
+		  worst[1] = grid_value(g);
+		  worst[2] = grid_value(b);
+		}
+	    }
+	}
+
+  stp_curve_free_curve_cache(&(lut.hue_map));
+  stp_curve_free_curve_cache(&(lut.lum_map));
+  stp_curve_free_curve_cache(&(lut.sat_map));
+  STP_SAFE_FREE(lut.fixed_hue_map);
+  STP_SAFE_FREE(lut.fixed_lum_map);
+  STP_SAFE_FREE(lut.fixed_sat_map);
+
+  if (max_error > MAX_ERROR)
+    {
+      printf("FAIL: maps %d, %s, saturation %.1f: error %d at %d %d %d\n",
+	     maps, modes[mode], saturation, max_error,
+	     worst[0], worst[1], worst[2]);
+      return 1;
+    }
+  return 0;
+}
+
+int
+main(int argc, char **argv)
+{
+  int maps, mode;
+  int tests = 0;
+  int failures = 0;
+  size_t i;
+
+  stp_init();
+  for (maps = 0; maps < 8; maps++)
+    for (mode = 0; mode < 3; mode++)
+      for (i = 0; i < sizeof(saturations) / sizeof(double); i++)
+	{
+	  failures += run_test(maps, mode, saturations[i]);
+	  tests++;
+	}
+  if (failures)
+    printf("%d of %d tests failed\n", failures, tests);
+  else
+    printf("All %d tests passed\n", tests);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,349 @@
+/*
+ *   Compare the AVX2 ordered dither row kernel against the generic code.
+ *
+ *   This program is free software; you can redistribute it and/or modify it
+ *   under the terms of the GNU General Public License as published by the Free
+ *   Software Foundation; either version 2 of the License, or (at your option)
+ *   any later version.
+ *
+ *   This program is distributed in the hope that it will be useful, but
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *   or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *   for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * The switch between the two is private to the ordered dither, so its
+ * source is compiled in directly.  Each row is dithered with the AVX2
+ * kernel and then again without it, which is what STP_COLOR_KERNELS=generic
+ * does for a whole run.  Input and mask rows end where an unreadable
+ * page starts, so that the kernel reading past them faults; the gathers
+ * are not checked by valgrind or the address sanitizer.
+ */
+#include "../src/main/dither-ordered.c"
+#include <stdio.h>
+#if defined(HAVE_SYS_MMAN_H) && defined(HAVE_UNISTD_H)
+#define USE_GUARD_PAGE
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#define TEST_CASES 400
+#define ROWS 8
+#define MAX_CHANNELS 7
+
+static int width;
+
+static int
+image_width(stp_image_t *image)
+{
+  return width;
+}
+
+static stp_image_t theImage =
+{
+  NULL,
+  NULL,
+  image_width,
+  NULL,
+  NULL,
+  NULL,
+  NULL,
+  NULL
+};
+
+static const stp_dotsize_t single_dotsize[] =
+{
+  { 0x1, 1.0 }
+};
+
+static const stp_dotsize_t variable_dotsizes[] =
+{
+  { 0x1, 0.28 },
+  { 0x2, 0.58 },
+  { 0x3, 1.0  }
+};
+
+#define SHADE(density, name)					\
+{  density, sizeof(name)/sizeof(stp_dotsize_t), name  }
+
+static const stp_shade_t normal_1bit_shades[] =
+{
+  SHADE(1.0, single_dotsize)
+};
+
+static const stp_shade_t photo_1bit_shades[] =
+{
+  SHADE(0.33, single_dotsize),
+  SHADE(1.0, single_dotsize)
+};
+
+static const stp_shade_t normal_2bit_shades[] =
+{
+  SHADE(1.0, variable_dotsizes)
+};
+
+static const stp_shade_t photo_2bit_shades[] =
+{
+  SHADE(0.33, variable_dotsizes),
+  SHADE(1.0, variable_dotsizes)
+};
+
+static const char *algorithms[] = { "Ordered", "OrderedNew" };
+static const int aspects[][2] = { { 1, 1 }, { 2, 1 }, { 1, 2 }, { 4, 1 } };
+
+static unsigned short
+random_value(void)
+{
+  switch (rand() % 5)
+    {
+    case 0:
+      return 0;
+    case 1:
+      return 65535;
+    case 2:
+      return 1 + rand() % 256;
+    default:
+      return rand() % 65536;
+    }
+}
+
+typedef struct
+{
+  char *base;
+  size_t size;			/* Up to the unreadable page */
+  size_t page;
+} guarded_t;
+
+static void *
+guarded_alloc(guarded_t *g, size_t bytes)
+{
+#ifdef USE_GUARD_PAGE
+  void *base;
+  g->page = sysconf(_SC_PAGESIZE);
+  g->size = (bytes + g->page - 1) / g->page * g->page;
+  if (posix_memalign(&base, g->page, g->size + g->page) != 0)
+    {
+      printf("Cannot allocate %lu bytes\n", (unsigned long) bytes);
+      exit(1);
+    }
+  g->base = base;
+  mprotect(g->base + g->size, g->page, PROT_NONE);
+  return g->base + g->size - bytes;
+#else
+  g->base = stp_malloc(bytes);
+  return g->base;
+#endif
+}
+
+static void
+guarded_free(guarded_t *g)
+{
+#ifdef USE_GUARD_PAGE
+  mprotect(g->base + g->size, g->page, PROT_READ | PROT_WRITE);
+  free(g->base);
+#else
+  stp_free(g->base);
+#endif
+}
+
+static int
+compare_row(stpi_dither_t *d, unsigned char **vector, int vector_ends[][2],
+	    int n, int row)
+{
+  int length = (d->dst_width + 7) / 8;
+  int i;
+  for (i = 0; i < CHANNEL_COUNT(d); i++)
+    {
+      stpi_dither_channel_t *dc = &(CHANNEL(d, i));
+      if (memcmp(vector[i], dc->ptr, length * dc->signif_bits) != 0)
+	{
+	  printf("FAIL: case %d row %d channel %d: output differs\n",
+		 n, row, i);
+	  return 1;
+	}
+      if (vector_ends[i][0] != dc->row_ends[0] ||
+	  vector_ends[i][1] != dc->row_ends[1])
+	{
+	  printf("FAIL: case %d row %d channel %d: row ends %d %d, "
+		 "should be %d %d\n", n, row, i, vector_ends[i][0],
+		 vector_ends[i][1], dc->row_ends[0], dc->row_ends[1]);
+	  return 1;
+	}
+    }
+  return 0;
+}
+
+static int
+run_test(int n)
+{
+  stp_vars_t *v = stp_vars_create();
+  stpi_dither_t *d;
+  stpi_ordered_dither_t *od;
+  int photo = rand() % 2;
+  int two_bit = rand() % 2;
+  int planar = rand() % 3 == 0;
+  int use_mask = rand() % 2;
+  const int *aspect = aspects[rand() % 4];
+  unsigned char *vector[MAX_CHANNELS];	/* Copies of the AVX2 output */
+  unsigned char *output[MAX_CHANNELS];
+  int vector_ends[MAX_CHANNELS][2];
+  unsigned short *raw;
+  unsigned char *mask = NULL;
+  guarded_t raw_alloc, mask_alloc;
+  size_t plane_stride = 0;
+  unsigned empty_planes = 0;
+  int channels, length, row, i, j;
+  int status = 0;
+
+  /*
+   * Multiples of 16 stop the kernel short of the end of interleaved
+   * rows; wide rows are split into bands that start on any byte.
+   */
+  switch (rand() % 3)
+    {
+    case 0:
+      width = 16 * (1 + rand() % 40);
+      break;
+    case 1:
+      width = 1 + rand() % 700;
+      break;
+    default:
+      width = 2048 + rand() % 3000;
+      stp_set_int_parameter(v, "RenderThreads", 2 + rand() % 3);
+      break;
+    }
+  length = (width + 7) / 8;
+
+  stp_set_driver(v, "escp2-ex");
+  stp_set_string_parameter(v, "DitherAlgorithm", algorithms[rand() % 2]);
+  stp_set_string_parameter(v, "ChannelBitDepth", "8");
+  stp_set_string_parameter(v, "PrintingMode", "Color");
+  stp_set_string_parameter(v, "InputImageType", "CMYK");
+  stp_dither_init(v, &theImage, width, aspect[0], aspect[1]);
+  for (i = 0; i < MAX_CHANNELS; i++)
+    {
+      vector[i] = stp_malloc(length * 2);
+      output[i] = stp_malloc(length * 2);
+    }
+  stp_dither_add_channel(v, output[0], STP_ECOLOR_K, 0);
+  stp_dither_add_channel(v, output[1], STP_ECOLOR_C, 0);
+  stp_dither_add_channel(v, output[2], STP_ECOLOR_M, 0);
+  stp_dither_add_channel(v, output[3], STP_ECOLOR_Y, 0);
+  if (photo)
+    {
+      stp_dither_add_channel(v, output[4], STP_ECOLOR_C, 1);
+      stp_dither_add_channel(v, output[5], STP_ECOLOR_M, 1);
+    }
+  if (two_bit)
+    stp_dither_set_transition(v, 0.5);
+  for (i = 0; i < 4; i++)
+    {
+      if (photo && (i == STP_ECOLOR_C || i == STP_ECOLOR_M))
+	stp_dither_set_inks_full(v, i, 2, two_bit ? photo_2bit_shades :
+				 photo_1bit_shades, 1.0, 0.5);
+      else
+	stp_dither_set_inks_full(v, i, 1, two_bit ? normal_2bit_shades :
+				 normal_1bit_shades, 1.0, 0.5);
+    }
+  d = (stpi_dither_t *) stpi_get_component(v, STPI_COMPONENT_DITHER);
+  channels = CHANNEL_COUNT(d);
+
+  if (planar)
+    {
+      plane_stride = (width + 15) & ~15;
+      raw = guarded_alloc(&raw_alloc,
+			  plane_stride * channels * sizeof(unsigned short));
+      for (i = 0; i < channels; i++)
+	if (rand() % 4 == 0)
+	  empty_planes |= 1 << i;
+    }
+  else
+    raw = guarded_alloc(&raw_alloc,
+			width * channels * sizeof(unsigned short));
+  if (use_mask)
+    mask = guarded_alloc(&mask_alloc, length);
+
+  for (row = 0; row < ROWS && !status; row++)
+    {
+      for (i = 0; i < width; i++)
+	for (j = 0; j < channels; j++)
+	  {
+	    unsigned short val = random_value();
+	    if (planar)
+	      raw[j * plane_stride + i] =
+		(empty_planes & (1 << j)) ? 0 : val;
+	    else
+	      raw[i * channels + j] = val;
+	  }
+      if (mask)
+	for (i = 0; i < length; i++)
+	  mask[i] = rand() % 3 == 0 ? 0xff : rand() % 256;
+
+      for (i = 0; i < 2; i++)
+	{
+	  od = (stpi_ordered_dither_t *) d->aux_data;
+	  if (od)
+	    od->avx2 = i == 0;
+	  if (planar)
+	    stpi_dither_planar(v, row, raw, plane_stride, empty_planes, 0, 0,
+			       mask);
+	  else
+	    stp_dither_internal(v, row, raw, 0, 0, mask);
+	  if (i == 0)
+	    for (j = 0; j < channels; j++)
+	      {
+		stpi_dither_channel_t *dc = &(CHANNEL(d, j));
+		memcpy(vector[j], dc->ptr, length * dc->signif_bits);
+		vector_ends[j][0] = dc->row_ends[0];
+		vector_ends[j][1] = dc->row_ends[1];
+	      }
+	}
+      status = compare_row(d, vector, vector_ends, n, row);
+    }
+  if (status)
+    printf("      %d wide, %s, aspect %d:%d, %s%s%s%s\n", width,
+	   stp_get_string_parameter(v, "DitherAlgorithm"), aspect[0],
+	   aspect[1], photo ? "photo, " : "", two_bit ? "2 bit" : "1 bit",
+	   planar ? ", planar" : "", mask ? ", mask" : "");
+
+  stp_vars_destroy(v);
+  for (i = 0; i < MAX_CHANNELS; i++)
+    {
+      stp_free(vector[i]);
+      stp_free(output[i]);
+    }
+  guarded_free(&raw_alloc);
+  if (mask)
+    guarded_free(&mask_alloc);
+  return status;
+}
+
+int
+main(int argc, char **argv)
+{
+  unsigned seed = 1;
+  int failures = 0;
+  int i;
+
+  if (argc > 1)
+    seed = strtoul(argv[1], NULL, 0);
+  stp_init();
+  if (stpi_kernel_level() < STPI_KERNEL_AVX2)
+    {
+      printf("AVX2 is not available; skipping\n");
+      return 77;
+    }
+
+  srand(seed);
+  for (i = 0; i < TEST_CASES; i++)
+    failures += run_test(i);
+  if (failures)
+    printf("%d of %d tests failed\n", failures, TEST_CASES);
+  else
+    printf("All %d tests passed\n", TEST_CASES);
+  return failures ? 1 : 0;
+}
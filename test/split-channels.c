@@ -0,0 +1,338 @@
+/*
+ *   Compare the AVX2 channel split against the scalar version, and time
+ *   both with six and eight inks.
+ *
+ *   This program is free software; you can redistribute it and/or modify it
+ *   under the terms of the GNU General Public License as published by the Free
+ *   Software Foundation; either version 2 of the License, or (at your option)
+ *   any later version.
+ *
+ *   This program is distributed in the hope that it will be useful, but
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *   or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *   for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Both versions are static, so the channel source is compiled in
+ * directly.  Usage: split-channels [-b] [seed]
+ * With -b, time the split instead of testing it.
+ */
+#include "../src/main/channel.c"
+#include <stdio.h>
+#include <sys/time.h>
+
+#define TEST_CASES 3000
+#define MAX_WIDTH 300
+#define BENCH_WIDTH 4000
+#define BENCH_ROWS 2000
+
+static int width;
+
+static int
+image_width(stp_image_t *image)
+{
+  return width;
+}
+
+static stp_image_t theImage =
+{
+  NULL,
+  NULL,
+  image_width,
+  NULL,
+  NULL,
+  NULL,
+  NULL,
+  NULL
+};
+
+static stp_vars_t *
+new_vars(int compact, int black)
+{
+  stp_vars_t *v = stp_vars_create();
+  stp_set_string_parameter(v, "STPIOutputType", "KCMY");
+  stp_set_string_parameter(v, "ColorCorrection", "Accurate");
+  stp_set_boolean_parameter(v, "CompactSubchannelTables", compact);
+  if (black)
+    stp_channel_set_black_channel(v, 0);
+  return v;
+}
+
+/*
+ * Subchannels go from light to dark, as printers set them up, so that
+ * compact tables can be made for them.
+ */
+static void
+add_channel(stp_vars_t *v, int channel, int subchannels, int random_density)
+{
+  double value = 1.0;
+  int k;
+  for (k = subchannels - 1; k >= 0; k--)
+    {
+      stp_channel_add(v, channel, k, value);
+      stp_channel_set_cutoff_adjustment(v, channel, k,
+					.5 + (rand() % 50) / 100.0);
+      if (random_density)
+	switch (rand() % 4)
+	  {
+	  case 0:
+	    stp_channel_set_density_adjustment(v, channel, k, 0);
+	    break;
+	  case 1:
+	    stp_channel_set_density_adjustment(v, channel, k,
+					       (rand() % 1000) / 1000.0);
+	    break;
+	  default:
+	    break;
+	  }
+      value *= .2 + (rand() % 60) / 100.0;
+    }
+}
+
+/*
+ * Values that catch out the vector arithmetic: zero, which the split
+ * skips; full scale; and small values, which leave the division with
+ * the least precision to spare.
+ */
+static unsigned short
+random_value(void)
+{
+  switch (rand() % 6)
+    {
+    case 0:
+      return 0;
+    case 1:
+      return 65535;
+    case 2:
+      return 1 + rand() % 16;
+    case 3:
+      return 65535 - rand() % 16;
+    default:
+      return rand() % 65536;
+    }
+}
+
+static void
+fill_input(unsigned short *input, int channels, unsigned zero_channels)
+{
+  int i, j;
+  for (i = 0; i < width; i++)
+    for (j = 0; j < channels; j++)
+      {
+	unsigned short *val = input + i * channels + j;
+	if (zero_channels & (1 << j))
+	  *val = 0;
+	else if (i > 0 && rand() % 4 == 0)
+	  *val = val[-channels];
+	else
+	  *val = random_value();
+      }
+}
+
+static unsigned
+convert(stp_vars_t *v, const unsigned short *input, size_t input_size,
+	unsigned short *output)
+{
+  stpi_channel_group_t *cg = get_channel_group(v);
+  unsigned zero_mask;
+  memcpy(stp_channel_get_input(v), input, input_size);
+  stp_channel_convert(v, &zero_mask);
+  memcpy(output, stp_channel_get_output(v),
+	 cg->total_channels * width * sizeof(unsigned short));
+  return zero_mask;
+}
+
+static int
+run_test(int n)
+{
+  int compact = rand() % 2;
+  int black = rand() % 2;
+  int planar = rand() % 4 == 0;
+  int channels = 1 + rand() % 6;
+  int subchannels[6] = { 1, 1, 1, 1, 1, 1 };
+  int spare = 8 - channels;	/* Subchannels beyond one per channel */
+  int total = 0;
+  unsigned zero_channels = 0;
+  stp_vars_t *v = new_vars(compact, black);
+  stpi_channel_group_t *cg;
+  unsigned short input[MAX_WIDTH * 8];
+  unsigned short vector[MAX_WIDTH * 8];
+  unsigned short scalar[MAX_WIDTH * 8];
+  unsigned vector_mask, scalar_mask;
+  int i, status = 0;
+
+  width = 1 + rand() % MAX_WIDTH;
+  for (i = 0; i < channels; i++)
+    {
+      int extra = rand() % 3;
+      if (extra > spare)
+	extra = spare;
+      spare -= extra;
+      subchannels[i] = 1 + extra;
+    }
+  /* At least one channel has to be split */
+  if (spare == 8 - channels)
+    subchannels[rand() % channels]++;
+  for (i = 0; i < channels; i++)
+    {
+      add_channel(v, i, subchannels[i], 1);
+      total += subchannels[i];
+      /* Channels with no ink at all are where the zero mask goes astray */
+      if (rand() % 4 == 0)
+	zero_channels |= 1 << i;
+    }
+  stp_channel_initialize(v, &theImage, channels);
+  if (planar)
+    stpi_channel_set_planar_output(v, 1);
+  cg = get_channel_group(v);
+  if (!cg->split_lanes)
+    {
+      stp_vars_destroy(v);
+      return -1;
+    }
+
+  fill_input(input, channels, zero_channels);
+  vector_mask = convert(v, input, channels * width * sizeof(unsigned short),
+			vector);
+  STP_SAFE_FREE(cg->split_lanes);
+  scalar_mask = convert(v, input, channels * width * sizeof(unsigned short),
+			scalar);
+  if (vector_mask != scalar_mask)
+    {
+      printf("FAIL: case %d: zero mask %x, should be %x\n",
+	     n, vector_mask, scalar_mask);
+      status = 1;
+    }
+  for (i = 0; i < total * width; i++)
+    if (vector[i] != scalar[i])
+      {
+	printf("FAIL: case %d (%d inks, %d wide%s%s%s): pixel %d channel %d "
+	       "is %d, should be %d\n", n, total, width,
+	       compact ? ", compact" : "", black ? ", black" : "",
+	       planar ? ", planar" : "", i / total, i % total,
+	       vector[i], scalar[i]);
+	status = 1;
+	break;
+      }
+  stp_vars_destroy(v);
+  return status;
+}
+
+static double
+compute_interval(struct timeval *tv1, struct timeval *tv2)
+{
+  return ((double) tv2->tv_sec + (double) tv2->tv_usec / 1000000.) -
+    ((double) tv1->tv_sec + (double) tv1->tv_usec / 1000000.);
+}
+
+static void
+time_split(stp_vars_t *v, const unsigned short *input, size_t input_size,
+	   const char *name)
+{
+  struct timeval tv1, tv2;
+  double interval;
+  unsigned zero_mask;
+  int row;
+  gettimeofday(&tv1, NULL);
+  for (row = 0; row < BENCH_ROWS; row++)
+    {
+      memcpy(stp_channel_get_input(v), input, input_size);
+      stp_channel_convert(v, &zero_mask);
+    }
+  gettimeofday(&tv2, NULL);
+  interval = compute_interval(&tv1, &tv2);
+  printf("  %-8s %8.3f s  %8.1f Mpixel/s\n", name, interval,
+	 (double) BENCH_ROWS * width / interval / 1000000.);
+}
+
+/*
+ * Six inks: light and dark cyan and magenta.  Eight inks: three blacks
+ * as well, like the photo printers with light and light light black.
+ */
+static void
+run_benchmark(int inks)
+{
+  stp_vars_t *v = new_vars(0, 1);
+  stpi_channel_group_t *cg;
+  struct split_lanes *lanes;
+  unsigned short *input = stp_malloc(4 * BENCH_WIDTH * sizeof(unsigned short));
+  int i, j;
+
+  width = BENCH_WIDTH;
+  add_channel(v, 0, inks == 8 ? 3 : 1, 0);
+  add_channel(v, 1, 2, 0);
+  add_channel(v, 2, 2, 0);
+  add_channel(v, 3, 1, 0);
+  stp_channel_initialize(v, &theImage, 4);
+  cg = get_channel_group(v);
+
+  /* A smooth sweep, which is closer to a real image than noise */
+  for (i = 0; i < width; i++)
+    for (j = 0; j < 4; j++)
+      input[i * 4 + j] = (unsigned) (i * (j + 1) * 65535 / width) % 65536;
+
+  printf("%d inks, %d pixels x %d rows:\n", inks, width, BENCH_ROWS);
+  lanes = cg->split_lanes;
+  if (lanes)
+    time_split(v, input, 4 * width * sizeof(unsigned short), "avx2");
+  cg->split_lanes = NULL;
+  time_split(v, input, 4 * width * sizeof(unsigned short), "scalar");
+  cg->split_lanes = lanes;
+  stp_free(input);
+  stp_vars_destroy(v);
+}
+
+int
+main(int argc, char **argv)
+{
+  int benchmark = 0;
+  unsigned seed = 1;
+  int tests = 0;
+  int failures = 0;
+  int i;
+
+  if (argc > 1 && strcmp(argv[1], "-b") == 0)
+    {
+      benchmark = 1;
+      argc--;
+      argv++;
+    }
+  if (argc > 1)
+    seed = strtoul(argv[1], NULL, 0);
+  stp_init();
+  if (benchmark)
+    {
+      run_benchmark(6);
+      run_benchmark(8);
+      return 0;
+    }
+  if (stpi_kernel_level() < STPI_KERNEL_AVX2)
+    {
+      printf("AVX2 is not available; skipping\n");
+      return 77;
+    }
+
+  srand(seed);
+  for (i = 0; i < TEST_CASES; i++)
+    {
+      int status = run_test(i);
+      if (status < 0)
+	continue;
+      tests++;
+      failures += status;
+    }
+  if (tests == 0)
+    {
+      printf("FAIL: no case used the AVX2 split\n");
+      return 1;
+    }
+  if (failures)
+    printf("%d of %d tests failed\n", failures, tests);
+  else
+    printf("All %d tests passed\n", tests);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,304 @@
+/*
+ *   Check that the threaded error diffusion and EvenTone dithers produce
+ *   the same output as the serial ones.
+ *
+ *   This program is free software; you can redistribute it and/or modify it
+ *   under the terms of the GNU General Public License as published by the Free
+ *   Software Foundation; either version 2 of the License, or (at your option)
+ *   any later version.
+ *
+ *   This program is distributed in the hope that it will be useful, but
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *   or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *   for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * These dithers carry error from one row to the next, so the same image
+ * is run through two dithers side by side, one limited to a single
+ * thread and one allowed several, and every row is compared as it is
+ * produced.  Rows at least 512 dots wide are split into blocks for the
+ * EvenTone wavefront, and rows at least 2048 wide into bands for the
+ * ordered dither that Adaptive uses for variable dot sizes.
+ */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <gutenprint/gutenprint.h>
+#include "../src/main/gutenprint-internal.h"
+#include "../src/main/dither-impl.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CASES_PER_ALGORITHM 12
+#define ROWS 12
+#define MAX_CHANNELS 7
+
+static int width;
+
+static int
+image_width(stp_image_t *image)
+{
+  return width;
+}
+
+static stp_image_t theImage =
+{
+  NULL,
+  NULL,
+  image_width,
+  NULL,
+  NULL,
+  NULL,
+  NULL,
+  NULL
+};
+
+static const stp_dotsize_t single_dotsize[] =
+{
+  { 0x1, 1.0 }
+};
+
+static const stp_dotsize_t variable_dotsizes[] =
+{
+  { 0x1, 0.28 },
+  { 0x2, 0.58 },
+  { 0x3, 1.0  }
+};
+
+#define SHADE(density, name)					\
+{  density, sizeof(name)/sizeof(stp_dotsize_t), name  }
+
+static const stp_shade_t normal_1bit_shades[] =
+{
+  SHADE(1.0, single_dotsize)
+};
+
+static const stp_shade_t photo_1bit_shades[] =
+{
+  SHADE(0.33, single_dotsize),
+  SHADE(1.0, single_dotsize)
+};
+
+static const stp_shade_t normal_2bit_shades[] =
+{
+  SHADE(1.0, variable_dotsizes)
+};
+
+static const stp_shade_t photo_2bit_shades[] =
+{
+  SHADE(0.33, variable_dotsizes),
+  SHADE(1.0, variable_dotsizes)
+};
+
+static const char *algorithms[] =
+{
+  "Adaptive", "Floyd", "EvenTone", "HybridEvenTone", "UniTone",
+  "HybridUniTone"
+};
+static const int aspects[][2] = { { 1, 1 }, { 2, 1 }, { 1, 2 } };
+
+typedef struct
+{
+  int width;
+  int aspect;
+  int photo;
+  int two_bit;
+  int threads;
+} test_case_t;
+
+static unsigned short
+random_value(void)
+{
+  switch (rand() % 5)
+    {
+    case 0:
+      return 0;
+    case 1:
+      return 65535;
+    case 2:
+      return 1 + rand() % 256;
+    default:
+      return rand() % 65536;
+    }
+}
+
+static stp_vars_t *
+setup_dither(const test_case_t *t, const char *algorithm,
+	     unsigned char **output, int length)
+{
+  stp_vars_t *v = stp_vars_create();
+  int i;
+
+  stp_set_driver(v, "escp2-ex");
+  stp_set_string_parameter(v, "DitherAlgorithm", algorithm);
+  stp_set_string_parameter(v, "ChannelBitDepth", "8");
+  stp_set_string_parameter(v, "PrintingMode", "Color");
+  stp_set_string_parameter(v, "InputImageType", "CMYK");
+  stp_dither_init(v, &theImage, width, aspects[t->aspect][0],
+		  aspects[t->aspect][1]);
+  stpi_dither_set_thread_count(v, t->threads);
+  for (i = 0; i < MAX_CHANNELS; i++)
+    output[i] = stp_zalloc(length * 2);
+  stp_dither_add_channel(v, output[0], STP_ECOLOR_K, 0);
+  stp_dither_add_channel(v, output[1], STP_ECOLOR_C, 0);
+  stp_dither_add_channel(v, output[2], STP_ECOLOR_M, 0);
+  stp_dither_add_channel(v, output[3], STP_ECOLOR_Y, 0);
+  if (t->photo)
+    {
+      stp_dither_add_channel(v, output[4], STP_ECOLOR_C, 1);
+      stp_dither_add_channel(v, output[5], STP_ECOLOR_M, 1);
+    }
+  if (t->two_bit)
+    stp_dither_set_transition(v, 0.5);
+  for (i = 0; i < 4; i++)
+    {
+      if (t->photo && (i == STP_ECOLOR_C || i == STP_ECOLOR_M))
+	stp_dither_set_inks_full(v, i, 2, t->two_bit ? photo_2bit_shades :
+				 photo_1bit_shades, 1.0, 0.5);
+      else
+	stp_dither_set_inks_full(v, i, 1, t->two_bit ? normal_2bit_shades :
+				 normal_1bit_shades, 1.0, 0.5);
+    }
+  return v;
+}
+
+static int
+compare_row(stpi_dither_t *serial, stpi_dither_t *threaded,
+	    const char *algorithm, int n, int row)
+{
+  int length = (serial->dst_width + 7) / 8;
+  int i;
+  for (i = 0; i < CHANNEL_COUNT(serial); i++)
+    {
+      stpi_dither_channel_t *sc = &(CHANNEL(serial, i));
+      stpi_dither_channel_t *tc = &(CHANNEL(threaded, i));
+      if (memcmp(tc->ptr, sc->ptr, length * sc->signif_bits) != 0)
+	{
+	  printf("FAIL: %s case %d row %d channel %d: output differs\n",
+		 algorithm, n, row, i);
+	  return 1;
+	}
+      if (tc->row_ends[0] != sc->row_ends[0] ||
+	  tc->row_ends[1] != sc->row_ends[1])
+	{
+	  printf("FAIL: %s case %d row %d channel %d: row ends %d %d, "
+		 "should be %d %d\n", algorithm, n, row, i, tc->row_ends[0],
+		 tc->row_ends[1], sc->row_ends[0], sc->row_ends[1]);
+	  return 1;
+	}
+    }
+  return 0;
+}
+
+static int
+run_test(const char *algorithm, int n)
+{
+  test_case_t t;
+  test_case_t serial_case;
+  stp_vars_t *serial_v, *threaded_v;
+  stpi_dither_t *serial, *threaded;
+  unsigned char *serial_output[MAX_CHANNELS];
+  unsigned char *threaded_output[MAX_CHANNELS];
+  unsigned short *raw;
+  unsigned char *mask = NULL;
+  int channels, length, row, i, j;
+  int status = 0;
+
+  switch (rand() % 3)
+    {
+    case 0:
+      t.width = 1 + rand() % 500;
+      break;
+    case 1:
+      t.width = 512 + rand() % 1500;
+      break;
+    default:
+      t.width = 2048 + rand() % 3000;
+      break;
+    }
+  t.aspect = rand() % 3;
+  t.photo = rand() % 2;
+  t.two_bit = rand() % 2;
+  t.threads = 2 + rand() % 3;
+  serial_case = t;
+  serial_case.threads = 1;
+  width = t.width;
+  length = (width + 7) / 8;
+
+  serial_v = setup_dither(&serial_case, algorithm, serial_output, length);
+  threaded_v = setup_dither(&t, algorithm, threaded_output, length);
+  serial = (stpi_dither_t *) stpi_get_component(serial_v,
+						STPI_COMPONENT_DITHER);
+  threaded = (stpi_dither_t *) stpi_get_component(threaded_v,
+						  STPI_COMPONENT_DITHER);
+  channels = CHANNEL_COUNT(serial);
+  raw = stp_malloc(width * channels * sizeof(unsigned short));
+  if (rand() % 2)
+    mask = stp_malloc(length);
+
+  for (row = 0; row < ROWS && !status; row++)
+    {
+      for (i = 0; i < width * channels; i++)
+	raw[i] = random_value();
+      if (mask)
+	for (i = 0; i < length; i++)
+	  mask[i] = rand() % 3 == 0 ? 0xff : rand() % 256;
+      for (j = 0; j < MAX_CHANNELS; j++)
+	{
+	  memset(serial_output[j], 0, length * 2);
+	  memset(threaded_output[j], 0, length * 2);
+	}
+      stp_dither_internal(serial_v, row, raw, 0, 0, mask);
+      stp_dither_internal(threaded_v, row, raw, 0, 0, mask);
+      status = compare_row(serial, threaded, algorithm, n, row);
+    }
+  if (status)
+    printf("      %d wide, aspect %d:%d, %d threads, %s%s%s\n", width,
+	   aspects[t.aspect][0], aspects[t.aspect][1], t.threads,
+	   t.photo ? "photo, " : "", t.two_bit ? "2 bit" : "1 bit",
+	   mask ? ", mask" : "");
+
+  stp_vars_destroy(serial_v);
+  stp_vars_destroy(threaded_v);
+  for (i = 0; i < MAX_CHANNELS; i++)
+    {
+      stp_free(serial_output[i]);
+      stp_free(threaded_output[i]);
+    }
+  stp_free(raw);
+  if (mask)
+    stp_free(mask);
+  return status;
+}
+
+int
+main(int argc, char **argv)
+{
+  unsigned seed = 1;
+  int tests = 0;
+  int failures = 0;
+  size_t i;
+  int j;
+
+  if (argc > 1)
+    seed = strtoul(argv[1], NULL, 0);
+  stp_init();
+
+  srand(seed);
+  for (i = 0; i < sizeof(algorithms) / sizeof(algorithms[0]); i++)
+    for (j = 0; j < CASES_PER_ALGORITHM; j++)
+      {
+	failures += run_test(algorithms[i], j);
+	tests++;
+      }
+  if (failures)
+    printf("%d of %d tests failed\n", failures, tests);
+  else
+    printf("All %d tests passed\n", tests);
+  return failures ? 1 : 0;
+}